@@ -0,0 +1,115 @@
+// Parser stress benchmark
+//
+// Generates one expression per shape, nested 'depth' levels deep, and times
+// lexing and parsing it. Every shape used to recurse once per level in the
+// parser; parse_precedence now keeps pending operators on a heap stack, so
+// all of them must parse at depth 100000 without touching the C stack limit.
+//
+// Usage: parser_stress [depth] [runs]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "lexer.h"
+#include "intern.h"
+#include "parser.h"
+#include "ast.h"
+#include "runtime/memory.h"
+#include "runtime/sys.h"
+
+typedef struct {
+    const char* name;
+    const char* open;     // Repeated 'depth' times before the operand
+    const char* close;    // Repeated 'depth' times after it
+} Shape;
+
+static const Shape shapes[] = {
+    {"parens", "(",  ")"},    // ((((a))))
+    {"unary",  "!",  ""},     // !!!!a
+    {"sum",    "",   "+a"},   // a+a+a+a
+    {"and",    "",   "&&a"},  // a&&a&&a&&a
+};
+
+// "let x = <shape>;\n"
+static char* generate(const Shape* shape, uint32_t depth) {
+    size_t open = strlen(shape->open);
+    size_t close = strlen(shape->close);
+    size_t length = 8 + depth * (open + close) + 1 + 2;
+    char* source = f_malloc(length + 1);
+
+    char* out = source;
+    memcpy(out, "let x = ", 8);
+    out += 8;
+    for (uint32_t i = 0; i < depth; i++, out += open) memcpy(out, shape->open, open);
+    *out++ = 'a';
+    for (uint32_t i = 0; i < depth; i++, out += close) memcpy(out, shape->close, close);
+    memcpy(out, ";\n", 3);
+    return source;
+}
+
+// Best of 'runs' times, in nanoseconds; false on a parse error
+static bool run_shape(const Shape* shape, uint32_t depth, uint32_t runs) {
+    char* source = generate(shape, depth);
+    uint64_t best_lex = UINT64_MAX;
+    uint64_t best_parse = UINT64_MAX;
+    uint32_t token_count = 0;
+    bool ok = true;
+
+    for (uint32_t run = 0; run < runs && ok; run++) {
+        ArenaAllocator ast_memory;
+        arena_allocator_init(&ast_memory, "ast", PHASE_PARSER, 0);
+        ast_set_arena(&ast_memory.arena);
+        Interner interner;
+        interner_init_borrowed(&interner);
+        TokenStream tokens;
+        token_stream_init(&tokens);
+
+        uint64_t start = sys_nanotime();
+        token_stream_lex(&tokens, source);
+        uint64_t lexed = sys_nanotime();
+
+        Parser parser;
+        parser_init_stream(&parser, &tokens, &interner, shape->name);
+        parse(&parser);
+        uint64_t parsed = sys_nanotime();
+        ok = !parser.had_error;
+
+        if (lexed - start < best_lex) best_lex = lexed - start;
+        if (parsed - lexed < best_parse) best_parse = parsed - lexed;
+        token_count = tokens.count;
+
+        parser_free(&parser);
+        token_stream_free(&tokens);
+        interner_free(&interner);
+        ast_set_arena(NULL);
+        allocator_release(&ast_memory.base);
+    }
+
+    if (ok) {
+        printf("%-8s depth %u: %u tokens, lex %.3f ms, parse %.3f ms (%.1f ns/token)\n",
+               shape->name, depth, token_count, best_lex / 1e6, best_parse / 1e6,
+               (double)best_parse / token_count);
+    } else {
+        fprintf(stderr, "%s: parse error at depth %u\n", shape->name, depth);
+    }
+    f_free(source);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    uint32_t depth = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 100000;
+    uint32_t runs = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 5;
+    if (depth == 0 || runs == 0) {
+        fprintf(stderr, "Usage: %s [depth] [runs]\n", argv[0]);
+        return 1;
+    }
+
+    memory_init();
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+        ok &= run_shape(&shapes[i], depth, runs);
+    }
+    return ok ? 0 : 1;
+}
@@ -3,6 +3,7 @@
 
 #include "common.h"
 #include "lexer.h"
+#include "intern.h"
 
 // AST node types
 typedef enum {
@@ -59,6 +60,7 @@ typedef enum {
     NODE_DEFER_STMT,      // Defer statement
     NODE_GO_STMT,         // Go statement
     NODE_SELECT_STMT,     // Select statement
+    NODE_CATCH_CLAUSE,    // Catch clause of a try statement
     
     // Types
     NODE_TYPE_REF,        // Type reference
@@ -79,6 +81,52 @@ typedef enum {
 typedef struct ASTNode ASTNode;
 typedef struct DynamicArray DynamicArray;
 
+// Child lists keep their first items inline (see FERRUM_SMALL_VEC): most
+// argument lists, blocks and parameter lists have at most three entries.
+// Tokens are large, so only one is inline, which keeps the largest node
+// from growing.
+FERRUM_SMALL_VEC(NodeList, node_list, ASTNode*, 3);
+FERRUM_SMALL_VEC(TokenList, token_list, Token, 1);
+
+// Where a variable lives, filled in by the resolver (see resolver.h).
+// Identifiers carry the binding they refer to; declarations carry the one
+// they create. A zeroed binding is unresolved.
+typedef enum {
+    BINDING_UNRESOLVED,
+    BINDING_LOCAL,      // Slot in the frame of the enclosing function
+    BINDING_UPVALUE,    // Index into the enclosing function's upvalues
+    BINDING_GLOBAL      // Global ID, in declaration order
+} BindingKind;
+
+typedef struct {
+    uint8_t kind;       // BindingKind
+    bool captured;      // Declarations only: a closure captures this local
+    uint32_t index;
+} Binding;
+
+// A variable a function captures from the function around it
+typedef struct {
+    bool is_local;      // A frame slot of that function, else one of its upvalues
+    uint32_t index;
+} Upvalue;
+
+// Frame layout of a function, allocated by the resolver with ast_alloc.
+// Parameters take slots 0 to param_count - 1; slots of locals in disjoint
+// blocks are reused, so frame_size is the most slots live at once.
+typedef struct {
+    Binding binding;        // Of the function's name; unresolved for closures and methods
+    uint32_t frame_size;
+    uint32_t param_count;
+    uint32_t upvalue_count;
+    Binding* params;
+    Upvalue* upvalues;      // In capture order
+} FrameInfo;
+
+typedef struct {
+    Symbol symbol;          // Interned name
+    Binding binding;
+} Identifier;
+
 // Node structures for each type
 typedef struct {
     Token op;
@@ -93,7 +141,7 @@ typedef struct {
 
 typedef struct {
     ASTNode* callee;
-    DynamicArray args;  // Array of ASTNode*
+    NodeList args;
 } CallExpr;
 
 typedef struct {
@@ -114,7 +162,7 @@ typedef struct {
 } LogicalExpr;
 
 typedef struct {
-    DynamicArray elements;  // Array of ASTNode*
+    NodeList elements;
 } ArrayExpr;
 
 typedef struct {
@@ -124,7 +172,7 @@ typedef struct {
 
 typedef struct {
     ASTNode* function;
-    DynamicArray captures;  // Array of Token
+    TokenList captures;
 } ClosureExpr;
 
 typedef struct {
@@ -139,57 +187,60 @@ typedef struct {
     Token name;
     ASTNode* value;
     bool is_mutable;
+    Binding binding;
 } VarDecl;
 
 typedef struct {
     Token name;
-    DynamicArray params;    // Array of Token
-    DynamicArray type_params; // Array of Token
+    TokenList params;
+    TokenList type_params;
     ASTNode* return_type;
     ASTNode* body;
+    FrameInfo* frame;       // NULL until resolved
 } FunctionDecl;
 
 typedef struct {
     Token name;
-    DynamicArray type_params; // Array of Token
-    DynamicArray superclasses; // Array of ASTNode*
-    DynamicArray members;     // Array of ASTNode*
+    TokenList type_params;
+    NodeList superclasses;
+    NodeList members;
 } ClassDecl;
 
 typedef struct {
     Token name;
-    DynamicArray type_params; // Array of Token
-    DynamicArray methods;     // Array of ASTNode*
+    TokenList type_params;
+    NodeList methods;
 } InterfaceDecl;
 
 typedef struct {
     Token name;
-    DynamicArray type_params; // Array of Token
-    DynamicArray methods;     // Array of ASTNode*
+    TokenList type_params;
+    NodeList methods;
 } TraitDecl;
 
 typedef struct {
     ASTNode* type;
     Token trait;
-    DynamicArray methods;    // Array of ASTNode*
+    NodeList methods;
 } ImplDecl;
 
 typedef struct {
     Token name;
-    DynamicArray type_params; // Array of Token
+    TokenList type_params;
     ASTNode* type;
 } TypeDecl;
 
 typedef struct {
     Token name;
-    DynamicArray variants;   // Array of Token
-    DynamicArray values;     // Array of ASTNode*
+    TokenList variants;
+    NodeList values;
 } EnumDecl;
 
 typedef struct {
     Token path;
     Token alias;
     bool is_all;
+    Binding binding;        // Of the alias, if there is one
 } ImportDecl;
 
 typedef struct {
@@ -197,7 +248,7 @@ typedef struct {
 } ExportDecl;
 
 typedef struct {
-    DynamicArray statements; // Array of ASTNode*
+    NodeList statements;
 } BlockStmt;
 
 typedef struct {
@@ -222,6 +273,7 @@ typedef struct {
     ASTNode* iterator;
     Token var;
     ASTNode* body;
+    Binding var_binding;
 } ForeachStmt;
 
 typedef struct {
@@ -242,17 +294,25 @@ typedef struct {
 
 typedef struct {
     ASTNode* try_block;
-    DynamicArray catch_blocks; // Array of ASTNode*
+    NodeList catch_blocks;  // NODE_CATCH_CLAUSE nodes
     ASTNode* finally_block;
 } TryStmt;
 
+// catch (ErrorType name) { body }
+typedef struct {
+    Token error_type;
+    Token var;
+    ASTNode* body;
+    Binding var_binding;
+} CatchClause;
+
 typedef struct {
     ASTNode* value;
 } ThrowStmt;
 
 typedef struct {
     ASTNode* value;
-    DynamicArray cases;     // Array of ASTNode*
+    NodeList cases;
     ASTNode* default_case;
 } MatchStmt;
 
@@ -276,6 +336,7 @@ typedef struct {
     Token name;
     ASTNode* element_type;
     ASTNode* capacity;     // Optional buffer size
+    Binding binding;
 } ChanDecl;
 
 // Go statement
@@ -291,17 +352,20 @@ typedef struct {
     ASTNode* body;
 } SelectCase;
 
+FERRUM_SMALL_VEC(SelectCaseList, select_case_list, SelectCase*, 3);
+
 // Select statement
 typedef struct {
-    DynamicArray cases;    // Array of SelectCase*
+    SelectCaseList cases;
     ASTNode* default_case; // Optional default case
 } SelectStmt;
 
 // Main AST node structure
 struct ASTNode {
     NodeType type;
-    uint32_t line;
-    uint32_t column;
+    uint32_t offset;    // Byte offset in source, resolved through a LineMap
+    uint32_t hash;      // Structural hash if hash-consed, 0 otherwise
+    uint32_t value_type; // TypeId from the type checker (types.h), 0 until checked
     
     union {
         // Expressions
@@ -325,7 +389,7 @@ struct ASTNode {
         char* string_value;
         bool bool_value;
         char char_value;
-        char* ident_name;
+        Identifier ident;
         
         // Declarations
         VarDecl var_decl;
@@ -356,60 +420,102 @@ struct ASTNode {
         DeferStmt defer_stmt;
         GoStmt go_stmt;
         SelectStmt select_stmt;
+        CatchClause catch_clause;
     };
 };
 
+// AST allocation
+//
+// While an arena is set (per thread), nodes, child lists and literal
+// strings are allocated from it and the whole tree is released with
+// arena_free; ast_free_node must not be used on such trees. Without an
+// arena every allocation comes from the heap as before. A child list that
+// spills out of its inline items must keep growing under the same mode.
+void ast_set_arena(Arena* arena);
+Arena* ast_get_arena(void);
+void* ast_alloc(usize size);
+
+// Hash-consing
+//
+// While a table and an arena are set (per thread), the constructors of pure
+// expressions - literals, identifiers, and unary, binary and logical
+// expressions whose operands are hash-consed themselves - return the node
+// already built for a structurally equal expression instead of allocating a
+// new one. Within one table, equal subexpressions are the same pointer.
+// Such nodes carry a nonzero structural hash computed from the expression
+// alone (kinds, values, operator types and symbol ids, never addresses), so
+// it is stable from run to run and can key memoized per-node results.
+//
+// A hash-consed node may be referenced from several places and must be
+// treated as immutable: passes that annotate or rewrite nodes copy shared
+// ones first. Its offset and operator token are those of the first
+// occurrence, so a diagnostic about a repeated subexpression points at the
+// first one. Nothing is shared without an arena, since ast_free_node cannot
+// release a tree with shared nodes.
+typedef struct {
+    ASTNode** slots;
+    uint32_t capacity;          // Power of two
+    uint32_t count;
+} HashConsTable;
+
+void hash_cons_init(HashConsTable* table);
+void hash_cons_free(HashConsTable* table);
+void ast_set_hash_cons(HashConsTable* table);
+HashConsTable* ast_get_hash_cons(void);
+bool ast_node_is_shared(const ASTNode* node);
+
 // AST node creation functions
-ASTNode* ast_new_node(NodeType type, uint32_t line, uint32_t column);
+ASTNode* ast_new_node(NodeType type, uint32_t offset);
 void ast_free_node(ASTNode* node);
 
 // Expression nodes
 ASTNode* ast_new_binary_expr(Token op, ASTNode* left, ASTNode* right);
 ASTNode* ast_new_unary_expr(Token op, ASTNode* operand);
-ASTNode* ast_new_call_expr(ASTNode* callee, DynamicArray args);
+ASTNode* ast_new_call_expr(ASTNode* callee, NodeList args);
 ASTNode* ast_new_get_expr(ASTNode* object, Token name);
 ASTNode* ast_new_set_expr(ASTNode* object, Token name, ASTNode* value);
 ASTNode* ast_new_logical_expr(Token op, ASTNode* left, ASTNode* right);
-ASTNode* ast_new_array_expr(DynamicArray elements);
+ASTNode* ast_new_array_expr(NodeList elements);
 ASTNode* ast_new_index_expr(ASTNode* array, ASTNode* index);
-ASTNode* ast_new_closure_expr(ASTNode* function, DynamicArray captures);
+ASTNode* ast_new_closure_expr(ASTNode* function, TokenList captures);
 ASTNode* ast_new_async_expr(ASTNode* expression);
 ASTNode* ast_new_await_expr(ASTNode* expression);
 
 // Literal nodes
-ASTNode* ast_new_int_literal(int64_t value, uint32_t line, uint32_t column);
-ASTNode* ast_new_float_literal(double value, uint32_t line, uint32_t column);
-ASTNode* ast_new_string_literal(char* value, uint32_t line, uint32_t column);
-ASTNode* ast_new_bool_literal(bool value, uint32_t line, uint32_t column);
-ASTNode* ast_new_char_literal(char value, uint32_t line, uint32_t column);
-ASTNode* ast_new_nil_literal(uint32_t line, uint32_t column);
-ASTNode* ast_new_identifier(const char* name, int length, uint32_t line, uint32_t column);
+ASTNode* ast_new_int_literal(int64_t value, uint32_t offset);
+ASTNode* ast_new_float_literal(double value, uint32_t offset);
+ASTNode* ast_new_string_literal(char* value, uint32_t offset);
+ASTNode* ast_new_bool_literal(bool value, uint32_t offset);
+ASTNode* ast_new_char_literal(char value, uint32_t offset);
+ASTNode* ast_new_nil_literal(uint32_t offset);
+ASTNode* ast_new_identifier(Symbol name, uint32_t offset);
 
 // Declaration nodes
 ASTNode* ast_new_var_decl(Token name, ASTNode* value);
-ASTNode* ast_new_function_decl(Token name, DynamicArray params, ASTNode* body);
-ASTNode* ast_new_class_decl(Token name, DynamicArray type_params, DynamicArray superclasses, DynamicArray members);
-ASTNode* ast_new_interface_decl(Token name, DynamicArray type_params, DynamicArray methods);
-ASTNode* ast_new_trait_decl(Token name, DynamicArray type_params, DynamicArray methods);
-ASTNode* ast_new_impl_decl(ASTNode* type, Token trait, DynamicArray methods);
-ASTNode* ast_new_type_decl(Token name, DynamicArray type_params, ASTNode* type);
-ASTNode* ast_new_enum_decl(Token name, DynamicArray variants, DynamicArray values);
+ASTNode* ast_new_function_decl(Token name, TokenList params, ASTNode* body);
+ASTNode* ast_new_class_decl(Token name, TokenList type_params, NodeList superclasses, NodeList members);
+ASTNode* ast_new_interface_decl(Token name, TokenList type_params, NodeList methods);
+ASTNode* ast_new_trait_decl(Token name, TokenList type_params, NodeList methods);
+ASTNode* ast_new_impl_decl(ASTNode* type, Token trait, NodeList methods);
+ASTNode* ast_new_type_decl(Token name, TokenList type_params, ASTNode* type);
+ASTNode* ast_new_enum_decl(Token name, TokenList variants, NodeList values);
 ASTNode* ast_new_import_decl(Token path, Token alias, bool is_all);
 ASTNode* ast_new_export_decl(ASTNode* declaration);
 
 // Statement nodes
-ASTNode* ast_new_block_stmt(DynamicArray statements);
+ASTNode* ast_new_block_stmt(NodeList statements);
 ASTNode* ast_new_if_stmt(ASTNode* condition, ASTNode* then_branch, ASTNode* else_branch);
 ASTNode* ast_new_while_stmt(ASTNode* condition, ASTNode* body);
 ASTNode* ast_new_for_stmt(ASTNode* initializer, ASTNode* condition, ASTNode* increment, ASTNode* body);
 ASTNode* ast_new_foreach_stmt(ASTNode* iterator, Token var, ASTNode* body);
 ASTNode* ast_new_return_stmt(ASTNode* value);
-ASTNode* ast_new_break_stmt(uint32_t line, uint32_t column);
-ASTNode* ast_new_continue_stmt(uint32_t line, uint32_t column);
+ASTNode* ast_new_break_stmt(uint32_t offset);
+ASTNode* ast_new_continue_stmt(uint32_t offset);
 ASTNode* ast_new_expr_stmt(ASTNode* expr);
-ASTNode* ast_new_try_stmt(ASTNode* try_block, DynamicArray catch_blocks, ASTNode* finally_block);
+ASTNode* ast_new_try_stmt(ASTNode* try_block, NodeList catch_blocks, ASTNode* finally_block);
+ASTNode* ast_new_catch_clause(Token error_type, Token var, ASTNode* body);
 ASTNode* ast_new_throw_stmt(ASTNode* value);
-ASTNode* ast_new_match_stmt(ASTNode* value, DynamicArray cases, ASTNode* default_case);
+ASTNode* ast_new_match_stmt(ASTNode* value, NodeList cases, ASTNode* default_case);
 ASTNode* ast_new_defer_stmt(ASTNode* statement);
 
 // New AST node creation functions
@@ -417,7 +523,7 @@ ASTNode* ast_new_chan_send_expr(ASTNode* channel, ASTNode* value);
 ASTNode* ast_new_chan_recv_expr(ASTNode* channel);
 ASTNode* ast_new_chan_decl(Token name, ASTNode* element_type, ASTNode* capacity);
 ASTNode* ast_new_go_stmt(ASTNode* expression);
-ASTNode* ast_new_select_case(ASTNode* channel, ASTNode* value, bool is_send, ASTNode* body);
-ASTNode* ast_new_select_stmt(DynamicArray cases, ASTNode* default_case);
+SelectCase* ast_new_select_case(ASTNode* channel, ASTNode* value, bool is_send, ASTNode* body);
+ASTNode* ast_new_select_stmt(SelectCaseList cases, ASTNode* default_case);
 
 #endif // FERRUM_AST_H
\ No newline at end of file
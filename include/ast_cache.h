@@ -0,0 +1,57 @@
+#ifndef FERRUM_AST_CACHE_H
+#define FERRUM_AST_CACHE_H
+
+#include "ast_flat.h"
+#include "intern.h"
+#include "runtime/sys.h"
+
+// On-disk AST cache
+//
+// A parsed module is stored as its FlatAST tables plus the names of its
+// interned symbols, in a file named after a hash of the source contents
+// ('<dir>/<key>.fast'). The tables hold indices and offsets only, so a
+// cache file is mapped read-only and used in place: loading is a header
+// check and a checksum pass, with no lexing or parsing. Token offsets refer
+// to the source, which the driver maps anyway to compute the key.
+//
+// A cache file is used only if all of these hold; otherwise it is ignored
+// and rewritten after a normal parse:
+//   - magic, byte order, format version and layout fingerprint (node and
+//     token sizes, node and token type counts) match this compiler
+//   - source length and content hash match the source being compiled
+//   - every section lies inside the file and the payload checksum matches
+// Files are written to a temporary name and renamed, so a reader never
+// sees a partial file.
+
+#define AST_CACHE_VERSION 1
+
+typedef struct {
+    MappedFile file;
+    FlatAST ast;                // Tables point into 'file'
+    const uint32_t* symbols;    // (offset, length) pairs into 'names'
+    const char* names;
+    uint32_t symbol_count;      // Symbols 1..symbol_count
+    uint32_t name_size;
+} AstCache;
+
+// Content hash of a source buffer, used as the cache key
+uint64_t ast_cache_key(const char* source, usize length);
+
+// Writes 'ast' and the names of 'interner'. Returns false if the file could
+// not be written; the cache is an optimization, so callers may ignore it.
+bool ast_cache_store(const char* dir, uint64_t key, usize source_length,
+                     const FlatAST* ast, const Interner* interner);
+
+// Maps and validates the cache file for 'key'. 'source' must stay alive
+// while the cached tree is in use.
+bool ast_cache_load(AstCache* cache, const char* dir, uint64_t key,
+                    const char* source, usize source_length);
+
+// Interns the cached names into 'interner', which must be empty, so they
+// get the symbol values stored in the tree. In borrow mode the names point
+// into the cache file.
+bool ast_cache_intern(const AstCache* cache, Interner* interner);
+
+void ast_cache_close(AstCache* cache);
+
+#endif // FERRUM_AST_CACHE_H
@@ -0,0 +1,131 @@
+#ifndef FERRUM_AST_FLAT_H
+#define FERRUM_AST_FLAT_H
+
+#include "ast.h"
+
+// Flat, index-based AST
+//
+// Nodes live in one array of 16-byte records and refer to each other by
+// 32-bit index; a converted tree is laid out in pre-order, so a parent always
+// precedes its children and a whole-tree pass is a linear scan. Index 0 is a
+// reserved null node (FLAT_NONE) in every table.
+//
+// Each node has two payload words, 'a' and 'b'. Anything that does not fit,
+// including all variable-length child lists, goes to the shared 'extra'
+// array; a list is stored as its length followed by its items. Names are
+// indices into the token table, string literals offsets into the string pool.
+//
+// Payload per node type:
+//   BINARY, LOGICAL      op, flags = op length, a = left, b = right
+//   UNARY                op, flags = op length, a = operand
+//   CALL                 a = callee, b = list(args)
+//   GET                  a = object, b = token(name)
+//   SET                  a = object, b = extra{token(name), value}
+//   ARRAY                b = list(elements)
+//   INDEX                a = array, b = index
+//   CLOSURE              a = function, b = list(token(capture))
+//   ASYNC, AWAIT         a = expression
+//   CHAN_SEND            a = channel, b = value
+//   CHAN_RECV            a = channel
+//   INT, FLOAT           a = low word, b = high word of the 64-bit value
+//   STRING               a = string pool offset, b = length
+//   BOOL                 flags = value
+//   CHAR                 a = value
+//   IDENTIFIER           a = Symbol
+//   VAR_DECL             a = token(name), b = value, flags = is_mutable
+//   FUNCTION_DECL        a = token(name), b = extra{body, return_type,
+//                        list(token(param)), list(token(type_param))}
+//   CLASS_DECL           a = token(name), b = extra{list(token(type_param)),
+//                        list(superclass), list(member)}
+//   INTERFACE, TRAIT     a = token(name), b = extra{list(token(type_param)),
+//                        list(method)}
+//   IMPL_DECL            a = type, b = extra{token(trait), list(method)}
+//   TYPE_DECL            a = token(name), b = extra{type,
+//                        list(token(type_param))}
+//   ENUM_DECL            a = token(name), b = extra{list(token(variant)),
+//                        list(value)}
+//   IMPORT_DECL          a = token(path), b = token(alias), flags = is_all
+//   EXPORT_DECL          a = declaration
+//   CHAN_DECL            a = token(name), b = extra{element_type, capacity}
+//   BLOCK                b = list(statements)
+//   IF                   a = condition, b = extra{then_branch, else_branch}
+//   WHILE                a = condition, b = body
+//   FOR                  b = extra{initializer, condition, increment, body}
+//   FOREACH              a = iterator, b = extra{token(var), body}
+//   RETURN, THROW        a = value
+//   EXPR_STMT            a = expr
+//   TRY                  a = try_block, b = extra{finally_block,
+//                        list(catch_block)}
+//   CATCH                a = body, b = extra{token(error_type), token(var)}
+//   MATCH                a = value, b = extra{default_case, list(case)}
+//   DEFER                a = statement
+//   GO                   a = expression
+//   SELECT               b = extra{default_case, count,
+//                        count x {channel, value, body, is_send}}
+//   everything else      no payload
+
+typedef uint32_t FlatIndex;
+
+#define FLAT_NONE 0
+
+typedef struct {
+    uint8_t type;         // NodeType
+    uint8_t flags;        // Boolean payload
+    uint16_t op;          // Operator TokenType
+    uint32_t offset;      // Byte offset in source
+    uint32_t a;           // First payload word
+    uint32_t b;           // Second payload word
+} FlatNode;
+
+// Name or path token, as a (type, offset, length) triple into the source
+typedef struct {
+    uint32_t type;
+    uint32_t offset;
+    uint32_t length;
+} FlatToken;
+
+typedef struct {
+    const char* source;   // Source the token offsets refer to
+    FlatNode* nodes;
+    uint32_t node_count;
+    uint32_t node_capacity;
+    uint32_t* extra;
+    uint32_t extra_count;
+    uint32_t extra_capacity;
+    FlatToken* tokens;
+    uint32_t token_count;
+    uint32_t token_capacity;
+    char* strings;        // '\0'-terminated string literals
+    uint32_t string_size;
+    uint32_t string_capacity;
+    FlatIndex root;
+} FlatAST;
+
+typedef void (*FlatVisitFn)(const FlatAST* ast, FlatIndex node, void* user);
+
+void flat_ast_init(FlatAST* ast, const char* source);
+void flat_ast_free(FlatAST* ast);
+
+// Appends a converted copy of 'tree' and makes it the root
+FlatIndex flat_ast_from_tree(FlatAST* ast, const ASTNode* tree);
+
+// Builds an ASTNode tree for 'node' (see ast_set_arena). Tokens point into
+// 'ast->source'; identifiers keep their Symbol values, so the names must be
+// interned in the same order as when the tree was flattened.
+ASTNode* flat_ast_to_tree(const FlatAST* ast, FlatIndex node);
+
+// Accessors
+const FlatNode* flat_ast_node(const FlatAST* ast, FlatIndex node);
+const uint32_t* flat_ast_list(const FlatAST* ast, uint32_t extra_index, uint32_t* count);
+Token flat_ast_token(const FlatAST* ast, uint32_t token);
+const char* flat_ast_string(const FlatAST* ast, const FlatNode* node);
+int64_t flat_node_int(const FlatNode* node);
+double flat_node_float(const FlatNode* node);
+
+// Pre-order walk over 'node' and all of its descendants
+void flat_ast_walk(const FlatAST* ast, FlatIndex node, FlatVisitFn visit, void* user);
+
+// Bytes held by all tables
+usize flat_ast_memory(const FlatAST* ast);
+
+#endif // FERRUM_AST_FLAT_H
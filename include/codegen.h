@@ -1,8 +1,9 @@
 #ifndef FERRUM_CODEGEN_H
 #define FERRUM_CODEGEN_H
 
-#include "ast.h"
+#include "ir.h"
 #include "common.h"
+#include "runtime/sys.h"
 
 typedef enum {
     TARGET_X86_64,
@@ -14,18 +15,18 @@ typedef struct {
     TargetArch arch;
     bool optimize;
     bool debug_info;
-    ByteBuffer output;
+    OutputFile output;  // Written to the output file while generating
 } CodeGenContext;
 
 // Code generation API
 void codegen_init(CodeGenContext* ctx, TargetArch arch);
 void codegen_free(CodeGenContext* ctx);
-bool codegen_generate(CodeGenContext* ctx, ASTNode* ast, const char* output_path);
+bool codegen_generate(CodeGenContext* ctx, const IrModule* module, const char* output_path);
 
 // Target-specific functions
-void codegen_x86_64(CodeGenContext* ctx, ASTNode* ast);
-void codegen_arm64(CodeGenContext* ctx, ASTNode* ast);
-void codegen_wasm(CodeGenContext* ctx, ASTNode* ast);
+void codegen_x86_64(CodeGenContext* ctx, const IrModule* module);
+void codegen_arm64(CodeGenContext* ctx, const IrModule* module);
+void codegen_wasm(CodeGenContext* ctx, const IrModule* module);
 
 // Helper functions
 void emit_instruction(CodeGenContext* ctx, const char* fmt, ...);
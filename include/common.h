@@ -51,10 +51,12 @@ typedef ptrdiff_t isize;
     #define FERRUM_PACKED __attribute__((packed))
     #define FERRUM_NO_RETURN __attribute__((noreturn))
     #define FERRUM_UNUSED __attribute__((unused))
+    #define FERRUM_THREAD_LOCAL __thread
 #else
     #define FERRUM_PACKED
     #define FERRUM_NO_RETURN
     #define FERRUM_UNUSED
+    #define FERRUM_THREAD_LOCAL __declspec(thread)
 #endif
 
 // Hata yönetimi
@@ -82,6 +84,37 @@ usize f_strlen(const char* str);
 char* f_strdup(const char* str);
 bool f_streq(const char* a, const char* b);
 
+// Bump-pointer arena
+//
+// Allocations are carved out of large chunks and never freed one by one;
+// arena_free releases everything in one pass over the chunk list.
+#define ARENA_DEFAULT_CHUNK_SIZE (1024 * 1024)
+#define ARENA_DEFAULT_ALIGNMENT 16
+
+typedef struct ArenaChunk {
+    struct ArenaChunk* next;
+    usize used;
+    usize capacity;
+    u8* data;
+} ArenaChunk;
+
+typedef struct Arena {
+    ArenaChunk* chunks;   // Current chunk first
+    usize chunk_size;     // Size of regular chunks
+    usize allocated;      // Bytes handed out, for statistics
+    usize released;       // Bytes dropped by arena_reset and arena_free
+    usize peak;           // Highest 'allocated' seen at a reset or free
+    usize allocations;    // Number of allocations, over the arena's lifetime
+} Arena;
+
+void arena_init(Arena* arena, usize chunk_size);
+void arena_free(Arena* arena);
+void arena_reset(Arena* arena);
+void arena_adopt(Arena* into, Arena* from);
+void* arena_alloc(Arena* arena, usize size);
+void* arena_alloc_aligned(Arena* arena, usize size, usize alignment);
+void* arena_calloc(Arena* arena, usize count, usize size);
+
 // Byte buffer yapısı
 typedef struct {
     u8* data;
@@ -100,9 +133,11 @@ typedef struct DynamicArray {
     usize count;
     usize capacity;
     usize item_size;
+    Arena* arena;       // Owner of 'items', NULL for the heap
 } DynamicArray;
 
 DynamicArray da_new(usize item_size, usize initial_capacity);
+DynamicArray da_new_in(Arena* arena, usize item_size, usize initial_capacity);
 void da_free(DynamicArray* arr);
 void da_append(DynamicArray* arr, const void* item);
 void* da_get(DynamicArray* arr, usize index);
@@ -111,4 +146,291 @@ void da_remove(DynamicArray* arr, usize index);
 void da_clear(DynamicArray* arr);
 void da_resize(DynamicArray* arr, usize new_capacity);
 
+// Small typed vectors
+//
+// FERRUM_SMALL_VEC(Name, prefix, Type, N) declares a vector of Type whose
+// first N items live in the struct itself: short lists need no allocation,
+// and copying the struct copies them. When it outgrows them the items move
+// to 'heap', and 'capacity' (0 while inline) becomes nonzero. A zeroed
+// struct is an empty vector. SMALL_VEC_ITEMS and SMALL_VEC_AT compile to a
+// compare and a load.
+//
+// FERRUM_SMALL_VEC_IMPL defines prefix_reserve, prefix_push and prefix_free
+// in one translation unit, given the functions that allocate and release
+// the heap storage.
+#define FERRUM_SMALL_VEC(Name, prefix, Type, N) \
+    typedef struct { \
+        u32 count; \
+        u32 capacity; \
+        union { \
+            Type local[N]; \
+            Type* heap; \
+        }; \
+    } Name; \
+    void prefix##_reserve(Name* vec, u32 capacity); \
+    void prefix##_push(Name* vec, Type item); \
+    void prefix##_free(Name* vec)
+
+#define SMALL_VEC_INLINE(vec) ((u32)(sizeof((vec)->local) / sizeof((vec)->local[0])))
+#define SMALL_VEC_ITEMS(vec) ((vec)->capacity > 0 ? (vec)->heap : (vec)->local)
+#define SMALL_VEC_AT(vec, index) (SMALL_VEC_ITEMS(vec)[index])
+
+#define FERRUM_SMALL_VEC_IMPL(Name, prefix, Type, alloc_fn, release_fn) \
+    void prefix##_reserve(Name* vec, u32 capacity) { \
+        if (capacity <= SMALL_VEC_INLINE(vec) || capacity <= vec->capacity) return; \
+        Type* items = (Type*)alloc_fn(capacity * sizeof(Type)); \
+        memcpy(items, SMALL_VEC_ITEMS(vec), vec->count * sizeof(Type)); \
+        if (vec->capacity > 0) release_fn(vec->heap); \
+        vec->heap = items; \
+        vec->capacity = capacity; \
+    } \
+    void prefix##_push(Name* vec, Type item) { \
+        u32 capacity = vec->capacity > 0 ? vec->capacity : SMALL_VEC_INLINE(vec); \
+        if (vec->count == capacity) prefix##_reserve(vec, capacity * 2); \
+        SMALL_VEC_ITEMS(vec)[vec->count++] = item; \
+    } \
+    void prefix##_free(Name* vec) { \
+        if (vec->capacity > 0) release_fn(vec->heap); \
+        memset(vec, 0, sizeof(Name)); \
+    }
+
+// Hashing
+//
+// hash_bytes reads eight bytes at a time; the length is mixed in, so
+// trailing zero bytes still change the hash. hash_u32 is a Fibonacci
+// multiply, which spreads consecutive keys over both ends of the result.
+u64 hash_bytes(const void* data, usize length, u64 seed);
+
+static inline u64 hash_u32(u32 key) {
+    u64 hash = (u64)key * 0x9e3779b97f4a7c15ull;
+    return hash ^ (hash >> 32);
+}
+
+// Swiss-table hash maps
+//
+// FERRUM_HASH_MAP(Name, prefix, Key, Value) declares an open-addressing map
+// from Key to Value. Slots come in groups of HASH_GROUP_WIDTH, and each slot
+// has a control byte: HASH_EMPTY, HASH_DELETED, or the top 7 bits of its
+// key's hash (HASH_H2). A lookup starts at the group picked by the low hash
+// bits, compares all control bytes of the group with the key's 7 bits at
+// once, and compares keys only where those match, so a miss rarely touches
+// an entry at all; the first group's entries are prefetched alongside its
+// control bytes. It stops at the first group with an empty slot. Groups
+// are probed triangularly, which visits every group of a power-of-two
+// table, and a map is rehashed before it is 7/8 full.
+//
+// Tables come from 'arena' if one is passed to prefix_init (growing
+// abandons the old ones, as in da_new_in), otherwise from the heap.
+// Pointers returned by get and put stay valid until the next insert.
+//
+// FERRUM_HASH_MAP_IMPL defines the functions in one translation unit, given
+// 'hash_fn(Key)' returning a u64 and 'equal_fn(Key, Key)'. U32Map and
+// StringMap below are ready-made instances.
+#define HASH_GROUP_WIDTH 16
+#define HASH_EMPTY 0x80
+#define HASH_DELETED 0xFE
+#define HASH_H2(hash) ((u8)((hash) >> 57))
+#define HASH_MAX_LOAD(capacity) ((capacity) - (capacity) / 8)
+
+// Bit i of the result is set if control byte i of the group equals 'byte'
+// (hash_group_match) or is empty or deleted (hash_group_match_free)
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__SSE2__)
+    #include <emmintrin.h>
+
+    static inline u32 hash_group_match(const u8* group, u8 byte) {
+        __m128i ctrl = _mm_load_si128((const __m128i*)group);
+        return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)byte)));
+    }
+
+    static inline u32 hash_group_match_free(const u8* group) {
+        return (u32)_mm_movemask_epi8(_mm_load_si128((const __m128i*)group));
+    }
+
+    #define hash_first_bit(mask) ((u32)__builtin_ctz(mask))
+    #define hash_prefetch(address) __builtin_prefetch(address)
+#else
+    static inline u32 hash_group_match(const u8* group, u8 byte) {
+        u32 mask = 0;
+        for (u32 i = 0; i < HASH_GROUP_WIDTH; i++) mask |= (u32)(group[i] == byte) << i;
+        return mask;
+    }
+
+    static inline u32 hash_group_match_free(const u8* group) {
+        u32 mask = 0;
+        for (u32 i = 0; i < HASH_GROUP_WIDTH; i++) mask |= (u32)(group[i] >> 7) << i;
+        return mask;
+    }
+
+    static inline u32 hash_first_bit(u32 mask) {
+        u32 bit = 0;
+        while (!(mask & 1)) {
+            mask >>= 1;
+            bit++;
+        }
+        return bit;
+    }
+
+    #define hash_prefetch(address) ((void)(address))
+#endif
+
+// Control bytes of a map with no table yet, so lookups need no special case
+extern const u8 hash_empty_group[HASH_GROUP_WIDTH];
+
+// Smallest table that holds 'count' entries under the load limit
+u32 hash_capacity_for(u32 count);
+void* hash_table_alloc(Arena* arena, usize size);
+void hash_table_release(Arena* arena, void* table);
+
+#define FERRUM_HASH_MAP(Name, prefix, Key, Value) \
+    typedef struct { \
+        Key key; \
+        Value value; \
+    } Name##Entry; \
+    typedef struct { \
+        u8* ctrl; \
+        Name##Entry* entries; \
+        u32 capacity; \
+        u32 group_mask; \
+        u32 count; \
+        u32 growth_left; \
+        Arena* arena; \
+    } Name; \
+    void prefix##_init(Name* map, Arena* arena); \
+    void prefix##_free(Name* map); \
+    void prefix##_clear(Name* map); \
+    void prefix##_reserve(Name* map, u32 count); \
+    Value* prefix##_get(const Name* map, Key key); \
+    Value* prefix##_put(Name* map, Key key, bool* inserted); \
+    void prefix##_set(Name* map, Key key, Value value); \
+    bool prefix##_remove(Name* map, Key key); \
+    Name##Entry* prefix##_next(const Name* map, u32* cursor)
+
+#define FERRUM_HASH_MAP_IMPL(Name, prefix, Key, Value, hash_fn, equal_fn) \
+    void prefix##_init(Name* map, Arena* arena) { \
+        map->ctrl = (u8*)hash_empty_group; \
+        map->entries = NULL; \
+        map->capacity = 0; \
+        map->group_mask = 0; \
+        map->count = 0; \
+        map->growth_left = 0; \
+        map->arena = arena; \
+    } \
+    void prefix##_free(Name* map) { \
+        if (map->capacity > 0) hash_table_release(map->arena, map->ctrl); \
+        prefix##_init(map, map->arena); \
+    } \
+    void prefix##_clear(Name* map) { \
+        if (map->capacity == 0) return; \
+        memset(map->ctrl, HASH_EMPTY, map->capacity); \
+        map->count = 0; \
+        map->growth_left = HASH_MAX_LOAD(map->capacity); \
+    } \
+    static Name##Entry* prefix##_find(const Name* map, Key key, u64 hash) { \
+        u8 h2 = HASH_H2(hash); \
+        u32 group = (u32)hash & map->group_mask; \
+        hash_prefetch(&map->entries[(usize)group * HASH_GROUP_WIDTH]); \
+        for (u32 step = 1;; step++) { \
+            const u8* ctrl = map->ctrl + (usize)group * HASH_GROUP_WIDTH; \
+            for (u32 match = hash_group_match(ctrl, h2); match; match &= match - 1) { \
+                Name##Entry* entry = &map->entries[(usize)group * HASH_GROUP_WIDTH + hash_first_bit(match)]; \
+                if (equal_fn(entry->key, key)) return entry; \
+            } \
+            if (hash_group_match(ctrl, HASH_EMPTY)) return NULL; \
+            group = (group + step) & map->group_mask; \
+        } \
+    } \
+    static usize prefix##_free_slot(const Name* map, u64 hash) { \
+        u32 group = (u32)hash & map->group_mask; \
+        for (u32 step = 1;; step++) { \
+            u32 open = hash_group_match_free(map->ctrl + (usize)group * HASH_GROUP_WIDTH); \
+            if (open) return (usize)group * HASH_GROUP_WIDTH + hash_first_bit(open); \
+            group = (group + step) & map->group_mask; \
+        } \
+    } \
+    static void prefix##_rehash(Name* map, u32 capacity) { \
+        Name old = *map; \
+        u8* table = (u8*)hash_table_alloc(map->arena, (usize)capacity * (1 + sizeof(Name##Entry))); \
+        memset(table, HASH_EMPTY, capacity); \
+        map->ctrl = table; \
+        map->entries = (Name##Entry*)(table + capacity); \
+        map->capacity = capacity; \
+        map->group_mask = capacity / HASH_GROUP_WIDTH - 1; \
+        map->growth_left = HASH_MAX_LOAD(capacity) - old.count; \
+        for (u32 i = 0; i < old.capacity; i++) { \
+            if (old.ctrl[i] & 0x80) continue; \
+            u64 hash = hash_fn(old.entries[i].key); \
+            usize slot = prefix##_free_slot(map, hash); \
+            map->ctrl[slot] = HASH_H2(hash); \
+            map->entries[slot] = old.entries[i]; \
+        } \
+        if (old.capacity > 0) hash_table_release(map->arena, old.ctrl); \
+    } \
+    void prefix##_reserve(Name* map, u32 count) { \
+        u32 capacity = hash_capacity_for(count); \
+        if (capacity > map->capacity) prefix##_rehash(map, capacity); \
+    } \
+    Value* prefix##_get(const Name* map, Key key) { \
+        Name##Entry* entry = prefix##_find(map, key, hash_fn(key)); \
+        return entry ? &entry->value : NULL; \
+    } \
+    Value* prefix##_put(Name* map, Key key, bool* inserted) { \
+        u64 hash = hash_fn(key); \
+        Name##Entry* entry = prefix##_find(map, key, hash); \
+        if (inserted) *inserted = entry == NULL; \
+        if (entry) return &entry->value; \
+        if (map->growth_left == 0) { \
+            bool mostly_deleted = map->count <= HASH_MAX_LOAD(map->capacity) / 2; \
+            prefix##_rehash(map, mostly_deleted ? hash_capacity_for(map->count + 1) \
+                                                : hash_capacity_for(map->capacity)); \
+        } \
+        usize slot = prefix##_free_slot(map, hash); \
+        if (map->ctrl[slot] == HASH_EMPTY) map->growth_left--; \
+        map->ctrl[slot] = HASH_H2(hash); \
+        map->count++; \
+        entry = &map->entries[slot]; \
+        entry->key = key; \
+        memset(&entry->value, 0, sizeof(Value)); \
+        return &entry->value; \
+    } \
+    void prefix##_set(Name* map, Key key, Value value) { \
+        *prefix##_put(map, key, NULL) = value; \
+    } \
+    bool prefix##_remove(Name* map, Key key) { \
+        Name##Entry* entry = prefix##_find(map, key, hash_fn(key)); \
+        if (!entry) return false; \
+        usize slot = (usize)(entry - map->entries); \
+        const u8* group = map->ctrl + slot / HASH_GROUP_WIDTH * HASH_GROUP_WIDTH; \
+        if (hash_group_match(group, HASH_EMPTY)) { \
+            map->ctrl[slot] = HASH_EMPTY; \
+            map->growth_left++; \
+        } else { \
+            map->ctrl[slot] = HASH_DELETED; \
+        } \
+        map->count--; \
+        return true; \
+    } \
+    Name##Entry* prefix##_next(const Name* map, u32* cursor) { \
+        for (u32 i = *cursor; i < map->capacity; i++) { \
+            if (!(map->ctrl[i] & 0x80)) { \
+                *cursor = i + 1; \
+                return &map->entries[i]; \
+            } \
+        } \
+        *cursor = map->capacity; \
+        return NULL; \
+    }
+
+// Ready-made maps. A StringKey does not own its text.
+typedef struct {
+    const char* text;
+    u32 length;
+} StringKey;
+
+#define u32_key_equal(a, b) ((a) == (b))
+#define string_key_hash(key) hash_bytes((key).text, (key).length, 0)
+#define string_key_equal(a, b) ((a).length == (b).length && memcmp((a).text, (b).text, (a).length) == 0)
+
+FERRUM_HASH_MAP(U32Map, u32_map, u32, u32);
+FERRUM_HASH_MAP(StringMap, string_map, StringKey, u32);
+
 #endif // FERRUM_COMMON_H
\ No newline at end of file
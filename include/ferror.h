@@ -1,9 +1,11 @@
 #ifndef FERRUM_ERROR_H
 #define FERRUM_ERROR_H
 
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include "common.h"
+#include "lexer.h"
 
 typedef enum {
     ERR_LEXER,          // Lexer hatası
@@ -33,10 +35,21 @@ void error_cleanup();
 
 // Hata oluşturma yardımcıları
 Error error_create(ErrorType type, const char* msg, uint32_t line, uint32_t col, const char* filename, bool fatal);
+Error error_create_at(ErrorType type, const char* msg, LineMap* lines, uint32_t offset, const char* filename, bool fatal);
 Error error_lexer(const char* msg, uint32_t line, uint32_t col, const char* filename);
 Error error_parser(const char* msg, uint32_t line, uint32_t col, const char* filename);
 Error error_semantic(const char* msg, uint32_t line, uint32_t col, const char* filename);
 
+// Derleyici geçişlerinin tanı mesajları:
+//   [dosya:satır:sütun] Error at '<near>': <mesaj>
+// 'out' NULL değilse sona eklenir, NULL ise stderr'e yazılır. 'lines' kaynağa
+// sahip değilse konum, 'near' NULL ise " at" kısmı yazılmaz; boş bir 'near'
+// girdinin sonu demektir. Sığmayan mesajlar kısaltılır.
+void diagnostic_report(ByteBuffer* out, const char* filename, LineMap* lines, uint32_t offset,
+                       const char* near, int near_length, const char* format, ...);
+void diagnostic_vreport(ByteBuffer* out, const char* filename, LineMap* lines, uint32_t offset,
+                        const char* near, int near_length, const char* format, va_list args);
+
 // Global hata durumu
 extern bool had_error;
 extern bool had_runtime_error;
@@ -0,0 +1,43 @@
+#ifndef FERRUM_FOLD_H
+#define FERRUM_FOLD_H
+
+#include "ast.h"
+#include "resolver.h"
+
+// Constant folding and propagation
+//
+// fold_program rewrites a type-checked tree in place:
+//   - unary, binary and logical expressions whose operands are literals
+//     become a literal;
+//   - a use of an immutable 'let' whose initializer folded to a literal
+//     becomes that literal. Locals also propagate into the closures that
+//     capture them. Globals only propagate into top-level code after their
+//     'let': a function may be called before the global is initialized;
+//   - algebraic identities are simplified: x + 0, x - 0, x * 1 and x / 1
+//     become x, x * 0 becomes 0 when x has no side effects, and
+//     'true && x', 'x || false' and the like lose their constant operand.
+//     The integer-only ones (x + 0, x * 0) are left alone for floats,
+//     where -0.0 and NaN make them wrong.
+//
+// Folding never changes what a program does. Integer arithmetic wraps
+// (two's complement), as the generated code does; division truncates
+// toward zero. A division that traps at run time (by zero, or INT64_MIN by
+// -1) is left in place so it still does. Floats follow IEEE 754 in double
+// precision.
+//
+// New literals carry the type of the expression they replace. The tree
+// must have been through resolve_program, which also leaves no shared
+// hash-consed node other than literals, and typecheck_program. Replaced
+// subtrees are freed when the tree is on the heap and left to the arena
+// otherwise.
+
+typedef struct {
+    uint32_t folded;        // Operations replaced by their result
+    uint32_t propagated;    // Variable uses replaced by their value
+    uint32_t simplified;    // Algebraic identities removed
+} FoldStats;
+
+// 'resolver' is the one that resolved 'root'. 'stats' may be NULL.
+void fold_program(ASTNode* root, const Resolver* resolver, FoldStats* stats);
+
+#endif // FERRUM_FOLD_H
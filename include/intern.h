@@ -0,0 +1,68 @@
+#ifndef FERRUM_INTERN_H
+#define FERRUM_INTERN_H
+
+#include "common.h"
+
+// Interned string handle. Two symbols from the same Interner are equal
+// exactly when their texts are equal, so comparing names is one integer
+// compare. 0 is never handed out.
+typedef uint32_t Symbol;
+
+#define SYMBOL_NONE 0
+
+// Per-symbol data, indexed by Symbol
+typedef struct {
+    const char* text;     // Copy in the arena ('\0'-terminated), or borrowed
+    uint32_t length;      // Length in bytes, without the terminator
+    uint32_t hash;        // intern_hash of the text
+} SymbolEntry;
+
+// Open-addressing slot; the hash is kept next to the id so most probes
+// never touch the entry table
+typedef struct {
+    uint32_t hash;
+    Symbol symbol;        // SYMBOL_NONE for an empty slot
+} InternSlot;
+
+// Arena chunk holding the bytes of interned strings
+typedef struct InternChunk {
+    struct InternChunk* next;
+    usize used;
+    usize capacity;
+    char data[];
+} InternChunk;
+
+typedef struct {
+    InternSlot* slots;    // Hash table, power-of-two sized
+    uint32_t slot_mask;   // Slot count - 1
+    SymbolEntry* entries; // Symbol -> text/length/hash
+    uint32_t count;       // Entries in use, including the SYMBOL_NONE slot
+    uint32_t capacity;    // Allocated entries
+    InternChunk* chunks;  // Newest chunk first
+    bool borrow;          // Point into the caller's text instead of copying
+} Interner;
+
+void interner_init(Interner* interner);
+
+// Borrowing interner: symbol texts point straight into the interned buffers
+// (typically a mapped source file), which must outlive the interner. Borrowed
+// texts are not '\0'-terminated; use symbol_length.
+void interner_init_borrowed(Interner* interner);
+void interner_free(Interner* interner);
+
+// Hash used by the table; exposed so callers that already walk the bytes
+// can precompute it and use intern_hashed
+uint32_t intern_hash(const char* text, uint32_t length);
+
+Symbol intern(Interner* interner, const char* text, uint32_t length);
+Symbol intern_hashed(Interner* interner, const char* text, uint32_t length, uint32_t hash);
+
+// Returns SYMBOL_NONE if the text was never interned
+Symbol intern_find(const Interner* interner, const char* text, uint32_t length);
+
+// Symbol accessors
+const char* symbol_text(const Interner* interner, Symbol symbol);
+uint32_t symbol_length(const Interner* interner, Symbol symbol);
+uint32_t symbol_hash(const Interner* interner, Symbol symbol);
+
+#endif // FERRUM_INTERN_H
@@ -0,0 +1,210 @@
+#ifndef FERRUM_IR_H
+#define FERRUM_IR_H
+
+#include "common.h"
+#include <stdio.h>
+
+// Mid-level IR
+//
+// A module is a list of functions, each a list of basic blocks in SSA
+// form. Every instruction that produces a value defines a new virtual
+// register (IrValue), numbered per function from 1; 0 means no value. A
+// register has a machine type (IrType), so backends never see language
+// types: ints and chars are 64-bit integers, floats are doubles, and
+// strings, arrays, channels, closures, nil and 'any' are pointer-sized.
+//
+// Every block ends in one terminator (jump, branch or ret) and records its
+// predecessors in the order their terminators were added. Phis come first
+// in a block and have one operand per predecessor, in that order.
+//
+// Memory is only touched by 'load' and 'store', which read and write a
+// word at a byte offset from an address, and by calls. Locals never need
+// memory: 'let' is immutable, so a declaration's value dominates all its
+// uses, and closures capture values rather than variables. Globals live
+// in memory ('global' is the address of one), and so do the values a
+// closure captured ('env' is the closure, its upvalues follow the code
+// address).
+//
+// Functions take their closure as a hidden first argument. A function
+// known at compile time is called directly ('call'); any other callee is
+// a closure value called through its code address ('calli'). Each
+// top-level function has a static closure, the value of 'func'. External
+// functions are provided by the runtime: they have no blocks and no
+// closure argument.
+//
+// Textual form, as ir_dump prints it:
+//
+//   function add_1(int, int) -> int
+//   b0:
+//       %1:ptr = env
+//       %2:int = param 0
+//       %3:int = param 1
+//       %4:int = add %2, %3
+//       ret %4
+
+typedef uint32_t IrValue;
+
+#define IR_NO_VALUE 0
+#define IR_NONE UINT32_MAX
+
+typedef enum {
+    IR_VOID,
+    IR_BOOL,
+    IR_INT,
+    IR_FLOAT,
+    IR_PTR,
+    IR_TYPE_COUNT
+} IrType;
+
+typedef enum {
+    // Operands in 'imm'
+    IR_CONST,           // Integer, bool or nil constant
+    IR_FCONST,          // Float constant, in 'fimm'
+    IR_STRING,          // Address of string literal 'imm'
+    IR_PARAM,           // Parameter 'imm'
+    IR_ENV,             // The function's own closure
+    IR_GLOBAL,          // Address of global 'imm'
+    IR_FUNC,            // Static closure of function 'imm'
+
+    // Integer and bool arithmetic; division truncates and traps on zero
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_NEG,
+    IR_NOT,
+
+    // Float arithmetic
+    IR_FADD,
+    IR_FSUB,
+    IR_FMUL,
+    IR_FDIV,
+    IR_FNEG,
+
+    // Comparisons produce a bool. Integer ones also compare bools, chars
+    // and pointers.
+    IR_EQ,
+    IR_NE,
+    IR_LT,
+    IR_LE,
+    IR_GT,
+    IR_GE,
+    IR_FEQ,
+    IR_FNE,
+    IR_FLT,
+    IR_FLE,
+    IR_FGT,
+    IR_FGE,
+
+    IR_PHI,             // One operand per predecessor
+    IR_LOAD,            // Word at args[0] + imm
+    IR_STORE,           // args[1] to args[0] + imm
+    IR_CALL,            // Function 'imm' with args
+    IR_CALLI,           // Closure args[0] with the rest
+    IR_CLOSURE,         // New closure of function 'imm' capturing args
+
+    // Terminators
+    IR_JUMP,            // To targets[0]
+    IR_BRANCH,          // To targets[0] if args[0], else targets[1]
+    IR_RET,             // args[0], if any
+
+    IR_OP_COUNT
+} IrOp;
+
+typedef struct IrBlock IrBlock;
+
+typedef struct {
+    uint8_t op;             // IrOp
+    uint8_t type;           // IrType of 'dest', IR_VOID if none
+    IrValue dest;
+    uint32_t arg_count;
+    IrValue* args;          // Allocated from the module arena
+    union {
+        int64_t imm;
+        double fimm;
+    };
+    IrBlock* targets[2];
+} IrInstr;
+
+struct IrBlock {
+    uint32_t id;            // Position in the function once placed
+    DynamicArray instrs;    // IrInstr; the last is the terminator
+    DynamicArray preds;     // IrBlock*
+};
+
+typedef struct {
+    const char* name;       // Assembly label
+    uint32_t index;         // In IrModule.functions
+    uint32_t param_count;   // Not counting the closure
+    uint32_t upvalue_count;
+    IrType result;
+    bool external;
+    DynamicArray params;    // uint8_t IrType per parameter, for dumps
+    DynamicArray blocks;    // IrBlock*, entry first
+    DynamicArray values;    // uint8_t IrType per register; [0] is IR_VOID
+} IrFunction;
+
+typedef struct {
+    Arena arena;            // Functions, blocks, instructions and their operands
+    DynamicArray functions; // IrFunction*; [0] is the top-level code, run as 'main'
+    DynamicArray strings;   // const char* per string literal
+    StringMap externs;      // Name -> index of an external function
+    uint32_t global_count;
+} IrModule;
+
+void ir_module_init(IrModule* module);
+void ir_module_free(IrModule* module);
+
+// Building. A new block is placed in its function when code starts going
+// into it, so the layout follows the source even when a branch target is
+// created before the blocks in between. Instructions are appended to a
+// block; the pointer ir_append returns is valid until the next instruction
+// is appended to that block.
+IrFunction* ir_function_new(IrModule* module, const char* name, IrType result);
+uint32_t ir_extern(IrModule* module, const char* name, IrType result);
+uint32_t ir_string(IrModule* module, const char* text, usize length);
+IrBlock* ir_block_new(IrModule* module);
+void ir_block_place(IrFunction* function, IrBlock* block);
+IrValue ir_param(IrModule* module, IrFunction* function, IrBlock* block, IrType type);
+IrInstr* ir_append(IrModule* module, IrFunction* function, IrBlock* block, IrOp op, IrType type,
+                   const IrValue* args, uint32_t count);
+IrValue ir_const(IrModule* module, IrFunction* function, IrBlock* block, IrType type, int64_t value);
+void ir_jump(IrModule* module, IrFunction* function, IrBlock* from, IrBlock* to);
+void ir_branch(IrModule* module, IrFunction* function, IrBlock* from, IrValue condition,
+               IrBlock* if_true, IrBlock* if_false);
+void ir_ret(IrModule* module, IrFunction* function, IrBlock* from, IrValue value);
+
+static inline IrInstr* ir_terminator(const IrBlock* block) {
+    if (block->instrs.count == 0) return NULL;
+    IrInstr* last = (IrInstr*)block->instrs.items + block->instrs.count - 1;
+    return last->op >= IR_JUMP ? last : NULL;
+}
+
+// Stores the targets of the block's terminator in 'successors' and
+// returns their number
+static inline uint32_t ir_successors(const IrBlock* block, IrBlock* successors[2]) {
+    IrInstr* last = ir_terminator(block);
+    if (!last || last->op == IR_RET) return 0;
+    successors[0] = last->targets[0];
+    if (last->op == IR_JUMP) return 1;
+    successors[1] = last->targets[1];
+    return 2;
+}
+
+static inline IrType ir_value_type(const IrFunction* function, IrValue value) {
+    return (IrType)((const uint8_t*)function->values.items)[value];
+}
+
+// Position of 'pred' among the predecessors of 'block', which is the phi
+// operand for that edge
+uint32_t ir_pred_index(const IrBlock* block, const IrBlock* pred);
+
+// Instructions in all functions of the module
+usize ir_instr_count(const IrModule* module);
+
+const char* ir_op_name(IrOp op);
+const char* ir_type_name(IrType type);
+void ir_dump_function(const IrFunction* function, const IrModule* module, FILE* out);
+void ir_dump(const IrModule* module, FILE* out);
+
+#endif // FERRUM_IR_H
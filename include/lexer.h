@@ -93,25 +93,98 @@ typedef enum {
     TOKEN_COUNT     // Number of token types
 } TokenType;
 
+// Decoded value of a numeric literal
+typedef union {
+    uint64_t int_value;   // TOKEN_INT, any base; negation is a separate token
+    double float_value;   // TOKEN_FLOAT, correctly rounded
+} TokenValue;
+
 // Token structure
 typedef struct {
     TokenType type;     // Type of token
-    const char* start;  // Start of token text in source
     int length;        // Length of token text
-    uint32_t line;     // Line number in source
-    uint32_t col;      // Column number in source
+    uint32_t offset;   // Byte offset of token in source (see LineMap)
+    TokenValue value;  // Literal value for TOKEN_INT/TOKEN_FLOAT, zero otherwise
+    const char* start;  // Start of token text in source
 } Token;
 
 // Lexer structure
 typedef struct {
+    const char* source;   // Start of source, offsets are relative to it
     const char* start;    // Start of current token
     const char* current;  // Current position in source
-    uint32_t line;       // Current line number
-    uint32_t col;        // Current column number
 } Lexer;
 
+// Line-start table
+//
+// Tokens and AST nodes only carry byte offsets. A LineMap turns an offset
+// into line/column when a diagnostic is actually printed; the table itself
+// is built on first use with a single newline scan of the source.
+typedef struct {
+    const char* source;   // Source the offsets refer to
+    uint32_t* starts;     // Offset of the first byte of each line
+    uint32_t count;       // Number of lines (0 until built)
+} LineMap;
+
+// Whole-file token stream (structure-of-arrays layout)
+//
+// Batch alternative to pulling tokens one by one from lex_next: the buffer is
+// lexed once and every token is kept as a 9-byte (type, offset, length)
+// triple. Offsets are relative to 'source', so sources are limited to 4 GiB.
+// The last token is always TOKEN_EOF.
+//
+// Numeric literals are rare compared to other tokens, so their decoded values
+// live in a side table sorted by token index instead of a per-token column.
+typedef struct {
+    const char* source;   // Source the offsets refer to
+    uint8_t* types;       // TokenType of each token
+    uint32_t* offsets;    // Byte offset of each token in source
+    uint32_t* lengths;    // Length of each token in bytes
+    uint32_t count;       // Number of tokens
+    uint32_t capacity;    // Allocated slots per array
+    uint32_t* literal_tokens;   // Token index of each literal, ascending
+    TokenValue* literal_values; // Decoded value of each literal
+    uint32_t literal_count;     // Number of literals
+    uint32_t literal_capacity;  // Allocated literal slots
+} TokenStream;
+
+// Source edit, in the coordinates of the buffer before the edit. 'removed'
+// bytes at 'offset' were replaced by 'inserted' new bytes.
+typedef struct {
+    uint32_t offset;      // First byte that changed
+    uint32_t removed;     // Bytes removed at offset
+    uint32_t inserted;    // Bytes inserted at offset
+} TokenEdit;
+
+// Tokens replaced by token_stream_relex: stream indices
+// [first, first + inserted) now hold the new tokens that took the place of
+// 'removed' old ones. Everything outside the range is unchanged apart from
+// offsets after the edit, which moved by inserted - removed.
+typedef struct {
+    uint32_t first;       // Index of the first replaced token
+    uint32_t removed;     // Old tokens dropped
+    uint32_t inserted;    // New tokens in their place
+} TokenRange;
+
 // Lexer functions
 void lexer_init(Lexer* lexer, const char* source);
+void lexer_seek(Lexer* lexer, uint32_t offset);
 Token lex_next(Lexer* lexer);
 
+// Token stream functions
+void token_stream_init(TokenStream* stream);
+void token_stream_free(TokenStream* stream);
+void token_stream_reserve(TokenStream* stream, uint32_t capacity);
+void token_stream_push(TokenStream* stream, TokenType type, uint32_t offset, uint32_t length);
+void token_stream_push_token(TokenStream* stream, const Token* token);
+void token_stream_append(TokenStream* stream, const TokenStream* part);
+void token_stream_lex(TokenStream* stream, const char* source);
+Token token_stream_get(const TokenStream* stream, uint32_t index);
+TokenRange token_stream_relex(TokenStream* stream, const char* source, TokenEdit edit);
+
+// Line map functions
+void line_map_init(LineMap* map, const char* source);
+void line_map_free(LineMap* map);
+void line_map_resolve(LineMap* map, uint32_t offset, uint32_t* line, uint32_t* col);
+
 #endif // FERRUM_LEXER_H
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef FERRUM_LEXER_PARALLEL_H
+#define FERRUM_LEXER_PARALLEL_H
+
+#include "lexer.h"
+#include "common.h"
+
+// Files smaller than this are always lexed on the calling thread
+#define LEXER_PARALLEL_MIN_BYTES (4u * 1024u * 1024u)
+
+// Lex 'source' ('length' bytes, '\0'-terminated) on up to 'thread_count'
+// threads. The buffer is split at newlines that lie outside string literals
+// and comments, each chunk is lexed on its own worker, and the pieces are
+// stitched back together. The resulting stream is identical to the one
+// token_stream_lex produces.
+void token_stream_lex_parallel(TokenStream* stream, const char* source, usize length, int thread_count);
+
+#endif // FERRUM_LEXER_PARALLEL_H
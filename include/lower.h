@@ -0,0 +1,33 @@
+#ifndef FERRUM_LOWER_H
+#define FERRUM_LOWER_H
+
+#include "ast.h"
+#include "ir.h"
+#include "resolver.h"
+#include "types.h"
+
+// Lowering to IR
+//
+// lower_program translates a resolved, type-checked tree into 'module':
+// the top-level code becomes function 0 ('main'), each function
+// declaration and closure an IR function. A variable's value is its
+// register: parameters and 'let's of a function bind a frame slot to the
+// register of their value, upvalues are loaded from the closure and
+// globals from their address. '&&' and '||' become branches that meet in
+// a phi; 'if', 'while' and 'for' become blocks, with 'break' and
+// 'continue' jumping to the loop's exit and increment.
+//
+// Builtins and the operations that need the runtime (string concatenation
+// and comparison) are calls to external rt_* functions.
+// print calls the rt_print_* variant for its argument's type.
+//
+// Constructs the IR cannot express yet (classes, fields, arrays,
+// exceptions, match, defer, select, foreach, async) and those with no
+// runtime yet (channels, 'go') are reported as errors.
+
+// 'source' is used to print line numbers in diagnostics and may be NULL.
+// Returns false if some construct could not be lowered; each is printed.
+bool lower_program(IrModule* module, ASTNode* root, const Resolver* resolver, TypeTable* types,
+                   Interner* interner, const char* source, const char* filename);
+
+#endif // FERRUM_LOWER_H
@@ -3,16 +3,24 @@
 
 #include "lexer.h"
 #include "ast.h"
+#include "intern.h"
 #include "common.h"
 
 // Parser structure
 typedef struct {
-    Lexer* lexer;           // Lexer instance
+    Lexer* lexer;           // Lexer instance (NULL in stream mode)
+    TokenStream* tokens;    // Pre-lexed token stream (NULL in lexer mode)
+    uint32_t token_index;   // Next token to read from 'tokens'
+    uint32_t token_end;     // Tokens from here on read as EOF
+    Interner* interner;     // Identifier names are interned here
     const char* filename;    // Source file name
+    LineMap lines;          // Offset -> line/column, built on first error
     Token current;          // Current token
     Token previous;         // Previous token
     bool had_error;         // Error flag
     bool panic_mode;        // Error recovery mode
+    ByteBuffer* diagnostics; // Errors are appended here instead of printed, if set
+    DynamicArray operators; // Pending operators of parse_precedence
 } Parser;
 
 typedef enum {
@@ -38,14 +46,18 @@ typedef struct {
 } ParseRule;
 
 // Parser functions
-void parser_init(Parser* parser, Lexer* lexer, const char* filename);
+void parser_init(Parser* parser, Lexer* lexer, Interner* interner, const char* filename);
+void parser_init_stream(Parser* parser, TokenStream* tokens, Interner* interner, const char* filename);
+void parser_free(Parser* parser);
 ASTNode* parse(Parser* parser);
+void parse_range(Parser* parser, uint32_t begin, uint32_t end, DynamicArray* declarations);
 
 // Helper functions
 void advance(Parser* parser);
 void consume(Parser* parser, TokenType type, const char* message);
 bool match(Parser* parser, TokenType type);
 bool check(Parser* parser, TokenType type);
+TokenType parser_peek(Parser* parser, uint32_t distance);
 
 // Expression parsing
 void parse_expression(Parser* parser, ASTNode** node, bool can_assign);
@@ -0,0 +1,52 @@
+#ifndef FERRUM_PARSER_INCREMENTAL_H
+#define FERRUM_PARSER_INCREMENTAL_H
+
+#include "parser.h"
+#include "ast_flat.h"
+
+// Incremental reparsing
+//
+// The stream is split into top-level declaration ranges the same way as for
+// parse_parallel. Every range is keyed by a hash of its tokens (type, length,
+// text and offset relative to the range start), so whitespace or edits
+// elsewhere in the file do not change it. On the next parse, a range whose
+// hash is still present reuses the subtrees parsed last time: they are only
+// rebased to the range's new offset. Only new or edited ranges go through
+// parse_declaration again. Ranges that reported errors are never reused, so
+// their diagnostics are repeated on every parse.
+//
+// The cache keeps a flat copy of each range (see ast_flat.h), taken right
+// after parsing, and hands out trees rebuilt from it. The resolver, type
+// checker and folder rewrite the tree they are given, so it must never be
+// the one the next parse reuses. Rebasing a flat copy only adds to its node
+// and token offsets. Names are interned into the cache's own interner,
+// which copies them, so symbols stay valid across sources and parses.
+
+typedef struct {
+    uint64_t hash;              // Hash of the range's tokens
+    uint32_t offset;            // Offset of the first token in 'flat'
+    uint32_t count;             // Number of declarations
+    FlatIndex* declarations;    // Their roots in 'flat'
+    FlatAST flat;               // Empty if had_error
+    bool had_error;
+} ParsedRange;
+
+typedef struct {
+    Interner interner;
+    ParsedRange* ranges;        // Ranges of the last parse, in source order
+    uint32_t range_count;
+
+    // Statistics of the last parse
+    uint32_t reused;
+    uint32_t reparsed;
+} ParseCache;
+
+void parse_cache_init(ParseCache* cache);
+void parse_cache_free(ParseCache* cache);
+
+// Parses 'tokens' into a root NODE_BLOCK_STMT, reusing what it can from the
+// previous call. The tree is allocated like any other parse (see
+// ast_set_arena) and belongs to the caller.
+ASTNode* parse_incremental(ParseCache* cache, TokenStream* tokens, const char* filename, bool* had_error);
+
+#endif // FERRUM_PARSER_INCREMENTAL_H
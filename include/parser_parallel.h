@@ -0,0 +1,34 @@
+#ifndef FERRUM_PARSER_PARALLEL_H
+#define FERRUM_PARSER_PARALLEL_H
+
+#include "parser.h"
+
+// Streams with fewer tokens are parsed on the calling thread
+#define PARSER_PARALLEL_MIN_TOKENS 65536
+
+// Splits the stream before every top-level declaration (see below) and
+// stores the range boundaries in a new array: range i is the token indices
+// [bounds[i], bounds[i + 1]), and bounds[count] is the index of the EOF
+// token. Returns the number of ranges. The caller frees 'bounds' with f_free.
+uint32_t parse_declaration_bounds(const TokenStream* tokens, uint32_t** bounds);
+
+// Parse a whole token stream into a root NODE_BLOCK_STMT on up to
+// 'thread_count' threads.
+//
+// A scan over the token types splits the stream before every top-level
+// fn/type/trait/impl/interface that follows a complete statement (';' or
+// '}') at brace depth 0. Each range is parsed on its own, as if it were a
+// file, by one of the workers; the declarations are concatenated in source
+// order. Because the ranges do not depend on the thread count, neither do the
+// tree and the diagnostics: errors are buffered per worker and printed in
+// source order after all workers finish.
+//
+// Identifiers are interned up front, so workers only read 'interner'. Nodes
+// go to the calling thread's AST arena when one is set (worker arenas are
+// adopted into it), otherwise to the heap. With hash-consing on, each worker
+// shares subexpressions through a table of its own, so equal expressions
+// parsed by different workers are equal nodes but not the same pointer.
+ASTNode* parse_parallel(TokenStream* tokens, Interner* interner, const char* filename,
+                        int thread_count, bool* had_error);
+
+#endif // FERRUM_PARSER_PARALLEL_H
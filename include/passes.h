@@ -0,0 +1,148 @@
+#ifndef FERRUM_PASSES_H
+#define FERRUM_PASSES_H
+
+#include "ast.h"
+#include "ir.h"
+#include "resolver.h"
+#include <stdio.h>
+
+// Optimization pipeline
+//
+// A PassManager runs the passes of an optimization level. Constant folding
+// on the tree runs before lowering (pass_manager_run_ast); the IR passes run
+// on each function of the lowered module (pass_manager_run_ir):
+//
+//   -O0  nothing
+//   -O1  fold, simplify, simplify-cfg, dce, renumber
+//   -O2  fold, then simplify, simplify-cfg, cse and dce repeated until no
+//        function changes (at most IR_MAX_ROUNDS times), renumber
+//   -O3  as -O2, with inline first in each round
+//
+// The passes (src/compiler/opt.c):
+//   simplify      folds instructions on constants and algebraic
+//                 identities, with the rules of fold.h; removes phis whose
+//                 operands are all the same value
+//   simplify-cfg  turns branches on constants into jumps, forwards jumps
+//                 through empty blocks, merges a block into its only
+//                 predecessor and removes unreachable blocks
+//   cse           replaces an instruction by an equal one that dominates it;
+//                 loads and calls are never merged
+//   dce           removes instructions whose value is unused and that have
+//                 no effect (a division only when it cannot trap)
+//   inline        replaces direct calls to small single-block functions by
+//                 their body
+//   renumber      numbers registers densely again, which shrinks frames
+//
+// Analyses are computed when a pass first asks for them and cached per
+// function. When a pass changes a function, the analyses it does not list
+// in 'preserves' are dropped for that function only. A pass is also
+// skipped on a function that has not changed since the pass last ran on
+// it, so later rounds only revisit what the previous round touched. A pass
+// that reads its callees (inline) is only skipped while no function in the
+// module has changed, since shrinking a callee can make it inlinable.
+//
+// With 'time_passes', every pass and analysis records its wall time, and
+// every IR pass how many instructions it added or removed;
+// pass_manager_report prints them. Analysis time is not counted in the pass
+// that asked for it.
+
+#define IR_MAX_ROUNDS 4
+
+typedef enum {
+    OPT_O0,
+    OPT_O1,
+    OPT_O2,
+    OPT_O3
+} OptLevel;
+
+typedef enum {
+    ANALYSIS_USES = 1 << 0,
+    ANALYSIS_DEFS = 1 << 1,
+    ANALYSIS_DOMINATORS = 1 << 2
+} AnalysisKind;
+
+typedef struct {
+    IrBlock** order;        // Reachable blocks in reverse postorder, entry first
+    uint32_t count;
+    uint32_t* idom;         // Block id -> immediate dominator's id; the entry's is itself, IR_NONE if unreachable
+    uint32_t* child;        // Block id -> first block it immediately dominates, or IR_NONE
+    uint32_t* sibling;      // Block id -> next block with the same immediate dominator, or IR_NONE
+} IrDominators;
+
+typedef struct {
+    uint32_t valid;         // AnalysisKind bits
+    uint32_t* uses;         // Register -> number of operands naming it
+    IrInstr** defs;         // Register -> defining instruction
+    IrDominators dominators;
+    uint32_t version;       // Incremented each time a pass changes the function
+    uint32_t* seen;         // Pipeline position -> 1 + version the pass last ran on (the
+                            // module's for passes that read callees), 0 if never
+} FunctionAnalyses;
+
+typedef struct PassManager PassManager;
+
+typedef struct {
+    const char* name;
+    uint32_t preserves;     // AnalysisKind bits still valid after a change
+    // Returns true if it changed 'function'
+    bool (*run)(PassManager* manager, IrFunction* function);
+    bool reads_callees;     // Depends on the functions 'function' calls, too
+} IrPass;
+
+typedef enum {
+    TIMING_PASS,
+    TIMING_ANALYSIS,
+    TIMING_STEP             // Recorded with pass_manager_record
+} TimingKind;
+
+typedef struct {
+    const char* name;
+    TimingKind kind;
+    bool measures_ir;       // False for what runs before lowering
+    uint64_t nanoseconds;
+    uint32_t runs;          // One per function for IR passes and analyses
+    uint32_t changed;       // Runs that changed something
+    int64_t delta;          // Change in module instructions over all runs
+} PassTiming;
+
+struct PassManager {
+    OptLevel level;
+    bool time_passes;
+    IrModule* module;
+    DynamicArray pipeline;  // const IrPass*, one round
+    uint32_t rounds;        // Most times the round is repeated
+    DynamicArray functions; // FunctionAnalyses per function of 'module'
+    DynamicArray timings;   // PassTiming, in order of first run
+    uint64_t analysis_time; // Spent in analyses during the running pass
+    uint32_t module_version; // Incremented each time a pass changes any function
+};
+
+void pass_manager_init(PassManager* manager, OptLevel level, bool time_passes);
+void pass_manager_free(PassManager* manager);
+
+// Passes on the checked tree, before lowering
+void pass_manager_run_ast(PassManager* manager, ASTNode* root, const Resolver* resolver);
+
+// The IR pipeline of the level, on every function with blocks
+void pass_manager_run_ir(PassManager* manager, IrModule* module);
+
+// Adds a step run outside the manager, such as lowering, to the report
+void pass_manager_record(PassManager* manager, const char* name, uint64_t nanoseconds,
+                         usize before, usize after);
+void pass_manager_report(const PassManager* manager, FILE* out);
+
+// Analyses of 'function', computed if not cached. They stay valid until
+// the function changes; a pass that changes it must stop using them.
+uint32_t* pass_uses(PassManager* manager, IrFunction* function);
+IrInstr** pass_defs(PassManager* manager, IrFunction* function);
+const IrDominators* pass_dominators(PassManager* manager, IrFunction* function);
+
+// The passes (src/compiler/opt.c)
+extern const IrPass pass_simplify;
+extern const IrPass pass_simplify_cfg;
+extern const IrPass pass_cse;
+extern const IrPass pass_dce;
+extern const IrPass pass_inline;
+extern const IrPass pass_renumber;
+
+#endif // FERRUM_PASSES_H
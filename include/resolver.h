@@ -0,0 +1,90 @@
+#ifndef FERRUM_RESOLVER_H
+#define FERRUM_RESOLVER_H
+
+#include "ast.h"
+#include "intern.h"
+#include "common.h"
+
+// Name resolution
+//
+// resolve_program walks a parsed tree once and binds every variable
+// reference to where the variable lives, so later passes read and write
+// variables by index and never look names up:
+//   - globals: top-level variables, functions and import aliases, plus the
+//     builtins, numbered in declaration order. All top-level names are
+//     declared before any body is resolved, so functions may refer to each
+//     other in any order.
+//   - locals: parameters and variables of a function, each in a frame slot
+//     (FrameInfo). A block's slots are reused once the block ends.
+//     Statements at top level that open blocks use the script frame.
+//   - upvalues: locals of an enclosing function used by a nested function
+//     or closure. Each function lists what it captures (FrameInfo.upvalues),
+//     either a slot of the function around it or one of that function's own
+//     upvalues, and the captured declaration is marked 'captured'. Names in
+//     a closure's capture list become its first upvalues.
+//
+// Blocks, function bodies and for loops open scopes, and an inner
+// declaration shadows an outer one; declaring a name twice in one scope is
+// an error. A variable is in scope after its declaration, so the
+// initializer of 'let x = x;' refers to an outer 'x'. Top-level variables
+// are hoisted for the functions that use them, but code outside function
+// bodies may not use one before its declaration has run: at top level
+// 'let x = x;' is an error rather than a read of the uninitialized global.
+// Function names are in scope in their own body. Class, enum, type,
+// interface and trait names live in the type namespace and are not bound
+// here; method bodies are resolved as functions.
+//
+// Hash-consed nodes may be shared between several places in the tree, so
+// the resolver replaces a shared node that needs a binding (an identifier,
+// or an expression containing one) with a private copy before annotating
+// it. Shared literals stay shared. Copies come from ast_alloc, so the AST
+// arena in effect when the tree was built should be set.
+
+typedef struct {
+    Symbol symbol;
+    uint32_t previous;      // Declaration this one shadows, or RESOLVER_NONE
+    uint32_t function;      // Depth of the declaring function, 0 for top level
+    Binding binding;
+    Binding* target;        // The declaring node's binding, NULL for builtins
+    bool pending;           // A hoisted top-level variable whose declaration has not been resolved yet
+} Declaration;
+
+typedef struct FunctionScope {
+    struct FunctionScope* enclosing;
+    FrameInfo* frame;
+    uint32_t depth;
+    uint32_t next_slot;
+    uint32_t max_slots;
+    DynamicArray upvalues;  // Upvalue
+    DynamicArray captures;  // Declaration index of each upvalue, to deduplicate
+} FunctionScope;
+
+typedef struct {
+    Interner* interner;
+    const char* filename;
+    LineMap lines;              // For diagnostics, built on first error
+    U32Map names;               // Symbol -> innermost declaration
+    DynamicArray declarations;  // Declaration, innermost last
+    uint32_t scope_start;       // First declaration of the innermost scope
+    uint32_t scope_depth;       // 0 at top level, where declarations are globals
+    FunctionScope* function;    // Innermost function, the script at top level
+    FunctionScope script;
+    uint32_t global_count;
+    uint32_t script_frame_size; // Slots used by blocks at top level
+    uint32_t error_count;
+} Resolver;
+
+#define RESOLVER_NONE UINT32_MAX
+
+// 'source' is used to print line numbers in diagnostics and may be NULL
+void resolver_init(Resolver* resolver, Interner* interner, const char* source, const char* filename);
+void resolver_free(Resolver* resolver);
+
+// Declares a global that is not in the source, such as a runtime builtin.
+// 'print' is declared by resolver_init. Returns its global ID.
+uint32_t resolver_declare_global(Resolver* resolver, const char* name);
+
+// Returns false if any name could not be resolved; each error is printed
+bool resolve_program(Resolver* resolver, ASTNode* root);
+
+#endif // FERRUM_RESOLVER_H
@@ -1,16 +1,117 @@
 #ifndef FERRUM_RUNTIME_MEMORY_H
 #define FERRUM_RUNTIME_MEMORY_H
 
-#include <stddef.h>
-#include <stdbool.h>
+#include "../common.h"
+#include <stdio.h>
+
+// Memory management
+//
+// Every allocation in the compiler goes through an Allocator: a table of
+// operations plus statistics. There are three backends:
+//   - system: malloc/realloc/free. Each block starts with a small header
+//     naming its allocator, so f_free returns it to the right one.
+//   - arena: wraps an Arena. Individual frees do nothing, and everything
+//     is released at once.
+//   - pool: fixed-size blocks carved from large chunks, recycled through
+//     a free list. Meant for many objects of one size.
+//
+// Each compiler phase has a system allocator of its own. f_malloc and the
+// other f_* functions use the current phase's allocator, so heap use is
+// charged to the phase that caused it, including allocations made by that
+// phase's worker threads. The driver switches phases between passes with
+// memory_set_phase. Arena and pool allocators name the phase they serve,
+// and memory_report lists them next to the phase heaps.
+
+typedef enum {
+    PHASE_DRIVER,       // Everything outside the phases below
+    PHASE_LEXER,
+    PHASE_PARSER,
+    PHASE_SEMANTIC,
+    PHASE_CODEGEN,
+    PHASE_COUNT
+} CompilerPhase;
+
+typedef struct {
+    size_t total_allocated;     // Bytes, over the allocator's lifetime
+    size_t total_freed;
+    size_t current_usage;       // Live bytes
+    size_t peak_usage;
+    size_t allocations;         // Number of allocations
+    size_t frees;
+} MemoryStats;
+
+typedef struct Allocator Allocator;
+
+typedef struct {
+    void* (*alloc)(Allocator* allocator, size_t size);
+    void* (*realloc)(Allocator* allocator, void* ptr, size_t old_size, size_t new_size);
+    void (*free)(Allocator* allocator, void* ptr, size_t size);
+    void (*release)(Allocator* allocator);            // Frees everything at once
+    void (*stats)(Allocator* allocator, MemoryStats* stats);
+} AllocatorOps;
+
+struct Allocator {
+    const AllocatorOps* ops;
+    const char* name;
+    CompilerPhase phase;
+    MemoryStats stats;
+    Allocator* next;            // Registered allocators, for memory_report
+};
+
+void* allocator_alloc(Allocator* allocator, size_t size);
+void* allocator_realloc(Allocator* allocator, void* ptr, size_t old_size, size_t new_size);
+void allocator_free(Allocator* allocator, void* ptr, size_t size);
+MemoryStats allocator_stats(Allocator* allocator);
+
+// Frees everything the allocator holds and unregisters it
+void allocator_release(Allocator* allocator);
+
+// Arena backend. 'arena' can also be used directly (e.g. with
+// ast_set_arena); its counters feed the statistics either way.
+typedef struct {
+    Allocator base;
+    Arena arena;
+} ArenaAllocator;
+
+void arena_allocator_init(ArenaAllocator* allocator, const char* name, CompilerPhase phase, size_t chunk_size);
+
+// Pool backend. Requests larger than 'block_size' are a bug and panic.
+typedef struct PoolChunk PoolChunk;
+
+typedef struct {
+    Allocator base;
+    size_t block_size;
+    size_t blocks_per_chunk;
+    PoolChunk* chunks;
+    void* free_list;
+} PoolAllocator;
+
+void pool_allocator_init(PoolAllocator* allocator, const char* name, CompilerPhase phase,
+                         size_t block_size, size_t blocks_per_chunk);
+
+// Phases
+void memory_set_phase(CompilerPhase phase);
+CompilerPhase memory_get_phase(void);
+Allocator* memory_phase_heap(CompilerPhase phase);
+
+// Totals over all phase heaps
+MemoryStats get_memory_stats(void);
+void reset_memory_stats(void);
+
+// One line per phase heap and per registered allocator
+void memory_report(FILE* out);
 
 // Memory management functions
 void memory_init(void);
 void memory_cleanup(void);
 
+// Called by a thread started with sys_thread_create just before it exits
+void memory_thread_exit(void);
+
 // Memory allocation functions
 void* f_malloc(size_t size);
+void* f_calloc(size_t count, size_t size);
 void* f_realloc(void* ptr, size_t old_size, size_t new_size);
 void f_free(void* ptr);
 
-#endif // FERRUM_RUNTIME_MEMORY_H 
\ No newline at end of file
+#endif // FERRUM_RUNTIME_MEMORY_H
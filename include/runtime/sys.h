@@ -28,6 +28,7 @@ void sys_clear_error(void);
 
 // Time functions
 uint64_t sys_time_ms(void);
+uint64_t sys_nanotime(void);    // Monotonic, for measuring intervals
 void sys_sleep_ms(uint32_t milliseconds);
 
 // Environment variables
@@ -75,4 +76,61 @@ void sys_mutex_unlock(Mutex* mutex);
 const char* sys_platform(void);
 int sys_cpu_count(void);
 
+// Read-only file mapping
+//
+// 'data' always has a '\0' right after the last byte, so it can be handed to
+// the lexer as is. On POSIX the file is mapped over an anonymous (zero-filled)
+// reservation one byte larger than the file: the tail of the last file page
+// is zeroed by the kernel, and a file that ends on a page boundary runs into
+// the reserved zero page. Elsewhere, or when mapping fails (pipes, special
+// files), the file is read into a heap buffer instead.
+typedef struct MappedFile {
+    const char* data;     // File contents followed by '\0'
+    size_t length;        // File size in bytes
+    void* base;           // Start of the mapping or heap buffer
+    size_t mapped;        // Bytes mapped, 0 for a heap buffer
+} MappedFile;
+
+bool sys_map_file(const char* path, MappedFile* file);
+void sys_unmap_file(MappedFile* file);
+
+// Last modification time of 'path' in nanoseconds, only good for telling
+// whether the file changed since an earlier call
+bool sys_file_mtime(const char* path, uint64_t* mtime);
+
+// Buffered output file
+//
+// Writes are copied into a list of fixed-size pages that never move, so the
+// buffer grows one page at a time without copying what it already holds.
+// sys_output_flush hands every buffered page to the OS in order (writev on
+// POSIX) and keeps the pages for reuse; writers that flush whenever
+// 'length' passes a threshold bound their memory use by it. Without an
+// open file the pages just accumulate until one is opened.
+#define SYS_OUTPUT_PAGE_SIZE (64 * 1024)
+
+typedef struct OutputPage {
+    struct OutputPage* next;
+    size_t used;
+    char data[SYS_OUTPUT_PAGE_SIZE];
+} OutputPage;
+
+typedef struct OutputFile {
+    OutputPage* head;     // Buffered pages, in order
+    OutputPage* tail;
+    OutputPage* spare;    // Flushed pages kept for reuse
+    size_t length;        // Bytes buffered
+    size_t written;       // Bytes flushed so far
+    int fd;               // -1 until sys_output_open
+    bool failed;          // A write failed; later output is dropped
+} OutputFile;
+
+void sys_output_init(OutputFile* out);
+bool sys_output_open(OutputFile* out, const char* path);
+void sys_output_write(OutputFile* out, const void* data, size_t size);
+bool sys_output_flush(OutputFile* out);
+
+// Flushes, closes the file and frees the pages; 'out' is left as after
+// sys_output_init. Returns false if any write failed.
+bool sys_output_close(OutputFile* out);
+
 #endif // FERRUM_RUNTIME_SYS_H 
\ No newline at end of file
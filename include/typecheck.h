@@ -0,0 +1,62 @@
+#ifndef FERRUM_TYPECHECK_H
+#define FERRUM_TYPECHECK_H
+
+#include "ast.h"
+#include "resolver.h"
+#include "types.h"
+
+// Type inference
+//
+// typecheck_program infers a type for every expression of a resolved tree
+// and stores it in ASTNode.value_type. Declarations get the type of what
+// they declare: a variable's type, or a function's fn(...) -> ... type.
+// Backends can rely on these being concrete: int and float values are
+// unboxed 64-bit machine values, and only 'any' needs a run-time tag.
+//
+// There are no annotations on variables or parameters, so their types come
+// from how they are used. Every declaration starts as an inference variable
+// and each use unifies it with what the use needs: both operands of an
+// arithmetic or comparison operator have one type, arguments have the
+// parameter types, every 'return' returns the function's return type.
+// Functions are not generic, so a function called with an int and later
+// with a string is an error. When checking is done, a type that is still
+// open is defaulted: int if it must be a number, 'any' otherwise.
+//
+// Variables are looked up through the resolver's bindings, so the tree must
+// have been through resolve_program first. The checker mirrors each frame
+// as an array of slot types; since the walk visits declarations in the
+// same order as the resolver, a slot holds the type of the declaration the
+// resolver bound it to. 'type' declarations name types for channel element
+// types and future annotations; class, interface, trait and enum names are
+// nominal types.
+
+typedef struct TypeScope {
+    struct TypeScope* enclosing;
+    TypeId* slots;              // Frame slot -> type
+    TypeId* upvalues;           // Upvalue -> type, from the enclosing scope
+    TypeId result;              // Return type
+    bool returns_value;         // Some 'return' has a value
+} TypeScope;
+
+typedef struct {
+    TypeTable* types;
+    Interner* interner;
+    const char* filename;
+    LineMap lines;              // For diagnostics, built on first error
+    U32Map named;               // Symbol -> type, for type names
+    DynamicArray globals;       // TypeId per global ID
+    DynamicArray checked;       // ASTNode* whose value_type is resolved at the end
+    TypeScope* scope;           // Innermost function, the script at top level
+    uint32_t error_count;
+} TypeChecker;
+
+// 'source' is used to print line numbers in diagnostics and may be NULL
+void type_checker_init(TypeChecker* checker, TypeTable* types, Interner* interner,
+                       const char* source, const char* filename);
+void type_checker_free(TypeChecker* checker);
+
+// Returns false if the program does not type check; each error is printed.
+// 'resolver' is the one that resolved 'root'.
+bool typecheck_program(TypeChecker* checker, ASTNode* root, const Resolver* resolver);
+
+#endif // FERRUM_TYPECHECK_H
@@ -0,0 +1,101 @@
+#ifndef FERRUM_TYPES_H
+#define FERRUM_TYPES_H
+
+#include "common.h"
+#include "intern.h"
+
+// Type objects
+//
+// A type is a 32-bit TypeId into a TypeTable. Constructed types are
+// interned, so two types are equal exactly when their ids are equal once
+// their inference variables have been resolved. Primitive types have the
+// id of their kind (TYPE_INT is the id of int), so they need no lookup.
+//
+// Inference variables stand for a type that is not known yet. They are
+// joined by union-find: unifying a variable with a type points the
+// variable at it, and type_find follows those links (compressing them) to
+// the representative. A variable may be restricted to some kinds, e.g. the
+// operands of '-' to int or float; type_resolve picks int for a variable
+// that allows it and 'any' for one that is still unconstrained.
+
+typedef uint32_t TypeId;
+
+typedef enum {
+    TYPE_NONE,          // Id 0: not checked
+    TYPE_ERROR,         // Ill-typed; unifies with anything so each error is reported once
+    TYPE_ANY,           // Only known at run time, stored boxed
+    TYPE_NIL,
+    TYPE_BOOL,
+    TYPE_INT,           // 64-bit signed
+    TYPE_FLOAT,         // 64-bit IEEE
+    TYPE_CHAR,
+    TYPE_STRING,
+    TYPE_ARRAY,         // Arguments: element type
+    TYPE_CHAN,          // Arguments: element type
+    TYPE_FUNCTION,      // Arguments: parameter types, then the return type
+    TYPE_NAMED,         // A class, interface, trait or enum, by name
+    TYPE_VAR,           // Inference variable, never interned
+    TYPE_KIND_COUNT
+} TypeKind;
+
+#define TYPE_KIND_BIT(kind) ((uint16_t)(1u << (kind)))
+#define TYPE_NUMERIC (TYPE_KIND_BIT(TYPE_INT) | TYPE_KIND_BIT(TYPE_FLOAT))
+#define TYPE_ORDERED (TYPE_NUMERIC | TYPE_KIND_BIT(TYPE_CHAR) | TYPE_KIND_BIT(TYPE_STRING))
+
+typedef struct {
+    uint8_t kind;           // TypeKind
+    uint16_t allowed;       // Variables: TYPE_KIND_BITs it may become, 0 for any
+    uint32_t arity;         // Number of arguments
+    Symbol name;            // TYPE_NAMED
+    TypeId parent;          // Variables: what it was unified with, itself while unbound
+    const TypeId* args;
+} TypeInfo;
+
+typedef struct {
+    TypeInfo* types;
+    uint32_t count;
+    uint32_t capacity;
+    StringMap interned;     // Encoded constructed type -> id
+    Arena arena;            // Encodings, which double as argument lists
+} TypeTable;
+
+void type_table_init(TypeTable* table);
+void type_table_free(TypeTable* table);
+
+static inline const TypeInfo* type_info(const TypeTable* table, TypeId type) {
+    return &table->types[type];
+}
+
+// Constructed types
+TypeId type_intern(TypeTable* table, TypeKind kind, Symbol name, const TypeId* args, uint32_t arity);
+TypeId type_array(TypeTable* table, TypeId element);
+TypeId type_chan(TypeTable* table, TypeId element);
+TypeId type_named(TypeTable* table, Symbol name);
+
+// 'params' has 'count' entries; the return type is passed separately
+TypeId type_function(TypeTable* table, const TypeId* params, uint32_t count, TypeId result);
+
+// A fresh inference variable; 'allowed' is 0 or a mask of TYPE_KIND_BITs
+TypeId type_var(TypeTable* table, uint16_t allowed);
+
+// Representative of 'type': a bound variable's target, or 'type' itself
+TypeId type_find(TypeTable* table, TypeId type);
+
+// Makes 'a' and 'b' the same type. Returns false, leaving the variables
+// bound so far in place, if they cannot be.
+bool type_unify(TypeTable* table, TypeId a, TypeId b);
+
+// Restricts 'type' to the kinds in 'allowed'. Returns false if it is
+// already something else.
+bool type_constrain(TypeTable* table, TypeId type, uint16_t allowed);
+
+// The interned type 'type' stands for, with every variable replaced by its
+// binding or its default. The defaults are bound, so every later call
+// agrees.
+TypeId type_resolve(TypeTable* table, TypeId type);
+
+// Writes a readable name ("int", "[string]", "fn(int) -> bool") to
+// 'buffer' and returns it
+const char* type_format(TypeTable* table, const Interner* interner, TypeId type, char* buffer, usize size);
+
+#endif // FERRUM_TYPES_H
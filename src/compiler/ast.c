@@ -3,34 +3,262 @@
 #include <stdlib.h>
 #include <string.h>
 
-ASTNode* ast_new_node(NodeType type, uint32_t line, uint32_t column) {
-    ASTNode* node = (ASTNode*)f_malloc(sizeof(ASTNode));
+static FERRUM_THREAD_LOCAL Arena* ast_arena = NULL;
+static FERRUM_THREAD_LOCAL HashConsTable* ast_hash_cons = NULL;
+
+void ast_set_arena(Arena* arena) {
+    ast_arena = arena;
+}
+
+Arena* ast_get_arena(void) {
+    return ast_arena;
+}
+
+void* ast_alloc(usize size) {
+    return ast_arena ? arena_alloc(ast_arena, size) : f_malloc(size);
+}
+
+// Arena memory is released with the arena
+static void ast_release(void* ptr) {
+    if (!ast_arena) f_free(ptr);
+}
+
+FERRUM_SMALL_VEC_IMPL(NodeList, node_list, ASTNode*, ast_alloc, ast_release)
+FERRUM_SMALL_VEC_IMPL(TokenList, token_list, Token, ast_alloc, ast_release)
+FERRUM_SMALL_VEC_IMPL(SelectCaseList, select_case_list, SelectCase*, ast_alloc, ast_release)
+
+ASTNode* ast_new_node(NodeType type, uint32_t offset) {
+    ASTNode* node = (ASTNode*)ast_alloc(sizeof(ASTNode));
+    memset(node, 0, sizeof(ASTNode));
+    node->type = type;
+    node->offset = offset;
+    return node;
+}
+
+void hash_cons_init(HashConsTable* table) {
+    table->capacity = 256;
+    table->count = 0;
+    table->slots = f_calloc(table->capacity, sizeof(ASTNode*));
+}
+
+void hash_cons_free(HashConsTable* table) {
+    f_free(table->slots);
+    memset(table, 0, sizeof(HashConsTable));
+}
+
+void ast_set_hash_cons(HashConsTable* table) {
+    ast_hash_cons = table;
+}
+
+HashConsTable* ast_get_hash_cons(void) {
+    return ast_hash_cons;
+}
+
+bool ast_node_is_shared(const ASTNode* node) {
+    return node && node->hash != 0;
+}
+
+static inline uint64_t hash_mix(uint64_t hash, uint64_t word) {
+    hash ^= word;
+    hash *= 0xff51afd7ed558ccdull;
+    return hash ^ (hash >> 33);
+}
+
+// Operands are hash-consed already, so their hashes stand in for their
+// whole subtrees
+static uint32_t structural_hash(const ASTNode* node) {
+    uint64_t hash = hash_mix(0x9e3779b97f4a7c15ull, (uint64_t)node->type);
+
+    switch (node->type) {
+        case NODE_INT_LITERAL:
+            hash = hash_mix(hash, (uint64_t)node->int_value);
+            break;
+        case NODE_FLOAT_LITERAL: {
+            uint64_t bits;
+            memcpy(&bits, &node->float_value, sizeof(bits));
+            hash = hash_mix(hash, bits);
+            break;
+        }
+        case NODE_STRING_LITERAL:
+            for (const char* c = node->string_value; *c; c++) {
+                hash = hash_mix(hash, (u8)*c);
+            }
+            break;
+        case NODE_BOOL_LITERAL:
+            hash = hash_mix(hash, node->bool_value);
+            break;
+        case NODE_CHAR_LITERAL:
+            hash = hash_mix(hash, (u8)node->char_value);
+            break;
+        case NODE_IDENTIFIER:
+            hash = hash_mix(hash, node->ident.symbol);
+            break;
+        case NODE_UNARY_EXPR:
+            hash = hash_mix(hash, (uint64_t)node->unary_expr.op.type);
+            hash = hash_mix(hash, node->unary_expr.operand->hash);
+            break;
+        case NODE_BINARY_EXPR:
+            hash = hash_mix(hash, (uint64_t)node->binary_expr.op.type);
+            hash = hash_mix(hash, node->binary_expr.left->hash);
+            hash = hash_mix(hash, node->binary_expr.right->hash);
+            break;
+        case NODE_LOGICAL_EXPR:
+            hash = hash_mix(hash, (uint64_t)node->logical_expr.op.type);
+            hash = hash_mix(hash, node->logical_expr.left->hash);
+            hash = hash_mix(hash, node->logical_expr.right->hash);
+            break;
+        default:
+            break;
+    }
+
+    uint32_t folded = (uint32_t)(hash ^ (hash >> 32));
+    return folded != 0 ? folded : 1;    // 0 marks nodes that are not shared
+}
+
+// Operands are compared by pointer, which is structural equality for
+// hash-consed nodes
+static bool structurally_equal(const ASTNode* a, const ASTNode* b) {
+    if (a->type != b->type) return false;
+
+    switch (a->type) {
+        case NODE_INT_LITERAL:
+            return a->int_value == b->int_value;
+        case NODE_FLOAT_LITERAL:
+            return memcmp(&a->float_value, &b->float_value, sizeof(double)) == 0;
+        case NODE_STRING_LITERAL:
+            return strcmp(a->string_value, b->string_value) == 0;
+        case NODE_BOOL_LITERAL:
+            return a->bool_value == b->bool_value;
+        case NODE_CHAR_LITERAL:
+            return a->char_value == b->char_value;
+        case NODE_NIL_LITERAL:
+            return true;
+        case NODE_IDENTIFIER:
+            return a->ident.symbol == b->ident.symbol;
+        case NODE_UNARY_EXPR:
+            return a->unary_expr.op.type == b->unary_expr.op.type &&
+                   a->unary_expr.operand == b->unary_expr.operand;
+        case NODE_BINARY_EXPR:
+            return a->binary_expr.op.type == b->binary_expr.op.type &&
+                   a->binary_expr.left == b->binary_expr.left &&
+                   a->binary_expr.right == b->binary_expr.right;
+        case NODE_LOGICAL_EXPR:
+            return a->logical_expr.op.type == b->logical_expr.op.type &&
+                   a->logical_expr.left == b->logical_expr.left &&
+                   a->logical_expr.right == b->logical_expr.right;
+        default:
+            return false;
+    }
+}
+
+// An operator over an impure operand (a call, an assignment, an error
+// node) is impure itself
+static bool hash_consable(const ASTNode* node) {
+    switch (node->type) {
+        case NODE_STRING_LITERAL:
+            return node->string_value != NULL;
+        case NODE_UNARY_EXPR:
+            return ast_node_is_shared(node->unary_expr.operand);
+        case NODE_BINARY_EXPR:
+            return ast_node_is_shared(node->binary_expr.left) &&
+                   ast_node_is_shared(node->binary_expr.right);
+        case NODE_LOGICAL_EXPR:
+            return ast_node_is_shared(node->logical_expr.left) &&
+                   ast_node_is_shared(node->logical_expr.right);
+        default:
+            return true;
+    }
+}
+
+static void hash_cons_grow(HashConsTable* table) {
+    uint32_t capacity = table->capacity * 2;
+    ASTNode** slots = f_calloc(capacity, sizeof(ASTNode*));
+
+    for (uint32_t i = 0; i < table->capacity; i++) {
+        ASTNode* node = table->slots[i];
+        if (!node) continue;
+        uint32_t slot = node->hash & (capacity - 1);
+        while (slots[slot]) slot = (slot + 1) & (capacity - 1);
+        slots[slot] = node;
+    }
+
+    f_free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+}
+
+// Pure expressions are built in a zeroed local first, so that a repeated
+// one costs a table probe and no allocation
+static void ast_init_pure(ASTNode* node, NodeType type, uint32_t offset) {
     memset(node, 0, sizeof(ASTNode));
     node->type = type;
-    node->line = line;
-    node->column = column;
+    node->offset = offset;
+}
+
+static ASTNode* ast_new_pure(const ASTNode* expr) {
+    HashConsTable* table = ast_hash_cons;
+    ASTNode* node;
+
+    if (!table || !ast_arena || !hash_consable(expr)) {
+        node = (ASTNode*)ast_alloc(sizeof(ASTNode));
+        memcpy(node, expr, sizeof(ASTNode));
+        return node;
+    }
+
+    uint32_t hash = structural_hash(expr);
+    uint32_t mask = table->capacity - 1;
+    uint32_t slot = hash & mask;
+    while ((node = table->slots[slot]) != NULL) {
+        if (node->hash == hash && structurally_equal(node, expr)) return node;
+        slot = (slot + 1) & mask;
+    }
+
+    node = (ASTNode*)ast_alloc(sizeof(ASTNode));
+    memcpy(node, expr, sizeof(ASTNode));
+    node->hash = hash;
+    table->slots[slot] = node;
+    if (++table->count * 2 > table->capacity) hash_cons_grow(table);
     return node;
 }
 
+static void free_nodes(NodeList* list) {
+    for (u32 i = 0; i < list->count; i++) {
+        ast_free_node(SMALL_VEC_AT(list, i));
+    }
+    node_list_free(list);
+}
+
+// Heap mode only (see ast_set_arena). Every node type is listed so that a
+// new one cannot be added without deciding what it owns.
 void ast_free_node(ASTNode* node) {
     if (!node) return;
     
     switch (node->type) {
         case NODE_INT_LITERAL:
         case NODE_FLOAT_LITERAL:
+        case NODE_BOOL_LITERAL:
+        case NODE_CHAR_LITERAL:
+        case NODE_NIL_LITERAL:
+        case NODE_IDENTIFIER:
+        case NODE_IMPORT_DECL:
+        case NODE_BREAK_STMT:
+        case NODE_CONTINUE_STMT:
+        case NODE_TYPE_REF:
+        case NODE_TYPE_FUNC:
+        case NODE_TYPE_ARRAY:
+        case NODE_TYPE_MAP:
+        case NODE_TYPE_TUPLE:
+        case NODE_TYPE_GENERIC:
+        case NODE_TYPE_UNION:
+        case NODE_TYPE_OPTIONAL:
+        case NODE_TYPE_CHAN:
+        case NODE_ERROR:
             break;
             
         case NODE_STRING_LITERAL:
             if (node->string_value) f_free(node->string_value);
             break;
             
-        case NODE_BOOL_LITERAL:
-            break;
-            
-        case NODE_IDENTIFIER:
-            if (node->ident_name) f_free(node->ident_name);
-            break;
-            
         case NODE_BINARY_EXPR:
             ast_free_node(node->binary_expr.left);
             ast_free_node(node->binary_expr.right);
@@ -42,11 +270,52 @@ void ast_free_node(ASTNode* node) {
             
         case NODE_CALL_EXPR:
             ast_free_node(node->call_expr.callee);
-            for (usize i = 0; i < node->call_expr.args.count; i++) {
-                ASTNode* arg = *(ASTNode**)da_get(&node->call_expr.args, i);
-                ast_free_node(arg);
-            }
-            da_free(&node->call_expr.args);
+            free_nodes(&node->call_expr.args);
+            break;
+            
+        case NODE_GET_EXPR:
+            ast_free_node(node->get_expr.object);
+            break;
+            
+        case NODE_SET_EXPR:
+            ast_free_node(node->set_expr.object);
+            ast_free_node(node->set_expr.value);
+            break;
+            
+        case NODE_LOGICAL_EXPR:
+            ast_free_node(node->logical_expr.left);
+            ast_free_node(node->logical_expr.right);
+            break;
+            
+        case NODE_ARRAY_EXPR:
+            free_nodes(&node->array_expr.elements);
+            break;
+            
+        case NODE_INDEX_EXPR:
+            ast_free_node(node->index_expr.array);
+            ast_free_node(node->index_expr.index);
+            break;
+            
+        case NODE_CLOSURE_EXPR:
+            ast_free_node(node->closure_expr.function);
+            token_list_free(&node->closure_expr.captures);
+            break;
+            
+        case NODE_ASYNC_EXPR:
+            ast_free_node(node->async_expr.expression);
+            break;
+            
+        case NODE_AWAIT_EXPR:
+            ast_free_node(node->await_expr.expression);
+            break;
+            
+        case NODE_CHAN_SEND_EXPR:
+            ast_free_node(node->chan_send_expr.channel);
+            ast_free_node(node->chan_send_expr.value);
+            break;
+            
+        case NODE_CHAN_RECV_EXPR:
+            ast_free_node(node->chan_recv_expr.channel);
             break;
             
         case NODE_VAR_DECL:
@@ -54,28 +323,65 @@ void ast_free_node(ASTNode* node) {
             break;
             
         case NODE_FUNCTION_DECL:
-            for (usize i = 0; i < node->func_decl.params.count; i++) {
-                Token* param = (Token*)da_get(&node->func_decl.params, i);
-                // Token'lar için ekstra temizleme gerekmez
-            }
-            da_free(&node->func_decl.params);
+            // Token'lar için ekstra temizleme gerekmez
+            token_list_free(&node->func_decl.params);
+            token_list_free(&node->func_decl.type_params);
+            ast_free_node(node->func_decl.return_type);
             ast_free_node(node->func_decl.body);
+            if (node->func_decl.frame) {
+                f_free(node->func_decl.frame->upvalues);
+                f_free(node->func_decl.frame);
+            }
+            break;
+            
+        case NODE_CLASS_DECL:
+            token_list_free(&node->class_decl.type_params);
+            free_nodes(&node->class_decl.superclasses);
+            free_nodes(&node->class_decl.members);
+            break;
+            
+        case NODE_INTERFACE_DECL:
+            token_list_free(&node->interface_decl.type_params);
+            free_nodes(&node->interface_decl.methods);
+            break;
+            
+        case NODE_TRAIT_DECL:
+            token_list_free(&node->trait_decl.type_params);
+            free_nodes(&node->trait_decl.methods);
+            break;
+            
+        case NODE_IMPL_DECL:
+            ast_free_node(node->impl_decl.type);
+            free_nodes(&node->impl_decl.methods);
+            break;
+            
+        case NODE_TYPE_DECL:
+            token_list_free(&node->type_decl.type_params);
+            ast_free_node(node->type_decl.type);
+            break;
+            
+        case NODE_ENUM_DECL:
+            token_list_free(&node->enum_decl.variants);
+            free_nodes(&node->enum_decl.values);
+            break;
+            
+        case NODE_EXPORT_DECL:
+            ast_free_node(node->export_decl.declaration);
+            break;
+            
+        case NODE_CHAN_DECL:
+            ast_free_node(node->chan_decl.element_type);
+            ast_free_node(node->chan_decl.capacity);
             break;
             
         case NODE_BLOCK_STMT:
-            for (usize i = 0; i < node->block_stmt.statements.count; i++) {
-                ASTNode* stmt = *(ASTNode**)da_get(&node->block_stmt.statements, i);
-                ast_free_node(stmt);
-            }
-            da_free(&node->block_stmt.statements);
+            free_nodes(&node->block_stmt.statements);
             break;
             
         case NODE_IF_STMT:
             ast_free_node(node->if_stmt.condition);
             ast_free_node(node->if_stmt.then_branch);
-            if (node->if_stmt.else_branch) {
-                ast_free_node(node->if_stmt.else_branch);
-            }
+            ast_free_node(node->if_stmt.else_branch);
             break;
             
         case NODE_WHILE_STMT:
@@ -84,107 +390,285 @@ void ast_free_node(ASTNode* node) {
             break;
             
         case NODE_FOR_STMT:
-            if (node->for_stmt.initializer) {
-                ast_free_node(node->for_stmt.initializer);
-            }
-            if (node->for_stmt.condition) {
-                ast_free_node(node->for_stmt.condition);
-            }
-            if (node->for_stmt.increment) {
-                ast_free_node(node->for_stmt.increment);
-            }
+            ast_free_node(node->for_stmt.initializer);
+            ast_free_node(node->for_stmt.condition);
+            ast_free_node(node->for_stmt.increment);
             ast_free_node(node->for_stmt.body);
             break;
             
+        case NODE_FOREACH_STMT:
+            ast_free_node(node->foreach_stmt.iterator);
+            ast_free_node(node->foreach_stmt.body);
+            break;
+            
         case NODE_RETURN_STMT:
-            if (node->return_stmt.value) {
-                ast_free_node(node->return_stmt.value);
-            }
+            ast_free_node(node->return_stmt.value);
             break;
             
         case NODE_EXPR_STMT:
             ast_free_node(node->expr_stmt.expr);
             break;
+            
+        case NODE_TRY_STMT:
+            ast_free_node(node->try_stmt.try_block);
+            free_nodes(&node->try_stmt.catch_blocks);
+            ast_free_node(node->try_stmt.finally_block);
+            break;
+            
+        case NODE_CATCH_CLAUSE:
+            ast_free_node(node->catch_clause.body);
+            break;
+            
+        case NODE_THROW_STMT:
+            ast_free_node(node->throw_stmt.value);
+            break;
+            
+        case NODE_MATCH_STMT:
+            ast_free_node(node->match_stmt.value);
+            free_nodes(&node->match_stmt.cases);
+            ast_free_node(node->match_stmt.default_case);
+            break;
+            
+        case NODE_DEFER_STMT:
+            ast_free_node(node->defer_stmt.statement);
+            break;
+            
+        case NODE_GO_STMT:
+            ast_free_node(node->go_stmt.expression);
+            break;
+            
+        case NODE_SELECT_STMT:
+            // Cases are SelectCase records, not nodes
+            for (u32 i = 0; i < node->select_stmt.cases.count; i++) {
+                SelectCase* select_case = SMALL_VEC_AT(&node->select_stmt.cases, i);
+                ast_free_node(select_case->channel);
+                ast_free_node(select_case->value);
+                ast_free_node(select_case->body);
+                f_free(select_case);
+            }
+            select_case_list_free(&node->select_stmt.cases);
+            ast_free_node(node->select_stmt.default_case);
+            break;
     }
     
     f_free(node);
 }
 
-ASTNode* ast_new_int_literal(int64_t value, uint32_t line, uint32_t column) {
-    ASTNode* node = ast_new_node(NODE_INT_LITERAL, line, column);
-    node->int_value = value;
+ASTNode* ast_new_int_literal(int64_t value, uint32_t offset) {
+    ASTNode node;
+    ast_init_pure(&node, NODE_INT_LITERAL, offset);
+    node.int_value = value;
+    return ast_new_pure(&node);
+}
+
+ASTNode* ast_new_float_literal(double value, uint32_t offset) {
+    ASTNode node;
+    ast_init_pure(&node, NODE_FLOAT_LITERAL, offset);
+    node.float_value = value;
+    return ast_new_pure(&node);
+}
+
+ASTNode* ast_new_string_literal(char* value, uint32_t offset) {
+    ASTNode node;
+    ast_init_pure(&node, NODE_STRING_LITERAL, offset);
+    node.string_value = value;
+    return ast_new_pure(&node);
+}
+
+ASTNode* ast_new_bool_literal(bool value, uint32_t offset) {
+    ASTNode node;
+    ast_init_pure(&node, NODE_BOOL_LITERAL, offset);
+    node.bool_value = value;
+    return ast_new_pure(&node);
+}
+
+ASTNode* ast_new_char_literal(char value, uint32_t offset) {
+    ASTNode node;
+    ast_init_pure(&node, NODE_CHAR_LITERAL, offset);
+    node.char_value = value;
+    return ast_new_pure(&node);
+}
+
+ASTNode* ast_new_nil_literal(uint32_t offset) {
+    ASTNode node;
+    ast_init_pure(&node, NODE_NIL_LITERAL, offset);
+    return ast_new_pure(&node);
+}
+
+ASTNode* ast_new_identifier(Symbol name, uint32_t offset) {
+    ASTNode node;
+    ast_init_pure(&node, NODE_IDENTIFIER, offset);
+    node.ident.symbol = name;
+    return ast_new_pure(&node);
+}
+
+ASTNode* ast_new_binary_expr(Token op, ASTNode* left, ASTNode* right) {
+    ASTNode node;
+    ast_init_pure(&node, NODE_BINARY_EXPR, op.offset);
+    node.binary_expr.op = op;
+    node.binary_expr.left = left;
+    node.binary_expr.right = right;
+    return ast_new_pure(&node);
+}
+
+ASTNode* ast_new_logical_expr(Token op, ASTNode* left, ASTNode* right) {
+    ASTNode node;
+    ast_init_pure(&node, NODE_LOGICAL_EXPR, op.offset);
+    node.logical_expr.op = op;
+    node.logical_expr.left = left;
+    node.logical_expr.right = right;
+    return ast_new_pure(&node);
+}
+
+ASTNode* ast_new_unary_expr(Token op, ASTNode* operand) {
+    ASTNode node;
+    ast_init_pure(&node, NODE_UNARY_EXPR, op.offset);
+    node.unary_expr.op = op;
+    node.unary_expr.operand = operand;
+    return ast_new_pure(&node);
+}
+
+ASTNode* ast_new_call_expr(ASTNode* callee, NodeList args) {
+    ASTNode* node = ast_new_node(NODE_CALL_EXPR, callee->offset);
+    node->call_expr.callee = callee;
+    node->call_expr.args = args;
     return node;
 }
 
-ASTNode* ast_new_float_literal(double value, uint32_t line, uint32_t column) {
-    ASTNode* node = ast_new_node(NODE_FLOAT_LITERAL, line, column);
-    node->float_value = value;
+ASTNode* ast_new_get_expr(ASTNode* object, Token name) {
+    ASTNode* node = ast_new_node(NODE_GET_EXPR, object->offset);
+    node->get_expr.object = object;
+    node->get_expr.name = name;
     return node;
 }
 
-ASTNode* ast_new_string_literal(char* value, uint32_t line, uint32_t column) {
-    ASTNode* node = ast_new_node(NODE_STRING_LITERAL, line, column);
-    node->string_value = value;
+ASTNode* ast_new_set_expr(ASTNode* object, Token name, ASTNode* value) {
+    ASTNode* node = ast_new_node(NODE_SET_EXPR, object->offset);
+    node->set_expr.object = object;
+    node->set_expr.name = name;
+    node->set_expr.value = value;
     return node;
 }
 
-ASTNode* ast_new_bool_literal(bool value, uint32_t line, uint32_t column) {
-    ASTNode* node = ast_new_node(NODE_BOOL_LITERAL, line, column);
-    node->bool_value = value;
+ASTNode* ast_new_array_expr(NodeList elements) {
+    ASTNode* node = ast_new_node(NODE_ARRAY_EXPR,
+        elements.count > 0 ? SMALL_VEC_AT(&elements, 0)->offset : 0);
+    node->array_expr.elements = elements;
     return node;
 }
 
-ASTNode* ast_new_identifier(char* name, uint32_t line, uint32_t column) {
-    ASTNode* node = ast_new_node(NODE_IDENTIFIER, line, column);
-    node->ident_name = name;
+ASTNode* ast_new_index_expr(ASTNode* array, ASTNode* index) {
+    ASTNode* node = ast_new_node(NODE_INDEX_EXPR, array->offset);
+    node->index_expr.array = array;
+    node->index_expr.index = index;
     return node;
 }
 
-ASTNode* ast_new_binary_expr(Token op, ASTNode* left, ASTNode* right) {
-    ASTNode* node = ast_new_node(NODE_BINARY_EXPR, op.line, op.col);
-    node->binary_expr.op = op;
-    node->binary_expr.left = left;
-    node->binary_expr.right = right;
+ASTNode* ast_new_closure_expr(ASTNode* function, TokenList captures) {
+    ASTNode* node = ast_new_node(NODE_CLOSURE_EXPR, function->offset);
+    node->closure_expr.function = function;
+    node->closure_expr.captures = captures;
     return node;
 }
 
-ASTNode* ast_new_unary_expr(Token op, ASTNode* operand) {
-    ASTNode* node = ast_new_node(NODE_UNARY_EXPR, op.line, op.col);
-    node->unary_expr.op = op;
-    node->unary_expr.operand = operand;
+ASTNode* ast_new_async_expr(ASTNode* expression) {
+    ASTNode* node = ast_new_node(NODE_ASYNC_EXPR, expression->offset);
+    node->async_expr.expression = expression;
     return node;
 }
 
-ASTNode* ast_new_call_expr(ASTNode* callee, DynamicArray args) {
-    ASTNode* node = ast_new_node(NODE_CALL_EXPR, callee->line, callee->column);
-    node->call_expr.callee = callee;
-    node->call_expr.args = args;
+ASTNode* ast_new_await_expr(ASTNode* expression) {
+    ASTNode* node = ast_new_node(NODE_AWAIT_EXPR, expression->offset);
+    node->await_expr.expression = expression;
     return node;
 }
 
 ASTNode* ast_new_var_decl(Token name, ASTNode* value) {
-    ASTNode* node = ast_new_node(NODE_VAR_DECL, name.line, name.col);
+    ASTNode* node = ast_new_node(NODE_VAR_DECL, name.offset);
     node->var_decl.name = name;
     node->var_decl.value = value;
     return node;
 }
 
-ASTNode* ast_new_function_decl(Token name, DynamicArray params, ASTNode* body) {
-    ASTNode* node = ast_new_node(NODE_FUNCTION_DECL, name.line, name.col);
+ASTNode* ast_new_function_decl(Token name, TokenList params, ASTNode* body) {
+    ASTNode* node = ast_new_node(NODE_FUNCTION_DECL, name.offset);
     node->func_decl.name = name;
     node->func_decl.params = params;
     node->func_decl.body = body;
     return node;
 }
 
-ASTNode* ast_new_block_stmt(DynamicArray statements) {
-    ASTNode* node = ast_new_node(NODE_BLOCK_STMT, 0, 0);
+ASTNode* ast_new_class_decl(Token name, TokenList type_params, NodeList superclasses, NodeList members) {
+    ASTNode* node = ast_new_node(NODE_CLASS_DECL, name.offset);
+    node->class_decl.name = name;
+    node->class_decl.type_params = type_params;
+    node->class_decl.superclasses = superclasses;
+    node->class_decl.members = members;
+    return node;
+}
+
+ASTNode* ast_new_interface_decl(Token name, TokenList type_params, NodeList methods) {
+    ASTNode* node = ast_new_node(NODE_INTERFACE_DECL, name.offset);
+    node->interface_decl.name = name;
+    node->interface_decl.type_params = type_params;
+    node->interface_decl.methods = methods;
+    return node;
+}
+
+ASTNode* ast_new_trait_decl(Token name, TokenList type_params, NodeList methods) {
+    ASTNode* node = ast_new_node(NODE_TRAIT_DECL, name.offset);
+    node->trait_decl.name = name;
+    node->trait_decl.type_params = type_params;
+    node->trait_decl.methods = methods;
+    return node;
+}
+
+ASTNode* ast_new_impl_decl(ASTNode* type, Token trait, NodeList methods) {
+    ASTNode* node = ast_new_node(NODE_IMPL_DECL, type ? type->offset : trait.offset);
+    node->impl_decl.type = type;
+    node->impl_decl.trait = trait;
+    node->impl_decl.methods = methods;
+    return node;
+}
+
+ASTNode* ast_new_type_decl(Token name, TokenList type_params, ASTNode* type) {
+    ASTNode* node = ast_new_node(NODE_TYPE_DECL, name.offset);
+    node->type_decl.name = name;
+    node->type_decl.type_params = type_params;
+    node->type_decl.type = type;
+    return node;
+}
+
+ASTNode* ast_new_enum_decl(Token name, TokenList variants, NodeList values) {
+    ASTNode* node = ast_new_node(NODE_ENUM_DECL, name.offset);
+    node->enum_decl.name = name;
+    node->enum_decl.variants = variants;
+    node->enum_decl.values = values;
+    return node;
+}
+
+ASTNode* ast_new_import_decl(Token path, Token alias, bool is_all) {
+    ASTNode* node = ast_new_node(NODE_IMPORT_DECL, path.offset);
+    node->import_decl.path = path;
+    node->import_decl.alias = alias;
+    node->import_decl.is_all = is_all;
+    return node;
+}
+
+ASTNode* ast_new_export_decl(ASTNode* declaration) {
+    ASTNode* node = ast_new_node(NODE_EXPORT_DECL, declaration->offset);
+    node->export_decl.declaration = declaration;
+    return node;
+}
+
+ASTNode* ast_new_block_stmt(NodeList statements) {
+    ASTNode* node = ast_new_node(NODE_BLOCK_STMT, 0);
     node->block_stmt.statements = statements;
     return node;
 }
 
 ASTNode* ast_new_if_stmt(ASTNode* condition, ASTNode* then_branch, ASTNode* else_branch) {
-    ASTNode* node = ast_new_node(NODE_IF_STMT, condition->line, condition->column);
+    ASTNode* node = ast_new_node(NODE_IF_STMT, condition->offset);
     node->if_stmt.condition = condition;
     node->if_stmt.then_branch = then_branch;
     node->if_stmt.else_branch = else_branch;
@@ -192,7 +676,7 @@ ASTNode* ast_new_if_stmt(ASTNode* condition, ASTNode* then_branch, ASTNode* else
 }
 
 ASTNode* ast_new_while_stmt(ASTNode* condition, ASTNode* body) {
-    ASTNode* node = ast_new_node(NODE_WHILE_STMT, condition->line, condition->column);
+    ASTNode* node = ast_new_node(NODE_WHILE_STMT, condition->offset);
     node->while_stmt.condition = condition;
     node->while_stmt.body = body;
     return node;
@@ -200,8 +684,7 @@ ASTNode* ast_new_while_stmt(ASTNode* condition, ASTNode* body) {
 
 ASTNode* ast_new_for_stmt(ASTNode* initializer, ASTNode* condition, ASTNode* increment, ASTNode* body) {
     ASTNode* node = ast_new_node(NODE_FOR_STMT, 
-        initializer ? initializer->line : (condition ? condition->line : increment ? increment->line : 0),
-        initializer ? initializer->column : (condition ? condition->column : increment ? increment->column : 0));
+        initializer ? initializer->offset : (condition ? condition->offset : increment ? increment->offset : 0));
     node->for_stmt.initializer = initializer;
     node->for_stmt.condition = condition;
     node->for_stmt.increment = increment;
@@ -210,32 +693,84 @@ ASTNode* ast_new_for_stmt(ASTNode* initializer, ASTNode* condition, ASTNode* inc
 }
 
 ASTNode* ast_new_return_stmt(ASTNode* value) {
-    ASTNode* node = ast_new_node(NODE_RETURN_STMT, value ? value->line : 0, value ? value->column : 0);
+    ASTNode* node = ast_new_node(NODE_RETURN_STMT, value ? value->offset : 0);
     node->return_stmt.value = value;
     return node;
 }
 
 ASTNode* ast_new_expr_stmt(ASTNode* expr) {
-    ASTNode* node = ast_new_node(NODE_EXPR_STMT, expr->line, expr->column);
+    ASTNode* node = ast_new_node(NODE_EXPR_STMT, expr->offset);
     node->expr_stmt.expr = expr;
     return node;
 }
 
+ASTNode* ast_new_foreach_stmt(ASTNode* iterator, Token var, ASTNode* body) {
+    ASTNode* node = ast_new_node(NODE_FOREACH_STMT, var.offset);
+    node->foreach_stmt.iterator = iterator;
+    node->foreach_stmt.var = var;
+    node->foreach_stmt.body = body;
+    return node;
+}
+
+ASTNode* ast_new_break_stmt(uint32_t offset) {
+    return ast_new_node(NODE_BREAK_STMT, offset);
+}
+
+ASTNode* ast_new_continue_stmt(uint32_t offset) {
+    return ast_new_node(NODE_CONTINUE_STMT, offset);
+}
+
+ASTNode* ast_new_try_stmt(ASTNode* try_block, NodeList catch_blocks, ASTNode* finally_block) {
+    ASTNode* node = ast_new_node(NODE_TRY_STMT, 0); // Offset will be set by parser
+    node->try_stmt.try_block = try_block;
+    node->try_stmt.catch_blocks = catch_blocks;
+    node->try_stmt.finally_block = finally_block;
+    return node;
+}
+
+ASTNode* ast_new_catch_clause(Token error_type, Token var, ASTNode* body) {
+    ASTNode* node = ast_new_node(NODE_CATCH_CLAUSE, error_type.offset);
+    node->catch_clause.error_type = error_type;
+    node->catch_clause.var = var;
+    node->catch_clause.body = body;
+    return node;
+}
+
+ASTNode* ast_new_throw_stmt(ASTNode* value) {
+    ASTNode* node = ast_new_node(NODE_THROW_STMT, value ? value->offset : 0);
+    node->throw_stmt.value = value;
+    return node;
+}
+
+ASTNode* ast_new_match_stmt(ASTNode* value, NodeList cases, ASTNode* default_case) {
+    ASTNode* node = ast_new_node(NODE_MATCH_STMT, value->offset);
+    node->match_stmt.value = value;
+    node->match_stmt.cases = cases;
+    node->match_stmt.default_case = default_case;
+    return node;
+}
+
+ASTNode* ast_new_defer_stmt(ASTNode* statement) {
+    ASTNode* node = ast_new_node(NODE_DEFER_STMT, statement->offset);
+    node->defer_stmt.statement = statement;
+    return node;
+}
+
 ASTNode* ast_new_chan_send_expr(ASTNode* channel, ASTNode* value) {
-    ASTNode* node = ast_new_node(NODE_CHAN_SEND_EXPR, channel->line, channel->column);
+    ASTNode* node = ast_new_node(NODE_CHAN_SEND_EXPR, channel->offset);
     node->chan_send_expr.channel = channel;
     node->chan_send_expr.value = value;
     return node;
 }
 
 ASTNode* ast_new_chan_recv_expr(ASTNode* channel) {
-    ASTNode* node = ast_new_node(NODE_CHAN_RECV_EXPR, channel->line, channel->column);
+    ASTNode* node = ast_new_node(NODE_CHAN_RECV_EXPR, channel->offset);
     node->chan_recv_expr.channel = channel;
     return node;
 }
 
 ASTNode* ast_new_chan_decl(Token name, ASTNode* element_type, ASTNode* capacity) {
-    ASTNode* node = ast_new_node(NODE_CHAN_DECL, name.line, name.col);
+    ASTNode* node = ast_new_node(NODE_CHAN_DECL, name.offset);
     node->chan_decl.name = name;
     node->chan_decl.element_type = element_type;
     node->chan_decl.capacity = capacity;
@@ -243,13 +778,13 @@ ASTNode* ast_new_chan_decl(Token name, ASTNode* element_type, ASTNode* capacity)
 }
 
 ASTNode* ast_new_go_stmt(ASTNode* expression) {
-    ASTNode* node = ast_new_node(NODE_GO_STMT, expression->line, expression->column);
+    ASTNode* node = ast_new_node(NODE_GO_STMT, expression->offset);
     node->go_stmt.expression = expression;
     return node;
 }
 
-ASTNode* ast_new_select_case(ASTNode* channel, ASTNode* value, bool is_send, ASTNode* body) {
-    SelectCase* case_node = malloc(sizeof(SelectCase));
+SelectCase* ast_new_select_case(ASTNode* channel, ASTNode* value, bool is_send, ASTNode* body) {
+    SelectCase* case_node = ast_alloc(sizeof(SelectCase));
     case_node->channel = channel;
     case_node->value = value;
     case_node->is_send = is_send;
@@ -257,8 +792,8 @@ ASTNode* ast_new_select_case(ASTNode* channel, ASTNode* value, bool is_send, AST
     return case_node;
 }
 
-ASTNode* ast_new_select_stmt(DynamicArray cases, ASTNode* default_case) {
-    ASTNode* node = ast_new_node(NODE_SELECT_STMT, 0, 0); // Line and column will be set by parser
+ASTNode* ast_new_select_stmt(SelectCaseList cases, ASTNode* default_case) {
+    ASTNode* node = ast_new_node(NODE_SELECT_STMT, 0); // Offset will be set by parser
     node->select_stmt.cases = cases;
     node->select_stmt.default_case = default_case;
     return node;
@@ -0,0 +1,212 @@
+#include "../../include/ast_cache.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#define AST_CACHE_BYTE_ORDER 0x01020304u
+
+// Changes whenever the layout of a cached table would change
+#define AST_CACHE_SCHEMA ((uint32_t)sizeof(FlatNode) | (uint32_t)sizeof(FlatToken) << 8 | \
+                          (uint32_t)NODE_ERROR << 16 | (uint32_t)TOKEN_COUNT << 24)
+
+typedef struct {
+    char magic[4];              // "FAST"
+    uint32_t byte_order;
+    uint32_t version;
+    uint32_t schema;
+    uint64_t source_key;
+    uint64_t source_length;
+    uint64_t file_size;
+    uint64_t checksum;          // Of everything after the header
+    uint32_t root;
+    uint32_t node_count;
+    uint32_t extra_count;
+    uint32_t token_count;
+    uint32_t string_size;
+    uint32_t symbol_count;
+    uint32_t name_size;
+    uint32_t reserved;
+    uint64_t nodes;             // Section offsets from the start of the file
+    uint64_t extra;
+    uint64_t tokens;
+    uint64_t strings;
+    uint64_t symbols;
+    uint64_t names;
+} AstCacheHeader;
+
+uint64_t ast_cache_key(const char* source, usize length) {
+    return hash_bytes(source, length, AST_CACHE_VERSION);
+}
+
+static void cache_path(char* path, usize size, const char* dir, uint64_t key) {
+    snprintf(path, size, "%s/%016llx.fast", dir, (unsigned long long)key);
+}
+
+static usize align8(usize offset) {
+    return (offset + 7) & ~(usize)7;
+}
+
+// Appends one section, padded to 8 bytes
+static uint64_t write_section(ByteBuffer* out, const void* data, usize size) {
+    static const u8 zeros[8] = {0};
+    uint64_t offset = out->length;
+    byte_buffer_append(out, data, size);
+    byte_buffer_append(out, zeros, align8(out->length) - out->length);
+    return offset;
+}
+
+bool ast_cache_store(const char* dir, uint64_t key, usize source_length,
+                     const FlatAST* ast, const Interner* interner) {
+    AstCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "FAST", 4);
+    header.byte_order = AST_CACHE_BYTE_ORDER;
+    header.version = AST_CACHE_VERSION;
+    header.schema = AST_CACHE_SCHEMA;
+    header.source_key = key;
+    header.source_length = source_length;
+    header.root = ast->root;
+    header.node_count = ast->node_count;
+    header.extra_count = ast->extra_count;
+    header.token_count = ast->token_count;
+    header.string_size = ast->string_size;
+    header.symbol_count = interner->count - 1;
+
+    ByteBuffer out = byte_buffer_new(sizeof(header) + (usize)ast->node_count * sizeof(FlatNode) * 2);
+    byte_buffer_append(&out, &header, sizeof(header));
+    header.nodes = write_section(&out, ast->nodes, (usize)ast->node_count * sizeof(FlatNode));
+    header.extra = write_section(&out, ast->extra, (usize)ast->extra_count * sizeof(uint32_t));
+    header.tokens = write_section(&out, ast->tokens, (usize)ast->token_count * sizeof(FlatToken));
+    header.strings = write_section(&out, ast->strings, ast->string_size);
+
+    // Symbol table, then the names it points to
+    header.symbols = out.length;
+    uint32_t name_offset = 0;
+    for (Symbol symbol = 1; symbol < interner->count; symbol++) {
+        uint32_t entry[2] = {name_offset, symbol_length(interner, symbol)};
+        byte_buffer_append(&out, entry, sizeof(entry));
+        name_offset += entry[1] + 1;
+    }
+    header.names = out.length;
+    for (Symbol symbol = 1; symbol < interner->count; symbol++) {
+        byte_buffer_append(&out, symbol_text(interner, symbol), symbol_length(interner, symbol));
+        byte_buffer_append_byte(&out, 0);
+    }
+    header.name_size = name_offset;
+    write_section(&out, NULL, 0);
+
+    header.file_size = out.length;
+    header.checksum = hash_bytes(out.data + sizeof(header), out.length - sizeof(header), 0);
+    memcpy(out.data, &header, sizeof(header));
+
+    // Write under a private name and rename, so readers never see a partial file
+    char path[1024];
+    char temp[1100];
+    cache_path(path, sizeof(path), dir, key);
+    snprintf(temp, sizeof(temp), "%s.%d.tmp", path, (int)getpid());
+
+    bool ok = false;
+    FILE* file = fopen(temp, "wb");
+    if (file) {
+        ok = fwrite(out.data, 1, out.length, file) == out.length;
+        ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+        if (ok) remove(path);
+#endif
+        ok = ok && rename(temp, path) == 0;
+        if (!ok) remove(temp);
+    }
+
+    byte_buffer_free(&out);
+    return ok;
+}
+
+static bool section_fits(uint64_t offset, uint64_t count, uint64_t item_size, uint64_t file_size) {
+    if (offset % 8 != 0 || offset < sizeof(AstCacheHeader) || offset > file_size) return false;
+    return count <= (file_size - offset) / item_size;
+}
+
+static bool header_valid(const AstCacheHeader* header, usize file_size, uint64_t key, usize source_length) {
+    if (memcmp(header->magic, "FAST", 4) != 0) return false;
+    if (header->byte_order != AST_CACHE_BYTE_ORDER) return false;
+    if (header->version != AST_CACHE_VERSION || header->schema != AST_CACHE_SCHEMA) return false;
+    if (header->source_key != key || header->source_length != source_length) return false;
+    if (header->file_size != file_size) return false;
+
+    return header->node_count > 0 && header->root < header->node_count &&
+           section_fits(header->nodes, header->node_count, sizeof(FlatNode), file_size) &&
+           section_fits(header->extra, header->extra_count, sizeof(uint32_t), file_size) &&
+           section_fits(header->tokens, header->token_count, sizeof(FlatToken), file_size) &&
+           section_fits(header->strings, header->string_size, 1, file_size) &&
+           section_fits(header->symbols, header->symbol_count, 2 * sizeof(uint32_t), file_size) &&
+           section_fits(header->names, header->name_size, 1, file_size);
+}
+
+bool ast_cache_load(AstCache* cache, const char* dir, uint64_t key,
+                    const char* source, usize source_length) {
+    memset(cache, 0, sizeof(AstCache));
+
+    char path[1024];
+    cache_path(path, sizeof(path), dir, key);
+    if (!sys_map_file(path, &cache->file)) return false;
+
+    const char* data = cache->file.data;
+    usize size = cache->file.length;
+    AstCacheHeader header;
+    if (size < sizeof(header)) {
+        ast_cache_close(cache);
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (!header_valid(&header, size, key, source_length) ||
+        hash_bytes(data + sizeof(header), size - sizeof(header), 0) != header.checksum) {
+        ast_cache_close(cache);
+        return false;
+    }
+
+    // The tables are used in place; capacities stay 0 since nothing may grow
+    FlatAST* ast = &cache->ast;
+    ast->source = source;
+    ast->nodes = (FlatNode*)(data + header.nodes);
+    ast->node_count = header.node_count;
+    ast->extra = (uint32_t*)(data + header.extra);
+    ast->extra_count = header.extra_count;
+    ast->tokens = (FlatToken*)(data + header.tokens);
+    ast->token_count = header.token_count;
+    ast->strings = (char*)(data + header.strings);
+    ast->string_size = header.string_size;
+    ast->root = header.root;
+
+    cache->symbols = (const uint32_t*)(data + header.symbols);
+    cache->names = data + header.names;
+    cache->symbol_count = header.symbol_count;
+    cache->name_size = header.name_size;
+    return true;
+}
+
+bool ast_cache_intern(const AstCache* cache, Interner* interner) {
+    if (interner->count != 1) return false;
+
+    for (uint32_t i = 0; i < cache->symbol_count; i++) {
+        uint32_t offset = cache->symbols[i * 2];
+        uint32_t length = cache->symbols[i * 2 + 1];
+        if (offset > cache->name_size || length > cache->name_size - offset) return false;
+
+        Symbol symbol = intern(interner, cache->names + offset, length);
+        if (symbol != i + 1) return false;
+    }
+    return true;
+}
+
+void ast_cache_close(AstCache* cache) {
+    if (!cache) return;
+    sys_unmap_file(&cache->file);
+    memset(cache, 0, sizeof(AstCache));
+}
@@ -0,0 +1,944 @@
+#include "../../include/ast_flat.h"
+#include <string.h>
+
+// Conversion state. Child indices of a list are collected on the scratch
+// stack while the children themselves are converted (which may push and pop
+// entries of their own), then copied to 'extra' in one piece.
+typedef struct {
+    FlatAST* ast;
+    uint32_t* scratch;
+    uint32_t scratch_count;
+    uint32_t scratch_capacity;
+} FlatBuilder;
+
+static void* grow(void* items, uint32_t* capacity, uint32_t needed, usize item_size) {
+    if (needed <= *capacity) return items;
+
+    uint32_t old = *capacity;
+    uint32_t fresh = old == 0 ? 256 : old;
+    while (fresh < needed) fresh *= 2;
+    items = f_realloc(items, old * item_size, fresh * item_size);
+    *capacity = fresh;
+    return items;
+}
+
+void flat_ast_init(FlatAST* ast, const char* source) {
+    memset(ast, 0, sizeof(FlatAST));
+    ast->source = source;
+
+    // Slot 0 of every table is the null entry
+    ast->nodes = grow(ast->nodes, &ast->node_capacity, 1, sizeof(FlatNode));
+    memset(&ast->nodes[0], 0, sizeof(FlatNode));
+    ast->nodes[0].type = NODE_ERROR;
+    ast->node_count = 1;
+
+    ast->extra = grow(ast->extra, &ast->extra_capacity, 1, sizeof(uint32_t));
+    ast->extra[0] = 0;
+    ast->extra_count = 1;
+
+    ast->tokens = grow(ast->tokens, &ast->token_capacity, 1, sizeof(FlatToken));
+    memset(&ast->tokens[0], 0, sizeof(FlatToken));
+    ast->token_count = 1;
+
+    ast->strings = grow(ast->strings, &ast->string_capacity, 1, sizeof(char));
+    ast->strings[0] = '\0';
+    ast->string_size = 1;
+}
+
+void flat_ast_free(FlatAST* ast) {
+    if (!ast) return;
+    f_free(ast->nodes);
+    f_free(ast->extra);
+    f_free(ast->tokens);
+    f_free(ast->strings);
+    memset(ast, 0, sizeof(FlatAST));
+}
+
+static FlatIndex push_node(FlatAST* ast, const ASTNode* node) {
+    ast->nodes = grow(ast->nodes, &ast->node_capacity, ast->node_count + 1, sizeof(FlatNode));
+    FlatNode* flat = &ast->nodes[ast->node_count];
+    memset(flat, 0, sizeof(FlatNode));
+    flat->type = (uint8_t)node->type;
+    flat->offset = node->offset;
+    return ast->node_count++;
+}
+
+static uint32_t push_extra(FlatAST* ast, uint32_t value) {
+    ast->extra = grow(ast->extra, &ast->extra_capacity, ast->extra_count + 1, sizeof(uint32_t));
+    ast->extra[ast->extra_count] = value;
+    return ast->extra_count++;
+}
+
+// Absent tokens (never filled in by the parser) map to FLAT_NONE
+static uint32_t push_token(FlatAST* ast, Token token) {
+    if (!token.start) return FLAT_NONE;
+
+    ast->tokens = grow(ast->tokens, &ast->token_capacity, ast->token_count + 1, sizeof(FlatToken));
+    FlatToken* flat = &ast->tokens[ast->token_count];
+    flat->type = (uint32_t)token.type;
+    flat->offset = token.offset;
+    flat->length = (uint32_t)token.length;
+    return ast->token_count++;
+}
+
+static uint32_t push_string(FlatAST* ast, const char* text, uint32_t length) {
+    uint32_t offset = ast->string_size;
+    ast->strings = grow(ast->strings, &ast->string_capacity, ast->string_size + length + 1, sizeof(char));
+    memcpy(ast->strings + offset, text, length);
+    ast->strings[offset + length] = '\0';
+    ast->string_size += length + 1;
+    return offset;
+}
+
+static void push_scratch(FlatBuilder* builder, uint32_t value) {
+    builder->scratch = grow(builder->scratch, &builder->scratch_capacity,
+                            builder->scratch_count + 1, sizeof(uint32_t));
+    builder->scratch[builder->scratch_count++] = value;
+}
+
+// Copies scratch[begin, end) to 'extra' as a length-prefixed list
+static void emit_list(FlatBuilder* builder, uint32_t begin, uint32_t end) {
+    FlatAST* ast = builder->ast;
+    push_extra(ast, end - begin);
+    for (uint32_t i = begin; i < end; i++) {
+        push_extra(ast, builder->scratch[i]);
+    }
+}
+
+static FlatIndex convert(FlatBuilder* builder, const ASTNode* node);
+
+static void collect_nodes(FlatBuilder* builder, const NodeList* list) {
+    for (u32 i = 0; i < list->count; i++) {
+        FlatIndex child = convert(builder, SMALL_VEC_AT(list, i));
+        push_scratch(builder, child);
+    }
+}
+
+static void collect_tokens(FlatBuilder* builder, const TokenList* list) {
+    for (u32 i = 0; i < list->count; i++) {
+        push_scratch(builder, push_token(builder->ast, SMALL_VEC_AT(list, i)));
+    }
+}
+
+static FlatIndex convert(FlatBuilder* builder, const ASTNode* node) {
+    if (!node) return FLAT_NONE;
+
+    FlatAST* ast = builder->ast;
+    FlatIndex index = push_node(ast, node);
+    uint32_t mark = builder->scratch_count;
+    uint32_t a = 0, b = 0;
+    uint16_t op = 0;
+    uint8_t flags = 0;
+
+    switch (node->type) {
+        case NODE_BINARY_EXPR:
+            op = (uint16_t)node->binary_expr.op.type;
+            flags = (uint8_t)node->binary_expr.op.length;
+            a = convert(builder, node->binary_expr.left);
+            b = convert(builder, node->binary_expr.right);
+            break;
+
+        case NODE_LOGICAL_EXPR:
+            op = (uint16_t)node->logical_expr.op.type;
+            flags = (uint8_t)node->logical_expr.op.length;
+            a = convert(builder, node->logical_expr.left);
+            b = convert(builder, node->logical_expr.right);
+            break;
+
+        case NODE_UNARY_EXPR:
+            op = (uint16_t)node->unary_expr.op.type;
+            flags = (uint8_t)node->unary_expr.op.length;
+            a = convert(builder, node->unary_expr.operand);
+            break;
+
+        case NODE_CALL_EXPR:
+            a = convert(builder, node->call_expr.callee);
+            collect_nodes(builder, &node->call_expr.args);
+            b = ast->extra_count;
+            emit_list(builder, mark, builder->scratch_count);
+            break;
+
+        case NODE_GET_EXPR:
+            a = convert(builder, node->get_expr.object);
+            b = push_token(ast, node->get_expr.name);
+            break;
+
+        case NODE_SET_EXPR: {
+            a = convert(builder, node->set_expr.object);
+            uint32_t name = push_token(ast, node->set_expr.name);
+            FlatIndex value = convert(builder, node->set_expr.value);
+            b = push_extra(ast, name);
+            push_extra(ast, value);
+            break;
+        }
+
+        case NODE_ARRAY_EXPR:
+            collect_nodes(builder, &node->array_expr.elements);
+            b = ast->extra_count;
+            emit_list(builder, mark, builder->scratch_count);
+            break;
+
+        case NODE_INDEX_EXPR:
+            a = convert(builder, node->index_expr.array);
+            b = convert(builder, node->index_expr.index);
+            break;
+
+        case NODE_CLOSURE_EXPR:
+            a = convert(builder, node->closure_expr.function);
+            collect_tokens(builder, &node->closure_expr.captures);
+            b = ast->extra_count;
+            emit_list(builder, mark, builder->scratch_count);
+            break;
+
+        case NODE_ASYNC_EXPR:
+            a = convert(builder, node->async_expr.expression);
+            break;
+
+        case NODE_AWAIT_EXPR:
+            a = convert(builder, node->await_expr.expression);
+            break;
+
+        case NODE_CHAN_SEND_EXPR:
+            a = convert(builder, node->chan_send_expr.channel);
+            b = convert(builder, node->chan_send_expr.value);
+            break;
+
+        case NODE_CHAN_RECV_EXPR:
+            a = convert(builder, node->chan_recv_expr.channel);
+            break;
+
+        case NODE_INT_LITERAL: {
+            uint64_t bits = (uint64_t)node->int_value;
+            a = (uint32_t)bits;
+            b = (uint32_t)(bits >> 32);
+            break;
+        }
+
+        case NODE_FLOAT_LITERAL: {
+            uint64_t bits;
+            memcpy(&bits, &node->float_value, sizeof(bits));
+            a = (uint32_t)bits;
+            b = (uint32_t)(bits >> 32);
+            break;
+        }
+
+        case NODE_STRING_LITERAL:
+            if (node->string_value) {
+                b = (uint32_t)strlen(node->string_value);
+                a = push_string(ast, node->string_value, b);
+            }
+            break;
+
+        case NODE_BOOL_LITERAL:
+            flags = node->bool_value;
+            break;
+
+        case NODE_CHAR_LITERAL:
+            a = (uint8_t)node->char_value;
+            break;
+
+        case NODE_IDENTIFIER:
+            a = node->ident.symbol;
+            break;
+
+        case NODE_VAR_DECL:
+            a = push_token(ast, node->var_decl.name);
+            b = convert(builder, node->var_decl.value);
+            flags = node->var_decl.is_mutable;
+            break;
+
+        case NODE_FUNCTION_DECL: {
+            a = push_token(ast, node->func_decl.name);
+            FlatIndex return_type = convert(builder, node->func_decl.return_type);
+            FlatIndex body = convert(builder, node->func_decl.body);
+            collect_tokens(builder, &node->func_decl.params);
+            uint32_t split = builder->scratch_count;
+            collect_tokens(builder, &node->func_decl.type_params);
+            b = push_extra(ast, body);
+            push_extra(ast, return_type);
+            emit_list(builder, mark, split);
+            emit_list(builder, split, builder->scratch_count);
+            break;
+        }
+
+        case NODE_CLASS_DECL: {
+            a = push_token(ast, node->class_decl.name);
+            collect_tokens(builder, &node->class_decl.type_params);
+            uint32_t first = builder->scratch_count;
+            collect_nodes(builder, &node->class_decl.superclasses);
+            uint32_t second = builder->scratch_count;
+            collect_nodes(builder, &node->class_decl.members);
+            b = ast->extra_count;
+            emit_list(builder, mark, first);
+            emit_list(builder, first, second);
+            emit_list(builder, second, builder->scratch_count);
+            break;
+        }
+
+        case NODE_INTERFACE_DECL:
+        case NODE_TRAIT_DECL: {
+            // InterfaceDecl and TraitDecl share one layout
+            const InterfaceDecl* decl = &node->interface_decl;
+            a = push_token(ast, decl->name);
+            collect_tokens(builder, &decl->type_params);
+            uint32_t split = builder->scratch_count;
+            collect_nodes(builder, &decl->methods);
+            b = ast->extra_count;
+            emit_list(builder, mark, split);
+            emit_list(builder, split, builder->scratch_count);
+            break;
+        }
+
+        case NODE_IMPL_DECL: {
+            a = convert(builder, node->impl_decl.type);
+            uint32_t trait = push_token(ast, node->impl_decl.trait);
+            collect_nodes(builder, &node->impl_decl.methods);
+            b = push_extra(ast, trait);
+            emit_list(builder, mark, builder->scratch_count);
+            break;
+        }
+
+        case NODE_TYPE_DECL: {
+            a = push_token(ast, node->type_decl.name);
+            FlatIndex type = convert(builder, node->type_decl.type);
+            collect_tokens(builder, &node->type_decl.type_params);
+            b = push_extra(ast, type);
+            emit_list(builder, mark, builder->scratch_count);
+            break;
+        }
+
+        case NODE_ENUM_DECL: {
+            a = push_token(ast, node->enum_decl.name);
+            collect_tokens(builder, &node->enum_decl.variants);
+            uint32_t split = builder->scratch_count;
+            collect_nodes(builder, &node->enum_decl.values);
+            b = ast->extra_count;
+            emit_list(builder, mark, split);
+            emit_list(builder, split, builder->scratch_count);
+            break;
+        }
+
+        case NODE_IMPORT_DECL:
+            a = push_token(ast, node->import_decl.path);
+            b = push_token(ast, node->import_decl.alias);
+            flags = node->import_decl.is_all;
+            break;
+
+        case NODE_EXPORT_DECL:
+            a = convert(builder, node->export_decl.declaration);
+            break;
+
+        case NODE_CHAN_DECL: {
+            a = push_token(ast, node->chan_decl.name);
+            FlatIndex element_type = convert(builder, node->chan_decl.element_type);
+            FlatIndex capacity = convert(builder, node->chan_decl.capacity);
+            b = push_extra(ast, element_type);
+            push_extra(ast, capacity);
+            break;
+        }
+
+        case NODE_BLOCK_STMT:
+            collect_nodes(builder, &node->block_stmt.statements);
+            b = ast->extra_count;
+            emit_list(builder, mark, builder->scratch_count);
+            break;
+
+        case NODE_IF_STMT: {
+            a = convert(builder, node->if_stmt.condition);
+            FlatIndex then_branch = convert(builder, node->if_stmt.then_branch);
+            FlatIndex else_branch = convert(builder, node->if_stmt.else_branch);
+            b = push_extra(ast, then_branch);
+            push_extra(ast, else_branch);
+            break;
+        }
+
+        case NODE_WHILE_STMT:
+            a = convert(builder, node->while_stmt.condition);
+            b = convert(builder, node->while_stmt.body);
+            break;
+
+        case NODE_FOR_STMT: {
+            FlatIndex initializer = convert(builder, node->for_stmt.initializer);
+            FlatIndex condition = convert(builder, node->for_stmt.condition);
+            FlatIndex increment = convert(builder, node->for_stmt.increment);
+            FlatIndex body = convert(builder, node->for_stmt.body);
+            b = push_extra(ast, initializer);
+            push_extra(ast, condition);
+            push_extra(ast, increment);
+            push_extra(ast, body);
+            break;
+        }
+
+        case NODE_FOREACH_STMT: {
+            a = convert(builder, node->foreach_stmt.iterator);
+            uint32_t var = push_token(ast, node->foreach_stmt.var);
+            FlatIndex body = convert(builder, node->foreach_stmt.body);
+            b = push_extra(ast, var);
+            push_extra(ast, body);
+            break;
+        }
+
+        case NODE_RETURN_STMT:
+            a = convert(builder, node->return_stmt.value);
+            break;
+
+        case NODE_THROW_STMT:
+            a = convert(builder, node->throw_stmt.value);
+            break;
+
+        case NODE_EXPR_STMT:
+            a = convert(builder, node->expr_stmt.expr);
+            break;
+
+        case NODE_TRY_STMT: {
+            a = convert(builder, node->try_stmt.try_block);
+            collect_nodes(builder, &node->try_stmt.catch_blocks);
+            FlatIndex finally_block = convert(builder, node->try_stmt.finally_block);
+            b = push_extra(ast, finally_block);
+            emit_list(builder, mark, builder->scratch_count);
+            break;
+        }
+
+        case NODE_CATCH_CLAUSE: {
+            a = convert(builder, node->catch_clause.body);
+            b = push_extra(ast, push_token(ast, node->catch_clause.error_type));
+            push_extra(ast, push_token(ast, node->catch_clause.var));
+            break;
+        }
+
+        case NODE_MATCH_STMT: {
+            a = convert(builder, node->match_stmt.value);
+            collect_nodes(builder, &node->match_stmt.cases);
+            FlatIndex default_case = convert(builder, node->match_stmt.default_case);
+            b = push_extra(ast, default_case);
+            emit_list(builder, mark, builder->scratch_count);
+            break;
+        }
+
+        case NODE_DEFER_STMT:
+            a = convert(builder, node->defer_stmt.statement);
+            break;
+
+        case NODE_GO_STMT:
+            a = convert(builder, node->go_stmt.expression);
+            break;
+
+        case NODE_SELECT_STMT: {
+            // Cases are SelectCase records, not nodes; four words each
+            const SelectCaseList* cases = &node->select_stmt.cases;
+            for (u32 i = 0; i < cases->count; i++) {
+                const SelectCase* select_case = SMALL_VEC_AT(cases, i);
+                push_scratch(builder, convert(builder, select_case->channel));
+                push_scratch(builder, convert(builder, select_case->value));
+                push_scratch(builder, convert(builder, select_case->body));
+                push_scratch(builder, select_case->is_send);
+            }
+            FlatIndex default_case = convert(builder, node->select_stmt.default_case);
+            b = push_extra(ast, default_case);
+            push_extra(ast, (uint32_t)cases->count);
+            for (uint32_t i = mark; i < builder->scratch_count; i++) {
+                push_extra(ast, builder->scratch[i]);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    builder->scratch_count = mark;
+
+    FlatNode* flat = &ast->nodes[index];
+    flat->op = op;
+    flat->flags = flags;
+    flat->a = a;
+    flat->b = b;
+    return index;
+}
+
+FlatIndex flat_ast_from_tree(FlatAST* ast, const ASTNode* tree) {
+    FlatBuilder builder;
+    builder.ast = ast;
+    builder.scratch = NULL;
+    builder.scratch_count = 0;
+    builder.scratch_capacity = 0;
+
+    ast->root = convert(&builder, tree);
+    f_free(builder.scratch);
+    return ast->root;
+}
+
+const FlatNode* flat_ast_node(const FlatAST* ast, FlatIndex node) {
+    return &ast->nodes[node];
+}
+
+// Returns the items of the list stored at extra[extra_index]
+const uint32_t* flat_ast_list(const FlatAST* ast, uint32_t extra_index, uint32_t* count) {
+    *count = ast->extra[extra_index];
+    return &ast->extra[extra_index + 1];
+}
+
+Token flat_ast_token(const FlatAST* ast, uint32_t token) {
+    const FlatToken* flat = &ast->tokens[token];
+    Token result;
+    result.type = (TokenType)flat->type;
+    result.length = (int)flat->length;
+    result.offset = flat->offset;
+    result.value.int_value = 0;
+    result.start = token == FLAT_NONE ? NULL : ast->source + flat->offset;
+    return result;
+}
+
+const char* flat_ast_string(const FlatAST* ast, const FlatNode* node) {
+    return ast->strings + node->a;
+}
+
+int64_t flat_node_int(const FlatNode* node) {
+    return (int64_t)(((uint64_t)node->b << 32) | node->a);
+}
+
+double flat_node_float(const FlatNode* node) {
+    uint64_t bits = ((uint64_t)node->b << 32) | node->a;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void walk_list(const FlatAST* ast, uint32_t extra_index, FlatVisitFn visit, void* user) {
+    uint32_t count;
+    const uint32_t* items = flat_ast_list(ast, extra_index, &count);
+    for (uint32_t i = 0; i < count; i++) {
+        flat_ast_walk(ast, items[i], visit, user);
+    }
+}
+
+static uint32_t list_end(const FlatAST* ast, uint32_t extra_index) {
+    return extra_index + 1 + ast->extra[extra_index];
+}
+
+void flat_ast_walk(const FlatAST* ast, FlatIndex index, FlatVisitFn visit, void* user) {
+    if (index == FLAT_NONE) return;
+
+    const FlatNode* node = &ast->nodes[index];
+    const uint32_t* extra = ast->extra;
+    visit(ast, index, user);
+
+    switch (node->type) {
+        case NODE_BINARY_EXPR:
+        case NODE_LOGICAL_EXPR:
+        case NODE_INDEX_EXPR:
+        case NODE_CHAN_SEND_EXPR:
+        case NODE_WHILE_STMT:
+            flat_ast_walk(ast, node->a, visit, user);
+            flat_ast_walk(ast, node->b, visit, user);
+            break;
+
+        case NODE_UNARY_EXPR:
+        case NODE_ASYNC_EXPR:
+        case NODE_AWAIT_EXPR:
+        case NODE_CHAN_RECV_EXPR:
+        case NODE_GET_EXPR:
+        case NODE_EXPORT_DECL:
+        case NODE_RETURN_STMT:
+        case NODE_THROW_STMT:
+        case NODE_EXPR_STMT:
+        case NODE_DEFER_STMT:
+        case NODE_GO_STMT:
+            flat_ast_walk(ast, node->a, visit, user);
+            break;
+
+        case NODE_VAR_DECL:
+            flat_ast_walk(ast, node->b, visit, user);
+            break;
+
+        case NODE_CALL_EXPR:
+        case NODE_CLOSURE_EXPR:
+            flat_ast_walk(ast, node->a, visit, user);
+            if (node->type == NODE_CALL_EXPR) walk_list(ast, node->b, visit, user);
+            break;
+
+        case NODE_SET_EXPR:
+            flat_ast_walk(ast, node->a, visit, user);
+            flat_ast_walk(ast, extra[node->b + 1], visit, user);
+            break;
+
+        case NODE_ARRAY_EXPR:
+        case NODE_BLOCK_STMT:
+            walk_list(ast, node->b, visit, user);
+            break;
+
+        case NODE_FUNCTION_DECL:
+            flat_ast_walk(ast, extra[node->b + 1], visit, user);   // return_type
+            flat_ast_walk(ast, extra[node->b], visit, user);       // body
+            break;
+
+        case NODE_CLASS_DECL: {
+            uint32_t superclasses = list_end(ast, node->b);
+            walk_list(ast, superclasses, visit, user);
+            walk_list(ast, list_end(ast, superclasses), visit, user);
+            break;
+        }
+
+        case NODE_INTERFACE_DECL:
+        case NODE_TRAIT_DECL:
+        case NODE_ENUM_DECL:
+            walk_list(ast, list_end(ast, node->b), visit, user);
+            break;
+
+        case NODE_IMPL_DECL:
+            flat_ast_walk(ast, node->a, visit, user);
+            walk_list(ast, node->b + 1, visit, user);
+            break;
+
+        case NODE_TYPE_DECL:
+        case NODE_CHAN_DECL:
+            flat_ast_walk(ast, extra[node->b], visit, user);
+            if (node->type == NODE_CHAN_DECL) flat_ast_walk(ast, extra[node->b + 1], visit, user);
+            break;
+
+        case NODE_IF_STMT:
+        case NODE_FOREACH_STMT:
+            flat_ast_walk(ast, node->a, visit, user);
+            if (node->type == NODE_IF_STMT) flat_ast_walk(ast, extra[node->b], visit, user);
+            flat_ast_walk(ast, extra[node->b + 1], visit, user);
+            break;
+
+        case NODE_FOR_STMT:
+            for (uint32_t i = 0; i < 4; i++) {
+                flat_ast_walk(ast, extra[node->b + i], visit, user);
+            }
+            break;
+
+        case NODE_TRY_STMT:
+        case NODE_MATCH_STMT:
+            flat_ast_walk(ast, node->a, visit, user);
+            walk_list(ast, node->b + 1, visit, user);
+            flat_ast_walk(ast, extra[node->b], visit, user);
+            break;
+
+        case NODE_CATCH_CLAUSE:
+            flat_ast_walk(ast, node->a, visit, user);
+            break;
+
+        case NODE_SELECT_STMT: {
+            uint32_t count = extra[node->b + 1];
+            const uint32_t* cases = &extra[node->b + 2];
+            for (uint32_t i = 0; i < count; i++) {
+                flat_ast_walk(ast, cases[i * 4], visit, user);
+                flat_ast_walk(ast, cases[i * 4 + 1], visit, user);
+                flat_ast_walk(ast, cases[i * 4 + 2], visit, user);
+            }
+            flat_ast_walk(ast, extra[node->b], visit, user);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+// Flat to tree conversion
+
+static ASTNode* rebuild(const FlatAST* ast, FlatIndex index);
+
+static NodeList rebuild_nodes(const FlatAST* ast, uint32_t extra_index) {
+    uint32_t count;
+    const uint32_t* items = flat_ast_list(ast, extra_index, &count);
+    NodeList list = {0};
+    node_list_reserve(&list, count);
+    for (uint32_t i = 0; i < count; i++) {
+        node_list_push(&list, rebuild(ast, items[i]));
+    }
+    return list;
+}
+
+static TokenList rebuild_tokens(const FlatAST* ast, uint32_t extra_index) {
+    uint32_t count;
+    const uint32_t* items = flat_ast_list(ast, extra_index, &count);
+    TokenList list = {0};
+    token_list_reserve(&list, count);
+    for (uint32_t i = 0; i < count; i++) {
+        token_list_push(&list, flat_ast_token(ast, items[i]));
+    }
+    return list;
+}
+
+// Operators keep their type and length in the node; they start at the
+// node's offset
+static Token rebuild_operator(const FlatAST* ast, const FlatNode* flat) {
+    Token op;
+    op.type = (TokenType)flat->op;
+    op.length = flat->flags;
+    op.offset = flat->offset;
+    op.value.int_value = 0;
+    op.start = ast->source + flat->offset;
+    return op;
+}
+
+static ASTNode* rebuild(const FlatAST* ast, FlatIndex index) {
+    if (index == FLAT_NONE) return NULL;
+
+    const FlatNode* flat = &ast->nodes[index];
+    const uint32_t* extra = ast->extra;
+    ASTNode* node = ast_new_node((NodeType)flat->type, flat->offset);
+
+    switch (node->type) {
+        case NODE_BINARY_EXPR:
+            node->binary_expr.op = rebuild_operator(ast, flat);
+            node->binary_expr.left = rebuild(ast, flat->a);
+            node->binary_expr.right = rebuild(ast, flat->b);
+            break;
+
+        case NODE_LOGICAL_EXPR:
+            node->logical_expr.op = rebuild_operator(ast, flat);
+            node->logical_expr.left = rebuild(ast, flat->a);
+            node->logical_expr.right = rebuild(ast, flat->b);
+            break;
+
+        case NODE_UNARY_EXPR:
+            node->unary_expr.op = rebuild_operator(ast, flat);
+            node->unary_expr.operand = rebuild(ast, flat->a);
+            break;
+
+        case NODE_CALL_EXPR:
+            node->call_expr.callee = rebuild(ast, flat->a);
+            node->call_expr.args = rebuild_nodes(ast, flat->b);
+            break;
+
+        case NODE_GET_EXPR:
+            node->get_expr.object = rebuild(ast, flat->a);
+            node->get_expr.name = flat_ast_token(ast, flat->b);
+            break;
+
+        case NODE_SET_EXPR:
+            node->set_expr.object = rebuild(ast, flat->a);
+            node->set_expr.name = flat_ast_token(ast, extra[flat->b]);
+            node->set_expr.value = rebuild(ast, extra[flat->b + 1]);
+            break;
+
+        case NODE_ARRAY_EXPR:
+            node->array_expr.elements = rebuild_nodes(ast, flat->b);
+            break;
+
+        case NODE_INDEX_EXPR:
+            node->index_expr.array = rebuild(ast, flat->a);
+            node->index_expr.index = rebuild(ast, flat->b);
+            break;
+
+        case NODE_CLOSURE_EXPR:
+            node->closure_expr.function = rebuild(ast, flat->a);
+            node->closure_expr.captures = rebuild_tokens(ast, flat->b);
+            break;
+
+        case NODE_ASYNC_EXPR:
+            node->async_expr.expression = rebuild(ast, flat->a);
+            break;
+
+        case NODE_AWAIT_EXPR:
+            node->await_expr.expression = rebuild(ast, flat->a);
+            break;
+
+        case NODE_CHAN_SEND_EXPR:
+            node->chan_send_expr.channel = rebuild(ast, flat->a);
+            node->chan_send_expr.value = rebuild(ast, flat->b);
+            break;
+
+        case NODE_CHAN_RECV_EXPR:
+            node->chan_recv_expr.channel = rebuild(ast, flat->a);
+            break;
+
+        case NODE_INT_LITERAL:
+            node->int_value = flat_node_int(flat);
+            break;
+
+        case NODE_FLOAT_LITERAL:
+            node->float_value = flat_node_float(flat);
+            break;
+
+        case NODE_STRING_LITERAL:
+            if (flat->a != 0) {
+                char* value = ast_alloc((usize)flat->b + 1);
+                memcpy(value, ast->strings + flat->a, (usize)flat->b + 1);
+                node->string_value = value;
+            }
+            break;
+
+        case NODE_BOOL_LITERAL:
+            node->bool_value = flat->flags;
+            break;
+
+        case NODE_CHAR_LITERAL:
+            node->char_value = (char)flat->a;
+            break;
+
+        case NODE_IDENTIFIER:
+            node->ident.symbol = flat->a;
+            break;
+
+        case NODE_VAR_DECL:
+            node->var_decl.name = flat_ast_token(ast, flat->a);
+            node->var_decl.value = rebuild(ast, flat->b);
+            node->var_decl.is_mutable = flat->flags;
+            break;
+
+        case NODE_FUNCTION_DECL: {
+            uint32_t params = flat->b + 2;
+            node->func_decl.name = flat_ast_token(ast, flat->a);
+            node->func_decl.body = rebuild(ast, extra[flat->b]);
+            node->func_decl.return_type = rebuild(ast, extra[flat->b + 1]);
+            node->func_decl.params = rebuild_tokens(ast, params);
+            node->func_decl.type_params = rebuild_tokens(ast, list_end(ast, params));
+            break;
+        }
+
+        case NODE_CLASS_DECL: {
+            uint32_t superclasses = list_end(ast, flat->b);
+            node->class_decl.name = flat_ast_token(ast, flat->a);
+            node->class_decl.type_params = rebuild_tokens(ast, flat->b);
+            node->class_decl.superclasses = rebuild_nodes(ast, superclasses);
+            node->class_decl.members = rebuild_nodes(ast, list_end(ast, superclasses));
+            break;
+        }
+
+        case NODE_INTERFACE_DECL:
+        case NODE_TRAIT_DECL:
+            // InterfaceDecl and TraitDecl share one layout
+            node->interface_decl.name = flat_ast_token(ast, flat->a);
+            node->interface_decl.type_params = rebuild_tokens(ast, flat->b);
+            node->interface_decl.methods = rebuild_nodes(ast, list_end(ast, flat->b));
+            break;
+
+        case NODE_IMPL_DECL:
+            node->impl_decl.type = rebuild(ast, flat->a);
+            node->impl_decl.trait = flat_ast_token(ast, extra[flat->b]);
+            node->impl_decl.methods = rebuild_nodes(ast, flat->b + 1);
+            break;
+
+        case NODE_TYPE_DECL:
+            node->type_decl.name = flat_ast_token(ast, flat->a);
+            node->type_decl.type = rebuild(ast, extra[flat->b]);
+            node->type_decl.type_params = rebuild_tokens(ast, flat->b + 1);
+            break;
+
+        case NODE_ENUM_DECL:
+            node->enum_decl.name = flat_ast_token(ast, flat->a);
+            node->enum_decl.variants = rebuild_tokens(ast, flat->b);
+            node->enum_decl.values = rebuild_nodes(ast, list_end(ast, flat->b));
+            break;
+
+        case NODE_IMPORT_DECL:
+            node->import_decl.path = flat_ast_token(ast, flat->a);
+            node->import_decl.alias = flat_ast_token(ast, flat->b);
+            node->import_decl.is_all = flat->flags;
+            break;
+
+        case NODE_EXPORT_DECL:
+            node->export_decl.declaration = rebuild(ast, flat->a);
+            break;
+
+        case NODE_CHAN_DECL:
+            node->chan_decl.name = flat_ast_token(ast, flat->a);
+            node->chan_decl.element_type = rebuild(ast, extra[flat->b]);
+            node->chan_decl.capacity = rebuild(ast, extra[flat->b + 1]);
+            break;
+
+        case NODE_BLOCK_STMT:
+            node->block_stmt.statements = rebuild_nodes(ast, flat->b);
+            break;
+
+        case NODE_IF_STMT:
+            node->if_stmt.condition = rebuild(ast, flat->a);
+            node->if_stmt.then_branch = rebuild(ast, extra[flat->b]);
+            node->if_stmt.else_branch = rebuild(ast, extra[flat->b + 1]);
+            break;
+
+        case NODE_WHILE_STMT:
+            node->while_stmt.condition = rebuild(ast, flat->a);
+            node->while_stmt.body = rebuild(ast, flat->b);
+            break;
+
+        case NODE_FOR_STMT:
+            node->for_stmt.initializer = rebuild(ast, extra[flat->b]);
+            node->for_stmt.condition = rebuild(ast, extra[flat->b + 1]);
+            node->for_stmt.increment = rebuild(ast, extra[flat->b + 2]);
+            node->for_stmt.body = rebuild(ast, extra[flat->b + 3]);
+            break;
+
+        case NODE_FOREACH_STMT:
+            node->foreach_stmt.iterator = rebuild(ast, flat->a);
+            node->foreach_stmt.var = flat_ast_token(ast, extra[flat->b]);
+            node->foreach_stmt.body = rebuild(ast, extra[flat->b + 1]);
+            break;
+
+        case NODE_RETURN_STMT:
+            node->return_stmt.value = rebuild(ast, flat->a);
+            break;
+
+        case NODE_THROW_STMT:
+            node->throw_stmt.value = rebuild(ast, flat->a);
+            break;
+
+        case NODE_EXPR_STMT:
+            node->expr_stmt.expr = rebuild(ast, flat->a);
+            break;
+
+        case NODE_TRY_STMT:
+            node->try_stmt.try_block = rebuild(ast, flat->a);
+            node->try_stmt.finally_block = rebuild(ast, extra[flat->b]);
+            node->try_stmt.catch_blocks = rebuild_nodes(ast, flat->b + 1);
+            break;
+
+        case NODE_CATCH_CLAUSE:
+            node->catch_clause.error_type = flat_ast_token(ast, extra[flat->b]);
+            node->catch_clause.var = flat_ast_token(ast, extra[flat->b + 1]);
+            node->catch_clause.body = rebuild(ast, flat->a);
+            break;
+
+        case NODE_MATCH_STMT:
+            node->match_stmt.value = rebuild(ast, flat->a);
+            node->match_stmt.default_case = rebuild(ast, extra[flat->b]);
+            node->match_stmt.cases = rebuild_nodes(ast, flat->b + 1);
+            break;
+
+        case NODE_DEFER_STMT:
+            node->defer_stmt.statement = rebuild(ast, flat->a);
+            break;
+
+        case NODE_GO_STMT:
+            node->go_stmt.expression = rebuild(ast, flat->a);
+            break;
+
+        case NODE_SELECT_STMT: {
+            uint32_t count = extra[flat->b + 1];
+            const uint32_t* cases = &extra[flat->b + 2];
+            SelectCaseList list = {0};
+            select_case_list_reserve(&list, count);
+            for (uint32_t i = 0; i < count; i++) {
+                SelectCase* select_case = ast_alloc(sizeof(SelectCase));
+                select_case->channel = rebuild(ast, cases[i * 4]);
+                select_case->value = rebuild(ast, cases[i * 4 + 1]);
+                select_case->body = rebuild(ast, cases[i * 4 + 2]);
+                select_case->is_send = cases[i * 4 + 3] != 0;
+                select_case_list_push(&list, select_case);
+            }
+            node->select_stmt.cases = list;
+            node->select_stmt.default_case = rebuild(ast, extra[flat->b]);
+            break;
+        }
+
+        default:
+            break;
+    }
+    return node;
+}
+
+ASTNode* flat_ast_to_tree(const FlatAST* ast, FlatIndex node) {
+    return rebuild(ast, node);
+}
+
+usize flat_ast_memory(const FlatAST* ast) {
+    return (usize)ast->node_capacity * sizeof(FlatNode) +
+           (usize)ast->extra_capacity * sizeof(uint32_t) +
+           (usize)ast->token_capacity * sizeof(FlatToken) +
+           (usize)ast->string_capacity;
+}
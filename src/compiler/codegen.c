@@ -1,232 +1,531 @@
 #include "../../include/codegen.h"
-#include "../../include/ast.h"
+#include "../../include/ir.h"
 #include "../../include/common.h"
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+
+// Buffered assembly is written out once it reaches this size
+#define CODEGEN_FLUSH_SIZE (1024 * 1024)
 
 void codegen_init(CodeGenContext* ctx, TargetArch arch) {
     ctx->arch = arch;
     ctx->optimize = false;
     ctx->debug_info = true;
-    ctx->output = byte_buffer_new(1024);
+    sys_output_init(&ctx->output);
 }
 
 void codegen_free(CodeGenContext* ctx) {
-    byte_buffer_free(&ctx->output);
+    sys_output_close(&ctx->output);
 }
 
-static void emit_instruction(CodeGenContext* ctx, const char* fmt, ...) {
+void emit_instruction(CodeGenContext* ctx, const char* fmt, ...) {
     va_list args;
     va_start(args, fmt);
     
     char buffer[256];
     int len = vsnprintf(buffer, sizeof(buffer), fmt, args);
     if (len > 0) {
-        byte_buffer_append(&ctx->output, buffer, len);
-        byte_buffer_append_byte(&ctx->output, '\n');
+        if ((usize)len >= sizeof(buffer)) len = sizeof(buffer) - 1;
+        buffer[len] = '\n';
+        sys_output_write(&ctx->output, buffer, (usize)len + 1);
+        if (ctx->output.length >= CODEGEN_FLUSH_SIZE) sys_output_flush(&ctx->output);
     }
     
     va_end(args);
 }
 
-static void emit_data_section(CodeGenContext* ctx, const char* label, const void* data, usize size) {
+void emit_data_section(CodeGenContext* ctx, const char* label, const void* data, usize size) {
     emit_instruction(ctx, "section .data");
     emit_instruction(ctx, "%s:", label);
-    emit_instruction(ctx, "  db ");
-    
+
+    // Sixteen bytes per line
     const u8* bytes = (const u8*)data;
-    for (usize i = 0; i < size; i++) {
-        if (i > 0) emit_instruction(ctx, ", ");
-        emit_instruction(ctx, "0x%02x", bytes[i]);
+    for (usize i = 0; i < size; i += 16) {
+        char line[128];
+        int length = snprintf(line, sizeof(line), "  db ");
+        for (usize j = i; j < size && j < i + 16; j++) {
+            length += snprintf(line + length, sizeof(line) - length, j > i ? ", 0x%02x" : "0x%02x", bytes[j]);
+        }
+        emit_instruction(ctx, "%s", line);
     }
 }
 
-static void emit_text_section(CodeGenContext* ctx) {
+void emit_text_section(CodeGenContext* ctx) {
     emit_instruction(ctx, "section .text");
 }
 
-static void emit_label(CodeGenContext* ctx, const char* label) {
+void emit_label(CodeGenContext* ctx, const char* label) {
     emit_instruction(ctx, "%s:", label);
 }
 
-static void emit_function_prologue(CodeGenContext* ctx, const char* func_name) {
+void emit_function_prologue(CodeGenContext* ctx, const char* func_name) {
     emit_instruction(ctx, "global %s", func_name);
     emit_label(ctx, func_name);
     emit_instruction(ctx, "  push rbp");
     emit_instruction(ctx, "  mov rbp, rsp");
 }
 
-static void emit_function_epilogue(CodeGenContext* ctx) {
+void emit_function_epilogue(CodeGenContext* ctx) {
     emit_instruction(ctx, "  mov rsp, rbp");
     emit_instruction(ctx, "  pop rbp");
     emit_instruction(ctx, "  ret");
 }
 
-// Runtime support functions for concurrency
-static void emit_runtime_support(CodeGenContext* ctx) {
-    // Channel operations
-    emit_function_prologue(ctx, "rt_chan_create");
-    emit_instruction(ctx, "  mov rdi, [rsp + 16]");  // element size
-    emit_instruction(ctx, "  mov rsi, [rsp + 24]");  // buffer capacity
+// x86-64 backend
+//
+// Every IR register has a stack slot at [rbp - 8 * register]. An
+// instruction loads its operands into rax and rcx (xmm0 and xmm1 for
+// floats) and stores its result back, so no register allocation is needed
+// yet. Phis are copies on the edges into their block. Calls follow the
+// System V convention; Ferrum functions take their closure in rdi first.
+//
+// With 'optimize', an integer compare whose only use is the branch right
+// after it leaves its result in the flags instead of its slot.
+
+#define X86_INT_ARGS 6
+#define X86_FLOAT_ARGS 8
+#define X86_STACK_ARGS 16
+
+static const char* const x86_int_args[X86_INT_ARGS] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
+
+typedef struct {
+    CodeGenContext* ctx;
+    const IrModule* module;
+    const IrFunction* function;
+    uint32_t int_params;        // Argument registers taken by the parameters so far
+    uint32_t float_params;
+    uint32_t stack_params;
+    uint32_t* uses;             // Per register, if optimizing
+    const char* flags;          // Condition the flags hold for the next branch, or NULL
+} X86Function;
+
+static bool x86_is_float(const X86Function* x86, IrValue value) {
+    return ir_value_type(x86->function, value) == IR_FLOAT;
+}
+
+static const IrFunction* x86_callee(const X86Function* x86, int64_t index) {
+    return ((IrFunction**)x86->module->functions.items)[index];
+}
+
+static void x86_load(X86Function* x86, const char* reg, IrValue value) {
+    emit_instruction(x86->ctx, "  mov %s, [rbp - %u]", reg, 8 * value);
+}
+
+static void x86_store(X86Function* x86, IrValue value, const char* reg) {
+    emit_instruction(x86->ctx, "  mov [rbp - %u], %s", 8 * value, reg);
+}
+
+// Phi copies on the edge 'from' -> 'to'. Several phis read their sources
+// before any is written, through the stack.
+static uint32_t x86_phi_count(const IrBlock* block) {
+    const IrInstr* instrs = block->instrs.items;
+    uint32_t count = 0;
+    while (count < block->instrs.count && instrs[count].op == IR_PHI) count++;
+    return count;
+}
+
+static void x86_edge(X86Function* x86, const IrBlock* from, const IrBlock* to) {
+    uint32_t count = x86_phi_count(to);
+    if (count == 0) return;
+
+    const IrInstr* phis = to->instrs.items;
+    uint32_t pred = ir_pred_index(to, from);
+    if (count == 1) {
+        x86_load(x86, "rax", phis[0].args[pred]);
+        x86_store(x86, phis[0].dest, "rax");
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        emit_instruction(x86->ctx, "  push qword [rbp - %u]", 8 * phis[i].args[pred]);
+    }
+    for (uint32_t i = count; i-- > 0;) {
+        emit_instruction(x86->ctx, "  pop qword [rbp - %u]", 8 * phis[i].dest);
+    }
+}
+
+static void x86_param(X86Function* x86, const IrInstr* instr) {
+    if (instr->type == IR_FLOAT && x86->float_params < X86_FLOAT_ARGS) {
+        emit_instruction(x86->ctx, "  movsd [rbp - %u], xmm%u", 8 * instr->dest, x86->float_params++);
+    } else if (instr->type != IR_FLOAT && x86->int_params < X86_INT_ARGS) {
+        x86_store(x86, instr->dest, x86_int_args[x86->int_params++]);
+    } else {
+        emit_instruction(x86->ctx, "  mov rax, [rbp + %u]", 16 + 8 * x86->stack_params++);
+        x86_store(x86, instr->dest, "rax");
+    }
+}
+
+static void x86_call(X86Function* x86, const IrInstr* instr) {
+    CodeGenContext* ctx = x86->ctx;
+    const IrFunction* callee = instr->op == IR_CALL ? x86_callee(x86, instr->imm) : NULL;
+    bool has_closure = !callee || !callee->external;
+    uint32_t first = instr->op == IR_CALLI ? 1 : 0;
+
+    // Register arguments are loaded first; stack arguments are pushed last
+    // to first, keeping rsp 16-byte aligned at the call
+    IrValue stack_buffer[X86_STACK_ARGS];
+    IrValue* stacked = stack_buffer;
+    if (instr->arg_count > X86_STACK_ARGS) stacked = f_malloc(instr->arg_count * sizeof(IrValue));
+    uint32_t stack_count = 0;
+    uint32_t ints = has_closure ? 1 : 0;
+    uint32_t floats = 0;
+    for (uint32_t i = first; i < instr->arg_count; i++) {
+        IrValue arg = instr->args[i];
+        if (x86_is_float(x86, arg) && floats < X86_FLOAT_ARGS) {
+            emit_instruction(ctx, "  movsd xmm%u, [rbp - %u]", floats++, 8 * arg);
+        } else if (!x86_is_float(x86, arg) && ints < X86_INT_ARGS) {
+            x86_load(x86, x86_int_args[ints++], arg);
+        } else {
+            stacked[stack_count++] = arg;
+        }
+    }
+    uint32_t stack_bytes = 8 * stack_count;
+    if (stack_count % 2) {
+        emit_instruction(ctx, "  sub rsp, 8");
+        stack_bytes += 8;
+    }
+    for (uint32_t i = stack_count; i-- > 0;) {
+        emit_instruction(ctx, "  push qword [rbp - %u]", 8 * stacked[i]);
+    }
+    if (stacked != stack_buffer) f_free(stacked);
+
+    if (!callee) {
+        x86_load(x86, "rdi", instr->args[0]);
+        emit_instruction(ctx, "  call [rdi]");
+    } else if (callee->external) {
+        // Variadic C functions read the number of vector registers from al
+        emit_instruction(ctx, "  mov eax, %u", floats);
+        emit_instruction(ctx, "  call %s", callee->name);
+    } else {
+        emit_instruction(ctx, "  lea rdi, [rel %s_closure]", callee->name);
+        emit_instruction(ctx, "  call %s", callee->name);
+    }
+    if (stack_bytes) emit_instruction(ctx, "  add rsp, %u", stack_bytes);
+
+    if (instr->dest == IR_NO_VALUE) return;
+    if (instr->type == IR_FLOAT) {
+        emit_instruction(ctx, "  movsd [rbp - %u], xmm0", 8 * instr->dest);
+        return;
+    }
+    // C functions return bool in al only
+    if (instr->type == IR_BOOL) emit_instruction(ctx, "  movzx eax, al");
+    x86_store(x86, instr->dest, "rax");
+}
+
+static void x86_closure(X86Function* x86, const IrInstr* instr) {
+    CodeGenContext* ctx = x86->ctx;
+    emit_instruction(ctx, "  mov edi, %u", 8 * (instr->arg_count + 1));
     emit_instruction(ctx, "  call malloc");
-    emit_instruction(ctx, "  mov [rax], rdi");       // store element size
-    emit_instruction(ctx, "  mov [rax + 8], rsi");   // store capacity
-    emit_instruction(ctx, "  mov qword [rax + 16], 0"); // head = 0
-    emit_instruction(ctx, "  mov qword [rax + 24], 0"); // tail = 0
-    emit_instruction(ctx, "  mov qword [rax + 32], 0"); // count = 0
-    emit_function_epilogue(ctx);
-
-    emit_function_prologue(ctx, "rt_chan_send");
-    emit_instruction(ctx, "  mov rdi, [rsp + 16]");  // channel
-    emit_instruction(ctx, "  mov rsi, [rsp + 24]");  // value ptr
-    emit_instruction(ctx, "  mov rdx, [rdi]");       // element size
-    emit_instruction(ctx, "  mov rcx, [rdi + 8]");   // capacity
-    emit_instruction(ctx, "  mov r8, [rdi + 32]");   // count
-    emit_instruction(ctx, "  cmp r8, rcx");
-    emit_instruction(ctx, "  je .wait");             // if full, wait
-    emit_instruction(ctx, "  mov r9, [rdi + 24]");   // tail
-    emit_instruction(ctx, "  imul r9, rdx");         // tail * element_size
-    emit_instruction(ctx, "  add r9, rdi");
-    emit_instruction(ctx, "  add r9, 40");           // data starts at offset 40
-    emit_instruction(ctx, "  push rcx");
-    emit_instruction(ctx, "  mov rcx, rdx");
-    emit_instruction(ctx, "  rep movsb");            // copy value
-    emit_instruction(ctx, "  pop rcx");
-    emit_instruction(ctx, "  inc qword [rdi + 24]");  // tail++
-    emit_instruction(ctx, "  inc qword [rdi + 32]");  // count++
-    emit_instruction(ctx, ".done:");
-    emit_function_epilogue(ctx);
-    emit_instruction(ctx, ".wait:");
-    emit_instruction(ctx, "  pause");
-    emit_instruction(ctx, "  jmp rt_chan_send");
-
-    emit_function_prologue(ctx, "rt_chan_recv");
-    emit_instruction(ctx, "  mov rdi, [rsp + 16]");  // channel
-    emit_instruction(ctx, "  mov rsi, [rsp + 24]");  // dest ptr
-    emit_instruction(ctx, "  mov rdx, [rdi]");       // element size
-    emit_instruction(ctx, "  mov r8, [rdi + 32]");   // count
-    emit_instruction(ctx, "  test r8, r8");
-    emit_instruction(ctx, "  jz .wait");             // if empty, wait
-    emit_instruction(ctx, "  mov r9, [rdi + 16]");   // head
-    emit_instruction(ctx, "  imul r9, rdx");         // head * element_size
-    emit_instruction(ctx, "  add r9, rdi");
-    emit_instruction(ctx, "  add r9, 40");           // data starts at offset 40
-    emit_instruction(ctx, "  push rcx");
-    emit_instruction(ctx, "  mov rcx, rdx");
-    emit_instruction(ctx, "  rep movsb");            // copy value
-    emit_instruction(ctx, "  pop rcx");
-    emit_instruction(ctx, "  inc qword [rdi + 16]");  // head++
-    emit_instruction(ctx, "  dec qword [rdi + 32]");  // count--
-    emit_instruction(ctx, ".done:");
-    emit_function_epilogue(ctx);
-    emit_instruction(ctx, ".wait:");
-    emit_instruction(ctx, "  pause");
-    emit_instruction(ctx, "  jmp rt_chan_recv");
-
-    // Goroutine support
-    emit_function_prologue(ctx, "rt_go");
-    emit_instruction(ctx, "  mov rdi, [rsp + 16]");  // function ptr
-    emit_instruction(ctx, "  mov rsi, [rsp + 24]");  // argument ptr
-    emit_instruction(ctx, "  push rdi");
-    emit_instruction(ctx, "  push rsi");
-    emit_instruction(ctx, "  call CreateThread");     // Windows-specific, need to adapt for other platforms
-    emit_function_epilogue(ctx);
-}
-
-static void codegen_x86_64(CodeGenContext* ctx, ASTNode* ast) {
-    if (!ast) return;
-    
-    switch (ast->type) {
-        case NODE_BLOCK_STMT:
-            for (usize i = 0; i < ast->block_stmt.statements.count; i++) {
-                ASTNode* stmt = *(ASTNode**)da_get(&ast->block_stmt.statements, i);
-                codegen_x86_64(ctx, stmt);
-            }
+    emit_instruction(ctx, "  lea rcx, [rel %s]", x86_callee(x86, instr->imm)->name);
+    emit_instruction(ctx, "  mov [rax], rcx");
+    for (uint32_t i = 0; i < instr->arg_count; i++) {
+        x86_load(x86, "rcx", instr->args[i]);
+        emit_instruction(ctx, "  mov [rax + %u], rcx", 8 * (i + 1));
+    }
+    x86_store(x86, instr->dest, "rax");
+}
+
+// Condition codes and their negations
+static const char* const x86_conditions[] = { "e", "ne", "l", "le", "g", "ge" };
+static const char* const x86_negated[] = { "ne", "e", "ge", "g", "le", "l" };
+
+static const char* x86_negate(const char* condition) {
+    for (usize i = 0; i < sizeof(x86_conditions) / sizeof(x86_conditions[0]); i++) {
+        if (strcmp(x86_conditions[i], condition) == 0) return x86_negated[i];
+    }
+    return NULL;
+}
+
+static void x86_compare(X86Function* x86, const IrInstr* instr, const IrInstr* next, const char* condition) {
+    x86_load(x86, "rax", instr->args[0]);
+    emit_instruction(x86->ctx, "  cmp rax, [rbp - %u]", 8 * instr->args[1]);
+    if (x86->uses && next && next->op == IR_BRANCH && next->args[0] == instr->dest && x86->uses[instr->dest] == 1) {
+        x86->flags = condition;
+        return;
+    }
+    emit_instruction(x86->ctx, "  set%s al", condition);
+    emit_instruction(x86->ctx, "  movzx eax, al");
+    x86_store(x86, instr->dest, "rax");
+}
+
+// ucomisd sets the flags of an unsigned compare, and the parity flag when
+// either side is NaN; only 'ne' holds then. Less-than swaps the operands.
+static void x86_float_compare(X86Function* x86, const IrInstr* instr) {
+    CodeGenContext* ctx = x86->ctx;
+    bool swap = instr->op == IR_FLT || instr->op == IR_FLE;
+    emit_instruction(ctx, "  movsd xmm0, [rbp - %u]", 8 * instr->args[swap ? 1 : 0]);
+    emit_instruction(ctx, "  ucomisd xmm0, [rbp - %u]", 8 * instr->args[swap ? 0 : 1]);
+    switch (instr->op) {
+        case IR_FEQ:
+            emit_instruction(ctx, "  sete al");
+            emit_instruction(ctx, "  setnp cl");
+            emit_instruction(ctx, "  and al, cl");
+            break;
+        case IR_FNE:
+            emit_instruction(ctx, "  setne al");
+            emit_instruction(ctx, "  setp cl");
+            emit_instruction(ctx, "  or al, cl");
+            break;
+        case IR_FLT:
+        case IR_FGT:
+            emit_instruction(ctx, "  seta al");
             break;
-            
-        case NODE_INT_LITERAL:
-            emit_instruction(ctx, "  mov rax, %ld", ast->int_value);
-            break;
-            
-        case NODE_BINARY_EXPR:
-            codegen_x86_64(ctx, ast->binary_expr.left);
-            emit_instruction(ctx, "  push rax");
-            codegen_x86_64(ctx, ast->binary_expr.right);
-            emit_instruction(ctx, "  pop rbx");
-            
-            switch (ast->binary_expr.op.type) {
-                case TOKEN_PLUS:
-                    emit_instruction(ctx, "  add rax, rbx");
-                    break;
-                case TOKEN_MINUS:
-                    emit_instruction(ctx, "  sub rax, rbx");
-                    break;
-                case TOKEN_STAR:
-                    emit_instruction(ctx, "  imul rax, rbx");
-                    break;
-                case TOKEN_SLASH:
-                    emit_instruction(ctx, "  cqo");
-                    emit_instruction(ctx, "  idiv rbx");
-                    break;
-                default:
-                    panic("Unsupported binary operator");
+        default:
+            emit_instruction(ctx, "  setae al");
+            break;
+    }
+    emit_instruction(ctx, "  movzx eax, al");
+    x86_store(x86, instr->dest, "rax");
+}
+
+static void x86_instr(X86Function* x86, const IrBlock* block, const IrInstr* instr, const IrInstr* following,
+                      const IrBlock* next) {
+    CodeGenContext* ctx = x86->ctx;
+    switch (instr->op) {
+        case IR_CONST:
+            if (instr->imm >= INT32_MIN && instr->imm <= INT32_MAX) {
+                emit_instruction(ctx, "  mov qword [rbp - %u], %lld", 8 * instr->dest, (long long)instr->imm);
+            } else {
+                emit_instruction(ctx, "  mov rax, %lld", (long long)instr->imm);
+                x86_store(x86, instr->dest, "rax");
             }
             break;
+        case IR_FCONST: {
+            uint64_t bits;
+            memcpy(&bits, &instr->fimm, sizeof(bits));
+            emit_instruction(ctx, "  mov rax, 0x%016llx", (unsigned long long)bits);
+            x86_store(x86, instr->dest, "rax");
+            break;
+        }
+        case IR_STRING:
+            emit_instruction(ctx, "  lea rax, [rel str_%lld]", (long long)instr->imm);
+            x86_store(x86, instr->dest, "rax");
+            break;
+        case IR_PARAM:
+            x86_param(x86, instr);
+            break;
+        case IR_ENV:
+            x86_store(x86, instr->dest, "rdi");
+            break;
+        case IR_GLOBAL:
+            emit_instruction(ctx, "  lea rax, [rel ferrum_globals + %lld]", 8 * (long long)instr->imm);
+            x86_store(x86, instr->dest, "rax");
+            break;
+        case IR_FUNC:
+            emit_instruction(ctx, "  lea rax, [rel %s_closure]", x86_callee(x86, instr->imm)->name);
+            x86_store(x86, instr->dest, "rax");
+            break;
 
-        case NODE_CHAN_DECL:
-            // Allocate channel
-            emit_instruction(ctx, "  mov rdi, %d", sizeof(void*));  // element size
-            emit_instruction(ctx, "  mov rsi, %d", ast->chan_decl.capacity ? 16 : 0);  // default capacity
-            emit_instruction(ctx, "  call rt_chan_create");
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL: {
+            const char* op = instr->op == IR_ADD ? "add" : instr->op == IR_SUB ? "sub" : "imul";
+            x86_load(x86, "rax", instr->args[0]);
+            emit_instruction(ctx, "  %s rax, [rbp - %u]", op, 8 * instr->args[1]);
+            x86_store(x86, instr->dest, "rax");
+            break;
+        }
+        case IR_DIV:
+            x86_load(x86, "rax", instr->args[0]);
+            emit_instruction(ctx, "  cqo");
+            emit_instruction(ctx, "  idiv qword [rbp - %u]", 8 * instr->args[1]);
+            x86_store(x86, instr->dest, "rax");
+            break;
+        case IR_NEG:
+        case IR_NOT:
+            x86_load(x86, "rax", instr->args[0]);
+            emit_instruction(ctx, instr->op == IR_NEG ? "  neg rax" : "  xor rax, 1");
+            x86_store(x86, instr->dest, "rax");
             break;
 
-        case NODE_CHAN_SEND_EXPR:
-            // Evaluate value
-            codegen_x86_64(ctx, ast->chan_send_expr.value);
-            emit_instruction(ctx, "  push rax");  // save value
-            // Get channel
-            codegen_x86_64(ctx, ast->chan_send_expr.channel);
-            emit_instruction(ctx, "  mov rdi, rax");  // channel ptr
-            emit_instruction(ctx, "  pop rsi");       // value
-            emit_instruction(ctx, "  call rt_chan_send");
+        case IR_FADD:
+        case IR_FSUB:
+        case IR_FMUL:
+        case IR_FDIV: {
+            static const char* const ops[] = { "addsd", "subsd", "mulsd", "divsd" };
+            emit_instruction(ctx, "  movsd xmm0, [rbp - %u]", 8 * instr->args[0]);
+            emit_instruction(ctx, "  %s xmm0, [rbp - %u]", ops[instr->op - IR_FADD], 8 * instr->args[1]);
+            emit_instruction(ctx, "  movsd [rbp - %u], xmm0", 8 * instr->dest);
+            break;
+        }
+        case IR_FNEG:
+            x86_load(x86, "rax", instr->args[0]);
+            emit_instruction(ctx, "  btc rax, 63");
+            x86_store(x86, instr->dest, "rax");
             break;
 
-        case NODE_CHAN_RECV_EXPR:
-            // Get channel
-            codegen_x86_64(ctx, ast->chan_recv_expr.channel);
-            emit_instruction(ctx, "  mov rdi, rax");  // channel ptr
-            emit_instruction(ctx, "  sub rsp, 8");    // space for result
-            emit_instruction(ctx, "  mov rsi, rsp");  // result ptr
-            emit_instruction(ctx, "  call rt_chan_recv");
-            emit_instruction(ctx, "  pop rax");       // get result
+        case IR_EQ:
+        case IR_NE:
+        case IR_LT:
+        case IR_LE:
+        case IR_GT:
+        case IR_GE:
+            x86_compare(x86, instr, following, x86_conditions[instr->op - IR_EQ]);
+            break;
+        case IR_FEQ:
+        case IR_FNE:
+        case IR_FLT:
+        case IR_FLE:
+        case IR_FGT:
+        case IR_FGE:
+            x86_float_compare(x86, instr);
             break;
 
-        case NODE_GO_STMT:
-            // Get function address
-            emit_instruction(ctx, "  lea rdi, [rip + %s]", "function_label");  // TODO: proper function labels
-            emit_instruction(ctx, "  mov rsi, 0");    // no arguments for now
-            emit_instruction(ctx, "  call rt_go");
+        case IR_PHI:
+            // Written by the predecessors (x86_edge)
+            break;
+        case IR_LOAD:
+            x86_load(x86, "rax", instr->args[0]);
+            emit_instruction(ctx, "  mov rax, [rax + %lld]", (long long)instr->imm);
+            x86_store(x86, instr->dest, "rax");
+            break;
+        case IR_STORE:
+            x86_load(x86, "rax", instr->args[0]);
+            x86_load(x86, "rcx", instr->args[1]);
+            emit_instruction(ctx, "  mov [rax + %lld], rcx", (long long)instr->imm);
+            break;
+        case IR_CALL:
+        case IR_CALLI:
+            x86_call(x86, instr);
+            break;
+        case IR_CLOSURE:
+            x86_closure(x86, instr);
             break;
 
-        case NODE_SELECT_STMT:
-            // TODO: Implement select statement
-            panic("Select statement not yet implemented");
+        case IR_JUMP:
+            x86_edge(x86, block, instr->targets[0]);
+            if (instr->targets[0] != next) emit_instruction(ctx, "  jmp .b%u", instr->targets[0]->id);
+            break;
+        case IR_BRANCH: {
+            const IrBlock* if_true = instr->targets[0];
+            const IrBlock* if_false = instr->targets[1];
+            const char* condition = x86->flags;
+            x86->flags = NULL;
+            if (!condition) {
+                emit_instruction(ctx, "  cmp qword [rbp - %u], 0", 8 * instr->args[0]);
+                condition = "ne";
+            }
+            if (x86_phi_count(if_true) == 0 && x86_phi_count(if_false) == 0) {
+                if (if_false == next) {
+                    emit_instruction(ctx, "  j%s .b%u", condition, if_true->id);
+                } else if (if_true == next) {
+                    emit_instruction(ctx, "  j%s .b%u", x86_negate(condition), if_false->id);
+                } else {
+                    emit_instruction(ctx, "  j%s .b%u", condition, if_true->id);
+                    emit_instruction(ctx, "  jmp .b%u", if_false->id);
+                }
+                break;
+            }
+            // Each edge makes its own phi copies
+            emit_instruction(ctx, "  j%s .e%u", x86_negate(condition), block->id);
+            x86_edge(x86, block, if_true);
+            emit_instruction(ctx, "  jmp .b%u", if_true->id);
+            emit_instruction(ctx, ".e%u:", block->id);
+            x86_edge(x86, block, if_false);
+            if (if_false != next) emit_instruction(ctx, "  jmp .b%u", if_false->id);
+            break;
+        }
+        case IR_RET:
+            if (instr->arg_count > 0) {
+                if (x86_is_float(x86, instr->args[0])) {
+                    emit_instruction(ctx, "  movsd xmm0, [rbp - %u]", 8 * instr->args[0]);
+                } else {
+                    x86_load(x86, "rax", instr->args[0]);
+                }
+            }
+            emit_function_epilogue(ctx);
             break;
-            
         default:
-            panic("Unsupported AST node type for codegen");
+            panic("Unsupported IR instruction for codegen: %s", ir_op_name((IrOp)instr->op));
     }
 }
 
-bool codegen_generate(CodeGenContext* ctx, ASTNode* ast, const char* output_path) {
-    if (!ast) return false;
+static void x86_function(CodeGenContext* ctx, const IrModule* module, const IrFunction* function) {
+    X86Function x86 = {
+        .ctx = ctx,
+        .module = module,
+        .function = function,
+        .int_params = 1,        // rdi holds the closure
+    };
+
+    if (ctx->optimize) {
+        x86.uses = f_calloc(function->values.count, sizeof(uint32_t));
+        IrBlock** blocks = function->blocks.items;
+        for (usize i = 0; i < function->blocks.count; i++) {
+            const IrInstr* instrs = blocks[i]->instrs.items;
+            for (usize j = 0; j < blocks[i]->instrs.count; j++) {
+                for (uint32_t k = 0; k < instrs[j].arg_count; k++) x86.uses[instrs[j].args[k]]++;
+            }
+        }
+    }
+
+    // Slots for registers 1 to count - 1, keeping rsp 16-byte aligned
+    uint32_t frame_size = (uint32_t)((8 * function->values.count + 15) & ~(usize)15);
+    emit_function_prologue(ctx, function->name);
+    emit_instruction(ctx, "  sub rsp, %u", frame_size);
+
+    IrBlock** blocks = function->blocks.items;
+    for (usize i = 0; i < function->blocks.count; i++) {
+        const IrBlock* block = blocks[i];
+        const IrBlock* next = i + 1 < function->blocks.count ? blocks[i + 1] : NULL;
+        emit_instruction(ctx, ".b%u:", block->id);
+
+        const IrInstr* instrs = block->instrs.items;
+        for (usize j = 0; j < block->instrs.count; j++) {
+            const IrInstr* following = j + 1 < block->instrs.count ? &instrs[j + 1] : NULL;
+            x86_instr(&x86, block, &instrs[j], following, next);
+        }
+    }
+    f_free(x86.uses);
+}
+
+void codegen_x86_64(CodeGenContext* ctx, const IrModule* module) {
+    IrFunction** functions = module->functions.items;
+
+    emit_instruction(ctx, "extern malloc");
+    for (usize i = 0; i < module->functions.count; i++) {
+        if (functions[i]->external) emit_instruction(ctx, "extern %s", functions[i]->name);
+    }
+
+    emit_text_section(ctx);
+    for (usize i = 0; i < module->functions.count; i++) {
+        if (!functions[i]->external) x86_function(ctx, module, functions[i]);
+    }
+
+    // Static closures of the functions, which capture nothing; the
+    // top-level code is only called from C
+    emit_instruction(ctx, "section .data");
+    for (usize i = 1; i < module->functions.count; i++) {
+        if (!functions[i]->external) emit_instruction(ctx, "%s_closure: dq %s", functions[i]->name, functions[i]->name);
+    }
+
+    const char** strings = module->strings.items;
+    for (usize i = 0; i < module->strings.count; i++) {
+        char label[32];
+        snprintf(label, sizeof(label), "str_%zu", i);
+        emit_data_section(ctx, label, strings[i], strlen(strings[i]) + 1);
+    }
+
+    if (module->global_count > 0) {
+        emit_instruction(ctx, "section .bss");
+        emit_instruction(ctx, "ferrum_globals: resq %u", module->global_count);
+    }
+}
+
+bool codegen_generate(CodeGenContext* ctx, const IrModule* module, const char* output_path) {
+    if (!module) return false;
+    
+    // Output reaches the file as it is generated (see emit_instruction)
+    if (!sys_output_open(&ctx->output, output_path)) {
+        panic("Cannot open output file: %s", output_path);
+        return false;
+    }
     
     emit_text_section(ctx);
-    emit_runtime_support(ctx);
     
     switch (ctx->arch) {
         case TARGET_X86_64:
-            codegen_x86_64(ctx, ast);
+            codegen_x86_64(ctx, module);
             break;
         case TARGET_ARM64:
         case TARGET_WASM:
@@ -236,15 +535,5 @@ bool codegen_generate(CodeGenContext* ctx, ASTNode* ast, const char* output_path
             return false;
     }
     
-    // Write output to file
-    FILE* out = fopen(output_path, "wb");
-    if (!out) {
-        panic("Cannot open output file: %s", output_path);
-        return false;
-    }
-    
-    fwrite(ctx->output.data, 1, ctx->output.length, out);
-    fclose(out);
-    
-    return true;
+    return sys_output_close(&ctx->output);
 }
\ No newline at end of file
@@ -5,34 +5,6 @@
 #include <stdarg.h>
 
 // Bellek yönetimi
-void* f_malloc(usize size) {
-    void* ptr = malloc(size);
-    if (!ptr && size != 0) {
-        panic("Memory allocation failed for size: %zu", size);
-    }
-    return ptr;
-}
-
-void* f_calloc(usize count, usize size) {
-    void* ptr = calloc(count, size);
-    if (!ptr && count != 0 && size != 0) {
-        panic("Memory allocation failed for count: %zu, size: %zu", count, size);
-    }
-    return ptr;
-}
-
-void* f_realloc(void* ptr, usize size) {
-    void* new_ptr = realloc(ptr, size);
-    if (!new_ptr && size != 0) {
-        panic("Memory reallocation failed for size: %zu", size);
-    }
-    return new_ptr;
-}
-
-void f_free(void* ptr) {
-    free(ptr);
-}
-
 void f_memcpy(void* dest, const void* src, usize size) {
     if (size > 0) {
         memcpy(dest, src, size);
@@ -64,6 +36,8 @@ void debug_log(const char* fmt, ...) {
     vfprintf(stderr, fmt, args);
     fprintf(stderr, "\n");
     va_end(args);
+#else
+    (void)fmt;
 #endif
 }
 
@@ -88,6 +62,190 @@ bool f_streq(const char* a, const char* b) {
     return strcmp(a, b) == 0;
 }
 
+// Arena implementasyonu
+static ArenaChunk* arena_new_chunk(usize capacity) {
+    // Header and data in one block; data starts cache-line aligned
+    ArenaChunk* chunk = f_malloc(sizeof(ArenaChunk) + capacity + 64);
+    uintptr_t data = ((uintptr_t)(chunk + 1) + 63) & ~(uintptr_t)63;
+    chunk->data = (u8*)data;
+    chunk->used = 0;
+    chunk->capacity = capacity;
+    chunk->next = NULL;
+    return chunk;
+}
+
+void arena_init(Arena* arena, usize chunk_size) {
+    arena->chunks = NULL;
+    arena->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK_SIZE;
+    arena->allocated = 0;
+    arena->released = 0;
+    arena->peak = 0;
+    arena->allocations = 0;
+}
+
+// Folds the current allocation count into the lifetime statistics
+static void arena_retire(Arena* arena) {
+    if (arena->allocated > arena->peak) arena->peak = arena->allocated;
+    arena->released += arena->allocated;
+    arena->allocated = 0;
+}
+
+void arena_free(Arena* arena) {
+    if (!arena) return;
+    
+    ArenaChunk* chunk = arena->chunks;
+    while (chunk) {
+        ArenaChunk* next = chunk->next;
+        f_free(chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+    arena_retire(arena);
+}
+
+// Keeps the first regular chunk for reuse and frees the rest
+void arena_reset(Arena* arena) {
+    ArenaChunk* keep = NULL;
+    ArenaChunk* chunk = arena->chunks;
+    while (chunk) {
+        ArenaChunk* next = chunk->next;
+        if (!keep && chunk->capacity == arena->chunk_size) {
+            keep = chunk;
+            keep->next = NULL;
+            keep->used = 0;
+        } else {
+            f_free(chunk);
+        }
+        chunk = next;
+    }
+    arena->chunks = keep;
+    arena_retire(arena);
+}
+
+// Moves every chunk of 'from' into 'into' (e.g. a worker thread's arena into
+// the caller's), so one arena_free releases both; 'from' is left empty.
+// The current chunk of 'into' stays first and keeps serving allocations.
+void arena_adopt(Arena* into, Arena* from) {
+    if (!from->chunks) return;
+    
+    ArenaChunk* last = from->chunks;
+    while (last->next) last = last->next;
+    
+    if (into->chunks) {
+        last->next = into->chunks->next;
+        into->chunks->next = from->chunks;
+    } else {
+        into->chunks = from->chunks;
+    }
+    
+    into->allocated += from->allocated;
+    into->allocations += from->allocations;
+    from->chunks = NULL;
+    from->allocated = 0;
+    from->allocations = 0;
+}
+
+// 'alignment' must be a power of two, at most 64
+void* arena_alloc_aligned(Arena* arena, usize size, usize alignment) {
+    ArenaChunk* chunk = arena->chunks;
+    if (chunk) {
+        usize offset = (chunk->used + alignment - 1) & ~(alignment - 1);
+        if (offset + size <= chunk->capacity) {
+            chunk->used = offset + size;
+            arena->allocated += size;
+            arena->allocations++;
+            return chunk->data + offset;
+        }
+    }
+    
+    // Oversized requests get a chunk of their own behind the current one,
+    // so the current chunk keeps filling up
+    if (size > arena->chunk_size / 4) {
+        ArenaChunk* large = arena_new_chunk(size);
+        large->used = size;
+        if (chunk) {
+            large->next = chunk->next;
+            chunk->next = large;
+        } else {
+            arena->chunks = large;
+        }
+        arena->allocated += size;
+        arena->allocations++;
+        return large->data;
+    }
+    
+    ArenaChunk* fresh = arena_new_chunk(arena->chunk_size);
+    fresh->next = chunk;
+    fresh->used = size;
+    arena->chunks = fresh;
+    arena->allocated += size;
+    arena->allocations++;
+    return fresh->data;
+}
+
+void* arena_alloc(Arena* arena, usize size) {
+    return arena_alloc_aligned(arena, size, ARENA_DEFAULT_ALIGNMENT);
+}
+
+void* arena_calloc(Arena* arena, usize count, usize size) {
+    void* ptr = arena_alloc(arena, count * size);
+    memset(ptr, 0, count * size);
+    return ptr;
+}
+
+// Hashing
+static inline u64 hash_mix(u64 hash, u64 word) {
+    hash ^= word;
+    hash *= 0xff51afd7ed558ccdull;
+    return hash ^ (hash >> 33);
+}
+
+u64 hash_bytes(const void* data, usize length, u64 seed) {
+    const u8* bytes = (const u8*)data;
+    u64 hash = hash_mix(seed, (u64)length);
+    usize i = 0;
+
+    for (; i + 8 <= length; i += 8) {
+        u64 word;
+        memcpy(&word, bytes + i, 8);
+        hash = hash_mix(hash, word);
+    }
+    if (i < length) {
+        u64 word = 0;
+        memcpy(&word, bytes + i, length - i);
+        hash = hash_mix(hash, word);
+    }
+    return hash_mix(hash, 0x9e3779b97f4a7c15ull);
+}
+
+// Hash map support
+_Alignas(HASH_GROUP_WIDTH) const u8 hash_empty_group[HASH_GROUP_WIDTH] = {
+    HASH_EMPTY, HASH_EMPTY, HASH_EMPTY, HASH_EMPTY, HASH_EMPTY, HASH_EMPTY, HASH_EMPTY, HASH_EMPTY,
+    HASH_EMPTY, HASH_EMPTY, HASH_EMPTY, HASH_EMPTY, HASH_EMPTY, HASH_EMPTY, HASH_EMPTY, HASH_EMPTY
+};
+
+u32 hash_capacity_for(u32 count) {
+    u32 capacity = HASH_GROUP_WIDTH;
+    while (HASH_MAX_LOAD(capacity) < count) {
+        if (capacity > UINT32_MAX / 2) panic("Hash map too large for %u entries", count);
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+// Control bytes come first, so tables must be group aligned; both the arena
+// and f_malloc align to 16
+void* hash_table_alloc(Arena* arena, usize size) {
+    return arena ? arena_alloc(arena, size) : f_malloc(size);
+}
+
+void hash_table_release(Arena* arena, void* table) {
+    if (!arena) f_free(table);
+}
+
+FERRUM_HASH_MAP_IMPL(U32Map, u32_map, u32, u32, hash_u32, u32_key_equal)
+FERRUM_HASH_MAP_IMPL(StringMap, string_map, StringKey, u32, string_key_hash, string_key_equal)
+
 // ByteBuffer implementasyonu
 ByteBuffer byte_buffer_new(usize initial_capacity) {
     ByteBuffer buf = {0};
@@ -116,7 +274,7 @@ void byte_buffer_append(ByteBuffer* buf, const void* data, usize size) {
             new_capacity = buf->length + size;
         }
         
-        u8* new_data = f_realloc(buf->data, new_capacity);
+        u8* new_data = f_realloc(buf->data, buf->capacity, new_capacity);
         if (!new_data) {
             panic("Failed to expand ByteBuffer to %zu bytes", new_capacity);
         }
@@ -144,9 +302,21 @@ DynamicArray da_new(usize item_size, usize initial_capacity) {
     return arr;
 }
 
+// Array whose storage comes from 'arena'; growing abandons the old block
+DynamicArray da_new_in(Arena* arena, usize item_size, usize initial_capacity) {
+    DynamicArray arr = {0};
+    arr.item_size = item_size;
+    arr.arena = arena;
+    if (initial_capacity > 0) {
+        arr.items = arena_alloc(arena, item_size * initial_capacity);
+        arr.capacity = initial_capacity;
+    }
+    return arr;
+}
+
 void da_free(DynamicArray* arr) {
     if (arr) {
-        f_free(arr->items);
+        if (!arr->arena) f_free(arr->items);
         arr->items = NULL;
         arr->count = 0;
         arr->capacity = 0;
@@ -158,7 +328,13 @@ void da_append(DynamicArray* arr, const void* item) {
     
     if (arr->count >= arr->capacity) {
         usize new_capacity = arr->capacity == 0 ? 4 : arr->capacity * 2;
-        void* new_items = f_realloc(arr->items, arr->item_size * new_capacity);
+        void* new_items;
+        if (arr->arena) {
+            new_items = arena_alloc(arr->arena, arr->item_size * new_capacity);
+            if (arr->count > 0) memcpy(new_items, arr->items, arr->item_size * arr->count);
+        } else {
+            new_items = f_realloc(arr->items, arr->item_size * arr->capacity, arr->item_size * new_capacity);
+        }
         if (!new_items) {
             panic("Failed to expand DynamicArray to %zu elements", new_capacity);
         }
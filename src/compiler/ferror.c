@@ -38,6 +38,78 @@ Error error_create(ErrorType type, const char* msg, uint32_t line, uint32_t col,
     return err;
 }
 
+// Konumu byte offset olarak alır; satır/sütun ancak hata oluştuğunda hesaplanır
+Error error_create_at(ErrorType type, const char* msg, LineMap* lines, uint32_t offset, const char* filename, bool fatal) {
+    uint32_t line;
+    uint32_t col;
+    line_map_resolve(lines, offset, &line, &col);
+    return error_create(type, msg, line, col, filename, fatal);
+}
+
+typedef struct {
+    char data[512];
+    usize length;       // Her zaman sizeof(data) - 1'den küçük veya eşit
+} DiagnosticText;
+
+// snprintf kısaltınca yazmak istediği uzunluğu döndürür; uzunluk tampona
+// sığacak şekilde kırpılır
+static void diagnostic_vappend(DiagnosticText* text, const char* format, va_list args) {
+    usize room = sizeof(text->data) - text->length;
+    int written = vsnprintf(text->data + text->length, room, format, args);
+    if (written < 0) return;
+    text->length += (usize)written < room ? (usize)written : room - 1;
+}
+
+static void diagnostic_append(DiagnosticText* text, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    diagnostic_vappend(text, format, args);
+    va_end(args);
+}
+
+void diagnostic_vreport(ByteBuffer* out, const char* filename, LineMap* lines, uint32_t offset,
+                        const char* near, int near_length, const char* format, va_list args) {
+    DiagnosticText text;
+    text.length = 0;
+    text.data[0] = '\0';
+
+    if (lines && lines->source) {
+        uint32_t line;
+        uint32_t col;
+        line_map_resolve(lines, offset, &line, &col);
+        diagnostic_append(&text, "[%s:%u:%u] Error", filename, line, col);
+    } else {
+        diagnostic_append(&text, "[%s] Error", filename);
+    }
+
+    if (near && near_length == 0) {
+        diagnostic_append(&text, " at end");
+    } else if (near) {
+        diagnostic_append(&text, " at '%.*s'", near_length, near);
+    }
+    diagnostic_append(&text, ": ");
+    diagnostic_vappend(&text, format, args);
+
+    // Satır sonu, mesaj kısaltılmış olsa bile yazılır
+    if (text.length > sizeof(text.data) - 2) text.length = sizeof(text.data) - 2;
+    text.data[text.length++] = '\n';
+    text.data[text.length] = '\0';
+
+    if (out) {
+        byte_buffer_append(out, text.data, text.length);
+    } else {
+        fputs(text.data, stderr);
+    }
+}
+
+void diagnostic_report(ByteBuffer* out, const char* filename, LineMap* lines, uint32_t offset,
+                       const char* near, int near_length, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    diagnostic_vreport(out, filename, lines, offset, near, near_length, format, args);
+    va_end(args);
+}
+
 Error error_lexer(const char* msg, uint32_t line, uint32_t col, const char* filename) {
     had_error = true;
     return error_create(ERR_LEXER, msg, line, col, filename, false);
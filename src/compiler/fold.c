@@ -0,0 +1,603 @@
+#include "../../include/fold.h"
+#include "../../include/types.h"
+#include "../../include/runtime/memory.h"
+#include <math.h>
+#include <string.h>
+
+// Known values of the variables of one function, mirroring its frame the
+// way the type checker does
+typedef struct FoldScope {
+    struct FoldScope* enclosing;
+    ASTNode** slots;            // Frame slot -> literal value, NULL if not constant
+    ASTNode** upvalues;
+} FoldScope;
+
+typedef struct {
+    FoldScope* scope;
+    FoldScope script;
+    ASTNode** globals;          // Global ID -> literal value
+    FoldStats stats;
+} Folder;
+
+static void fold_node(Folder* folder, ASTNode** slot);
+
+static bool is_literal(const ASTNode* node) {
+    if (!node) return false;
+    switch (node->type) {
+        case NODE_INT_LITERAL:
+        case NODE_FLOAT_LITERAL:
+        case NODE_STRING_LITERAL:
+        case NODE_BOOL_LITERAL:
+        case NODE_CHAR_LITERAL:
+        case NODE_NIL_LITERAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Whether evaluating 'node' can be skipped: it has no side effects and
+// cannot trap
+static bool is_pure(const ASTNode* node) {
+    if (!node) return true;
+    switch (node->type) {
+        case NODE_IDENTIFIER:
+            return true;
+        case NODE_UNARY_EXPR:
+            return is_pure(node->unary_expr.operand);
+        case NODE_LOGICAL_EXPR:
+            return is_pure(node->logical_expr.left) && is_pure(node->logical_expr.right);
+        case NODE_BINARY_EXPR: {
+            const ASTNode* right = node->binary_expr.right;
+            if (node->binary_expr.op.type == TOKEN_SLASH && node->value_type != TYPE_FLOAT &&
+                !(right->type == NODE_INT_LITERAL && right->int_value != 0 && right->int_value != -1)) {
+                return false;
+            }
+            return is_pure(node->binary_expr.left) && is_pure(right);
+        }
+        default:
+            return is_literal(node);
+    }
+}
+
+// Frees a subtree that is no longer referenced; arena trees go all at once
+static void discard(ASTNode* node) {
+    if (!ast_get_arena()) ast_free_node(node);
+}
+
+static void replace(ASTNode** slot, ASTNode* with, uint32_t* counter) {
+    ASTNode* old = *slot;
+    *slot = with;
+    discard(old);
+    (*counter)++;
+}
+
+static ASTNode* new_literal(NodeType type, uint32_t offset, TypeId value_type) {
+    ASTNode* node = ast_new_node(type, offset);
+    node->value_type = value_type;
+    return node;
+}
+
+static ASTNode* new_int(uint32_t offset, int64_t value) {
+    ASTNode* node = new_literal(NODE_INT_LITERAL, offset, TYPE_INT);
+    node->int_value = value;
+    return node;
+}
+
+static ASTNode* new_float(uint32_t offset, double value) {
+    ASTNode* node = new_literal(NODE_FLOAT_LITERAL, offset, TYPE_FLOAT);
+    node->float_value = value;
+    return node;
+}
+
+static ASTNode* new_bool(uint32_t offset, bool value) {
+    ASTNode* node = new_literal(NODE_BOOL_LITERAL, offset, TYPE_BOOL);
+    node->bool_value = value;
+    return node;
+}
+
+static ASTNode* new_string(uint32_t offset, const char* left, usize left_length, const char* right, usize right_length) {
+    ASTNode* node = new_literal(NODE_STRING_LITERAL, offset, TYPE_STRING);
+    char* text = ast_alloc(left_length + right_length + 1);
+    memcpy(text, left, left_length);
+    memcpy(text + left_length, right, right_length);
+    text[left_length + right_length] = '\0';
+    node->string_value = text;
+    return node;
+}
+
+// A private copy, so no literal node is reachable twice in a heap tree
+static ASTNode* copy_literal(const ASTNode* value, uint32_t offset) {
+    if (value->type == NODE_STRING_LITERAL) {
+        return new_string(offset, value->string_value, strlen(value->string_value), "", 0);
+    }
+    ASTNode* node = ast_alloc(sizeof(ASTNode));
+    *node = *value;
+    node->offset = offset;
+    node->hash = 0;
+    return node;
+}
+
+// Arithmetic as the generated code does it
+static int64_t wrap_add(int64_t a, int64_t b) { return (int64_t)((uint64_t)a + (uint64_t)b); }
+static int64_t wrap_sub(int64_t a, int64_t b) { return (int64_t)((uint64_t)a - (uint64_t)b); }
+static int64_t wrap_mul(int64_t a, int64_t b) { return (int64_t)((uint64_t)a * (uint64_t)b); }
+
+// Result of 'left op right' for two literals, or NULL to leave it to run time
+static ASTNode* eval_binary(TokenType op, const ASTNode* left, const ASTNode* right, uint32_t offset) {
+    if (left->type != right->type) return NULL;
+
+    switch (left->type) {
+        case NODE_INT_LITERAL: {
+            int64_t a = left->int_value;
+            int64_t b = right->int_value;
+            switch (op) {
+                case TOKEN_PLUS:    return new_int(offset, wrap_add(a, b));
+                case TOKEN_MINUS:   return new_int(offset, wrap_sub(a, b));
+                case TOKEN_STAR:    return new_int(offset, wrap_mul(a, b));
+                case TOKEN_SLASH:
+                    if (b == 0 || (a == INT64_MIN && b == -1)) return NULL;
+                    return new_int(offset, a / b);
+                case TOKEN_EQEQ:    return new_bool(offset, a == b);
+                case TOKEN_BANG_EQ: return new_bool(offset, a != b);
+                case TOKEN_GT:      return new_bool(offset, a > b);
+                case TOKEN_GTEQ:    return new_bool(offset, a >= b);
+                case TOKEN_LTEQ:    return new_bool(offset, a <= b);
+                default:            return NULL;
+            }
+        }
+
+        case NODE_FLOAT_LITERAL: {
+            double a = left->float_value;
+            double b = right->float_value;
+            switch (op) {
+                case TOKEN_PLUS:    return new_float(offset, a + b);
+                case TOKEN_MINUS:   return new_float(offset, a - b);
+                case TOKEN_STAR:    return new_float(offset, a * b);
+                case TOKEN_SLASH:   return new_float(offset, a / b);
+                case TOKEN_EQEQ:    return new_bool(offset, a == b);
+                case TOKEN_BANG_EQ: return new_bool(offset, a != b);
+                case TOKEN_GT:      return new_bool(offset, a > b);
+                case TOKEN_GTEQ:    return new_bool(offset, a >= b);
+                case TOKEN_LTEQ:    return new_bool(offset, a <= b);
+                default:            return NULL;
+            }
+        }
+
+        case NODE_STRING_LITERAL: {
+            const char* a = left->string_value;
+            const char* b = right->string_value;
+            switch (op) {
+                case TOKEN_PLUS:    return new_string(offset, a, strlen(a), b, strlen(b));
+                case TOKEN_EQEQ:    return new_bool(offset, strcmp(a, b) == 0);
+                case TOKEN_BANG_EQ: return new_bool(offset, strcmp(a, b) != 0);
+                case TOKEN_GT:      return new_bool(offset, strcmp(a, b) > 0);
+                case TOKEN_GTEQ:    return new_bool(offset, strcmp(a, b) >= 0);
+                case TOKEN_LTEQ:    return new_bool(offset, strcmp(a, b) <= 0);
+                default:            return NULL;
+            }
+        }
+
+        case NODE_CHAR_LITERAL: {
+            unsigned char a = (unsigned char)left->char_value;
+            unsigned char b = (unsigned char)right->char_value;
+            switch (op) {
+                case TOKEN_EQEQ:    return new_bool(offset, a == b);
+                case TOKEN_BANG_EQ: return new_bool(offset, a != b);
+                case TOKEN_GT:      return new_bool(offset, a > b);
+                case TOKEN_GTEQ:    return new_bool(offset, a >= b);
+                case TOKEN_LTEQ:    return new_bool(offset, a <= b);
+                default:            return NULL;
+            }
+        }
+
+        case NODE_BOOL_LITERAL:
+            switch (op) {
+                case TOKEN_EQEQ:    return new_bool(offset, left->bool_value == right->bool_value);
+                case TOKEN_BANG_EQ: return new_bool(offset, left->bool_value != right->bool_value);
+                default:            return NULL;
+            }
+
+        case NODE_NIL_LITERAL:
+            switch (op) {
+                case TOKEN_EQEQ:    return new_bool(offset, true);
+                case TOKEN_BANG_EQ: return new_bool(offset, false);
+                default:            return NULL;
+            }
+
+        default:
+            return NULL;
+    }
+}
+
+static bool is_number(const ASTNode* node, double value) {
+    if (node->type == NODE_INT_LITERAL) return node->int_value == (int64_t)value;
+    if (node->type == NODE_FLOAT_LITERAL) return node->float_value == value && !signbit(node->float_value);
+    return false;
+}
+
+// Replaces the operation in 'slot' with one of its operands, which is
+// detached first so discarding the operation leaves it alone
+static void keep_operand(Folder* folder, ASTNode** slot, ASTNode** operand) {
+    ASTNode* kept = *operand;
+    *operand = NULL;
+    replace(slot, kept, &folder->stats.simplified);
+}
+
+static void fold_binary(Folder* folder, ASTNode** slot) {
+    ASTNode* node = *slot;
+    BinaryExpr* binary = &node->binary_expr;
+    fold_node(folder, &binary->left);
+    fold_node(folder, &binary->right);
+
+    ASTNode* left = binary->left;
+    ASTNode* right = binary->right;
+    if (!left || !right) return;
+
+    if (is_literal(left) && is_literal(right)) {
+        ASTNode* result = eval_binary(binary->op.type, left, right, node->offset);
+        if (result) replace(slot, result, &folder->stats.folded);
+        return;
+    }
+
+    // x + 0 and x * 0 do not hold for floats (-0.0 + 0 is 0.0, NaN * 0 is NaN)
+    bool integer = node->value_type == TYPE_INT;
+    switch (binary->op.type) {
+        case TOKEN_PLUS:
+            if (!integer) break;
+            if (is_number(right, 0)) {
+                keep_operand(folder, slot, &binary->left);
+            } else if (is_number(left, 0)) {
+                keep_operand(folder, slot, &binary->right);
+            }
+            break;
+
+        case TOKEN_MINUS:
+            if (is_number(right, 0)) keep_operand(folder, slot, &binary->left);
+            break;
+
+        case TOKEN_STAR:
+            if (is_number(right, 1)) {
+                keep_operand(folder, slot, &binary->left);
+            } else if (is_number(left, 1)) {
+                keep_operand(folder, slot, &binary->right);
+            } else if (integer && ((is_number(right, 0) && is_pure(left)) || (is_number(left, 0) && is_pure(right)))) {
+                replace(slot, new_int(node->offset, 0), &folder->stats.simplified);
+            }
+            break;
+
+        case TOKEN_SLASH:
+            if (is_number(right, 1)) keep_operand(folder, slot, &binary->left);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void fold_unary(Folder* folder, ASTNode** slot) {
+    ASTNode* node = *slot;
+    fold_node(folder, &node->unary_expr.operand);
+
+    ASTNode* operand = node->unary_expr.operand;
+    if (!is_literal(operand)) return;
+
+    ASTNode* result = NULL;
+    if (node->unary_expr.op.type == TOKEN_MINUS) {
+        if (operand->type == NODE_INT_LITERAL) {
+            result = new_int(node->offset, wrap_sub(0, operand->int_value));
+        } else if (operand->type == NODE_FLOAT_LITERAL) {
+            result = new_float(node->offset, -operand->float_value);
+        }
+    } else if (node->unary_expr.op.type == TOKEN_BANG && operand->type == NODE_BOOL_LITERAL) {
+        result = new_bool(node->offset, !operand->bool_value);
+    }
+    if (result) replace(slot, result, &folder->stats.folded);
+}
+
+static void fold_logical(Folder* folder, ASTNode** slot) {
+    ASTNode* node = *slot;
+    LogicalExpr* logical = &node->logical_expr;
+    fold_node(folder, &logical->left);
+    fold_node(folder, &logical->right);
+
+    ASTNode* left = logical->left;
+    ASTNode* right = logical->right;
+    if (!left || !right) return;
+    bool is_and = logical->op.type == TOKEN_AMPAMP;
+
+    // A constant left operand either decides the result, and the right one
+    // never runs, or hands the result to the right one
+    if (left->type == NODE_BOOL_LITERAL) {
+        if (left->bool_value == is_and) {
+            keep_operand(folder, slot, &logical->right);
+        } else {
+            replace(slot, new_bool(node->offset, left->bool_value), &folder->stats.folded);
+        }
+        return;
+    }
+
+    // 'x && true' and 'x || false' are x; 'x && false' and 'x || true' are
+    // constant if x can be skipped
+    if (right->type == NODE_BOOL_LITERAL) {
+        if (right->bool_value == is_and) {
+            keep_operand(folder, slot, &logical->left);
+        } else if (is_pure(left)) {
+            replace(slot, new_bool(node->offset, right->bool_value), &folder->stats.simplified);
+        }
+    }
+}
+
+// Variables
+static ASTNode* known_value(Folder* folder, Binding binding) {
+    FoldScope* scope = folder->scope;
+    switch (binding.kind) {
+        case BINDING_LOCAL:
+            return scope->slots[binding.index];
+        case BINDING_UPVALUE:
+            return scope->upvalues[binding.index];
+        case BINDING_GLOBAL:
+            // A function may run before a global's 'let' has, so only the
+            // code that follows the 'let' at top level may rely on it
+            return scope == &folder->script ? folder->globals[binding.index] : NULL;
+        default:
+            return NULL;
+    }
+}
+
+static void set_value(Folder* folder, Binding binding, ASTNode* value) {
+    if (binding.kind == BINDING_LOCAL) {
+        folder->scope->slots[binding.index] = value;
+    } else if (binding.kind == BINDING_GLOBAL) {
+        folder->globals[binding.index] = value;
+    }
+}
+
+static void fold_function(Folder* folder, ASTNode* node) {
+    FrameInfo* frame = node->func_decl.frame;
+    if (!frame) return;
+
+    FoldScope* enclosing = folder->scope;
+    FoldScope scope = {
+        .enclosing = enclosing,
+        .slots = f_calloc(frame->frame_size ? frame->frame_size : 1, sizeof(ASTNode*)),
+        .upvalues = f_calloc(frame->upvalue_count ? frame->upvalue_count : 1, sizeof(ASTNode*)),
+    };
+    for (uint32_t i = 0; i < frame->upvalue_count; i++) {
+        Upvalue upvalue = frame->upvalues[i];
+        scope.upvalues[i] = upvalue.is_local ? enclosing->slots[upvalue.index] : enclosing->upvalues[upvalue.index];
+    }
+
+    folder->scope = &scope;
+    fold_node(folder, &node->func_decl.body);
+    folder->scope = enclosing;
+
+    f_free(scope.slots);
+    f_free(scope.upvalues);
+}
+
+static void fold_list(Folder* folder, NodeList* list) {
+    ASTNode** items = SMALL_VEC_ITEMS(list);
+    for (uint32_t i = 0; i < list->count; i++) {
+        fold_node(folder, &items[i]);
+    }
+}
+
+static void fold_members(Folder* folder, NodeList* members) {
+    for (uint32_t i = 0; i < members->count; i++) {
+        ASTNode* member = SMALL_VEC_AT(members, i);
+        if (member && member->type == NODE_FUNCTION_DECL) {
+            fold_function(folder, member);
+        }
+    }
+}
+
+static void fold_node(Folder* folder, ASTNode** slot) {
+    ASTNode* node = *slot;
+    if (!node) return;
+
+    switch (node->type) {
+        case NODE_IDENTIFIER: {
+            ASTNode* value = known_value(folder, node->ident.binding);
+            if (value) replace(slot, copy_literal(value, node->offset), &folder->stats.propagated);
+            break;
+        }
+
+        case NODE_BINARY_EXPR:
+            fold_binary(folder, slot);
+            break;
+
+        case NODE_UNARY_EXPR:
+            fold_unary(folder, slot);
+            break;
+
+        case NODE_LOGICAL_EXPR:
+            fold_logical(folder, slot);
+            break;
+
+        case NODE_CALL_EXPR:
+            fold_node(folder, &node->call_expr.callee);
+            fold_list(folder, &node->call_expr.args);
+            break;
+
+        case NODE_GET_EXPR:
+            fold_node(folder, &node->get_expr.object);
+            break;
+
+        case NODE_SET_EXPR:
+            fold_node(folder, &node->set_expr.object);
+            fold_node(folder, &node->set_expr.value);
+            break;
+
+        case NODE_ARRAY_EXPR:
+            fold_list(folder, &node->array_expr.elements);
+            break;
+
+        case NODE_INDEX_EXPR:
+            fold_node(folder, &node->index_expr.array);
+            fold_node(folder, &node->index_expr.index);
+            break;
+
+        case NODE_CLOSURE_EXPR:
+            if (node->closure_expr.function && node->closure_expr.function->type == NODE_FUNCTION_DECL) {
+                fold_function(folder, node->closure_expr.function);
+            }
+            break;
+
+        case NODE_ASYNC_EXPR:
+            fold_node(folder, &node->async_expr.expression);
+            break;
+
+        case NODE_AWAIT_EXPR:
+            fold_node(folder, &node->await_expr.expression);
+            break;
+
+        case NODE_CHAN_SEND_EXPR:
+            fold_node(folder, &node->chan_send_expr.channel);
+            fold_node(folder, &node->chan_send_expr.value);
+            break;
+
+        case NODE_CHAN_RECV_EXPR:
+            fold_node(folder, &node->chan_recv_expr.channel);
+            break;
+
+        // Every declaration resets its slot, which may have held a constant
+        // of an earlier block
+        case NODE_VAR_DECL: {
+            VarDecl* decl = &node->var_decl;
+            fold_node(folder, &decl->value);
+            set_value(folder, decl->binding, !decl->is_mutable && is_literal(decl->value) ? decl->value : NULL);
+            break;
+        }
+
+        case NODE_FUNCTION_DECL:
+            if (node->func_decl.frame) set_value(folder, node->func_decl.frame->binding, NULL);
+            fold_function(folder, node);
+            break;
+
+        case NODE_CLASS_DECL:
+            fold_members(folder, &node->class_decl.members);
+            break;
+
+        case NODE_INTERFACE_DECL:
+            fold_members(folder, &node->interface_decl.methods);
+            break;
+
+        case NODE_TRAIT_DECL:
+            fold_members(folder, &node->trait_decl.methods);
+            break;
+
+        case NODE_IMPL_DECL:
+            fold_members(folder, &node->impl_decl.methods);
+            break;
+
+        case NODE_ENUM_DECL:
+            fold_list(folder, &node->enum_decl.values);
+            break;
+
+        case NODE_IMPORT_DECL:
+            set_value(folder, node->import_decl.binding, NULL);
+            break;
+
+        case NODE_EXPORT_DECL:
+            fold_node(folder, &node->export_decl.declaration);
+            break;
+
+        case NODE_CHAN_DECL:
+            fold_node(folder, &node->chan_decl.capacity);
+            set_value(folder, node->chan_decl.binding, NULL);
+            break;
+
+        case NODE_BLOCK_STMT:
+            fold_list(folder, &node->block_stmt.statements);
+            break;
+
+        case NODE_IF_STMT:
+            fold_node(folder, &node->if_stmt.condition);
+            fold_node(folder, &node->if_stmt.then_branch);
+            fold_node(folder, &node->if_stmt.else_branch);
+            break;
+
+        case NODE_WHILE_STMT:
+            fold_node(folder, &node->while_stmt.condition);
+            fold_node(folder, &node->while_stmt.body);
+            break;
+
+        case NODE_FOR_STMT:
+            fold_node(folder, &node->for_stmt.initializer);
+            fold_node(folder, &node->for_stmt.condition);
+            fold_node(folder, &node->for_stmt.increment);
+            fold_node(folder, &node->for_stmt.body);
+            break;
+
+        case NODE_FOREACH_STMT:
+            fold_node(folder, &node->foreach_stmt.iterator);
+            set_value(folder, node->foreach_stmt.var_binding, NULL);
+            fold_node(folder, &node->foreach_stmt.body);
+            break;
+
+        case NODE_RETURN_STMT:
+            fold_node(folder, &node->return_stmt.value);
+            break;
+
+        case NODE_EXPR_STMT:
+            fold_node(folder, &node->expr_stmt.expr);
+            break;
+
+        case NODE_TRY_STMT:
+            fold_node(folder, &node->try_stmt.try_block);
+            fold_list(folder, &node->try_stmt.catch_blocks);
+            fold_node(folder, &node->try_stmt.finally_block);
+            break;
+
+        case NODE_CATCH_CLAUSE:
+            set_value(folder, node->catch_clause.var_binding, NULL);
+            fold_node(folder, &node->catch_clause.body);
+            break;
+
+        case NODE_THROW_STMT:
+            fold_node(folder, &node->throw_stmt.value);
+            break;
+
+        case NODE_MATCH_STMT:
+            fold_node(folder, &node->match_stmt.value);
+            fold_list(folder, &node->match_stmt.cases);
+            fold_node(folder, &node->match_stmt.default_case);
+            break;
+
+        case NODE_DEFER_STMT:
+            fold_node(folder, &node->defer_stmt.statement);
+            break;
+
+        case NODE_GO_STMT:
+            fold_node(folder, &node->go_stmt.expression);
+            break;
+
+        case NODE_SELECT_STMT: {
+            SelectCase** cases = SMALL_VEC_ITEMS(&node->select_stmt.cases);
+            for (uint32_t i = 0; i < node->select_stmt.cases.count; i++) {
+                fold_node(folder, &cases[i]->channel);
+                fold_node(folder, &cases[i]->value);
+                fold_node(folder, &cases[i]->body);
+            }
+            fold_node(folder, &node->select_stmt.default_case);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+void fold_program(ASTNode* root, const Resolver* resolver, FoldStats* stats) {
+    Folder folder = {0};
+    folder.script.slots = f_calloc(resolver->script_frame_size ? resolver->script_frame_size : 1, sizeof(ASTNode*));
+    folder.globals = f_calloc(resolver->global_count ? resolver->global_count : 1, sizeof(ASTNode*));
+    folder.scope = &folder.script;
+
+    fold_node(&folder, &root);
+
+    f_free(folder.script.slots);
+    f_free(folder.globals);
+    if (stats) *stats = folder.stats;
+}
@@ -0,0 +1,176 @@
+#include "../../include/intern.h"
+#include <string.h>
+
+#define INTERN_CHUNK_SIZE (64 * 1024)
+#define INTERN_INITIAL_SLOTS 1024
+#define INTERN_INITIAL_ENTRIES 512
+
+void interner_init(Interner* interner) {
+    interner->slots = f_calloc(INTERN_INITIAL_SLOTS, sizeof(InternSlot));
+    interner->slot_mask = INTERN_INITIAL_SLOTS - 1;
+    interner->entries = f_malloc(INTERN_INITIAL_ENTRIES * sizeof(SymbolEntry));
+    interner->capacity = INTERN_INITIAL_ENTRIES;
+    interner->chunks = NULL;
+    interner->borrow = false;
+
+    // Entry 0 backs SYMBOL_NONE
+    interner->entries[0].text = "";
+    interner->entries[0].length = 0;
+    interner->entries[0].hash = 0;
+    interner->count = 1;
+}
+
+void interner_init_borrowed(Interner* interner) {
+    interner_init(interner);
+    interner->borrow = true;
+}
+
+void interner_free(Interner* interner) {
+    if (!interner) return;
+
+    InternChunk* chunk = interner->chunks;
+    while (chunk) {
+        InternChunk* next = chunk->next;
+        f_free(chunk);
+        chunk = next;
+    }
+
+    f_free(interner->slots);
+    f_free(interner->entries);
+    interner->slots = NULL;
+    interner->entries = NULL;
+    interner->chunks = NULL;
+    interner->count = 0;
+    interner->capacity = 0;
+    interner->slot_mask = 0;
+}
+
+// FNV-1a
+uint32_t intern_hash(const char* text, uint32_t length) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Copies the text into the arena. Strings larger than a chunk get a chunk of
+// their own, linked behind the current one so it keeps filling up.
+static const char* intern_store(Interner* interner, const char* text, uint32_t length) {
+    usize size = (usize)length + 1;
+    InternChunk* chunk = interner->chunks;
+
+    if (!chunk || chunk->capacity - chunk->used < size) {
+        usize capacity = size > INTERN_CHUNK_SIZE ? size : INTERN_CHUNK_SIZE;
+        InternChunk* fresh = f_malloc(sizeof(InternChunk) + capacity);
+        fresh->used = 0;
+        fresh->capacity = capacity;
+
+        if (chunk && capacity != INTERN_CHUNK_SIZE) {
+            fresh->next = chunk->next;
+            chunk->next = fresh;
+        } else {
+            fresh->next = chunk;
+            interner->chunks = fresh;
+        }
+        chunk = fresh;
+    }
+
+    char* copy = chunk->data + chunk->used;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    chunk->used += size;
+    return copy;
+}
+
+static void intern_grow(Interner* interner) {
+    uint32_t slot_count = (interner->slot_mask + 1) * 2;
+    InternSlot* slots = f_calloc(slot_count, sizeof(InternSlot));
+    uint32_t mask = slot_count - 1;
+
+    for (uint32_t i = 0; i <= interner->slot_mask; i++) {
+        InternSlot slot = interner->slots[i];
+        if (slot.symbol == SYMBOL_NONE) continue;
+
+        uint32_t index = slot.hash & mask;
+        while (slots[index].symbol != SYMBOL_NONE) {
+            index = (index + 1) & mask;
+        }
+        slots[index] = slot;
+    }
+
+    f_free(interner->slots);
+    interner->slots = slots;
+    interner->slot_mask = mask;
+}
+
+// Linear probe for 'text'. Returns its slot, or the empty slot where it
+// would be inserted.
+static uint32_t intern_probe(const Interner* interner, const char* text, uint32_t length, uint32_t hash) {
+    uint32_t index = hash & interner->slot_mask;
+    for (;;) {
+        InternSlot slot = interner->slots[index];
+        if (slot.symbol == SYMBOL_NONE) return index;
+
+        if (slot.hash == hash) {
+            const SymbolEntry* entry = &interner->entries[slot.symbol];
+            if (entry->length == length && memcmp(entry->text, text, length) == 0) {
+                return index;
+            }
+        }
+        index = (index + 1) & interner->slot_mask;
+    }
+}
+
+Symbol intern_hashed(Interner* interner, const char* text, uint32_t length, uint32_t hash) {
+    uint32_t index = intern_probe(interner, text, length, hash);
+    if (interner->slots[index].symbol != SYMBOL_NONE) {
+        return interner->slots[index].symbol;
+    }
+
+    // Keep the load factor at or below 1/2
+    if ((interner->count + 1) * 2 > interner->slot_mask + 1) {
+        intern_grow(interner);
+        index = intern_probe(interner, text, length, hash);
+    }
+
+    if (interner->count >= interner->capacity) {
+        uint32_t capacity = interner->capacity * 2;
+        interner->entries = f_realloc(interner->entries,
+                                      interner->capacity * sizeof(SymbolEntry),
+                                      capacity * sizeof(SymbolEntry));
+        interner->capacity = capacity;
+    }
+
+    Symbol symbol = interner->count++;
+    SymbolEntry* entry = &interner->entries[symbol];
+    entry->text = interner->borrow ? text : intern_store(interner, text, length);
+    entry->length = length;
+    entry->hash = hash;
+
+    interner->slots[index].hash = hash;
+    interner->slots[index].symbol = symbol;
+    return symbol;
+}
+
+Symbol intern(Interner* interner, const char* text, uint32_t length) {
+    return intern_hashed(interner, text, length, intern_hash(text, length));
+}
+
+Symbol intern_find(const Interner* interner, const char* text, uint32_t length) {
+    uint32_t index = intern_probe(interner, text, length, intern_hash(text, length));
+    return interner->slots[index].symbol;
+}
+
+const char* symbol_text(const Interner* interner, Symbol symbol) {
+    return interner->entries[symbol].text;
+}
+
+uint32_t symbol_length(const Interner* interner, Symbol symbol) {
+    return interner->entries[symbol].length;
+}
+
+uint32_t symbol_hash(const Interner* interner, Symbol symbol) {
+    return interner->entries[symbol].hash;
+}
@@ -0,0 +1,318 @@
+#include "../../include/ir.h"
+#include <string.h>
+
+#define IR_ARENA_CHUNK_SIZE (256 * 1024)
+
+void ir_module_init(IrModule* module) {
+    arena_init(&module->arena, IR_ARENA_CHUNK_SIZE);
+    module->functions = da_new(sizeof(IrFunction*), 64);
+    module->strings = da_new(sizeof(const char*), 64);
+    string_map_init(&module->externs, NULL);
+    module->global_count = 0;
+}
+
+void ir_module_free(IrModule* module) {
+    da_free(&module->functions);
+    da_free(&module->strings);
+    string_map_free(&module->externs);
+    arena_free(&module->arena);
+}
+
+static const char* ir_copy_name(IrModule* module, const char* text, usize length) {
+    char* copy = arena_alloc(&module->arena, length + 1);
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+IrFunction* ir_function_new(IrModule* module, const char* name, IrType result) {
+    IrFunction* function = arena_calloc(&module->arena, 1, sizeof(IrFunction));
+    function->name = ir_copy_name(module, name, strlen(name));
+    function->index = (uint32_t)module->functions.count;
+    function->result = result;
+    function->params = da_new_in(&module->arena, sizeof(uint8_t), 4);
+    function->blocks = da_new_in(&module->arena, sizeof(IrBlock*), 4);
+    function->values = da_new_in(&module->arena, sizeof(uint8_t), 16);
+
+    uint8_t none = IR_VOID;
+    da_append(&function->values, &none);
+    da_append(&module->functions, &function);
+    return function;
+}
+
+uint32_t ir_extern(IrModule* module, const char* name, IrType result) {
+    StringKey key = { name, (u32)strlen(name) };
+    u32* found = string_map_get(&module->externs, key);
+    if (found) return *found;
+
+    IrFunction* function = ir_function_new(module, name, result);
+    function->external = true;
+    string_map_set(&module->externs, (StringKey){ function->name, key.length }, function->index);
+    return function->index;
+}
+
+uint32_t ir_string(IrModule* module, const char* text, usize length) {
+    const char* copy = ir_copy_name(module, text, length);
+    da_append(&module->strings, &copy);
+    return (uint32_t)module->strings.count - 1;
+}
+
+IrBlock* ir_block_new(IrModule* module) {
+    IrBlock* block = arena_alloc(&module->arena, sizeof(IrBlock));
+    block->id = IR_NONE;
+    block->instrs = da_new_in(&module->arena, sizeof(IrInstr), 8);
+    block->preds = da_new_in(&module->arena, sizeof(IrBlock*), 2);
+    return block;
+}
+
+void ir_block_place(IrFunction* function, IrBlock* block) {
+    block->id = (uint32_t)function->blocks.count;
+    da_append(&function->blocks, &block);
+}
+
+IrInstr* ir_append(IrModule* module, IrFunction* function, IrBlock* block, IrOp op, IrType type,
+                   const IrValue* args, uint32_t count) {
+    IrInstr instr = {
+        .op = (uint8_t)op,
+        .type = (uint8_t)type,
+        .arg_count = count,
+    };
+    if (count > 0) {
+        instr.args = arena_alloc_aligned(&module->arena, count * sizeof(IrValue), _Alignof(IrValue));
+        memcpy(instr.args, args, count * sizeof(IrValue));
+    }
+    if (type != IR_VOID) {
+        uint8_t value_type = (uint8_t)type;
+        instr.dest = (IrValue)function->values.count;
+        da_append(&function->values, &value_type);
+    }
+    da_append(&block->instrs, &instr);
+    return (IrInstr*)block->instrs.items + block->instrs.count - 1;
+}
+
+IrValue ir_param(IrModule* module, IrFunction* function, IrBlock* block, IrType type) {
+    IrInstr* instr = ir_append(module, function, block, IR_PARAM, type, NULL, 0);
+    instr->imm = function->param_count++;
+    uint8_t param_type = (uint8_t)type;
+    da_append(&function->params, &param_type);
+    return instr->dest;
+}
+
+IrValue ir_const(IrModule* module, IrFunction* function, IrBlock* block, IrType type, int64_t value) {
+    IrInstr* instr = ir_append(module, function, block, IR_CONST, type, NULL, 0);
+    instr->imm = value;
+    return instr->dest;
+}
+
+void ir_jump(IrModule* module, IrFunction* function, IrBlock* from, IrBlock* to) {
+    IrInstr* instr = ir_append(module, function, from, IR_JUMP, IR_VOID, NULL, 0);
+    instr->targets[0] = to;
+    da_append(&to->preds, &from);
+}
+
+void ir_branch(IrModule* module, IrFunction* function, IrBlock* from, IrValue condition,
+               IrBlock* if_true, IrBlock* if_false) {
+    // One edge per predecessor, so each phi operand has a single edge
+    if (if_true == if_false) {
+        ir_jump(module, function, from, if_true);
+        return;
+    }
+    IrInstr* instr = ir_append(module, function, from, IR_BRANCH, IR_VOID, &condition, 1);
+    instr->targets[0] = if_true;
+    instr->targets[1] = if_false;
+    da_append(&if_true->preds, &from);
+    da_append(&if_false->preds, &from);
+}
+
+void ir_ret(IrModule* module, IrFunction* function, IrBlock* from, IrValue value) {
+    ir_append(module, function, from, IR_RET, IR_VOID, &value, value != IR_NO_VALUE ? 1 : 0);
+}
+
+uint32_t ir_pred_index(const IrBlock* block, const IrBlock* pred) {
+    IrBlock** preds = block->preds.items;
+    for (uint32_t i = 0; i < block->preds.count; i++) {
+        if (preds[i] == pred) return i;
+    }
+    return IR_NONE;
+}
+
+usize ir_instr_count(const IrModule* module) {
+    usize count = 0;
+    IrFunction** functions = module->functions.items;
+    for (usize i = 0; i < module->functions.count; i++) {
+        IrBlock** blocks = functions[i]->blocks.items;
+        for (usize j = 0; j < functions[i]->blocks.count; j++) {
+            count += blocks[j]->instrs.count;
+        }
+    }
+    return count;
+}
+
+// Dumping
+const char* ir_op_name(IrOp op) {
+    static const char* const names[IR_OP_COUNT] = {
+        [IR_CONST] = "const",
+        [IR_FCONST] = "fconst",
+        [IR_STRING] = "string",
+        [IR_PARAM] = "param",
+        [IR_ENV] = "env",
+        [IR_GLOBAL] = "global",
+        [IR_FUNC] = "func",
+        [IR_ADD] = "add",
+        [IR_SUB] = "sub",
+        [IR_MUL] = "mul",
+        [IR_DIV] = "div",
+        [IR_NEG] = "neg",
+        [IR_NOT] = "not",
+        [IR_FADD] = "fadd",
+        [IR_FSUB] = "fsub",
+        [IR_FMUL] = "fmul",
+        [IR_FDIV] = "fdiv",
+        [IR_FNEG] = "fneg",
+        [IR_EQ] = "eq",
+        [IR_NE] = "ne",
+        [IR_LT] = "lt",
+        [IR_LE] = "le",
+        [IR_GT] = "gt",
+        [IR_GE] = "ge",
+        [IR_FEQ] = "feq",
+        [IR_FNE] = "fne",
+        [IR_FLT] = "flt",
+        [IR_FLE] = "fle",
+        [IR_FGT] = "fgt",
+        [IR_FGE] = "fge",
+        [IR_PHI] = "phi",
+        [IR_LOAD] = "load",
+        [IR_STORE] = "store",
+        [IR_CALL] = "call",
+        [IR_CALLI] = "calli",
+        [IR_CLOSURE] = "closure",
+        [IR_JUMP] = "jump",
+        [IR_BRANCH] = "branch",
+        [IR_RET] = "ret",
+    };
+    return op < IR_OP_COUNT && names[op] ? names[op] : "?";
+}
+
+const char* ir_type_name(IrType type) {
+    static const char* const names[IR_TYPE_COUNT] = {
+        [IR_VOID] = "void",
+        [IR_BOOL] = "bool",
+        [IR_INT] = "int",
+        [IR_FLOAT] = "float",
+        [IR_PTR] = "ptr",
+    };
+    return type < IR_TYPE_COUNT ? names[type] : "?";
+}
+
+static void ir_dump_args(const IrInstr* instr, uint32_t first, FILE* out) {
+    for (uint32_t i = first; i < instr->arg_count; i++) {
+        fprintf(out, "%s%%%u", i > first ? ", " : "", instr->args[i]);
+    }
+}
+
+static void ir_dump_instr(const IrInstr* instr, const IrBlock* block, const IrModule* module, FILE* out) {
+    IrFunction** functions = module->functions.items;
+
+    fputs("    ", out);
+    if (instr->dest != IR_NO_VALUE) fprintf(out, "%%%u:%s = ", instr->dest, ir_type_name((IrType)instr->type));
+    fputs(ir_op_name((IrOp)instr->op), out);
+
+    switch (instr->op) {
+        case IR_CONST:
+        case IR_PARAM:
+        case IR_GLOBAL:
+            fprintf(out, " %lld", (long long)instr->imm);
+            break;
+        case IR_FCONST:
+            fprintf(out, " %.17g", instr->fimm);
+            break;
+        case IR_STRING:
+            fputs(" \"", out);
+            for (const char* c = ((const char**)module->strings.items)[instr->imm]; *c; c++) {
+                if (*c == '"' || *c == '\\' || (unsigned char)*c < ' ') {
+                    fprintf(out, "\\x%02x", (unsigned char)*c);
+                } else {
+                    fputc(*c, out);
+                }
+            }
+            fputs("\"", out);
+            break;
+        case IR_FUNC:
+            fprintf(out, " %s", functions[instr->imm]->name);
+            break;
+        case IR_LOAD:
+            fprintf(out, " %%%u + %lld", instr->args[0], (long long)instr->imm);
+            break;
+        case IR_STORE:
+            fprintf(out, " %%%u + %lld, %%%u", instr->args[0], (long long)instr->imm, instr->args[1]);
+            break;
+        case IR_CALL:
+        case IR_CLOSURE:
+            fprintf(out, " %s(", functions[instr->imm]->name);
+            ir_dump_args(instr, 0, out);
+            fputs(")", out);
+            break;
+        case IR_CALLI:
+            fprintf(out, " %%%u(", instr->args[0]);
+            ir_dump_args(instr, 1, out);
+            fputs(")", out);
+            break;
+        case IR_PHI: {
+            IrBlock** preds = block->preds.items;
+            for (uint32_t i = 0; i < instr->arg_count; i++) {
+                fprintf(out, "%s [%%%u, b%u]", i > 0 ? "," : "", instr->args[i], preds[i]->id);
+            }
+            break;
+        }
+        case IR_JUMP:
+            fprintf(out, " b%u", instr->targets[0]->id);
+            break;
+        case IR_BRANCH:
+            fprintf(out, " %%%u, b%u, b%u", instr->args[0], instr->targets[0]->id, instr->targets[1]->id);
+            break;
+        default:
+            if (instr->arg_count > 0) fputs(" ", out);
+            ir_dump_args(instr, 0, out);
+            break;
+    }
+    fputs("\n", out);
+}
+
+void ir_dump_function(const IrFunction* function, const IrModule* module, FILE* out) {
+    if (function->external) {
+        fprintf(out, "extern %s -> %s\n", function->name, ir_type_name(function->result));
+        return;
+    }
+
+    fprintf(out, "function %s(", function->name);
+    const uint8_t* params = function->params.items;
+    for (uint32_t i = 0; i < function->params.count; i++) {
+        fprintf(out, "%s%s", i > 0 ? ", " : "", ir_type_name((IrType)params[i]));
+    }
+    fprintf(out, ") -> %s\n", ir_type_name(function->result));
+
+    IrBlock** blocks = function->blocks.items;
+    for (usize i = 0; i < function->blocks.count; i++) {
+        IrBlock* block = blocks[i];
+        fprintf(out, "b%u:", block->id);
+        IrBlock** preds = block->preds.items;
+        for (usize j = 0; j < block->preds.count; j++) {
+            fprintf(out, "%s b%u", j == 0 ? "    ; preds" : ",", preds[j]->id);
+        }
+        fputs("\n", out);
+
+        IrInstr* instrs = block->instrs.items;
+        for (usize j = 0; j < block->instrs.count; j++) {
+            ir_dump_instr(&instrs[j], block, module, out);
+        }
+    }
+}
+
+void ir_dump(const IrModule* module, FILE* out) {
+    IrFunction** functions = module->functions.items;
+    for (usize i = 0; i < module->functions.count; i++) {
+        if (i > 0) fputs("\n", out);
+        ir_dump_function(functions[i], module, out);
+    }
+}
@@ -1,52 +1,101 @@
 // src/compiler/lexer.c
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 #include "../../include/lexer.h"
 #include "../../include/ferror.h"
 
+// Keyword table, laid out as a perfect hash over (first char, second char,
+// last char, length). The multipliers in keyword_slot() were found by a small
+// offline search so that every keyword lands in its own slot; if a keyword is
+// added or renamed, the search has to be rerun and the table regenerated.
+#define KEYWORD_MIN_LENGTH 2
+#define KEYWORD_MAX_LENGTH 9
+#define KEYWORD_TABLE_SIZE 128
+
 static const struct {
     const char* keyword;
+    int length;
     TokenType token;
-} keywords[] = {
-    // Control flow
-    {"fn", TOKEN_FN}, {"let", TOKEN_LET}, {"if", TOKEN_IF},
-    {"else", TOKEN_ELSE}, {"for", TOKEN_FOR}, {"while", TOKEN_WHILE},
-    {"return", TOKEN_RETURN}, {"break", TOKEN_BREAK}, {"continue", TOKEN_CONTINUE},
-    {"match", TOKEN_MATCH}, {"case", TOKEN_CASE}, {"default", TOKEN_DEFAULT},
-    
-    // Type system
-    {"type", TOKEN_TYPE}, {"struct", TOKEN_STRUCT}, {"enum", TOKEN_ENUM},
-    {"interface", TOKEN_INTERFACE}, {"impl", TOKEN_IMPL}, {"trait", TOKEN_TRAIT},
-    {"pub", TOKEN_PUB}, {"priv", TOKEN_PRIV}, {"static", TOKEN_STATIC},
-    
-    // Module system
-    {"import", TOKEN_IMPORT}, {"from", TOKEN_FROM}, {"as", TOKEN_AS},
-    {"mod", TOKEN_MOD}, {"use", TOKEN_USE},
-    
-    // Error handling
-    {"try", TOKEN_TRY}, {"catch", TOKEN_CATCH}, {"throw", TOKEN_THROW},
-    {"finally", TOKEN_FINALLY},
-    
-    // Concurrency
-    {"go", TOKEN_GO}, {"chan", TOKEN_CHAN}, {"select", TOKEN_SELECT},
-    {"defer", TOKEN_DEFER}, {"async", TOKEN_ASYNC}, {"await", TOKEN_AWAIT},
-    
-    // Memory management
-    {"alloc", TOKEN_ALLOC}, {"free", TOKEN_FREE}, {"ref", TOKEN_REF},
-    {"deref", TOKEN_DEREF}, {"move", TOKEN_MOVE}, {"copy", TOKEN_COPY},
-    
-    // Constants
-    {"true", TOKEN_TRUE}, {"false", TOKEN_FALSE}, {"nil", TOKEN_NIL},
-    {"self", TOKEN_SELF}, {"super", TOKEN_SUPER}
+} keywords[KEYWORD_TABLE_SIZE] = {
+    [  1] = {"break",     5, TOKEN_BREAK},
+    [ 10] = {"case",      4, TOKEN_CASE},
+    [ 16] = {"type",      4, TOKEN_TYPE},
+    [ 20] = {"select",    6, TOKEN_SELECT},
+    [ 24] = {"go",        2, TOKEN_GO},
+    [ 26] = {"else",      4, TOKEN_ELSE},
+    [ 27] = {"ref",       3, TOKEN_REF},
+    [ 29] = {"false",     5, TOKEN_FALSE},
+    [ 31] = {"finally",   7, TOKEN_FINALLY},
+    [ 34] = {"self",      4, TOKEN_SELF},
+    [ 35] = {"catch",     5, TOKEN_CATCH},
+    [ 38] = {"chan",      4, TOKEN_CHAN},
+    [ 40] = {"from",      4, TOKEN_FROM},
+    [ 41] = {"defer",     5, TOKEN_DEFER},
+    [ 43] = {"for",       3, TOKEN_FOR},
+    [ 44] = {"priv",      4, TOKEN_PRIV},
+    [ 47] = {"pub",       3, TOKEN_PUB},
+    [ 53] = {"trait",     5, TOKEN_TRAIT},
+    [ 54] = {"continue",  8, TOKEN_CONTINUE},
+    [ 56] = {"import",    6, TOKEN_IMPORT},
+    [ 59] = {"default",   7, TOKEN_DEFAULT},
+    [ 60] = {"true",      4, TOKEN_TRUE},
+    [ 64] = {"static",    6, TOKEN_STATIC},
+    [ 67] = {"super",     5, TOKEN_SUPER},
+    [ 68] = {"as",        2, TOKEN_AS},
+    [ 71] = {"async",     5, TOKEN_ASYNC},
+    [ 72] = {"struct",    6, TOKEN_STRUCT},
+    [ 73] = {"deref",     5, TOKEN_DEREF},
+    [ 77] = {"use",       3, TOKEN_USE},
+    [ 79] = {"interface", 9, TOKEN_INTERFACE},
+    [ 82] = {"copy",      4, TOKEN_COPY},
+    [ 85] = {"throw",     5, TOKEN_THROW},
+    [ 87] = {"while",     5, TOKEN_WHILE},
+    [ 91] = {"try",       3, TOKEN_TRY},
+    [ 94] = {"return",    6, TOKEN_RETURN},
+    [ 95] = {"match",     5, TOKEN_MATCH},
+    [ 99] = {"nil",       3, TOKEN_NIL},
+    [101] = {"mod",       3, TOKEN_MOD},
+    [103] = {"let",       3, TOKEN_LET},
+    [104] = {"free",      4, TOKEN_FREE},
+    [110] = {"move",      4, TOKEN_MOVE},
+    [112] = {"if",        2, TOKEN_IF},
+    [114] = {"enum",      4, TOKEN_ENUM},
+    [115] = {"alloc",     5, TOKEN_ALLOC},
+    [118] = {"impl",      4, TOKEN_IMPL},
+    [126] = {"fn",        2, TOKEN_FN},
+    [127] = {"await",     5, TOKEN_AWAIT},
 };
 
+static inline unsigned keyword_slot(const char* start, int length) {
+    unsigned first = (unsigned char)start[0];
+    unsigned second = (unsigned char)start[1];
+    unsigned last = (unsigned char)start[length - 1];
+    return (first * 6 + second * 12 + last * 8 + (unsigned)length) & (KEYWORD_TABLE_SIZE - 1);
+}
+
+// Resolves an identifier to its keyword token, or TOKEN_IDENT. O(1): one hash,
+// one length check and a single memcmp against the only possible candidate.
+static TokenType keyword_type(const char* start, int length) {
+    if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH) {
+        return TOKEN_IDENT;
+    }
+    
+    unsigned slot = keyword_slot(start, length);
+    if (keywords[slot].length == length &&
+        memcmp(start, keywords[slot].keyword, length) == 0) {
+        return keywords[slot].token;
+    }
+    return TOKEN_IDENT;
+}
+
 static Token make_token(Lexer* lexer, TokenType type, int length) {
     Token token;
     token.type = type;
     token.start = lexer->current - length;
     token.length = length;
-    token.line = lexer->line;
-    token.col = lexer->col - length;
+    token.offset = (uint32_t)(token.start - lexer->source);
+    token.value.int_value = 0;
     return token;
 }
 
@@ -58,44 +107,63 @@ static bool is_alpha(char c) {
     return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
 }
 
-static bool is_hex_digit(char c) {
-    return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
-}
-
-static bool is_binary_digit(char c) {
-    return c == '0' || c == '1';
-}
-
-static bool is_octal_digit(char c) {
-    return c >= '0' && c <= '7';
-}
-
 static Token make_ident_or_keyword(Lexer* lexer) {
     const char* start = lexer->current - 1;
     int length = 1;
     
     while (is_alpha(*lexer->current) || is_digit(*lexer->current) || *lexer->current == '_') {
         lexer->current++;
-        lexer->col++;
         length++;
     }
     
-    // Check if identifier is a keyword
-    for (size_t i = 0; i < sizeof(keywords)/sizeof(keywords[0]); i++) {
-        if (strlen(keywords[i].keyword) == length && 
-            memcmp(start, keywords[i].keyword, length) == 0) {
-            return make_token(lexer, keywords[i].token, length);
-        }
+    return make_token(lexer, keyword_type(start, length), length);
+}
+
+static int digit_value(char c, int base) {
+    int value;
+    if (c >= '0' && c <= '9') {
+        value = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        value = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        value = c - 'A' + 10;
+    } else {
+        return -1;
+    }
+    return value < base ? value : -1;
+}
+
+// Exactly representable powers of ten for the float fast path
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Decodes a float literal. When the digits fit in a double's 53-bit mantissa
+// and the power of ten is exact, one multiply or divide is correctly rounded
+// (Clinger's fast path). Anything else goes through strtod on a bounded copy
+// of the token, never on the rest of the source.
+static double decode_float(const char* start, int length, uint64_t mantissa, bool exact, int exponent) {
+    if (exact && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        double value = (double)mantissa;
+        return exponent < 0 ? value / exact_pow10[-exponent] : value * exact_pow10[exponent];
     }
     
-    // Regular identifier
-    return make_token(lexer, TOKEN_IDENT, length);
+    char buffer[128];
+    char* text = length < (int)sizeof(buffer) ? buffer : f_malloc((usize)length + 1);
+    memcpy(text, start, (usize)length);
+    text[length] = '\0';
+    double value = strtod(text, NULL);
+    if (text != buffer) f_free(text);
+    return value;
 }
 
+// Scans and decodes a numeric literal. Integers are accumulated while
+// scanning (decimal, 0x hex, 0b binary, leading-0 octal); a value that does
+// not fit in 64 bits is an error token. Only decimal literals may have a
+// fraction or an exponent.
 static Token make_number(Lexer* lexer) {
     const char* start = lexer->current - 1;
-    int length = 1;
-    bool is_float = false;
     int base = 10;
     
     // Check for hex, binary, or octal prefix
@@ -103,58 +171,89 @@ static Token make_number(Lexer* lexer) {
         if (*lexer->current == 'x' || *lexer->current == 'X') {
             base = 16;
             lexer->current++;
-            lexer->col++;
-            length++;
         } else if (*lexer->current == 'b' || *lexer->current == 'B') {
             base = 2;
             lexer->current++;
-            lexer->col++;
-            length++;
         } else if (*lexer->current >= '0' && *lexer->current <= '7') {
             base = 8;
         }
     }
     
-    // Parse digits
-    for (;;) {
-        char c = *lexer->current;
-        bool valid = false;
+    // The leading digit is re-read unless it was part of a 0x/0b prefix
+    if (base == 10 || base == 8) lexer->current = start;
+    const char* digits = lexer->current;
+    
+    uint64_t value = 0;
+    bool exact = true;
+    int digit;
+    while ((digit = digit_value(*lexer->current, base)) >= 0) {
+        if (value > (UINT64_MAX - (uint64_t)digit) / (uint64_t)base) exact = false;
+        value = value * (uint64_t)base + (uint64_t)digit;
+        lexer->current++;
+    }
+    
+    if (lexer->current == digits) {
+        // "0x" or "0b" without digits
+        return make_token(lexer, TOKEN_ERROR, (int)(lexer->current - start));
+    }
+    
+    bool is_float = false;
+    int exponent = 0;
+    
+    if (base == 10 && *lexer->current == '.') {
+        is_float = true;
+        lexer->current++;
         
-        switch (base) {
-            case 16: valid = is_hex_digit(c); break;
-            case 2: valid = is_binary_digit(c); break;
-            case 8: valid = is_octal_digit(c); break;
-            case 10: valid = is_digit(c); break;
+        while (is_digit(*lexer->current)) {
+            if (value > (UINT64_MAX - 9) / 10) {
+                exact = false;
+            } else {
+                value = value * 10 + (uint64_t)(*lexer->current - '0');
+                exponent--;
+            }
+            lexer->current++;
         }
+    }
+    
+    if (base == 10 && (*lexer->current == 'e' || *lexer->current == 'E')) {
+        is_float = true;
+        lexer->current++;
         
-        if (!valid && c != '.' && c != 'e' && c != 'E') break;
-        
-        if (c == '.') {
-            if (is_float || base != 10) break;
-            is_float = true;
-        } else if ((c == 'e' || c == 'E') && base == 10) {
-            is_float = true;
+        bool negative = false;
+        if (*lexer->current == '+' || *lexer->current == '-') {
+            negative = *lexer->current == '-';
             lexer->current++;
-            lexer->col++;
-            length++;
-            
-            if (*lexer->current == '+' || *lexer->current == '-') {
-                lexer->current++;
-                lexer->col++;
-                length++;
-            }
-            
-            if (!is_digit(*lexer->current)) {
-                return make_token(lexer, TOKEN_ERROR, length);
-            }
         }
         
-        lexer->current++;
-        lexer->col++;
-        length++;
+        if (!is_digit(*lexer->current)) {
+            return make_token(lexer, TOKEN_ERROR, (int)(lexer->current - start));
+        }
+        
+        int power = 0;
+        while (is_digit(*lexer->current)) {
+            // Anything this large over- or underflows anyway
+            if (power < 100000) power = power * 10 + (*lexer->current - '0');
+            lexer->current++;
+        }
+        exponent += negative ? -power : power;
     }
     
-    return make_token(lexer, is_float ? TOKEN_FLOAT : TOKEN_INT, length);
+    int length = (int)(lexer->current - start);
+    
+    if (is_float) {
+        Token token = make_token(lexer, TOKEN_FLOAT, length);
+        token.value.float_value = decode_float(start, length, value, exact, exponent);
+        return token;
+    }
+    
+    if (!exact) {
+        // Integer literal does not fit in 64 bits
+        return make_token(lexer, TOKEN_ERROR, length);
+    }
+    
+    Token token = make_token(lexer, TOKEN_INT, length);
+    token.value.int_value = value;
+    return token;
 }
 
 static Token make_string(Lexer* lexer, char quote) {
@@ -168,7 +267,6 @@ static Token make_string(Lexer* lexer, char quote) {
         }
         
         lexer->current++;
-        lexer->col++;
         length++;
         
         if (escaped) {
@@ -197,7 +295,6 @@ static Token make_char(Lexer* lexer) {
         }
         
         lexer->current++;
-        lexer->col++;
         length++;
         
         if (escaped) {
@@ -215,54 +312,128 @@ static Token make_char(Lexer* lexer) {
     return make_token(lexer, TOKEN_CHAR, length);
 }
 
+// Whitespace and comment skipping
+//
+// The skipper works on spans instead of single bytes: scan_span() finds the
+// next byte that ends the span for the given mode. With SSE2/AVX2 it looks at
+// 16/32 bytes per step; otherwise it falls back to a byte loop. Positions are
+// not tracked here at all, newlines are only counted when a LineMap is built.
+typedef enum {
+    SCAN_BLANKS,        // Stop at the first byte that is not ' ', '\t', '\r' or '\n'
+    SCAN_LINE_END,      // Stop at '\n' or '\0' (line comment body)
+    SCAN_COMMENT_BODY   // Stop at '/', '*' or '\0' (block comment body)
+} ScanMode;
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__AVX2__) || defined(__SSE2__))
+    #if defined(__AVX2__)
+        #include <immintrin.h>
+        #define LEX_SIMD_WIDTH 32
+        #define LEX_SIMD_FULL 0xFFFFFFFFu
+        typedef __m256i LexBlock;
+
+        static inline LexBlock lex_load(const char* p) {
+            return _mm256_load_si256((const __m256i*)p);
+        }
+
+        static inline uint32_t lex_eq(LexBlock block, char c) {
+            return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(c)));
+        }
+    #else
+        #include <emmintrin.h>
+        #define LEX_SIMD_WIDTH 16
+        #define LEX_SIMD_FULL 0xFFFFu
+        typedef __m128i LexBlock;
+
+        static inline LexBlock lex_load(const char* p) {
+            return _mm_load_si128((const __m128i*)p);
+        }
+
+        static inline uint32_t lex_eq(LexBlock block, char c) {
+            return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(c)));
+        }
+    #endif
+
+static inline uint32_t scan_stop_mask(LexBlock block, ScanMode mode) {
+    switch (mode) {
+        case SCAN_BLANKS:
+            return ~(lex_eq(block, ' ') | lex_eq(block, '\t') | lex_eq(block, '\r') | lex_eq(block, '\n')) & LEX_SIMD_FULL;
+        case SCAN_LINE_END:
+            return lex_eq(block, '\n') | lex_eq(block, '\0');
+        default:
+            return lex_eq(block, '/') | lex_eq(block, '*') | lex_eq(block, '\0');
+    }
+}
+
+// Loads are aligned, so a block never straddles a page boundary and reading
+// past the '\0' terminator stays inside memory the source already occupies.
+static const char* scan_span(const char* p, ScanMode mode) {
+    uintptr_t misalign = (uintptr_t)p & (LEX_SIMD_WIDTH - 1);
+    const char* block = p - misalign;
+    uint32_t stop = scan_stop_mask(lex_load(block), mode) & (LEX_SIMD_FULL << misalign);
+    
+    while (stop == 0) {
+        block += LEX_SIMD_WIDTH;
+        stop = scan_stop_mask(lex_load(block), mode);
+    }
+    return block + __builtin_ctz(stop);
+}
+#else
+static const char* scan_span(const char* p, ScanMode mode) {
+    for (;; p++) {
+        char c = *p;
+        
+        switch (mode) {
+            case SCAN_BLANKS:
+                if (c != ' ' && c != '\t' && c != '\r' && c != '\n') return p;
+                break;
+            case SCAN_LINE_END:
+                if (c == '\n' || c == '\0') return p;
+                break;
+            default:
+                if (c == '/' || c == '*' || c == '\0') return p;
+                break;
+        }
+    }
+}
+#endif
+
 static void skip_whitespace(Lexer* lexer) {
     for (;;) {
-        char c = *lexer->current;
-        switch (c) {
+        const char* p = lexer->current;
+        
+        switch (*p) {
             case ' ':
             case '\r':
             case '\t':
-                lexer->current++;
-                lexer->col++;
-                break;
             case '\n':
-                lexer->line++;
-                lexer->col = 1;
-                lexer->current++;
+                lexer->current = scan_span(p, SCAN_BLANKS);
                 break;
             case '/':
-                if (lexer->current[1] == '/') {
+                if (p[1] == '/') {
                     // Line comment
-                    while (*lexer->current != '\n' && *lexer->current != '\0') {
-                        lexer->current++;
-                        lexer->col++;
-                    }
-                } else if (lexer->current[1] == '*') {
-                    // Block comment
-                    lexer->current += 2;
-                    lexer->col += 2;
+                    lexer->current = scan_span(p + 2, SCAN_LINE_END);
+                } else if (p[1] == '*') {
+                    // Block comment, nesting allowed
                     int nesting = 1;
+                    p += 2;
                     
-                    while (nesting > 0 && *lexer->current != '\0') {
-                        if (lexer->current[0] == '/' && lexer->current[1] == '*') {
+                    while (nesting > 0) {
+                        p = scan_span(p, SCAN_COMMENT_BODY);
+                        if (*p == '\0') break;
+                        
+                        if (p[0] == '/' && p[1] == '*') {
                             nesting++;
-                            lexer->current += 2;
-                            lexer->col += 2;
-                        } else if (lexer->current[0] == '*' && lexer->current[1] == '/') {
+                            p += 2;
+                        } else if (p[0] == '*' && p[1] == '/') {
                             nesting--;
-                            lexer->current += 2;
-                            lexer->col += 2;
+                            p += 2;
                         } else {
-                            if (*lexer->current == '\n') {
-                                lexer->line++;
-                                lexer->col = 1;
-                            } else {
-                                lexer->col++;
-                            }
-                            lexer->current++;
+                            p++;
                         }
                     }
                     
+                    lexer->current = p;
+                    
                     if (nesting > 0) {
                         // Unterminated block comment
                         return;
@@ -277,6 +448,19 @@ static void skip_whitespace(Lexer* lexer) {
     }
 }
 
+void lexer_init(Lexer* lexer, const char* source) {
+    lexer->source = source;
+    lexer->start = source;
+    lexer->current = source;
+}
+
+// Restarts lexing at 'offset'. Only valid at a token boundary, i.e. outside
+// string literals and comments.
+void lexer_seek(Lexer* lexer, uint32_t offset) {
+    lexer->start = lexer->source + offset;
+    lexer->current = lexer->source + offset;
+}
+
 Token lex_next(Lexer* lexer) {
     skip_whitespace(lexer);
     
@@ -287,7 +471,6 @@ Token lex_next(Lexer* lexer) {
     }
     
     char c = *lexer->current++;
-    lexer->col++;
     
     if (is_alpha(c)) return make_ident_or_keyword(lexer);
     if (is_digit(c)) return make_number(lexer);
@@ -309,32 +492,26 @@ Token lex_next(Lexer* lexer) {
         case '!':
             if (*lexer->current == '=') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_BANG_EQ, 2);
             }
             return make_token(lexer, TOKEN_BANG, 1);
         case '=':
             if (*lexer->current == '=') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_EQEQ, 2);
             } else if (*lexer->current == '>') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_ARROW, 2);
             }
             return make_token(lexer, TOKEN_EQ, 1);
         case '<':
             if (*lexer->current == '=') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_LTEQ, 2);
             } else if (*lexer->current == '<') {
                 lexer->current++;
-                lexer->col++;
                 if (*lexer->current == '=') {
                     lexer->current++;
-                    lexer->col++;
                     return make_token(lexer, TOKEN_LSHIFT_EQ, 3);
                 }
                 return make_token(lexer, TOKEN_LSHIFT, 2);
@@ -343,14 +520,11 @@ Token lex_next(Lexer* lexer) {
         case '>':
             if (*lexer->current == '=') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_GTEQ, 2);
             } else if (*lexer->current == '>') {
                 lexer->current++;
-                lexer->col++;
                 if (*lexer->current == '=') {
                     lexer->current++;
-                    lexer->col++;
                     return make_token(lexer, TOKEN_RSHIFT_EQ, 3);
                 }
                 return make_token(lexer, TOKEN_RSHIFT, 2);
@@ -359,76 +533,63 @@ Token lex_next(Lexer* lexer) {
         case '+':
             if (*lexer->current == '=') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_PLUS_EQ, 2);
             } else if (*lexer->current == '+') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_PLUS_PLUS, 2);
             }
             return make_token(lexer, TOKEN_PLUS, 1);
         case '-':
             if (*lexer->current == '=') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_MINUS_EQ, 2);
             } else if (*lexer->current == '-') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_MINUS_MINUS, 2);
             } else if (*lexer->current == '>') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_ARROW, 2);
             }
             return make_token(lexer, TOKEN_MINUS, 1);
         case '*':
             if (*lexer->current == '=') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_STAR_EQ, 2);
             }
             return make_token(lexer, TOKEN_STAR, 1);
         case '/':
             if (*lexer->current == '=') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_SLASH_EQ, 2);
             }
             return make_token(lexer, TOKEN_SLASH, 1);
         case '%':
             if (*lexer->current == '=') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_PERCENT_EQ, 2);
             }
             return make_token(lexer, TOKEN_PERCENT, 1);
         case '&':
             if (*lexer->current == '&') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_AMPAMP, 2);
             } else if (*lexer->current == '=') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_AMP_EQ, 2);
             }
             return make_token(lexer, TOKEN_AMP, 1);
         case '|':
             if (*lexer->current == '|') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_PIPEPIPE, 2);
             } else if (*lexer->current == '=') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_PIPE_EQ, 2);
             }
             return make_token(lexer, TOKEN_PIPE, 1);
         case '^':
             if (*lexer->current == '=') {
                 lexer->current++;
-                lexer->col++;
                 return make_token(lexer, TOKEN_CARET_EQ, 2);
             }
             return make_token(lexer, TOKEN_CARET, 1);
@@ -440,4 +601,371 @@ Token lex_next(Lexer* lexer) {
         default:
             return make_token(lexer, TOKEN_ERROR, 1);
     }
-}
\ No newline at end of file
+}
+
+// Token stream implementation
+void token_stream_init(TokenStream* stream) {
+    stream->source = NULL;
+    stream->types = NULL;
+    stream->offsets = NULL;
+    stream->lengths = NULL;
+    stream->count = 0;
+    stream->capacity = 0;
+    stream->literal_tokens = NULL;
+    stream->literal_values = NULL;
+    stream->literal_count = 0;
+    stream->literal_capacity = 0;
+}
+
+void token_stream_free(TokenStream* stream) {
+    if (!stream) return;
+    f_free(stream->types);
+    f_free(stream->offsets);
+    f_free(stream->lengths);
+    f_free(stream->literal_tokens);
+    f_free(stream->literal_values);
+    token_stream_init(stream);
+}
+
+void token_stream_reserve(TokenStream* stream, uint32_t capacity) {
+    if (capacity <= stream->capacity) return;
+    
+    uint32_t old = stream->capacity;
+    stream->types = f_realloc(stream->types, old * sizeof(uint8_t), capacity * sizeof(uint8_t));
+    stream->offsets = f_realloc(stream->offsets, old * sizeof(uint32_t), capacity * sizeof(uint32_t));
+    stream->lengths = f_realloc(stream->lengths, old * sizeof(uint32_t), capacity * sizeof(uint32_t));
+    stream->capacity = capacity;
+}
+
+static void token_stream_reserve_literals(TokenStream* stream, uint32_t capacity) {
+    if (capacity <= stream->literal_capacity) return;
+    
+    uint32_t old = stream->literal_capacity;
+    stream->literal_tokens = f_realloc(stream->literal_tokens, old * sizeof(uint32_t), capacity * sizeof(uint32_t));
+    stream->literal_values = f_realloc(stream->literal_values, old * sizeof(TokenValue), capacity * sizeof(TokenValue));
+    stream->literal_capacity = capacity;
+}
+
+static bool token_has_value(TokenType type) {
+    return type == TOKEN_INT || type == TOKEN_FLOAT;
+}
+
+// Index of the first literal belonging to token 'index' or a later token
+static uint32_t token_stream_first_literal(const TokenStream* stream, uint32_t index) {
+    uint32_t low = 0;
+    uint32_t high = stream->literal_count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (stream->literal_tokens[mid] < index) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void token_stream_push(TokenStream* stream, TokenType type, uint32_t offset, uint32_t length) {
+    if (stream->count >= stream->capacity) {
+        token_stream_reserve(stream, stream->capacity == 0 ? 1024 : stream->capacity * 2);
+    }
+    
+    stream->types[stream->count] = (uint8_t)type;
+    stream->offsets[stream->count] = offset;
+    stream->lengths[stream->count] = length;
+    stream->count++;
+}
+
+// Pushes a token together with its literal value, if it has one
+void token_stream_push_token(TokenStream* stream, const Token* token) {
+    token_stream_push(stream, token->type, token->offset, (uint32_t)token->length);
+    if (!token_has_value(token->type)) return;
+    
+    if (stream->literal_count >= stream->literal_capacity) {
+        token_stream_reserve_literals(stream, stream->literal_capacity == 0 ? 256 : stream->literal_capacity * 2);
+    }
+    
+    stream->literal_tokens[stream->literal_count] = stream->count - 1;
+    stream->literal_values[stream->literal_count] = token->value;
+    stream->literal_count++;
+}
+
+// Appends every token of 'part', which must refer to the same source
+void token_stream_append(TokenStream* stream, const TokenStream* part) {
+    uint32_t base = stream->count;
+    token_stream_reserve(stream, stream->count + part->count);
+    memcpy(stream->types + base, part->types, part->count * sizeof(uint8_t));
+    memcpy(stream->offsets + base, part->offsets, part->count * sizeof(uint32_t));
+    memcpy(stream->lengths + base, part->lengths, part->count * sizeof(uint32_t));
+    stream->count += part->count;
+    
+    uint32_t literal_base = stream->literal_count;
+    token_stream_reserve_literals(stream, stream->literal_count + part->literal_count);
+    for (uint32_t i = 0; i < part->literal_count; i++) {
+        stream->literal_tokens[literal_base + i] = part->literal_tokens[i] + base;
+    }
+    memcpy(stream->literal_values + literal_base, part->literal_values, part->literal_count * sizeof(TokenValue));
+    stream->literal_count += part->literal_count;
+}
+
+void token_stream_lex(TokenStream* stream, const char* source) {
+    Lexer lexer;
+    lexer_init(&lexer, source);
+    stream->source = source;
+    stream->count = 0;
+    stream->literal_count = 0;
+    
+    for (;;) {
+        Token token = lex_next(&lexer);
+        token_stream_push_token(stream, &token);
+        if (token.type == TOKEN_EOF) break;
+    }
+}
+
+// Rebuilds a full Token. Indices past the end yield the trailing EOF token.
+Token token_stream_get(const TokenStream* stream, uint32_t index) {
+    if (index >= stream->count) index = stream->count - 1;
+    
+    Token token;
+    token.type = (TokenType)stream->types[index];
+    token.length = (int)stream->lengths[index];
+    token.offset = stream->offsets[index];
+    token.start = stream->source + token.offset;
+    token.value.int_value = 0;
+    if (token_has_value(token.type)) {
+        token.value = stream->literal_values[token_stream_first_literal(stream, index)];
+    }
+    return token;
+}
+
+// Index of the first token whose end lies at or after 'offset'
+static uint32_t token_stream_first_ending_at(const TokenStream* stream, uint32_t offset) {
+    uint32_t low = 0;
+    uint32_t high = stream->count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (stream->offsets[mid] + stream->lengths[mid] < offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Index of the first token starting at or after 'offset'
+static uint32_t token_stream_first_starting_at(const TokenStream* stream, uint32_t offset) {
+    uint32_t low = 0;
+    uint32_t high = stream->count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (stream->offsets[mid] < offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Updates a stream after an edit to its source. 'source' is the edited
+// buffer (it may have moved); 'edit' describes the change relative to the
+// buffer the stream was lexed from.
+//
+// Lexing restarts at the start of the last token that ends before the edit:
+// the text up to there is unchanged, and re-lexing that token covers any
+// lookahead into the edited bytes. It stops at the first new token that
+// starts past the edit at the shifted position of an old token with the same
+// type and length. From that point the remaining text is identical and the
+// lexer carries no state across token boundaries, so every old token after
+// it is still valid. Only the tokens in between are lexed; the tail is moved
+// and its offsets are shifted.
+TokenRange token_stream_relex(TokenStream* stream, const char* source, TokenEdit edit) {
+    int64_t delta = (int64_t)edit.inserted - (int64_t)edit.removed;
+    uint32_t edit_end = edit.offset + edit.inserted;
+    
+    uint32_t first = token_stream_first_ending_at(stream, edit.offset);
+    uint32_t restart = 0;
+    if (first > 0) {
+        first--;
+        restart = stream->offsets[first];
+    }
+    
+    // Candidate old tokens to resynchronize with start after the removed bytes
+    uint32_t old = token_stream_first_starting_at(stream, edit.offset + edit.removed);
+    
+    TokenStream fresh;
+    token_stream_init(&fresh);
+    
+    Lexer lexer;
+    lexer_init(&lexer, source);
+    lexer_seek(&lexer, restart);
+    
+    for (;;) {
+        Token token = lex_next(&lexer);
+        
+        if (token.offset >= edit_end) {
+            while (old < stream->count && (int64_t)stream->offsets[old] + delta < (int64_t)token.offset) {
+                old++;
+            }
+            if (old < stream->count &&
+                (int64_t)stream->offsets[old] + delta == (int64_t)token.offset &&
+                stream->types[old] == (uint8_t)token.type &&
+                stream->lengths[old] == (uint32_t)token.length) {
+                break;
+            }
+        }
+        
+        token_stream_push_token(&fresh, &token);
+        if (token.type == TOKEN_EOF) {
+            old = stream->count;
+            break;
+        }
+    }
+    
+    TokenRange range;
+    range.first = first;
+    range.removed = old - first;
+    range.inserted = fresh.count;
+    
+    // Literal values of the replaced tokens, located before the tokens move
+    uint32_t literal_first = token_stream_first_literal(stream, first);
+    uint32_t literal_old = token_stream_first_literal(stream, old);
+    
+    // Splice: move the surviving tail, then drop the new tokens in front of it
+    uint32_t tail = stream->count - old;
+    uint32_t count = first + fresh.count + tail;
+    token_stream_reserve(stream, count);
+    
+    uint32_t to = first + fresh.count;
+    if (to != old) {
+        memmove(stream->types + to, stream->types + old, tail * sizeof(uint8_t));
+        memmove(stream->offsets + to, stream->offsets + old, tail * sizeof(uint32_t));
+        memmove(stream->lengths + to, stream->lengths + old, tail * sizeof(uint32_t));
+    }
+    for (uint32_t i = to; i < count; i++) {
+        stream->offsets[i] = (uint32_t)((int64_t)stream->offsets[i] + delta);
+    }
+    
+    memcpy(stream->types + first, fresh.types, fresh.count * sizeof(uint8_t));
+    memcpy(stream->offsets + first, fresh.offsets, fresh.count * sizeof(uint32_t));
+    memcpy(stream->lengths + first, fresh.lengths, fresh.count * sizeof(uint32_t));
+    
+    // Same splice for the literal side table; tail literals follow their
+    // tokens to their new indices
+    uint32_t literal_tail = stream->literal_count - literal_old;
+    uint32_t literal_to = literal_first + fresh.literal_count;
+    uint32_t literal_count = literal_to + literal_tail;
+    token_stream_reserve_literals(stream, literal_count);
+    
+    memmove(stream->literal_tokens + literal_to, stream->literal_tokens + literal_old, literal_tail * sizeof(uint32_t));
+    memmove(stream->literal_values + literal_to, stream->literal_values + literal_old, literal_tail * sizeof(TokenValue));
+    for (uint32_t i = literal_to; i < literal_count; i++) {
+        stream->literal_tokens[i] = stream->literal_tokens[i] - old + to;
+    }
+    for (uint32_t i = 0; i < fresh.literal_count; i++) {
+        stream->literal_tokens[literal_first + i] = fresh.literal_tokens[i] + first;
+    }
+    memcpy(stream->literal_values + literal_first, fresh.literal_values, fresh.literal_count * sizeof(TokenValue));
+    stream->literal_count = literal_count;
+    
+    stream->source = source;
+    stream->count = count;
+    token_stream_free(&fresh);
+    return range;
+}
+
+// Line map implementation
+void line_map_init(LineMap* map, const char* source) {
+    map->source = source;
+    map->starts = NULL;
+    map->count = 0;
+}
+
+void line_map_free(LineMap* map) {
+    if (!map) return;
+    f_free(map->starts);
+    map->starts = NULL;
+    map->count = 0;
+}
+
+#ifdef LEX_SIMD_WIDTH
+// One pass to count lines with popcount so the table is allocated once,
+// a second pass to record the start of every line.
+static void line_map_build(LineMap* map) {
+    const char* source = map->source;
+    uintptr_t misalign = (uintptr_t)source & (LEX_SIMD_WIDTH - 1);
+    const char* first = source - misalign;
+    uint32_t first_valid = (LEX_SIMD_FULL << misalign) & LEX_SIMD_FULL;
+    
+    uint32_t lines = 1;
+    const char* block = first;
+    uint32_t valid = first_valid;
+    for (;;) {
+        LexBlock bytes = lex_load(block);
+        uint32_t end = lex_eq(bytes, '\0') & valid;
+        uint32_t newlines = lex_eq(bytes, '\n') & valid;
+        if (end) newlines &= (1u << __builtin_ctz(end)) - 1;
+        lines += (uint32_t)__builtin_popcount(newlines);
+        if (end) break;
+        block += LEX_SIMD_WIDTH;
+        valid = LEX_SIMD_FULL;
+    }
+    
+    map->starts = f_malloc(lines * sizeof(uint32_t));
+    map->starts[0] = 0;
+    map->count = 1;
+    
+    block = first;
+    valid = first_valid;
+    for (;;) {
+        LexBlock bytes = lex_load(block);
+        uint32_t end = lex_eq(bytes, '\0') & valid;
+        uint32_t newlines = lex_eq(bytes, '\n') & valid;
+        if (end) newlines &= (1u << __builtin_ctz(end)) - 1;
+        while (newlines) {
+            map->starts[map->count++] = (uint32_t)(block + __builtin_ctz(newlines) + 1 - source);
+            newlines &= newlines - 1;
+        }
+        if (end) break;
+        block += LEX_SIMD_WIDTH;
+        valid = LEX_SIMD_FULL;
+    }
+}
+#else
+static void line_map_build(LineMap* map) {
+    uint32_t lines = 1;
+    for (const char* p = map->source; *p != '\0'; p++) {
+        if (*p == '\n') lines++;
+    }
+    
+    map->starts = f_malloc(lines * sizeof(uint32_t));
+    map->starts[0] = 0;
+    map->count = 1;
+    
+    for (const char* p = map->source; *p != '\0'; p++) {
+        if (*p == '\n') map->starts[map->count++] = (uint32_t)(p + 1 - map->source);
+    }
+}
+#endif
+
+// Turns a byte offset into a 1-based line and column. The table is built on
+// the first call, so compilations without diagnostics never pay for it.
+void line_map_resolve(LineMap* map, uint32_t offset, uint32_t* line, uint32_t* col) {
+    if (!map->starts) line_map_build(map);
+    
+    // Last line start <= offset
+    uint32_t low = 0;
+    uint32_t high = map->count;
+    while (high - low > 1) {
+        uint32_t mid = low + (high - low) / 2;
+        if (map->starts[mid] <= offset) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    
+    *line = low + 1;
+    *col = offset - map->starts[low] + 1;
+}
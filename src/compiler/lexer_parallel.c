@@ -0,0 +1,192 @@
+#include "../../include/lexer_parallel.h"
+#include "../../include/runtime/sys.h"
+#include <string.h>
+
+#define LEXER_MAX_CHUNKS 64
+
+typedef enum {
+    PRESCAN_CODE,
+    PRESCAN_STRING,
+    PRESCAN_LINE_COMMENT,
+    PRESCAN_BLOCK_COMMENT
+} PrescanState;
+
+typedef struct {
+    const char* source;   // Whole source, offsets stay global
+    uint32_t begin;       // First byte of the chunk
+    uint32_t end;         // First byte of the next chunk
+    bool last;            // Last chunk owns the EOF token
+    TokenStream tokens;   // Tokens starting in [begin, end)
+} LexChunk;
+
+// Walks the source with the lexer's string and comment rules and picks one
+// split point per worker: the first newline at or after each target offset
+// where the lexer is between tokens. String and char literals end at a
+// newline, so only block comments can make a newline unsafe. The scan stops
+// as soon as every split is found; a '\0' before that ends it early, which
+// keeps embedded NULs inside the last chunk where the lexer stops anyway.
+static int find_split_points(const char* source, usize length, int chunks, uint32_t* splits) {
+    int count = 0;
+    splits[count++] = 0;
+
+    usize target = length / (usize)chunks;
+    PrescanState state = PRESCAN_CODE;
+    char quote = '\0';
+    bool escaped = false;
+    int nesting = 0;
+    usize i = 0;
+
+    while (count < chunks) {
+        switch (state) {
+            case PRESCAN_CODE:
+                i += strcspn(source + i, "\n\"'/");
+                if (source[i] == '\0') return count;
+
+                if (source[i] == '\n') {
+                    i++;
+                    if (i >= target) {
+                        splits[count++] = (uint32_t)i;
+                        target = (usize)count * length / (usize)chunks;
+                    }
+                } else if (source[i] == '/') {
+                    if (source[i + 1] == '/') {
+                        state = PRESCAN_LINE_COMMENT;
+                        i += 2;
+                    } else if (source[i + 1] == '*') {
+                        state = PRESCAN_BLOCK_COMMENT;
+                        nesting = 1;
+                        i += 2;
+                    } else {
+                        i++;
+                    }
+                } else {
+                    state = PRESCAN_STRING;
+                    quote = source[i];
+                    escaped = false;
+                    i++;
+                }
+                break;
+
+            case PRESCAN_STRING: {
+                char c = source[i];
+                if (c == '\0') return count;
+                if (c == '\n') {
+                    // Unterminated literal; the newline itself is code again
+                    state = PRESCAN_CODE;
+                    break;
+                }
+
+                i++;
+                if (escaped) {
+                    escaped = false;
+                } else if (c == '\\') {
+                    escaped = true;
+                } else if (c == quote) {
+                    state = PRESCAN_CODE;
+                }
+                break;
+            }
+
+            case PRESCAN_LINE_COMMENT:
+                i += strcspn(source + i, "\n");
+                if (source[i] == '\0') return count;
+                state = PRESCAN_CODE;
+                break;
+
+            case PRESCAN_BLOCK_COMMENT:
+                i += strcspn(source + i, "/*");
+                if (source[i] == '\0') return count;
+
+                if (source[i] == '/' && source[i + 1] == '*') {
+                    nesting++;
+                    i += 2;
+                } else if (source[i] == '*' && source[i + 1] == '/') {
+                    if (--nesting == 0) state = PRESCAN_CODE;
+                    i += 2;
+                } else {
+                    i++;
+                }
+                break;
+        }
+    }
+
+    return count;
+}
+
+static void lex_chunk(void* arg) {
+    LexChunk* chunk = (LexChunk*)arg;
+
+    Lexer lexer;
+    lexer_init(&lexer, chunk->source);
+    lexer_seek(&lexer, chunk->begin);
+
+    token_stream_init(&chunk->tokens);
+    chunk->tokens.source = chunk->source;
+    token_stream_reserve(&chunk->tokens, (chunk->end - chunk->begin) / 4 + 16);
+
+    for (;;) {
+        Token token = lex_next(&lexer);
+        if (token.type == TOKEN_EOF) {
+            if (chunk->last) {
+                token_stream_push_token(&chunk->tokens, &token);
+            }
+            break;
+        }
+
+        // The next chunk starts here; it lexes this token itself
+        if (token.offset >= chunk->end) break;
+
+        token_stream_push_token(&chunk->tokens, &token);
+    }
+}
+
+void token_stream_lex_parallel(TokenStream* stream, const char* source, usize length, int thread_count) {
+    if (thread_count > LEXER_MAX_CHUNKS) thread_count = LEXER_MAX_CHUNKS;
+
+    if (thread_count <= 1 || length < LEXER_PARALLEL_MIN_BYTES) {
+        token_stream_lex(stream, source);
+        return;
+    }
+
+    uint32_t splits[LEXER_MAX_CHUNKS];
+    int chunk_count = find_split_points(source, length, thread_count, splits);
+    if (chunk_count <= 1) {
+        token_stream_lex(stream, source);
+        return;
+    }
+
+    LexChunk chunks[LEXER_MAX_CHUNKS];
+    Thread* workers[LEXER_MAX_CHUNKS] = {0};
+
+    for (int i = 0; i < chunk_count; i++) {
+        chunks[i].source = source;
+        chunks[i].begin = splits[i];
+        chunks[i].last = i == chunk_count - 1;
+        chunks[i].end = chunks[i].last ? UINT32_MAX : splits[i + 1];
+    }
+
+    // Chunk 0 runs on the calling thread; a worker that cannot be started
+    // is lexed inline instead
+    for (int i = 1; i < chunk_count; i++) {
+        workers[i] = sys_thread_create(lex_chunk, &chunks[i]);
+        if (!workers[i]) lex_chunk(&chunks[i]);
+    }
+    lex_chunk(&chunks[0]);
+
+    uint32_t total = 0;
+    for (int i = 0; i < chunk_count; i++) {
+        if (workers[i]) sys_thread_join(workers[i]);
+        total += chunks[i].tokens.count;
+    }
+
+    // Stitch the chunks back together in source order
+    stream->source = source;
+    stream->count = 0;
+    stream->literal_count = 0;
+    token_stream_reserve(stream, total);
+
+    for (int i = 0; i < chunk_count; i++) {
+        token_stream_append(stream, &chunks[i].tokens);
+        token_stream_free(&chunks[i].tokens);
+    }
+}
@@ -0,0 +1,813 @@
+#include "../../include/lower.h"
+#include "../../include/ferror.h"
+#include "../../include/runtime/memory.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LOWER_NAME_SIZE 128
+#define LOWER_STACK_ARGS 8
+
+// A closure object is its code address followed by the captured values
+#define UPVALUE_OFFSET(index) (8 * ((int64_t)(index) + 1))
+
+// The function being lowered. Slots mirror its frame the way the type
+// checker's do, holding the register of each variable's value.
+typedef struct LowerScope {
+    struct LowerScope* enclosing;
+    IrFunction* function;
+    IrBlock* block;             // Where code goes, NULL after a return, break or continue
+    IrValue* slots;             // Frame slot -> register
+    const uint8_t* upvalues;    // IrType per upvalue
+    IrValue env;                // The function's closure
+    IrBlock* break_target;      // Exit of the innermost loop, NULL outside loops
+    IrBlock* continue_target;
+} LowerScope;
+
+typedef struct {
+    IrModule* module;
+    TypeTable* types;
+    Interner* interner;
+    const char* filename;
+    LineMap lines;              // For diagnostics, built on first error
+    uint32_t* functions;        // Global ID -> IR function of a top-level 'fn', or IR_NONE
+    Symbol* builtins;           // Global ID -> builtin name, or SYMBOL_NONE
+    LowerScope* scope;
+    uint32_t error_count;
+} Lowerer;
+
+static IrValue lower_expression(Lowerer* lowerer, ASTNode* node);
+static void lower_statement(Lowerer* lowerer, ASTNode* node);
+
+// Error handling
+static void error_at(Lowerer* lowerer, uint32_t offset, const char* format, ...) {
+    lowerer->error_count++;
+
+    va_list args;
+    va_start(args, format);
+    diagnostic_vreport(NULL, lowerer->filename, &lowerer->lines, offset, NULL, 0, format, args);
+    va_end(args);
+}
+
+static void unsupported(Lowerer* lowerer, ASTNode* node, const char* what) {
+    error_at(lowerer, node->offset, "%s cannot be compiled yet", what);
+}
+
+// Types
+static TypeKind type_kind(Lowerer* lowerer, TypeId type) {
+    return (TypeKind)type_info(lowerer->types, type_find(lowerer->types, type))->kind;
+}
+
+static IrType machine_type(Lowerer* lowerer, TypeId type) {
+    switch (type_kind(lowerer, type)) {
+        case TYPE_BOOL:
+            return IR_BOOL;
+        case TYPE_INT:
+        case TYPE_CHAR:
+            return IR_INT;
+        case TYPE_FLOAT:
+            return IR_FLOAT;
+        default:
+            return IR_PTR;
+    }
+}
+
+static IrType node_type(Lowerer* lowerer, const ASTNode* node) {
+    return machine_type(lowerer, node->value_type);
+}
+
+// Parameter 'index' of a function declaration, or its result when 'index'
+// is the parameter count
+static IrType signature_type(Lowerer* lowerer, const ASTNode* function, uint32_t index) {
+    const TypeInfo* info = type_info(lowerer->types, type_find(lowerer->types, function->value_type));
+    if (info->kind != TYPE_FUNCTION || index >= info->arity) return IR_PTR;
+    return machine_type(lowerer, info->args[index]);
+}
+
+// Emitting into the current block
+static IrInstr* emit(Lowerer* lowerer, IrOp op, IrType type, const IrValue* args, uint32_t count) {
+    LowerScope* scope = lowerer->scope;
+    return ir_append(lowerer->module, scope->function, scope->block, op, type, args, count);
+}
+
+static IrValue emit_value(Lowerer* lowerer, IrOp op, IrType type, const IrValue* args, uint32_t count) {
+    return emit(lowerer, op, type, args, count)->dest;
+}
+
+static IrValue emit_const(Lowerer* lowerer, IrType type, int64_t value) {
+    LowerScope* scope = lowerer->scope;
+    return ir_const(lowerer->module, scope->function, scope->block, type, value);
+}
+
+static IrValue emit_zero(Lowerer* lowerer, IrType type) {
+    if (type != IR_FLOAT) return emit_const(lowerer, type, 0);
+    IrInstr* instr = emit(lowerer, IR_FCONST, IR_FLOAT, NULL, 0);
+    instr->fimm = 0.0;
+    return instr->dest;
+}
+
+static IrValue emit_load(Lowerer* lowerer, IrValue address, int64_t offset, IrType type) {
+    IrInstr* instr = emit(lowerer, IR_LOAD, type, &address, 1);
+    instr->imm = offset;
+    return instr->dest;
+}
+
+static void emit_store(Lowerer* lowerer, IrValue address, int64_t offset, IrValue value) {
+    IrValue args[2] = { address, value };
+    emit(lowerer, IR_STORE, IR_VOID, args, 2)->imm = offset;
+}
+
+static IrValue emit_index(Lowerer* lowerer, IrOp op, IrType type, int64_t index) {
+    IrInstr* instr = emit(lowerer, op, type, NULL, 0);
+    instr->imm = index;
+    return instr->dest;
+}
+
+// 'result' is what this call site expects, IR_VOID for nothing
+static IrValue emit_runtime_call(Lowerer* lowerer, const char* name, IrType result, const IrValue* args, uint32_t count) {
+    uint32_t function = ir_extern(lowerer->module, name, result);
+    IrInstr* instr = emit(lowerer, IR_CALL, result, args, count);
+    instr->imm = function;
+    return instr->dest;
+}
+
+// Control flow. A block with no predecessors is unreachable: code after a
+// 'return' is not lowered at all.
+static void start(Lowerer* lowerer, IrBlock* block) {
+    LowerScope* scope = lowerer->scope;
+    if (block->preds.count == 0 && scope->function->blocks.count > 0) {
+        scope->block = NULL;
+        return;
+    }
+    ir_block_place(scope->function, block);
+    scope->block = block;
+}
+
+static void jump(Lowerer* lowerer, IrBlock* to) {
+    LowerScope* scope = lowerer->scope;
+    if (scope->block) ir_jump(lowerer->module, scope->function, scope->block, to);
+    scope->block = NULL;
+}
+
+static void branch(Lowerer* lowerer, IrValue condition, IrBlock* if_true, IrBlock* if_false) {
+    LowerScope* scope = lowerer->scope;
+    ir_branch(lowerer->module, scope->function, scope->block, condition, if_true, if_false);
+    scope->block = NULL;
+}
+
+static void ret(Lowerer* lowerer, IrValue value) {
+    LowerScope* scope = lowerer->scope;
+    ir_ret(lowerer->module, scope->function, scope->block, value);
+    scope->block = NULL;
+}
+
+// Variables
+static IrValue global_address(Lowerer* lowerer, uint32_t index) {
+    return emit_index(lowerer, IR_GLOBAL, IR_PTR, index);
+}
+
+static IrValue read_variable(Lowerer* lowerer, ASTNode* node) {
+    LowerScope* scope = lowerer->scope;
+    Binding binding = node->ident.binding;
+    switch (binding.kind) {
+        case BINDING_LOCAL:
+            return scope->slots[binding.index];
+        case BINDING_UPVALUE:
+            return emit_load(lowerer, scope->env, UPVALUE_OFFSET(binding.index), (IrType)scope->upvalues[binding.index]);
+        case BINDING_GLOBAL:
+            if (lowerer->functions[binding.index] != IR_NONE) {
+                return emit_index(lowerer, IR_FUNC, IR_PTR, lowerer->functions[binding.index]);
+            }
+            if (lowerer->builtins[binding.index] != SYMBOL_NONE) {
+                unsupported(lowerer, node, "A builtin used as a value");
+                return emit_zero(lowerer, IR_PTR);
+            }
+            return emit_load(lowerer, global_address(lowerer, binding.index), 0, node_type(lowerer, node));
+        default:
+            return emit_zero(lowerer, node_type(lowerer, node));
+    }
+}
+
+static void define(Lowerer* lowerer, Binding binding, IrValue value) {
+    switch (binding.kind) {
+        case BINDING_LOCAL:
+            lowerer->scope->slots[binding.index] = value;
+            break;
+        case BINDING_GLOBAL:
+            emit_store(lowerer, global_address(lowerer, binding.index), 0, value);
+            break;
+        default:
+            break;
+    }
+}
+
+// Functions
+static IrFunction* new_function(Lowerer* lowerer, const ASTNode* node) {
+    char name[LOWER_NAME_SIZE];
+    Token token = node->func_decl.name;
+    uint32_t index = (uint32_t)lowerer->module->functions.count;
+    if (token.length > 0) {
+        snprintf(name, sizeof(name), "%.*s_%u", (int)token.length, token.start, index);
+    } else {
+        snprintf(name, sizeof(name), "closure_%u", index);
+    }
+    return ir_function_new(lowerer->module, name, signature_type(lowerer, node, node->func_decl.frame->param_count));
+}
+
+// Falling off the end returns the zero of the result type
+static void finish_function(Lowerer* lowerer) {
+    LowerScope* scope = lowerer->scope;
+    if (!scope->block) return;
+    IrType result = scope->function->result;
+    ret(lowerer, result == IR_VOID ? IR_NO_VALUE : emit_zero(lowerer, result));
+}
+
+static void lower_function_body(Lowerer* lowerer, ASTNode* node, IrFunction* function, const uint8_t* upvalues) {
+    FrameInfo* frame = node->func_decl.frame;
+    LowerScope scope = {
+        .enclosing = lowerer->scope,
+        .function = function,
+        .slots = f_calloc(frame->frame_size ? frame->frame_size : 1, sizeof(IrValue)),
+        .upvalues = upvalues,
+    };
+    function->upvalue_count = frame->upvalue_count;
+
+    lowerer->scope = &scope;
+    start(lowerer, ir_block_new(lowerer->module));
+    scope.env = emit_value(lowerer, IR_ENV, IR_PTR, NULL, 0);
+    for (uint32_t i = 0; i < frame->param_count; i++) {
+        IrValue param = ir_param(lowerer->module, function, scope.block, signature_type(lowerer, node, i));
+        scope.slots[frame->params[i].index] = param;
+    }
+
+    lower_statement(lowerer, node->func_decl.body);
+    finish_function(lowerer);
+    lowerer->scope = scope.enclosing;
+    f_free(scope.slots);
+}
+
+// A nested function or closure: its code, then a closure object holding
+// the values it captures. A nested function that calls itself captures
+// its own closure, which is stored once the closure exists.
+static IrValue lower_closure(Lowerer* lowerer, ASTNode* node) {
+    LowerScope* scope = lowerer->scope;
+    FrameInfo* frame = node->func_decl.frame;
+    uint32_t count = frame->upvalue_count;
+
+    IrValue stack_values[LOWER_STACK_ARGS];
+    uint8_t stack_types[LOWER_STACK_ARGS];
+    IrValue* values = count <= LOWER_STACK_ARGS ? stack_values : f_malloc(count * sizeof(IrValue));
+    uint8_t* types = count <= LOWER_STACK_ARGS ? stack_types : f_malloc(count);
+
+    uint32_t self = IR_NONE;
+    for (uint32_t i = 0; i < count; i++) {
+        Upvalue upvalue = frame->upvalues[i];
+        if (upvalue.is_local && frame->binding.kind == BINDING_LOCAL && upvalue.index == frame->binding.index) {
+            self = i;
+            values[i] = emit_zero(lowerer, IR_PTR);
+        } else if (upvalue.is_local) {
+            values[i] = scope->slots[upvalue.index];
+        } else {
+            values[i] = emit_load(lowerer, scope->env, UPVALUE_OFFSET(upvalue.index), (IrType)scope->upvalues[upvalue.index]);
+        }
+        types[i] = (uint8_t)ir_value_type(scope->function, values[i]);
+    }
+
+    IrFunction* function = new_function(lowerer, node);
+    lower_function_body(lowerer, node, function, types);
+
+    IrInstr* instr = emit(lowerer, IR_CLOSURE, IR_PTR, values, count);
+    instr->imm = function->index;
+    IrValue closure = instr->dest;
+    if (self != IR_NONE) emit_store(lowerer, closure, UPVALUE_OFFSET(self), closure);
+
+    if (values != stack_values) f_free(values);
+    if (types != stack_types) f_free(types);
+    return closure;
+}
+
+static void lower_function_decl(Lowerer* lowerer, ASTNode* node) {
+    FrameInfo* frame = node->func_decl.frame;
+    if (!frame) return;
+
+    Binding binding = frame->binding;
+    if (binding.kind == BINDING_GLOBAL && lowerer->functions[binding.index] != IR_NONE) {
+        IrFunction** functions = lowerer->module->functions.items;
+        lower_function_body(lowerer, node, functions[lowerer->functions[binding.index]], NULL);
+    } else {
+        define(lowerer, binding, lower_closure(lowerer, node));
+    }
+}
+
+// Expressions
+static IrValue lower_condition(Lowerer* lowerer, ASTNode* node) {
+    IrValue value = lower_expression(lowerer, node);
+    IrType type = ir_value_type(lowerer->scope->function, value);
+    if (type == IR_BOOL) return value;
+
+    IrValue args[2] = { value, emit_zero(lowerer, type) };
+    return emit_value(lowerer, type == IR_FLOAT ? IR_FNE : IR_NE, IR_BOOL, args, 2);
+}
+
+static IrValue lower_string_binary(Lowerer* lowerer, ASTNode* node, IrValue* args) {
+    IrOp compare;
+    switch (node->binary_expr.op.type) {
+        case TOKEN_PLUS:
+            return emit_runtime_call(lowerer, "rt_string_concat", IR_PTR, args, 2);
+        case TOKEN_EQEQ:
+            return emit_runtime_call(lowerer, "rt_string_equal", IR_BOOL, args, 2);
+        case TOKEN_BANG_EQ: {
+            IrValue equal = emit_runtime_call(lowerer, "rt_string_equal", IR_BOOL, args, 2);
+            return emit_value(lowerer, IR_NOT, IR_BOOL, &equal, 1);
+        }
+        case TOKEN_GT:
+            compare = IR_GT;
+            break;
+        case TOKEN_GTEQ:
+            compare = IR_GE;
+            break;
+        case TOKEN_LT:
+            compare = IR_LT;
+            break;
+        case TOKEN_LTEQ:
+            compare = IR_LE;
+            break;
+        default:
+            unsupported(lowerer, node, "This string operator");
+            return emit_zero(lowerer, node_type(lowerer, node));
+    }
+
+    // rt_string_compare orders like strcmp
+    IrValue order[2] = { emit_runtime_call(lowerer, "rt_string_compare", IR_INT, args, 2) };
+    order[1] = emit_zero(lowerer, IR_INT);
+    return emit_value(lowerer, compare, IR_BOOL, order, 2);
+}
+
+static IrValue lower_binary(Lowerer* lowerer, ASTNode* node) {
+    BinaryExpr* binary = &node->binary_expr;
+    IrValue args[2] = { lower_expression(lowerer, binary->left), lower_expression(lowerer, binary->right) };
+
+    TypeKind kind = type_kind(lowerer, binary->left->value_type);
+    if (kind == TYPE_STRING) return lower_string_binary(lowerer, node, args);
+
+    bool is_float = kind == TYPE_FLOAT;
+    IrOp op;
+    switch (binary->op.type) {
+        case TOKEN_PLUS:
+            op = is_float ? IR_FADD : IR_ADD;
+            break;
+        case TOKEN_MINUS:
+            op = is_float ? IR_FSUB : IR_SUB;
+            break;
+        case TOKEN_STAR:
+            op = is_float ? IR_FMUL : IR_MUL;
+            break;
+        case TOKEN_SLASH:
+            op = is_float ? IR_FDIV : IR_DIV;
+            break;
+        case TOKEN_EQEQ:
+            op = is_float ? IR_FEQ : IR_EQ;
+            break;
+        case TOKEN_BANG_EQ:
+            op = is_float ? IR_FNE : IR_NE;
+            break;
+        case TOKEN_GT:
+            op = is_float ? IR_FGT : IR_GT;
+            break;
+        case TOKEN_GTEQ:
+            op = is_float ? IR_FGE : IR_GE;
+            break;
+        case TOKEN_LT:
+            op = is_float ? IR_FLT : IR_LT;
+            break;
+        case TOKEN_LTEQ:
+            op = is_float ? IR_FLE : IR_LE;
+            break;
+        default:
+            unsupported(lowerer, node, "This operator");
+            return emit_zero(lowerer, node_type(lowerer, node));
+    }
+    return emit_value(lowerer, op, node_type(lowerer, node), args, 2);
+}
+
+static IrValue lower_unary(Lowerer* lowerer, ASTNode* node) {
+    IrValue operand = lower_expression(lowerer, node->unary_expr.operand);
+    IrType type = node_type(lowerer, node);
+    switch (node->unary_expr.op.type) {
+        case TOKEN_MINUS:
+            return emit_value(lowerer, type == IR_FLOAT ? IR_FNEG : IR_NEG, type, &operand, 1);
+        case TOKEN_BANG:
+            return emit_value(lowerer, IR_NOT, IR_BOOL, &operand, 1);
+        default:
+            unsupported(lowerer, node, "This operator");
+            return emit_zero(lowerer, type);
+    }
+}
+
+// The right operand runs only if the left one does not decide the result;
+// on the edge that skips it, the result is the left operand
+static IrValue lower_logical(Lowerer* lowerer, ASTNode* node) {
+    LowerScope* scope = lowerer->scope;
+    IrValue left = lower_condition(lowerer, node->logical_expr.left);
+    IrBlock* from = scope->block;
+    IrBlock* right_block = ir_block_new(lowerer->module);
+    IrBlock* merge = ir_block_new(lowerer->module);
+    if (node->logical_expr.op.type == TOKEN_AMPAMP) {
+        branch(lowerer, left, right_block, merge);
+    } else {
+        branch(lowerer, left, merge, right_block);
+    }
+
+    start(lowerer, right_block);
+    IrValue right = lower_condition(lowerer, node->logical_expr.right);
+    jump(lowerer, merge);
+    start(lowerer, merge);
+
+    IrValue args[2];
+    IrBlock** preds = merge->preds.items;
+    for (uint32_t i = 0; i < 2; i++) {
+        args[i] = preds[i] == from ? left : right;
+    }
+    return emit_value(lowerer, IR_PHI, IR_BOOL, args, 2);
+}
+
+// print picks the runtime function for its argument's type; any other
+// builtin 'name' is rt_name. Nil results are only materialized if 'used'.
+static IrValue lower_builtin(Lowerer* lowerer, ASTNode* node, Symbol builtin, IrValue* args, uint32_t count, bool used) {
+    const char* text = symbol_text(lowerer->interner, builtin);
+    uint32_t length = symbol_length(lowerer->interner, builtin);
+    IrType result = node_type(lowerer, node);
+
+    if (length == 5 && memcmp(text, "print", 5) == 0 && count == 1) {
+        static const char* const names[TYPE_KIND_COUNT] = {
+            [TYPE_NIL] = "rt_print_nil",
+            [TYPE_BOOL] = "rt_print_bool",
+            [TYPE_INT] = "rt_print_int",
+            [TYPE_FLOAT] = "rt_print_float",
+            [TYPE_CHAR] = "rt_print_char",
+            [TYPE_STRING] = "rt_print_string",
+        };
+        TypeKind kind = type_kind(lowerer, SMALL_VEC_AT(&node->call_expr.args, 0)->value_type);
+        emit_runtime_call(lowerer, names[kind] ? names[kind] : "rt_print_any", IR_VOID, args, 1);
+        return used ? emit_zero(lowerer, result) : IR_NO_VALUE;
+    }
+
+    char name[LOWER_NAME_SIZE];
+    snprintf(name, sizeof(name), "rt_%.*s", (int)length, text);
+    return emit_runtime_call(lowerer, name, result, args, count);
+}
+
+static IrValue lower_call(Lowerer* lowerer, ASTNode* node, bool used) {
+    CallExpr* call = &node->call_expr;
+    ASTNode* callee = call->callee;
+
+    uint32_t direct = IR_NONE;
+    Symbol builtin = SYMBOL_NONE;
+    if (callee->type == NODE_IDENTIFIER && callee->ident.binding.kind == BINDING_GLOBAL) {
+        direct = lowerer->functions[callee->ident.binding.index];
+        builtin = lowerer->builtins[callee->ident.binding.index];
+    }
+
+    // An indirect call passes the closure first
+    uint32_t first = direct == IR_NONE && builtin == SYMBOL_NONE ? 1 : 0;
+    uint32_t count = call->args.count + first;
+    IrValue stack[LOWER_STACK_ARGS];
+    IrValue* args = count <= LOWER_STACK_ARGS ? stack : f_malloc(count * sizeof(IrValue));
+    if (first) args[0] = lower_expression(lowerer, callee);
+    for (uint32_t i = 0; i < call->args.count; i++) {
+        args[first + i] = lower_expression(lowerer, SMALL_VEC_AT(&call->args, i));
+    }
+
+    IrValue value;
+    if (builtin != SYMBOL_NONE) {
+        value = lower_builtin(lowerer, node, builtin, args, count, used);
+    } else {
+        IrInstr* instr = emit(lowerer, first ? IR_CALLI : IR_CALL, node_type(lowerer, node), args, count);
+        if (!first) instr->imm = direct;
+        value = instr->dest;
+    }
+
+    if (args != stack) f_free(args);
+    return value;
+}
+
+static IrValue lower_expression(Lowerer* lowerer, ASTNode* node) {
+    if (!node) return emit_zero(lowerer, IR_PTR);
+
+    switch (node->type) {
+        case NODE_INT_LITERAL:
+            return emit_const(lowerer, IR_INT, node->int_value);
+        case NODE_FLOAT_LITERAL: {
+            IrInstr* instr = emit(lowerer, IR_FCONST, IR_FLOAT, NULL, 0);
+            instr->fimm = node->float_value;
+            return instr->dest;
+        }
+        case NODE_BOOL_LITERAL:
+            return emit_const(lowerer, IR_BOOL, node->bool_value);
+        case NODE_CHAR_LITERAL:
+            return emit_const(lowerer, IR_INT, (unsigned char)node->char_value);
+        case NODE_NIL_LITERAL:
+            return emit_zero(lowerer, IR_PTR);
+        case NODE_STRING_LITERAL: {
+            uint32_t index = ir_string(lowerer->module, node->string_value, strlen(node->string_value));
+            return emit_index(lowerer, IR_STRING, IR_PTR, index);
+        }
+
+        case NODE_IDENTIFIER:
+            return read_variable(lowerer, node);
+        case NODE_BINARY_EXPR:
+            return lower_binary(lowerer, node);
+        case NODE_UNARY_EXPR:
+            return lower_unary(lowerer, node);
+        case NODE_LOGICAL_EXPR:
+            return lower_logical(lowerer, node);
+        case NODE_CALL_EXPR:
+            return lower_call(lowerer, node, true);
+
+        case NODE_CLOSURE_EXPR:
+            if (node->closure_expr.function && node->closure_expr.function->func_decl.frame) {
+                return lower_closure(lowerer, node->closure_expr.function);
+            }
+            return emit_zero(lowerer, IR_PTR);
+
+        case NODE_GET_EXPR:
+        case NODE_SET_EXPR:
+            unsupported(lowerer, node, "Field access");
+            break;
+        case NODE_ARRAY_EXPR:
+        case NODE_INDEX_EXPR:
+            unsupported(lowerer, node, "An array");
+            break;
+        case NODE_CHAN_SEND_EXPR:
+        case NODE_CHAN_RECV_EXPR:
+            unsupported(lowerer, node, "A channel");
+            break;
+        case NODE_ASYNC_EXPR:
+        case NODE_AWAIT_EXPR:
+            unsupported(lowerer, node, "async");
+            break;
+        default:
+            unsupported(lowerer, node, "This expression");
+            break;
+    }
+    return emit_zero(lowerer, node_type(lowerer, node));
+}
+
+// Statements
+static void lower_if(Lowerer* lowerer, ASTNode* node) {
+    IfStmt* stmt = &node->if_stmt;
+    IrValue condition = lower_condition(lowerer, stmt->condition);
+    IrBlock* then_block = ir_block_new(lowerer->module);
+    IrBlock* else_block = stmt->else_branch ? ir_block_new(lowerer->module) : NULL;
+    IrBlock* merge = ir_block_new(lowerer->module);
+    branch(lowerer, condition, then_block, else_block ? else_block : merge);
+
+    start(lowerer, then_block);
+    lower_statement(lowerer, stmt->then_branch);
+    jump(lowerer, merge);
+    if (else_block) {
+        start(lowerer, else_block);
+        lower_statement(lowerer, stmt->else_branch);
+        jump(lowerer, merge);
+    }
+    start(lowerer, merge);
+}
+
+// 'body' runs while 'condition' (always, if NULL) holds; 'continue' goes to
+// 'increment', then back to the condition
+static void lower_loop(Lowerer* lowerer, ASTNode* condition, ASTNode* increment, ASTNode* body) {
+    LowerScope* scope = lowerer->scope;
+    IrBlock* header = ir_block_new(lowerer->module);
+    IrBlock* body_block = ir_block_new(lowerer->module);
+    IrBlock* step = increment ? ir_block_new(lowerer->module) : header;
+    IrBlock* exit = ir_block_new(lowerer->module);
+
+    jump(lowerer, header);
+    start(lowerer, header);
+    if (condition) {
+        branch(lowerer, lower_condition(lowerer, condition), body_block, exit);
+    } else {
+        jump(lowerer, body_block);
+    }
+
+    IrBlock* outer_break = scope->break_target;
+    IrBlock* outer_continue = scope->continue_target;
+    scope->break_target = exit;
+    scope->continue_target = step;
+    start(lowerer, body_block);
+    lower_statement(lowerer, body);
+    jump(lowerer, step);
+    scope->break_target = outer_break;
+    scope->continue_target = outer_continue;
+
+    if (increment) {
+        start(lowerer, step);
+        if (scope->block) {
+            lower_expression(lowerer, increment);
+            jump(lowerer, header);
+        }
+    }
+    start(lowerer, exit);
+}
+
+static void lower_statement(Lowerer* lowerer, ASTNode* node) {
+    LowerScope* scope = lowerer->scope;
+    if (!node || !scope->block) return;
+
+    switch (node->type) {
+        case NODE_VAR_DECL: {
+            ASTNode* value = node->var_decl.value;
+            define(lowerer, node->var_decl.binding,
+                   value ? lower_expression(lowerer, value) : emit_zero(lowerer, node_type(lowerer, node)));
+            break;
+        }
+
+        case NODE_FUNCTION_DECL:
+            lower_function_decl(lowerer, node);
+            break;
+
+        case NODE_CHAN_DECL:
+            // The binding still gets a value so later uses lower
+            unsupported(lowerer, node, "A channel");
+            define(lowerer, node->chan_decl.binding, emit_zero(lowerer, IR_PTR));
+            break;
+
+        case NODE_EXPORT_DECL:
+            lower_statement(lowerer, node->export_decl.declaration);
+            break;
+
+        // Nothing to run
+        case NODE_TYPE_DECL:
+        case NODE_INTERFACE_DECL:
+        case NODE_ENUM_DECL:
+        case NODE_IMPORT_DECL:
+            break;
+
+        case NODE_BLOCK_STMT:
+            for (uint32_t i = 0; i < node->block_stmt.statements.count; i++) {
+                lower_statement(lowerer, SMALL_VEC_AT(&node->block_stmt.statements, i));
+            }
+            break;
+
+        case NODE_IF_STMT:
+            lower_if(lowerer, node);
+            break;
+
+        case NODE_WHILE_STMT:
+            lower_loop(lowerer, node->while_stmt.condition, NULL, node->while_stmt.body);
+            break;
+
+        case NODE_FOR_STMT:
+            lower_statement(lowerer, node->for_stmt.initializer);
+            if (scope->block) {
+                lower_loop(lowerer, node->for_stmt.condition, node->for_stmt.increment, node->for_stmt.body);
+            }
+            break;
+
+        case NODE_RETURN_STMT: {
+            IrType result = scope->function->result;
+            ASTNode* value = node->return_stmt.value;
+            if (result == IR_VOID) {
+                if (value) lower_expression(lowerer, value);
+                ret(lowerer, IR_NO_VALUE);
+            } else {
+                ret(lowerer, value ? lower_expression(lowerer, value) : emit_zero(lowerer, result));
+            }
+            break;
+        }
+
+        case NODE_BREAK_STMT:
+        case NODE_CONTINUE_STMT: {
+            IrBlock* target = node->type == NODE_BREAK_STMT ? scope->break_target : scope->continue_target;
+            if (!target) {
+                error_at(lowerer, node->offset, "'%s' outside of a loop",
+                         node->type == NODE_BREAK_STMT ? "break" : "continue");
+                break;
+            }
+            jump(lowerer, target);
+            break;
+        }
+
+        case NODE_EXPR_STMT: {
+            // Calls to nil builtins produce no value here
+            ASTNode* expr = node->expr_stmt.expr;
+            if (expr && expr->type == NODE_CALL_EXPR) {
+                lower_call(lowerer, expr, false);
+            } else {
+                lower_expression(lowerer, expr);
+            }
+            break;
+        }
+
+        case NODE_GO_STMT:
+            unsupported(lowerer, node, "'go'");
+            break;
+
+        case NODE_CLASS_DECL:
+            unsupported(lowerer, node, "A class");
+            break;
+        case NODE_TRAIT_DECL:
+        case NODE_IMPL_DECL:
+            unsupported(lowerer, node, "A trait");
+            break;
+        case NODE_FOREACH_STMT:
+            unsupported(lowerer, node, "'foreach'");
+            break;
+        case NODE_TRY_STMT:
+        case NODE_CATCH_CLAUSE:
+        case NODE_THROW_STMT:
+            unsupported(lowerer, node, "An exception");
+            break;
+        case NODE_MATCH_STMT:
+            unsupported(lowerer, node, "'match'");
+            break;
+        case NODE_DEFER_STMT:
+            unsupported(lowerer, node, "'defer'");
+            break;
+        case NODE_SELECT_STMT:
+            unsupported(lowerer, node, "'select'");
+            break;
+
+        default:
+            // An expression in statement position
+            lower_expression(lowerer, node);
+            break;
+    }
+}
+
+// Top level
+//
+// Every top-level function gets its IR function before any code is
+// lowered, so calls to functions declared later are direct.
+static void hoist_function(Lowerer* lowerer, ASTNode* node) {
+    if (node->type == NODE_EXPORT_DECL && node->export_decl.declaration) {
+        hoist_function(lowerer, node->export_decl.declaration);
+    } else if (node->type == NODE_FUNCTION_DECL && node->func_decl.frame &&
+               node->func_decl.frame->binding.kind == BINDING_GLOBAL) {
+        lowerer->functions[node->func_decl.frame->binding.index] = new_function(lowerer, node)->index;
+    }
+}
+
+// Function bodies are lowered even after top-level code that returns
+static void lower_top_level(Lowerer* lowerer, ASTNode* node) {
+    if (node->type == NODE_EXPORT_DECL && node->export_decl.declaration) {
+        lower_top_level(lowerer, node->export_decl.declaration);
+    } else if (node->type == NODE_FUNCTION_DECL && node->func_decl.frame &&
+               node->func_decl.frame->binding.kind == BINDING_GLOBAL) {
+        lower_function_decl(lowerer, node);
+    } else {
+        lower_statement(lowerer, node);
+    }
+}
+
+bool lower_program(IrModule* module, ASTNode* root, const Resolver* resolver, TypeTable* types,
+                   Interner* interner, const char* source, const char* filename) {
+    Lowerer lowerer = {
+        .module = module,
+        .types = types,
+        .interner = interner,
+        .filename = filename,
+    };
+    line_map_init(&lowerer.lines, source);
+
+    uint32_t global_count = resolver->global_count;
+    module->global_count = global_count;
+    lowerer.functions = f_malloc((global_count ? global_count : 1) * sizeof(uint32_t));
+    lowerer.builtins = f_calloc(global_count ? global_count : 1, sizeof(Symbol));
+    for (uint32_t i = 0; i < global_count; i++) {
+        lowerer.functions[i] = IR_NONE;
+    }
+    const Declaration* declarations = resolver->declarations.items;
+    for (usize i = 0; i < resolver->declarations.count; i++) {
+        if (!declarations[i].target && declarations[i].binding.kind == BINDING_GLOBAL) {
+            lowerer.builtins[declarations[i].binding.index] = declarations[i].symbol;
+        }
+    }
+
+    // The top-level code returns 0 from 'main'
+    LowerScope script = {
+        .function = ir_function_new(module, "main", IR_INT),
+        .slots = f_calloc(resolver->script_frame_size ? resolver->script_frame_size : 1, sizeof(IrValue)),
+    };
+    lowerer.scope = &script;
+    start(&lowerer, ir_block_new(module));
+
+    if (root) {
+        usize count = root->type == NODE_BLOCK_STMT ? root->block_stmt.statements.count : 1;
+        ASTNode** items = root->type == NODE_BLOCK_STMT ? SMALL_VEC_ITEMS(&root->block_stmt.statements) : &root;
+        for (usize i = 0; i < count; i++) {
+            if (items[i]) hoist_function(&lowerer, items[i]);
+        }
+        for (usize i = 0; i < count; i++) {
+            if (items[i]) lower_top_level(&lowerer, items[i]);
+        }
+    }
+    finish_function(&lowerer);
+
+    lowerer.scope = NULL;
+    f_free(script.slots);
+    f_free(lowerer.functions);
+    f_free(lowerer.builtins);
+    line_map_free(&lowerer.lines);
+    return lowerer.error_count == 0;
+}
@@ -6,12 +6,23 @@
 
 #include "common.h"
 #include "lexer.h"
+#include "lexer_parallel.h"
+#include "intern.h"
 #include "parser.h"
+#include "parser_parallel.h"
+#include "parser_incremental.h"
 #include "ast.h"
+#include "ast_flat.h"
+#include "ast_cache.h"
+#include "resolver.h"
+#include "typecheck.h"
+#include "lower.h"
+#include "passes.h"
 #include "codegen.h"
 #include "ferror.h"
 #include "runtime/memory.h"
 #include "runtime/io.h"
+#include "runtime/sys.h"
 
 static void print_usage(const char* program_name) {
     printf("Usage: %s [options] <source_file>\n", program_name);
@@ -20,6 +31,13 @@ static void print_usage(const char* program_name) {
     printf("  -v           Print version information\n");
     printf("  -h           Print this help message\n");
     printf("  -d           Enable debug output\n");
+    printf("  -O<n>        Optimization level 0 to 3 (default: 1)\n");
+    printf("  -j <n>       Lex and parse on n threads (default: one per CPU)\n");
+    printf("  --cache-dir <dir>  Reuse parsed ASTs of unchanged sources from <dir>\n");
+    printf("  --mem-stats  Print memory usage per compiler phase\n");
+    printf("  --dump-ir    Print the IR of the program, after optimization\n");
+    printf("  --time-passes  Print the time and IR size change of each pass\n");
+    printf("  --watch      Recompile whenever the source file changes\n");
 }
 
 static void print_version(void) {
@@ -27,40 +45,141 @@ static void print_version(void) {
     printf("Copyright (c) 2024 Ferrum Team\n");
 }
 
-static char* read_file(const char* path) {
-    FILE* file = fopen(path, "rb");
-    if (file == NULL) {
-        ferror_set("Could not open file '%s'", path);
-        return NULL;
-    }
+// Options that apply after parsing
+typedef struct {
+    const char* output_file;
+    OptLevel opt_level;
+    bool dump_ir;
+    bool time_passes;
+    bool mem_stats;
+} BuildOptions;
 
-    fseek(file, 0L, SEEK_END);
-    size_t file_size = ftell(file);
-    rewind(file);
+// Polling period of --watch
+#define WATCH_INTERVAL_MS 200
 
-    char* buffer = (char*)malloc(file_size + 1);
-    if (buffer == NULL) {
-        ferror_set("Not enough memory to read '%s'", path);
-        fclose(file);
-        return NULL;
+// Runs everything after the parser on 'ast' and writes the output file.
+// Diagnostics are printed here; the tree is left to the caller to free.
+static bool compile_tree(ASTNode* ast, Interner* interner, const char* source, const char* source_file,
+                         const BuildOptions* options) {
+    // Bind every variable reference to its frame slot, upvalue or global,
+    // infer the type of every expression, then run the passes on the tree
+    memory_set_phase(PHASE_SEMANTIC);
+    PassManager passes;
+    pass_manager_init(&passes, options->opt_level, options->time_passes);
+    Resolver resolver;
+    resolver_init(&resolver, interner, source, source_file);
+    bool checked = resolve_program(&resolver, ast);
+    TypeTable types;
+    type_table_init(&types);
+    if (checked) {
+        TypeChecker checker;
+        type_checker_init(&checker, &types, interner, source, source_file);
+        checked = typecheck_program(&checker, ast, &resolver);
+        type_checker_free(&checker);
+        if (checked) pass_manager_run_ast(&passes, ast, &resolver);
     }
-
-    size_t bytes_read = fread(buffer, sizeof(char), file_size, file);
-    if (bytes_read < file_size) {
-        ferror_set("Could not read file '%s'", path);
-        free(buffer);
-        fclose(file);
-        return NULL;
+    memory_set_phase(PHASE_DRIVER);
+    if (!checked) {
+        fprintf(stderr, "Error: Semantic analysis failed\n");
+        pass_manager_free(&passes);
+        resolver_free(&resolver);
+        type_table_free(&types);
+        return false;
     }
 
-    buffer[bytes_read] = '\0';
-    fclose(file);
-    return buffer;
+    // Lower the tree to IR and optimize it; the backend only sees the IR
+    memory_set_phase(PHASE_CODEGEN);
+    IrModule module;
+    ir_module_init(&module);
+    uint64_t start = options->time_passes ? sys_nanotime() : 0;
+    bool lowered = lower_program(&module, ast, &resolver, &types, interner, source, source_file);
+    resolver_free(&resolver);
+    if (options->time_passes) pass_manager_record(&passes, "lower", sys_nanotime() - start, 0, ir_instr_count(&module));
+    if (lowered) pass_manager_run_ir(&passes, &module);
+    if (lowered && options->dump_ir) ir_dump(&module, stdout);
+
+    // Initialize code generation context
+    CodeGenContext codegen_ctx;
+    codegen_init(&codegen_ctx, TARGET_X86_64);  // Default to x86_64
+    codegen_ctx.optimize = options->opt_level > OPT_O0;
+
+    // Generate code
+    start = options->time_passes ? sys_nanotime() : 0;
+    bool generated = lowered && codegen_generate(&codegen_ctx, &module, options->output_file);
+    if (options->time_passes) pass_manager_record(&passes, "codegen", sys_nanotime() - start, 0, 0);
+    memory_set_phase(PHASE_DRIVER);
+    if (options->time_passes) pass_manager_report(&passes, stderr);
+    if (options->mem_stats) memory_report(stderr);
+    // Lowering has printed its own diagnostics; codegen only fails to write
+    if (lowered && !generated) fprintf(stderr, "Error: Code generation failed - %s\n", sys_get_error_message());
+
+    pass_manager_free(&passes);
+    ir_module_free(&module);
+    type_table_free(&types);
+    codegen_free(&codegen_ctx);
+    return generated;
+}
+
+// Recompiles 'source_file' each time its modification time changes, until
+// the process is interrupted. The file is lexed again every time, but
+// parse_incremental only parses the declarations that changed.
+FERRUM_NO_RETURN static void watch(const char* source_file, const BuildOptions* options) {
+    ParseCache cache;
+    parse_cache_init(&cache);
+    uint64_t built = 0;
+
+    for (;;) {
+        uint64_t modified;
+        if (!sys_file_mtime(source_file, &modified) || modified == built) {
+            sys_sleep_ms(WATCH_INTERVAL_MS);
+            continue;
+        }
+        built = modified;
+
+        MappedFile input;
+        if (!sys_map_file(source_file, &input)) {
+            fprintf(stderr, "Error: Could not open file '%s'\n", source_file);
+            continue;
+        }
+
+        ArenaAllocator ast_memory;
+        arena_allocator_init(&ast_memory, "ast", PHASE_PARSER, 0);
+        ast_set_arena(&ast_memory.arena);
+        TokenStream tokens;
+        token_stream_init(&tokens);
+
+        memory_set_phase(PHASE_LEXER);
+        token_stream_lex(&tokens, input.data);
+        memory_set_phase(PHASE_PARSER);
+        bool parse_error = false;
+        ASTNode* ast = parse_incremental(&cache, &tokens, source_file, &parse_error);
+        memory_set_phase(PHASE_DRIVER);
+
+        if (parse_error) {
+            fprintf(stderr, "Error: Parsing failed\n");
+        } else if (compile_tree(ast, &cache.interner, input.data, source_file, options)) {
+            printf("Compiled %s to %s (%u declaration ranges reused, %u parsed)\n",
+                   source_file, options->output_file, cache.reused, cache.reparsed);
+        }
+        fflush(stdout);
+
+        ast_set_arena(NULL);
+        allocator_release(&ast_memory.base);
+        token_stream_free(&tokens);
+        sys_unmap_file(&input);
+    }
 }
 
 int main(int argc, char* argv[]) {
     char* output_file = "a.out";
     bool debug_mode = false;
+    int thread_count = 0;
+    char* cache_dir = NULL;
+    bool mem_stats = false;
+    bool dump_ir = false;
+    OptLevel opt_level = OPT_O1;
+    bool time_passes = false;
+    bool watch_mode = false;
     char* source_file = NULL;
 
     // Parse command line arguments
@@ -79,6 +198,32 @@ int main(int argc, char* argv[]) {
                 return 1;
             }
             output_file = argv[i];
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: -j requires an argument\n");
+                return 1;
+            }
+            thread_count = atoi(argv[i]);
+        } else if (strcmp(argv[i], "--cache-dir") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: --cache-dir requires an argument\n");
+                return 1;
+            }
+            cache_dir = argv[i];
+        } else if (strcmp(argv[i], "--mem-stats") == 0) {
+            mem_stats = true;
+        } else if (strcmp(argv[i], "--dump-ir") == 0) {
+            dump_ir = true;
+        } else if (strncmp(argv[i], "-O", 2) == 0) {
+            if (argv[i][2] < '0' || argv[i][2] > '3' || argv[i][3] != '\0') {
+                fprintf(stderr, "Error: Unknown optimization level '%s'\n", argv[i]);
+                return 1;
+            }
+            opt_level = (OptLevel)(argv[i][2] - '0');
+        } else if (strcmp(argv[i], "--time-passes") == 0) {
+            time_passes = true;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch_mode = true;
         } else if (source_file == NULL) {
             source_file = argv[i];
         } else {
@@ -96,27 +241,75 @@ int main(int argc, char* argv[]) {
     // Initialize the memory system
     memory_init();
 
-    // Read the source file
-    char* source = read_file(source_file);
-    if (source == NULL) {
-        fprintf(stderr, "Error: %s\n", ferror_get());
+    if (watch_mode) {
+        BuildOptions options = {output_file, opt_level, dump_ir, time_passes, mem_stats};
+        watch(source_file, &options);
+    }
+
+    // Map the source file; tokens and identifier names point into it
+    MappedFile input;
+    if (!sys_map_file(source_file, &input)) {
+        fprintf(stderr, "Error: Could not open file '%s'\n", source_file);
         return 1;
     }
+    const char* source = input.data;
 
-    // Initialize lexer
-    Lexer lexer;
-    lexer_init(&lexer, source);
+    // The AST lives in one arena, released in a single call
+    ArenaAllocator ast_memory;
+    arena_allocator_init(&ast_memory, "ast", PHASE_PARSER, 0);
+    ast_set_arena(&ast_memory.arena);
 
-    // Initialize parser
-    Parser parser;
-    parser_init(&parser, &lexer, source_file);
+    Interner interner;
+    interner_init_borrowed(&interner);
+    TokenStream tokens;
+    token_stream_init(&tokens);
+    if (thread_count <= 0) thread_count = sys_cpu_count();
 
-    // Parse the program
-    ASTNode* ast = parse(&parser);
-    if (ast == NULL || parser.had_error) {
-        fprintf(stderr, "Error: Parsing failed\n");
-        free(source);
-        return 1;
+    // An unchanged source skips lexing and parsing: its tree is rebuilt
+    // from the mapped cache file
+    AstCache cache;
+    memset(&cache, 0, sizeof(cache));
+    uint64_t cache_key = 0;
+    ASTNode* ast = NULL;
+    if (cache_dir) {
+        cache_key = ast_cache_key(source, input.length);
+        if (ast_cache_load(&cache, cache_dir, cache_key, source, input.length)) {
+            if (ast_cache_intern(&cache, &interner)) {
+                ast = flat_ast_to_tree(&cache.ast, cache.ast.root);
+            } else {
+                interner_free(&interner);
+                interner_init_borrowed(&interner);
+            }
+        }
+    }
+
+    if (!ast) {
+        // Lex the whole file up front
+        memory_set_phase(PHASE_LEXER);
+        token_stream_lex_parallel(&tokens, source, input.length, thread_count);
+
+        // Parse the program
+        memory_set_phase(PHASE_PARSER);
+        bool parse_error = false;
+        ast = parse_parallel(&tokens, &interner, source_file, thread_count, &parse_error);
+        memory_set_phase(PHASE_DRIVER);
+        if (ast == NULL || parse_error) {
+            fprintf(stderr, "Error: Parsing failed\n");
+            allocator_release(&ast_memory.base);
+            interner_free(&interner);
+            token_stream_free(&tokens);
+            ast_cache_close(&cache);
+            sys_unmap_file(&input);
+            return 1;
+        }
+
+        if (cache_dir) {
+            FlatAST flat;
+            flat_ast_init(&flat, source);
+            flat_ast_from_tree(&flat, ast);
+            ast_cache_store(cache_dir, cache_key, input.length, &flat, &interner);
+            flat_ast_free(&flat);
+        }
     }
 
     if (debug_mode) {
@@ -125,23 +318,16 @@ int main(int argc, char* argv[]) {
         printf("Debug: AST root node type = %d\n", ast->type);
     }
 
-    // Initialize code generation context
-    CodeGenContext codegen_ctx;
-    codegen_init(&codegen_ctx, TARGET_X86_64);  // Default to x86_64
-
-    // Generate code
-    if (!codegen_generate(&codegen_ctx, ast, output_file)) {
-        fprintf(stderr, "Error: Code generation failed - %s\n", ferror_get());
-        ast_free_node(ast);
-        codegen_free(&codegen_ctx);
-        free(source);
-        return 1;
-    }
+    BuildOptions options = {output_file, opt_level, dump_ir, time_passes, mem_stats};
+    bool compiled = compile_tree(ast, &interner, source, source_file, &options);
 
     // Cleanup
-    ast_free_node(ast);
-    codegen_free(&codegen_ctx);
-    free(source);
+    allocator_release(&ast_memory.base);
+    interner_free(&interner);
+    token_stream_free(&tokens);
+    ast_cache_close(&cache);
+    sys_unmap_file(&input);
+    if (!compiled) return 1;
     memory_cleanup();
 
     printf("Successfully compiled %s to %s\n", source_file, output_file);
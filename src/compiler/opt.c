@@ -0,0 +1,747 @@
+#include "../../include/passes.h"
+#include <math.h>
+#include <string.h>
+
+// Functions with at most this many instructions are inlined
+#define INLINE_MAX_INSTRS 24
+
+// Replacements
+//
+// A pass that finds a register equal to another records it in 'replace'
+// (register -> the value standing for it, IR_NO_VALUE if none) and
+// rewrites the operands once at the end; the replaced instructions go.
+static IrValue resolve(const IrValue* replace, IrValue value) {
+    while (replace[value] != IR_NO_VALUE) value = replace[value];
+    return value;
+}
+
+static void apply_replacements(IrFunction* function, const IrValue* replace) {
+    IrBlock** blocks = function->blocks.items;
+    for (usize i = 0; i < function->blocks.count; i++) {
+        IrInstr* instrs = blocks[i]->instrs.items;
+        usize kept = 0;
+        for (usize j = 0; j < blocks[i]->instrs.count; j++) {
+            if (instrs[j].dest != IR_NO_VALUE && replace[instrs[j].dest] != IR_NO_VALUE) continue;
+            for (uint32_t k = 0; k < instrs[j].arg_count; k++) {
+                instrs[j].args[k] = resolve(replace, instrs[j].args[k]);
+            }
+            instrs[kept++] = instrs[j];
+        }
+        blocks[i]->instrs.count = kept;
+    }
+}
+
+static bool int_constant(IrInstr** defs, IrValue value, int64_t* result) {
+    IrInstr* def = defs[value];
+    if (!def || def->op != IR_CONST) return false;
+    *result = def->imm;
+    return true;
+}
+
+static bool float_constant(IrInstr** defs, IrValue value, double* result) {
+    IrInstr* def = defs[value];
+    if (!def || def->op != IR_FCONST) return false;
+    *result = def->fimm;
+    return true;
+}
+
+static void make_const(IrInstr* instr, int64_t value) {
+    instr->op = IR_CONST;
+    instr->arg_count = 0;
+    instr->imm = value;
+}
+
+static void make_fconst(IrInstr* instr, double value) {
+    instr->op = IR_FCONST;
+    instr->arg_count = 0;
+    instr->fimm = value;
+}
+
+// simplify
+//
+// The rules of fold.h: integers wrap, a division that traps stays, and the
+// identities that do not hold for -0.0 and NaN are only applied to ints
+static int64_t fold_int(IrOp op, int64_t a, int64_t b) {
+    switch (op) {
+        case IR_ADD: return (int64_t)((uint64_t)a + (uint64_t)b);
+        case IR_SUB: return (int64_t)((uint64_t)a - (uint64_t)b);
+        case IR_MUL: return (int64_t)((uint64_t)a * (uint64_t)b);
+        default: return a / b;
+    }
+}
+
+static bool compare_int(IrOp op, int64_t a, int64_t b) {
+    switch (op) {
+        case IR_EQ: return a == b;
+        case IR_NE: return a != b;
+        case IR_LT: return a < b;
+        case IR_LE: return a <= b;
+        case IR_GT: return a > b;
+        default: return a >= b;
+    }
+}
+
+static bool compare_float(IrOp op, double a, double b) {
+    switch (op) {
+        case IR_FEQ: return a == b;
+        case IR_FNE: return a != b;
+        case IR_FLT: return a < b;
+        case IR_FLE: return a <= b;
+        case IR_FGT: return a > b;
+        default: return a >= b;
+    }
+}
+
+// Rewrites 'instr' in place and sets 'changed', or returns the value it
+// equals; IR_NO_VALUE if neither
+static IrValue simplify_instr(IrInstr** defs, IrInstr* instr, bool* changed) {
+    IrOp op = (IrOp)instr->op;
+    IrValue* args = instr->args;
+    int64_t a, b;
+    double x, y;
+
+    switch (op) {
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV: {
+            bool left = int_constant(defs, args[0], &a);
+            bool right = int_constant(defs, args[1], &b);
+            if (left && right) {
+                if (op == IR_DIV && (b == 0 || (a == INT64_MIN && b == -1))) return IR_NO_VALUE;
+                make_const(instr, fold_int(op, a, b));
+                *changed = true;
+                return IR_NO_VALUE;
+            }
+            if (right && b == 0 && (op == IR_ADD || op == IR_SUB)) return args[0];
+            if (left && a == 0 && op == IR_ADD) return args[1];
+            if (right && b == 1 && (op == IR_MUL || op == IR_DIV)) return args[0];
+            if (left && a == 1 && op == IR_MUL) return args[1];
+            if ((op == IR_MUL && ((left && a == 0) || (right && b == 0))) ||
+                (op == IR_SUB && args[0] == args[1])) {
+                make_const(instr, 0);
+                *changed = true;
+            }
+            return IR_NO_VALUE;
+        }
+        case IR_NEG:
+        case IR_NOT:
+            if (int_constant(defs, args[0], &a)) {
+                make_const(instr, op == IR_NEG ? (int64_t)(0 - (uint64_t)a) : a ^ 1);
+                *changed = true;
+            } else if (defs[args[0]] && defs[args[0]]->op == op) {
+                return defs[args[0]]->args[0];
+            }
+            return IR_NO_VALUE;
+
+        case IR_FADD:
+        case IR_FSUB:
+        case IR_FMUL:
+        case IR_FDIV: {
+            bool left = float_constant(defs, args[0], &x);
+            bool right = float_constant(defs, args[1], &y);
+            if (left && right) {
+                double result = op == IR_FADD ? x + y : op == IR_FSUB ? x - y : op == IR_FMUL ? x * y : x / y;
+                make_fconst(instr, result);
+                *changed = true;
+                return IR_NO_VALUE;
+            }
+            if (right && y == 1.0 && (op == IR_FMUL || op == IR_FDIV)) return args[0];
+            if (left && x == 1.0 && op == IR_FMUL) return args[1];
+            // x - 0.0 is x, but -0.0 - -0.0 is +0.0
+            if (right && y == 0.0 && !signbit(y) && op == IR_FSUB) return args[0];
+            return IR_NO_VALUE;
+        }
+        case IR_FNEG:
+            if (float_constant(defs, args[0], &x)) {
+                make_fconst(instr, -x);
+                *changed = true;
+            } else if (defs[args[0]] && defs[args[0]]->op == IR_FNEG) {
+                return defs[args[0]]->args[0];
+            }
+            return IR_NO_VALUE;
+
+        case IR_EQ:
+        case IR_NE:
+        case IR_LT:
+        case IR_LE:
+        case IR_GT:
+        case IR_GE:
+            if (int_constant(defs, args[0], &a) && int_constant(defs, args[1], &b)) {
+                make_const(instr, compare_int(op, a, b));
+                *changed = true;
+            } else if (args[0] == args[1]) {
+                make_const(instr, op == IR_EQ || op == IR_LE || op == IR_GE);
+                *changed = true;
+            }
+            return IR_NO_VALUE;
+        case IR_FEQ:
+        case IR_FNE:
+        case IR_FLT:
+        case IR_FLE:
+        case IR_FGT:
+        case IR_FGE:
+            if (float_constant(defs, args[0], &x) && float_constant(defs, args[1], &y)) {
+                make_const(instr, compare_float(op, x, y));
+                *changed = true;
+            }
+            return IR_NO_VALUE;
+
+        case IR_PHI: {
+            // Operands that are the phi itself come from a loop that does
+            // not change it
+            IrValue same = IR_NO_VALUE;
+            for (uint32_t i = 0; i < instr->arg_count; i++) {
+                if (args[i] == instr->dest || args[i] == same) continue;
+                if (same != IR_NO_VALUE) return IR_NO_VALUE;
+                same = args[i];
+            }
+            return same;
+        }
+        case IR_BRANCH:
+            // branch (not c), t, f is branch c, f, t; the edges are unchanged
+            while (defs[args[0]] && defs[args[0]]->op == IR_NOT) {
+                args[0] = defs[args[0]]->args[0];
+                IrBlock* swap = instr->targets[0];
+                instr->targets[0] = instr->targets[1];
+                instr->targets[1] = swap;
+                *changed = true;
+            }
+            return IR_NO_VALUE;
+        default:
+            return IR_NO_VALUE;
+    }
+}
+
+// Blocks in reverse postorder, so operands are simplified before their
+// uses, except for phi operands coming around a loop
+static bool simplify_function(PassManager* manager, IrFunction* function) {
+    IrInstr** defs = pass_defs(manager, function);
+    const IrDominators* dominators = pass_dominators(manager, function);
+    IrValue* replace = f_calloc(function->values.count, sizeof(IrValue));
+    bool changed = false;
+    bool replaced = false;
+
+    for (uint32_t i = 0; i < dominators->count; i++) {
+        IrBlock* block = dominators->order[i];
+        IrInstr* instrs = block->instrs.items;
+        for (usize j = 0; j < block->instrs.count; j++) {
+            IrInstr* instr = &instrs[j];
+            for (uint32_t k = 0; k < instr->arg_count; k++) {
+                instr->args[k] = resolve(replace, instr->args[k]);
+            }
+            IrValue value = simplify_instr(defs, instr, &changed);
+            if (value != IR_NO_VALUE) {
+                replace[instr->dest] = value;
+                replaced = true;
+            }
+        }
+    }
+
+    if (replaced) apply_replacements(function, replace);
+    f_free(replace);
+    return changed || replaced;
+}
+
+const IrPass pass_simplify = { "simplify", ANALYSIS_DOMINATORS, simplify_function, false };
+
+// simplify-cfg
+
+// Removes the edge from 'pred' to 'block' and its phi operands
+static void remove_pred(IrBlock* block, const IrBlock* pred) {
+    uint32_t index = ir_pred_index(block, pred);
+    if (index == IR_NONE) return;
+
+    IrBlock** preds = block->preds.items;
+    memmove(&preds[index], &preds[index + 1], (block->preds.count - index - 1) * sizeof(IrBlock*));
+    block->preds.count--;
+    IrInstr* instrs = block->instrs.items;
+    for (usize i = 0; i < block->instrs.count && instrs[i].op == IR_PHI; i++) {
+        IrValue* args = instrs[i].args;
+        memmove(&args[index], &args[index + 1], (instrs[i].arg_count - index - 1) * sizeof(IrValue));
+        instrs[i].arg_count--;
+    }
+}
+
+static uint32_t phi_count(const IrBlock* block) {
+    const IrInstr* instrs = block->instrs.items;
+    uint32_t count = 0;
+    while (count < block->instrs.count && instrs[count].op == IR_PHI) count++;
+    return count;
+}
+
+// A block holding only a jump is skipped by its predecessors, unless the
+// target has phis, which would need an operand for each new edge
+static bool forward_block(IrBlock* block) {
+    IrInstr* last = ir_terminator(block);
+    if (block->id == 0 || block->instrs.count != 1 || last->op != IR_JUMP) return false;
+    IrBlock* target = last->targets[0];
+    if (target == block || phi_count(target) > 0) return false;
+
+    IrBlock** preds = block->preds.items;
+    for (usize i = 0; i < block->preds.count; i++) {
+        IrBlock* pred = preds[i];
+        IrInstr* jump = ir_terminator(pred);
+        for (int t = 0; t < 2; t++) {
+            if (jump->targets[t] == block) jump->targets[t] = target;
+        }
+        if (jump->op == IR_BRANCH && jump->targets[0] == jump->targets[1]) {
+            jump->op = IR_JUMP;
+            jump->arg_count = 0;
+        }
+        if (ir_pred_index(target, pred) == IR_NONE) da_append(&target->preds, &pred);
+    }
+    block->preds.count = 0;
+    remove_pred(target, block);
+    return true;
+}
+
+// 'block' jumps to a block whose only predecessor it is: the two become one
+static bool merge_successor(IrBlock* block, IrValue* replace) {
+    IrInstr* last = ir_terminator(block);
+    if (!last || last->op != IR_JUMP) return false;
+    IrBlock* next = last->targets[0];
+    if (next == block || next->id == 0 || next->preds.count != 1) return false;
+
+    block->instrs.count--;
+    IrInstr* instrs = next->instrs.items;
+    for (usize i = 0; i < next->instrs.count; i++) {
+        if (instrs[i].op == IR_PHI) {
+            replace[instrs[i].dest] = resolve(replace, instrs[i].args[0]);
+        } else {
+            da_append(&block->instrs, &instrs[i]);
+        }
+    }
+
+    IrBlock* successors[2];
+    uint32_t count = ir_successors(next, successors);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t index = ir_pred_index(successors[i], next);
+        if (index != IR_NONE) ((IrBlock**)successors[i]->preds.items)[index] = block;
+    }
+    next->instrs.count = 0;
+    next->preds.count = 0;
+    return true;
+}
+
+// Phis of a block with one predecessor are their operand
+static bool remove_trivial_phis(IrBlock* block, IrValue* replace) {
+    uint32_t count = phi_count(block);
+    if (count == 0 || block->preds.count != 1) return false;
+
+    IrInstr* instrs = block->instrs.items;
+    for (uint32_t i = 0; i < count; i++) {
+        replace[instrs[i].dest] = resolve(replace, instrs[i].args[0]);
+    }
+    memmove(instrs, instrs + count, (block->instrs.count - count) * sizeof(IrInstr));
+    block->instrs.count -= count;
+    return true;
+}
+
+static bool remove_unreachable(IrFunction* function) {
+    IrBlock** blocks = function->blocks.items;
+    usize count = function->blocks.count;
+    bool* reachable = f_calloc(count, sizeof(bool));
+    IrBlock** stack = f_malloc(count * sizeof(IrBlock*));
+    usize depth = 0;
+    reachable[0] = true;
+    stack[depth++] = blocks[0];
+    while (depth > 0) {
+        IrBlock* successors[2];
+        uint32_t successor_count = ir_successors(stack[--depth], successors);
+        for (uint32_t i = 0; i < successor_count; i++) {
+            if (reachable[successors[i]->id]) continue;
+            reachable[successors[i]->id] = true;
+            stack[depth++] = successors[i];
+        }
+    }
+
+    usize kept = 0;
+    for (usize i = 0; i < count; i++) {
+        if (reachable[i]) continue;
+        IrBlock* successors[2];
+        uint32_t successor_count = ir_successors(blocks[i], successors);
+        for (uint32_t j = 0; j < successor_count; j++) remove_pred(successors[j], blocks[i]);
+    }
+    for (usize i = 0; i < count; i++) {
+        if (!reachable[i]) continue;
+        blocks[kept] = blocks[i];
+        blocks[kept]->id = (uint32_t)kept;
+        kept++;
+    }
+    function->blocks.count = kept;
+
+    f_free(reachable);
+    f_free(stack);
+    return kept != count;
+}
+
+static bool simplify_cfg_function(PassManager* manager, IrFunction* function) {
+    IrInstr** defs = pass_defs(manager, function);
+    IrValue* replace = f_calloc(function->values.count, sizeof(IrValue));
+    bool changed = false;
+    bool replaced = false;
+
+    // Branches on constants, while 'defs' still points at the instructions
+    IrBlock** blocks = function->blocks.items;
+    for (usize i = 0; i < function->blocks.count; i++) {
+        IrInstr* last = ir_terminator(blocks[i]);
+        int64_t condition;
+        if (!last || last->op != IR_BRANCH || !int_constant(defs, last->args[0], &condition)) continue;
+        IrBlock* taken = last->targets[condition ? 0 : 1];
+        remove_pred(last->targets[condition ? 1 : 0], blocks[i]);
+        last->op = IR_JUMP;
+        last->arg_count = 0;
+        last->targets[0] = taken;
+        changed = true;
+    }
+
+    for (bool progress = true; progress;) {
+        progress = false;
+        blocks = function->blocks.items;
+        for (usize i = 0; i < function->blocks.count; i++) {
+            if (forward_block(blocks[i])) progress = true;
+        }
+        for (usize i = 0; i < function->blocks.count; i++) {
+            while (merge_successor(blocks[i], replace)) progress = replaced = true;
+            if (remove_trivial_phis(blocks[i], replace)) progress = replaced = true;
+        }
+        if (remove_unreachable(function)) progress = true;
+        changed |= progress;
+    }
+
+    if (replaced) apply_replacements(function, replace);
+    f_free(replace);
+    return changed;
+}
+
+const IrPass pass_simplify_cfg = { "simplify-cfg", 0, simplify_cfg_function, false };
+
+// cse
+//
+// Available expressions live in a map while the dominator tree is walked:
+// entering a block adds its instructions, leaving it removes them again
+static bool commutative(IrOp op) {
+    return op == IR_ADD || op == IR_MUL || op == IR_EQ || op == IR_NE ||
+           op == IR_FADD || op == IR_FMUL || op == IR_FEQ || op == IR_FNE;
+}
+
+static bool cse_candidate(const IrInstr* instr) {
+    switch (instr->op) {
+        case IR_PARAM:
+        case IR_PHI:
+        case IR_LOAD:
+        case IR_STORE:
+        case IR_CALL:
+        case IR_CALLI:
+        case IR_CLOSURE:
+            return false;
+        default:
+            return instr->dest != IR_NO_VALUE;
+    }
+}
+
+// Operands in a canonical order
+static void expr_operands(const IrInstr* instr, IrValue* first, IrValue* second) {
+    *first = instr->arg_count > 0 ? instr->args[0] : IR_NO_VALUE;
+    *second = instr->arg_count > 1 ? instr->args[1] : IR_NO_VALUE;
+    if (commutative((IrOp)instr->op) && *first > *second) {
+        IrValue swap = *first;
+        *first = *second;
+        *second = swap;
+    }
+}
+
+static u64 expr_hash(const IrInstr* instr) {
+    u64 words[3];
+    IrValue first, second;
+    expr_operands(instr, &first, &second);
+    words[0] = (u64)instr->op | (u64)instr->type << 8 | (u64)instr->arg_count << 16;
+    words[1] = (u64)first | (u64)second << 32;
+    memcpy(&words[2], &instr->imm, sizeof(u64));
+    return hash_bytes(words, sizeof(words), 0);
+}
+
+static bool expr_equal(const IrInstr* a, const IrInstr* b) {
+    IrValue a_first, a_second, b_first, b_second;
+    expr_operands(a, &a_first, &a_second);
+    expr_operands(b, &b_first, &b_second);
+    return a->op == b->op && a->type == b->type && a->arg_count == b->arg_count &&
+           a_first == b_first && a_second == b_second && memcmp(&a->imm, &b->imm, sizeof(a->imm)) == 0;
+}
+
+FERRUM_HASH_MAP(ExprMap, expr_map, const IrInstr*, IrInstr*);
+FERRUM_HASH_MAP_IMPL(ExprMap, expr_map, const IrInstr*, IrInstr*, expr_hash, expr_equal)
+
+typedef struct {
+    uint32_t block;
+    uint32_t mark;          // Expressions to keep on leaving; IR_NONE on entering
+} CseVisit;
+
+static bool cse_function(PassManager* manager, IrFunction* function) {
+    const IrDominators* dominators = pass_dominators(manager, function);
+    IrBlock** blocks = function->blocks.items;
+    IrValue* replace = f_calloc(function->values.count, sizeof(IrValue));
+    ExprMap available;
+    expr_map_init(&available, NULL);
+    DynamicArray added = da_new(sizeof(IrInstr*), 64);
+    CseVisit* stack = f_malloc(2 * function->blocks.count * sizeof(CseVisit));
+    usize depth = 0;
+    bool changed = false;
+
+    stack[depth++] = (CseVisit){ 0, IR_NONE };
+    while (depth > 0) {
+        CseVisit visit = stack[--depth];
+        if (visit.mark != IR_NONE) {
+            while (added.count > visit.mark) {
+                expr_map_remove(&available, ((IrInstr**)added.items)[--added.count]);
+            }
+            continue;
+        }
+        stack[depth++] = (CseVisit){ visit.block, (uint32_t)added.count };
+
+        IrBlock* block = blocks[visit.block];
+        IrInstr* instrs = block->instrs.items;
+        for (usize j = 0; j < block->instrs.count; j++) {
+            IrInstr* instr = &instrs[j];
+            for (uint32_t k = 0; k < instr->arg_count; k++) {
+                instr->args[k] = resolve(replace, instr->args[k]);
+            }
+            if (!cse_candidate(instr)) continue;
+
+            bool inserted;
+            IrInstr** found = expr_map_put(&available, instr, &inserted);
+            if (inserted) {
+                *found = instr;
+                da_append(&added, &instr);
+            } else {
+                replace[instr->dest] = (*found)->dest;
+                changed = true;
+            }
+        }
+
+        for (uint32_t child = dominators->child[visit.block]; child != IR_NONE; child = dominators->sibling[child]) {
+            stack[depth++] = (CseVisit){ child, IR_NONE };
+        }
+    }
+
+    if (changed) apply_replacements(function, replace);
+    f_free(stack);
+    da_free(&added);
+    expr_map_free(&available);
+    f_free(replace);
+    return changed;
+}
+
+const IrPass pass_cse = { "cse", ANALYSIS_DOMINATORS, cse_function, false };
+
+// dce
+static bool removable(IrInstr** defs, const IrInstr* instr) {
+    int64_t divisor;
+    switch (instr->op) {
+        case IR_PARAM:      // Numbered by position
+        case IR_STORE:
+        case IR_CALL:
+        case IR_CALLI:
+        case IR_JUMP:
+        case IR_BRANCH:
+        case IR_RET:
+            return false;
+        case IR_DIV:
+            return int_constant(defs, instr->args[1], &divisor) && divisor != 0 && divisor != -1;
+        default:
+            return instr->dest != IR_NO_VALUE;
+    }
+}
+
+static bool dce_function(PassManager* manager, IrFunction* function) {
+    uint32_t* uses = pass_uses(manager, function);
+    IrInstr** defs = pass_defs(manager, function);
+    usize count = function->values.count;
+    bool* dead = f_calloc(count, sizeof(bool));
+    IrValue* worklist = f_malloc(count * sizeof(IrValue));
+    usize pending = 0;
+    bool changed = false;
+
+    for (IrValue value = 1; value < count; value++) {
+        if (defs[value] && uses[value] == 0 && removable(defs, defs[value])) {
+            dead[value] = true;
+            worklist[pending++] = value;
+        }
+    }
+    while (pending > 0) {
+        IrInstr* instr = defs[worklist[--pending]];
+        changed = true;
+        for (uint32_t i = 0; i < instr->arg_count; i++) {
+            IrValue arg = instr->args[i];
+            if (--uses[arg] == 0 && !dead[arg] && defs[arg] && removable(defs, defs[arg])) {
+                dead[arg] = true;
+                worklist[pending++] = arg;
+            }
+        }
+    }
+
+    if (changed) {
+        IrBlock** blocks = function->blocks.items;
+        for (usize i = 0; i < function->blocks.count; i++) {
+            IrInstr* instrs = blocks[i]->instrs.items;
+            usize kept = 0;
+            for (usize j = 0; j < blocks[i]->instrs.count; j++) {
+                if (instrs[j].dest == IR_NO_VALUE || !dead[instrs[j].dest]) instrs[kept++] = instrs[j];
+            }
+            blocks[i]->instrs.count = kept;
+        }
+    }
+
+    f_free(dead);
+    f_free(worklist);
+    return changed;
+}
+
+const IrPass pass_dce = { "dce", ANALYSIS_DOMINATORS, dce_function, false };
+
+// inline
+//
+// A direct call to a function of one block is replaced by a copy of its
+// instructions: parameters become the arguments, the closure the callee's
+// static one, and the returned value the call's
+static const IrFunction* inline_callee(const IrModule* module, const IrFunction* caller, const IrInstr* call) {
+    if (call->op != IR_CALL) return NULL;
+    const IrFunction* callee = ((IrFunction**)module->functions.items)[call->imm];
+    if (callee->external || callee == caller || callee->blocks.count != 1) return NULL;
+    if (call->arg_count != callee->param_count) return NULL;
+
+    const IrBlock* body = ((IrBlock**)callee->blocks.items)[0];
+    const IrInstr* last = ir_terminator(body);
+    if (body->instrs.count > INLINE_MAX_INSTRS || !last || last->op != IR_RET) return NULL;
+    if (call->dest != IR_NO_VALUE && (last->arg_count == 0 || callee->result != (IrType)call->type)) return NULL;
+    return callee;
+}
+
+static IrValue new_value(IrFunction* function, IrType type) {
+    uint8_t value_type = (uint8_t)type;
+    da_append(&function->values, &value_type);
+    return (IrValue)function->values.count - 1;
+}
+
+typedef struct {
+    IrValue call;
+    IrValue result;
+} InlineResult;
+
+static void inline_call(IrModule* module, IrFunction* function, DynamicArray* out, const IrInstr* call,
+                        const IrFunction* callee, DynamicArray* results) {
+    const IrBlock* body = ((IrBlock**)callee->blocks.items)[0];
+    IrValue* map = f_calloc(callee->values.count, sizeof(IrValue));
+    const IrInstr* instrs = body->instrs.items;
+
+    for (usize i = 0; i < body->instrs.count; i++) {
+        const IrInstr* instr = &instrs[i];
+        switch (instr->op) {
+            case IR_PARAM:
+                map[instr->dest] = call->args[instr->imm];
+                break;
+            case IR_ENV: {
+                IrInstr closure = { .op = IR_FUNC, .type = IR_PTR, .imm = callee->index };
+                closure.dest = map[instr->dest] = new_value(function, IR_PTR);
+                da_append(out, &closure);
+                break;
+            }
+            case IR_RET:
+                if (call->dest != IR_NO_VALUE) {
+                    InlineResult result = { call->dest, map[instr->args[0]] };
+                    da_append(results, &result);
+                }
+                break;
+            default: {
+                IrInstr copy = *instr;
+                if (instr->arg_count > 0) {
+                    copy.args = arena_alloc_aligned(&module->arena, instr->arg_count * sizeof(IrValue), _Alignof(IrValue));
+                    for (uint32_t k = 0; k < instr->arg_count; k++) copy.args[k] = map[instr->args[k]];
+                }
+                if (instr->dest != IR_NO_VALUE) {
+                    copy.dest = map[instr->dest] = new_value(function, (IrType)instr->type);
+                }
+                da_append(out, &copy);
+                break;
+            }
+        }
+    }
+    f_free(map);
+}
+
+static bool inline_function(PassManager* manager, IrFunction* function) {
+    IrModule* module = manager->module;
+    DynamicArray results = da_new(sizeof(InlineResult), 0);
+    bool changed = false;
+
+    IrBlock** blocks = function->blocks.items;
+    for (usize i = 0; i < function->blocks.count; i++) {
+        IrBlock* block = blocks[i];
+        IrInstr* instrs = block->instrs.items;
+        usize count = block->instrs.count;
+        usize first = 0;
+        while (first < count && !inline_callee(module, function, &instrs[first])) first++;
+        if (first == count) continue;
+
+        // Rebuilt in a new array; the old one stays in the arena
+        DynamicArray rebuilt = da_new_in(&module->arena, sizeof(IrInstr), count + INLINE_MAX_INSTRS);
+        for (usize j = 0; j < count; j++) {
+            const IrFunction* callee = j < first ? NULL : inline_callee(module, function, &instrs[j]);
+            if (callee) {
+                inline_call(module, function, &rebuilt, &instrs[j], callee, &results);
+            } else {
+                da_append(&rebuilt, &instrs[j]);
+            }
+        }
+        block->instrs = rebuilt;
+        changed = true;
+    }
+
+    if (results.count > 0) {
+        IrValue* replace = f_calloc(function->values.count, sizeof(IrValue));
+        InlineResult* replaced = results.items;
+        for (usize i = 0; i < results.count; i++) {
+            replace[replaced[i].call] = replaced[i].result;
+        }
+        apply_replacements(function, replace);
+        f_free(replace);
+    }
+    da_free(&results);
+    return changed;
+}
+
+const IrPass pass_inline = { "inline", ANALYSIS_DOMINATORS, inline_function, true };
+
+// renumber
+static bool renumber_function(PassManager* manager, IrFunction* function) {
+    IrValue* number = f_calloc(function->values.count, sizeof(IrValue));
+    DynamicArray values = da_new_in(&manager->module->arena, sizeof(uint8_t), function->values.count);
+    uint8_t none = IR_VOID;
+    da_append(&values, &none);
+
+    IrBlock** blocks = function->blocks.items;
+    for (usize i = 0; i < function->blocks.count; i++) {
+        IrInstr* instrs = blocks[i]->instrs.items;
+        for (usize j = 0; j < blocks[i]->instrs.count; j++) {
+            if (instrs[j].dest == IR_NO_VALUE) continue;
+            number[instrs[j].dest] = (IrValue)values.count;
+            da_append(&values, &instrs[j].type);
+        }
+    }
+    bool changed = values.count != function->values.count;
+    if (changed) {
+        for (usize i = 0; i < function->blocks.count; i++) {
+            IrInstr* instrs = blocks[i]->instrs.items;
+            for (usize j = 0; j < blocks[i]->instrs.count; j++) {
+                instrs[j].dest = number[instrs[j].dest];
+                for (uint32_t k = 0; k < instrs[j].arg_count; k++) instrs[j].args[k] = number[instrs[j].args[k]];
+            }
+        }
+        function->values = values;
+    }
+    f_free(number);
+    return changed;
+}
+
+const IrPass pass_renumber = { "renumber", ANALYSIS_DOMINATORS, renumber_function, false };
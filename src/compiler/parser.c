@@ -8,73 +8,68 @@
 #include <string.h>
 #include <stdio.h>
 
-// Precedence levels
+// An operator waiting for its operand on the parse_precedence stack
 typedef enum {
-    PREC_NONE,
-    PREC_ASSIGNMENT,  // = += -= *= /= %= &= |= ^= <<= >>=
-    PREC_CONDITIONAL, // ?:
-    PREC_OR,         // ||
-    PREC_AND,        // &&
-    PREC_BITWISE_OR, // |
-    PREC_BITWISE_XOR,// ^
-    PREC_BITWISE_AND,// &
-    PREC_EQUALITY,   // == !=
-    PREC_COMPARISON, // < > <= >=
-    PREC_SHIFT,      // << >>
-    PREC_TERM,       // + -
-    PREC_FACTOR,     // * / %
-    PREC_UNARY,      // ! ~ - + ++ -- & *
-    PREC_CALL,       // . () []
-    PREC_PRIMARY
-} Precedence;
-
-typedef void (*ParseFn)(Parser* parser, ASTNode** node, bool can_assign);
+    FRAME_UNARY,
+    FRAME_BINARY,
+    FRAME_LOGICAL,
+    FRAME_GROUPING
+} FrameKind;
 
 typedef struct {
-    ParseFn prefix;
-    ParseFn infix;
-    Precedence precedence;
-} ParseRule;
+    FrameKind kind;
+    Precedence precedence;  // Binding power of the pending operand
+    Token op;
+    ASTNode* left;
+} OperatorFrame;
 
-static void parse_expression(Parser* parser, ASTNode** node, bool can_assign);
-static void parse_statement(Parser* parser, ASTNode** node);
 static void parse_declaration(Parser* parser, ASTNode** node);
-static void parse_block(Parser* parser, ASTNode** node);
+static void synchronize(Parser* parser);
+static ParseRule* get_rule(TokenType type);
 
 // Error handling
-static void error_at(Parser* parser, Token* token, const char* message) {
+void error_at(Parser* parser, Token* token, const char* message) {
     if (parser->panic_mode) return;
     parser->panic_mode = true;
     parser->had_error = true;
 
-    fprintf(stderr, "[%s:%d:%d] Error", parser->filename, token->line, token->col);
-
-    if (token->type == TOKEN_EOF) {
-        fprintf(stderr, " at end");
-    } else {
-        fprintf(stderr, " at '%.*s'", token->length, token->start);
-    }
-
-    fprintf(stderr, ": %s\n", message);
+    // An empty 'near' prints as "at end"
+    bool at_end = token->type == TOKEN_EOF;
+    diagnostic_report(parser->diagnostics, parser->filename, &parser->lines, token->offset,
+                      at_end ? "" : token->start, at_end ? 0 : (int)token->length, "%s", message);
 }
 
-static void error_at_current(Parser* parser, const char* message) {
+void error_at_current(Parser* parser, const char* message) {
     error_at(parser, &parser->current, message);
 }
 
 // Token handling
-static void advance(Parser* parser) {
+static Token next_token(Parser* parser) {
+    if (parser->tokens) {
+        if (parser->token_index >= parser->token_end) {
+            // End of the parsed range, positioned at the first token past it
+            Token end = token_stream_get(parser->tokens, parser->token_end);
+            end.type = TOKEN_EOF;
+            end.length = 0;
+            return end;
+        }
+        return token_stream_get(parser->tokens, parser->token_index++);
+    }
+    return lex_next(parser->lexer);
+}
+
+void advance(Parser* parser) {
     parser->previous = parser->current;
 
     for (;;) {
-        parser->current = lex_next(parser->lexer);
+        parser->current = next_token(parser);
         if (parser->current.type != TOKEN_ERROR) break;
 
         error_at_current(parser, parser->current.start);
     }
 }
 
-static void consume(Parser* parser, TokenType type, const char* message) {
+void consume(Parser* parser, TokenType type, const char* message) {
     if (parser->current.type == type) {
         advance(parser);
         return;
@@ -82,63 +77,132 @@ static void consume(Parser* parser, TokenType type, const char* message) {
     error_at_current(parser, message);
 }
 
-static bool check(Parser* parser, TokenType type) {
+bool check(Parser* parser, TokenType type) {
     return parser->current.type == type;
 }
 
-static bool match(Parser* parser, TokenType type) {
+bool match(Parser* parser, TokenType type) {
     if (!check(parser, type)) return false;
     advance(parser);
     return true;
 }
 
+// Type of the token 'distance' places after the current one. Constant time
+// in stream mode; in lexer mode there is no lookahead buffer, so only the
+// current token is visible.
+TokenType parser_peek(Parser* parser, uint32_t distance) {
+    if (distance == 0 || !parser->tokens) return parser->current.type;
+
+    uint32_t index = parser->token_index + distance - 1;
+    if (index >= parser->token_end) return TOKEN_EOF;
+    return (TokenType)parser->tokens->types[index];
+}
+
 // Parsing functions
-static void parse_precedence(Parser* parser, Precedence precedence, ASTNode** node, bool can_assign) {
-    advance(parser);
-    ParseFn prefix = get_rule(parser->previous.type)->prefix;
-    if (prefix == NULL) {
-        error_at_current(parser, "Expected expression");
-        return;
-    }
 
-    prefix(parser, node, can_assign);
+static void push_operator(Parser* parser, FrameKind kind, Precedence precedence, Token op, ASTNode* left) {
+    OperatorFrame frame = {kind, precedence, op, left};
+    da_append(&parser->operators, &frame);
+}
+
+// Operator-precedence parsing over an explicit stack
+//
+// The rule table is the same as for recursive Pratt parsing, but the
+// operator rules (unary, binary, logical, grouping) do not recurse: they
+// push a frame and the loop goes on to read the operand. When the next
+// token binds less tightly than the pending operand, the top frame is
+// reduced into a node. Nesting depth therefore costs heap stack space,
+// not C stack. Calls, member access and channel operations still parse
+// their own sub-expressions, each with a frame base of its own.
+void parse_precedence(Parser* parser, Precedence precedence, ASTNode** node, bool can_assign) {
+    usize base = parser->operators.count;
+    ASTNode* operand = NULL;
 
-    while (precedence <= get_rule(parser->current.type)->precedence) {
+    for (;;) {
+        // Operand position
         advance(parser);
-        ParseFn infix = get_rule(parser->previous.type)->infix;
-        infix(parser, node, can_assign);
-    }
+        ParseFn prefix = get_rule(parser->previous.type)->prefix;
+        if (prefix == NULL) {
+            error_at_current(parser, "Expected expression");
+            parser->operators.count = base;
+            // Placeholder, so that callers can build their node; nothing
+            // after the parser runs once there is an error
+            *node = ast_new_nil_literal(parser->previous.offset);
+            return;
+        }
 
-    if (can_assign && match(parser, TOKEN_EQ)) {
-        error_at_current(parser, "Invalid assignment target");
+        usize depth = parser->operators.count;
+        prefix(parser, &operand, can_assign);
+        if (parser->operators.count > depth) continue;
+
+        // Operator position
+        for (;;) {
+            OperatorFrame* top = parser->operators.count > base
+                ? &((OperatorFrame*)parser->operators.items)[parser->operators.count - 1]
+                : NULL;
+            Precedence floor = top ? top->precedence : precedence;
+
+            if (floor <= get_rule(parser->current.type)->precedence) {
+                advance(parser);
+                depth = parser->operators.count;
+                get_rule(parser->previous.type)->infix(parser, &operand, can_assign);
+                if (parser->operators.count > depth) break;
+                continue;
+            }
+
+            if (can_assign && match(parser, TOKEN_EQ)) {
+                error_at_current(parser, "Invalid assignment target");
+            }
+            if (!top) {
+                *node = operand;
+                return;
+            }
+
+            OperatorFrame frame = *top;
+            parser->operators.count--;
+            switch (frame.kind) {
+                case FRAME_UNARY:
+                    operand = ast_new_unary_expr(frame.op, operand);
+                    break;
+                case FRAME_BINARY:
+                    operand = ast_new_binary_expr(frame.op, frame.left, operand);
+                    break;
+                case FRAME_LOGICAL:
+                    operand = ast_new_logical_expr(frame.op, frame.left, operand);
+                    break;
+                case FRAME_GROUPING:
+                    consume(parser, TOKEN_RPAREN, "Expect ')' after expression");
+                    break;
+            }
+        }
     }
 }
 
+// The lexer has already decoded the literal
 static void parse_number(Parser* parser, ASTNode** node, bool can_assign) {
     (void)can_assign;
-    double value = strtod(parser->previous.start, NULL);
-    if (strchr(parser->previous.start, '.')) {
-        *node = ast_new_float_literal(value, parser->previous.line, parser->previous.col);
+    Token number = parser->previous;
+    if (number.type == TOKEN_FLOAT) {
+        *node = ast_new_float_literal(number.value.float_value, number.offset);
     } else {
-        *node = ast_new_int_literal((int64_t)value, parser->previous.line, parser->previous.col);
+        *node = ast_new_int_literal((int64_t)number.value.int_value, number.offset);
     }
 }
 
 static void parse_literal(Parser* parser, ASTNode** node, bool can_assign) {
     (void)can_assign;
     TokenType type = parser->previous.type;
-    uint32_t line = parser->previous.line;
-    uint32_t col = parser->previous.col;
+    uint32_t offset = parser->previous.offset;
     
     switch (type) {
         case TOKEN_TRUE:
-            *node = ast_new_bool_literal(true, line, col);
+            *node = ast_new_bool_literal(true, offset);
             break;
         case TOKEN_FALSE:
-            *node = ast_new_bool_literal(false, line, col);
+            *node = ast_new_bool_literal(false, offset);
             break;
         case TOKEN_NIL:
-            *node = ast_new_nil_literal(line, col);
+            *node = ast_new_nil_literal(offset);
             break;
         default:
             error_at_current(parser, "Invalid literal");
@@ -150,57 +214,49 @@ static void parse_string(Parser* parser, ASTNode** node, bool can_assign) {
     (void)can_assign;
     // Remove surrounding quotes
     int length = parser->previous.length - 2;
-    char* value = malloc(length + 1);
+    char* value = ast_alloc(length + 1);
     memcpy(value, parser->previous.start + 1, length);
     value[length] = '\0';
-    *node = ast_new_string_literal(value, parser->previous.line, parser->previous.col);
+    *node = ast_new_string_literal(value, parser->previous.offset);
 }
 
 static void parse_identifier(Parser* parser, ASTNode** node, bool can_assign) {
+    (void)can_assign;
     Token name = parser->previous;
-    *node = ast_new_identifier(name.start, name.length, name.line, name.col);
+    Symbol symbol = intern(parser->interner, name.start, (uint32_t)name.length);
+    *node = ast_new_identifier(symbol, name.offset);
 }
 
 static void parse_grouping(Parser* parser, ASTNode** node, bool can_assign) {
+    (void)node;
     (void)can_assign;
-    parse_expression(parser, node, can_assign);
-    consume(parser, TOKEN_RPAREN, "Expect ')' after expression");
+    push_operator(parser, FRAME_GROUPING, PREC_ASSIGNMENT, parser->previous, NULL);
 }
 
 static void parse_unary(Parser* parser, ASTNode** node, bool can_assign) {
+    (void)node;
     (void)can_assign;
-    TokenType operator_type = parser->previous.type;
-    Token operator = parser->previous;
-
-    // Parse the operand
-    parse_precedence(parser, PREC_UNARY, node, can_assign);
-
-    // Create unary expression node
-    *node = ast_new_unary_expr(operator, *node);
+    push_operator(parser, FRAME_UNARY, PREC_UNARY, parser->previous, NULL);
 }
 
 static void parse_binary(Parser* parser, ASTNode** node, bool can_assign) {
     (void)can_assign;
-    TokenType operator_type = parser->previous.type;
     Token operator = parser->previous;
-    ParseRule* rule = get_rule(operator_type);
+    ParseRule* rule = get_rule(operator.type);
 
-    // Parse the right operand
-    parse_precedence(parser, (Precedence)(rule->precedence + 1), node, can_assign);
-
-    // Create binary expression node
-    *node = ast_new_binary_expr(operator, *node, node);
+    // Left associative: the right operand binds one level tighter
+    push_operator(parser, FRAME_BINARY, (Precedence)(rule->precedence + 1), operator, *node);
 }
 
 static void parse_call(Parser* parser, ASTNode** node, bool can_assign) {
     (void)can_assign;
-    DynamicArray args = da_new(sizeof(ASTNode*), 8);
+    NodeList args = {0};
 
     if (!check(parser, TOKEN_RPAREN)) {
         do {
             ASTNode* arg = NULL;
             parse_expression(parser, &arg, can_assign);
-            da_append(&args, &arg);
+            node_list_push(&args, arg);
         } while (match(parser, TOKEN_COMMA));
     }
 
@@ -223,21 +279,15 @@ static void parse_dot(Parser* parser, ASTNode** node, bool can_assign) {
 
 static void parse_and(Parser* parser, ASTNode** node, bool can_assign) {
     (void)can_assign;
-    Token operator = parser->previous;
-    ASTNode* right = NULL;
-    parse_precedence(parser, PREC_AND, &right, can_assign);
-    *node = ast_new_logical_expr(operator, *node, right);
+    push_operator(parser, FRAME_LOGICAL, PREC_AND, parser->previous, *node);
 }
 
 static void parse_or(Parser* parser, ASTNode** node, bool can_assign) {
     (void)can_assign;
-    Token operator = parser->previous;
-    ASTNode* right = NULL;
-    parse_precedence(parser, PREC_OR, &right, can_assign);
-    *node = ast_new_logical_expr(operator, *node, right);
+    push_operator(parser, FRAME_LOGICAL, PREC_OR, parser->previous, *node);
 }
 
-static void parse_var_declaration(Parser* parser, ASTNode** node) {
+void parse_var_declaration(Parser* parser, ASTNode** node) {
     consume(parser, TOKEN_IDENT, "Expect variable name");
     Token name = parser->previous;
 
@@ -250,18 +300,18 @@ static void parse_var_declaration(Parser* parser, ASTNode** node) {
     *node = ast_new_var_decl(name, initializer);
 }
 
-static void parse_function(Parser* parser, ASTNode** node) {
+void parse_function(Parser* parser, ASTNode** node) {
     consume(parser, TOKEN_IDENT, "Expect function name");
     Token name = parser->previous;
 
     consume(parser, TOKEN_LPAREN, "Expect '(' after function name");
-    DynamicArray params = da_new(sizeof(Token), 8);
+    TokenList params = {0};
 
     if (!check(parser, TOKEN_RPAREN)) {
         do {
             consume(parser, TOKEN_IDENT, "Expect parameter name");
             Token param = parser->previous;
-            da_append(&params, &param);
+            token_list_push(&params, param);
         } while (match(parser, TOKEN_COMMA));
     }
 
@@ -342,13 +392,13 @@ static void parse_for_statement(Parser* parser, ASTNode** node) {
     *node = ast_new_for_stmt(initializer, condition, increment, body);
 }
 
-static void parse_block(Parser* parser, ASTNode** node) {
-    DynamicArray statements = da_new(sizeof(ASTNode*), 8);
+void parse_block(Parser* parser, ASTNode** node) {
+    NodeList statements = {0};
 
     while (!check(parser, TOKEN_RBRACE) && !check(parser, TOKEN_EOF)) {
         ASTNode* statement = NULL;
         parse_declaration(parser, &statement);
-        if (statement) da_append(&statements, &statement);
+        if (statement) node_list_push(&statements, statement);
     }
 
     consume(parser, TOKEN_RBRACE, "Expect '}' after block");
@@ -362,12 +412,13 @@ static void parse_expression_statement(Parser* parser, ASTNode** node) {
 }
 
 static void parse_try_statement(Parser* parser, ASTNode** node) {
+    Token keyword = parser->previous;
     consume(parser, TOKEN_LBRACE, "Expect '{' after 'try'");
     
     ASTNode* try_block = NULL;
     parse_block(parser, &try_block);
     
-    DynamicArray catch_blocks = da_new(sizeof(ASTNode*), 4);
+    NodeList catch_blocks = {0};
     ASTNode* finally_block = NULL;
     
     while (match(parser, TOKEN_CATCH)) {
@@ -382,9 +433,8 @@ static void parse_try_statement(Parser* parser, ASTNode** node) {
         ASTNode* catch_block = NULL;
         parse_block(parser, &catch_block);
         
-        // Create catch block node
-        ASTNode* catch_node = ast_new_catch_block(error_type, error_var, catch_block);
-        da_append(&catch_blocks, &catch_node);
+        ASTNode* catch_node = ast_new_catch_clause(error_type, error_var, catch_block);
+        node_list_push(&catch_blocks, catch_node);
     }
     
     if (match(parser, TOKEN_FINALLY)) {
@@ -393,6 +443,7 @@ static void parse_try_statement(Parser* parser, ASTNode** node) {
     }
     
     *node = ast_new_try_stmt(try_block, catch_blocks, finally_block);
+    (*node)->offset = keyword.offset;
 }
 
 static void parse_throw_statement(Parser* parser, ASTNode** node) {
@@ -402,79 +453,9 @@ static void parse_throw_statement(Parser* parser, ASTNode** node) {
     *node = ast_new_throw_stmt(value);
 }
 
-static void parse_go_statement(Parser* parser, ASTNode** node) {
-    ASTNode* expr = NULL;
-    if (match(parser, TOKEN_LBRACE)) {
-        parse_block(parser, &expr);
-    } else {
-        parse_expression(parser, &expr, false);
-    }
-    *node = ast_new_go_stmt(expr);
-}
-
-static void parse_chan_declaration(Parser* parser, ASTNode** node) {
-    consume(parser, TOKEN_LT, "Expect '<' after 'chan'");
-    ASTNode* type = NULL;
-    parse_expression(parser, &type, false);
-    consume(parser, TOKEN_GT, "Expect '>' after channel type");
-    
-    consume(parser, TOKEN_IDENT, "Expect channel name");
-    Token name = parser->previous;
-    
-    ASTNode* capacity = NULL;
-    if (match(parser, TOKEN_LPAREN)) {
-        parse_expression(parser, &capacity, false);
-        consume(parser, TOKEN_RPAREN, "Expect ')' after channel capacity");
-    }
-    
-    consume(parser, TOKEN_SEMI, "Expect ';' after channel declaration");
-    *node = ast_new_chan_decl(name, type, capacity);
-}
-
-static void parse_select_statement(Parser* parser, ASTNode** node) {
-    consume(parser, TOKEN_LBRACE, "Expect '{' after 'select'");
-    
-    DynamicArray cases = da_new(sizeof(ASTNode*), 8);
-    ASTNode* default_case = NULL;
-    
-    while (!check(parser, TOKEN_RBRACE) && !check(parser, TOKEN_EOF)) {
-        if (match(parser, TOKEN_CASE)) {
-            ASTNode* channel = NULL;
-            ASTNode* value = NULL;
-            bool is_send = false;
-            
-            parse_expression(parser, &channel, false);
-            
-            if (match(parser, TOKEN_ARROW)) {
-                // Receive case: chan <- value
-                parse_expression(parser, &value, false);
-            } else if (match(parser, TOKEN_LT)) {
-                consume(parser, TOKEN_MINUS, "Expect '-' after '<' in send operation");
-                // Send case: chan <- value
-                is_send = true;
-                parse_expression(parser, &value, false);
-            }
-            
-            consume(parser, TOKEN_LBRACE, "Expect '{' after select case");
-            ASTNode* body = NULL;
-            parse_block(parser, &body);
-            
-            ASTNode* case_node = ast_new_select_case(channel, value, is_send, body);
-            da_append(&cases, &case_node);
-        } else if (match(parser, TOKEN_DEFAULT)) {
-            consume(parser, TOKEN_LBRACE, "Expect '{' after 'default'");
-            parse_block(parser, &default_case);
-        } else {
-            error_at_current(parser, "Expect 'case' or 'default' in select statement");
-            break;
-        }
-    }
-    
-    consume(parser, TOKEN_RBRACE, "Expect '}' after select cases");
-    *node = ast_new_select_stmt(cases, default_case);
-}
-
-static void parse_async_expression(Parser* parser, ASTNode** node) {
+static void parse_async(Parser* parser, ASTNode** node, bool can_assign) {
+    (void)can_assign;
+    Token keyword = parser->previous;
     ASTNode* expr = NULL;
     if (match(parser, TOKEN_LBRACE)) {
         parse_block(parser, &expr);
@@ -482,37 +463,20 @@ static void parse_async_expression(Parser* parser, ASTNode** node) {
         parse_expression(parser, &expr, false);
     }
     *node = ast_new_async_expr(expr);
+    (*node)->offset = keyword.offset;
 }
 
-static void parse_await_expression(Parser* parser, ASTNode** node) {
+// 'await' binds like a unary operator
+static void parse_await(Parser* parser, ASTNode** node, bool can_assign) {
+    (void)can_assign;
+    Token keyword = parser->previous;
     ASTNode* expr = NULL;
-    parse_expression(parser, &expr, false);
+    parse_precedence(parser, PREC_UNARY, &expr, false);
     *node = ast_new_await_expr(expr);
+    (*node)->offset = keyword.offset;
 }
 
-static void parse_chan_operation(Parser* parser, ASTNode** node, bool can_assign) {
-    (void)can_assign;
-    ASTNode* channel = NULL;
-    ASTNode* value = NULL;
-    bool is_send = false;
-    
-    if (match(parser, TOKEN_LT)) {
-        consume(parser, TOKEN_MINUS, "Expect '-' after '<' in channel operation");
-        if (parser->previous.type == TOKEN_IDENT) {
-            // Send operation: ch <- value
-            channel = *node;
-            is_send = true;
-            parse_expression(parser, &value, false);
-            *node = ast_new_chan_send_expr(channel, value);
-        } else {
-            // Receive operation: <- ch
-            parse_expression(parser, &channel, false);
-            *node = ast_new_chan_recv_expr(channel);
-        }
-    }
-}
-
-static void parse_statement(Parser* parser, ASTNode** node) {
+void parse_statement(Parser* parser, ASTNode** node) {
     if (match(parser, TOKEN_IF)) {
         parse_if_statement(parser, node);
     } else if (match(parser, TOKEN_WHILE)) {
@@ -538,12 +502,12 @@ static void parse_statement(Parser* parser, ASTNode** node) {
     }
 }
 
-static void parse_type_params(Parser* parser, DynamicArray* type_params) {
+static void parse_type_params(Parser* parser, TokenList* type_params) {
     if (match(parser, TOKEN_LT)) {
         do {
             consume(parser, TOKEN_IDENT, "Expect type parameter name");
             Token param = parser->previous;
-            da_append(type_params, &param);
+            token_list_push(type_params, param);
         } while (match(parser, TOKEN_COMMA));
         consume(parser, TOKEN_GT, "Expect '>' after type parameters");
     }
@@ -553,7 +517,7 @@ static void parse_type_declaration(Parser* parser, ASTNode** node) {
     consume(parser, TOKEN_IDENT, "Expect type name");
     Token name = parser->previous;
     
-    DynamicArray type_params = da_new(sizeof(Token), 4);
+    TokenList type_params = {0};
     parse_type_params(parser, &type_params);
     
     consume(parser, TOKEN_EQ, "Expect '=' after type name");
@@ -570,16 +534,16 @@ static void parse_interface_declaration(Parser* parser, ASTNode** node) {
     consume(parser, TOKEN_IDENT, "Expect interface name");
     Token name = parser->previous;
     
-    DynamicArray type_params = da_new(sizeof(Token), 4);
+    TokenList type_params = {0};
     parse_type_params(parser, &type_params);
     
     consume(parser, TOKEN_LBRACE, "Expect '{' before interface body");
     
-    DynamicArray methods = da_new(sizeof(ASTNode*), 8);
+    NodeList methods = {0};
     while (!check(parser, TOKEN_RBRACE) && !check(parser, TOKEN_EOF)) {
         ASTNode* method = NULL;
         parse_function(parser, &method);
-        da_append(&methods, &method);
+        node_list_push(&methods, method);
     }
     
     consume(parser, TOKEN_RBRACE, "Expect '}' after interface body");
@@ -591,16 +555,16 @@ static void parse_trait_declaration(Parser* parser, ASTNode** node) {
     consume(parser, TOKEN_IDENT, "Expect trait name");
     Token name = parser->previous;
     
-    DynamicArray type_params = da_new(sizeof(Token), 4);
+    TokenList type_params = {0};
     parse_type_params(parser, &type_params);
     
     consume(parser, TOKEN_LBRACE, "Expect '{' before trait body");
     
-    DynamicArray methods = da_new(sizeof(ASTNode*), 8);
+    NodeList methods = {0};
     while (!check(parser, TOKEN_RBRACE) && !check(parser, TOKEN_EOF)) {
         ASTNode* method = NULL;
         parse_function(parser, &method);
-        da_append(&methods, &method);
+        node_list_push(&methods, method);
     }
     
     consume(parser, TOKEN_RBRACE, "Expect '}' after trait body");
@@ -618,11 +582,11 @@ static void parse_impl_declaration(Parser* parser, ASTNode** node) {
     
     consume(parser, TOKEN_LBRACE, "Expect '{' before impl body");
     
-    DynamicArray methods = da_new(sizeof(ASTNode*), 8);
+    NodeList methods = {0};
     while (!check(parser, TOKEN_RBRACE) && !check(parser, TOKEN_EOF)) {
         ASTNode* method = NULL;
         parse_function(parser, &method);
-        da_append(&methods, &method);
+        node_list_push(&methods, method);
     }
     
     consume(parser, TOKEN_RBRACE, "Expect '}' after impl body");
@@ -650,7 +614,7 @@ static void parse_declaration(Parser* parser, ASTNode** node) {
     if (parser->panic_mode) synchronize(parser);
 }
 
-static void parse_expression(Parser* parser, ASTNode** node, bool can_assign) {
+void parse_expression(Parser* parser, ASTNode** node, bool can_assign) {
     parse_precedence(parser, PREC_ASSIGNMENT, node, can_assign);
 }
 
@@ -700,6 +664,7 @@ static ParseRule rules[] = {
     [TOKEN_IDENT]     = {parse_identifier, NULL,          PREC_NONE},
     [TOKEN_STRING]    = {parse_string,  NULL,          PREC_NONE},
     [TOKEN_INT]       = {parse_number,  NULL,          PREC_NONE},
+    [TOKEN_FLOAT]     = {parse_number,  NULL,          PREC_NONE},
     [TOKEN_AMPAMP]    = {NULL,          parse_and,     PREC_AND},
     [TOKEN_PIPEPIPE]  = {NULL,          parse_or,      PREC_OR},
     [TOKEN_IF]        = {NULL,          NULL,          PREC_NONE},
@@ -717,8 +682,8 @@ static ParseRule rules[] = {
     [TOKEN_CHAN]      = {NULL,          NULL,          PREC_NONE},
     [TOKEN_SELECT]    = {NULL,          NULL,          PREC_NONE},
     [TOKEN_DEFER]     = {NULL,          NULL,          PREC_NONE},
-    [TOKEN_ASYNC]     = {NULL,          NULL,          PREC_NONE},
-    [TOKEN_AWAIT]     = {NULL,          NULL,          PREC_NONE},
+    [TOKEN_ASYNC]     = {parse_async,   NULL,          PREC_NONE},
+    [TOKEN_AWAIT]     = {parse_await,   NULL,          PREC_NONE},
     [TOKEN_ALLOC]     = {NULL,          NULL,          PREC_NONE},
     [TOKEN_FREE]      = {NULL,          NULL,          PREC_NONE},
     [TOKEN_REF]       = {NULL,          NULL,          PREC_NONE},
@@ -733,16 +698,69 @@ static ParseRule* get_rule(TokenType type) {
     return &rules[type];
 }
 
-void parser_init(Parser* parser, Lexer* lexer, const char* filename) {
+void parser_init(Parser* parser, Lexer* lexer, Interner* interner, const char* filename) {
     parser->lexer = lexer;
+    parser->tokens = NULL;
+    parser->token_index = 0;
+    parser->token_end = 0;
+    parser->interner = interner;
+    parser->diagnostics = NULL;
+    parser->operators = da_new(sizeof(OperatorFrame), 16);
+    parser->filename = filename;
+    line_map_init(&parser->lines, lexer->source);
+    parser->had_error = false;
+    parser->panic_mode = false;
+    advance(parser);
+}
+
+void parser_init_stream(Parser* parser, TokenStream* tokens, Interner* interner, const char* filename) {
+    parser->lexer = NULL;
+    parser->tokens = tokens;
+    parser->token_index = 0;
+    parser->token_end = tokens->count;
+    parser->interner = interner;
+    parser->diagnostics = NULL;
+    parser->operators = da_new(sizeof(OperatorFrame), 16);
     parser->filename = filename;
+    line_map_init(&parser->lines, tokens->source);
     parser->had_error = false;
     parser->panic_mode = false;
     advance(parser);
 }
 
+void parser_free(Parser* parser) {
+    line_map_free(&parser->lines);
+    da_free(&parser->operators);
+}
+
+// Parses declarations up to EOF into a root block
 ASTNode* parse(Parser* parser) {
-    ASTNode* node = NULL;
-    parse_declaration(parser, &node);
-    return node;
+    uint32_t offset = parser->current.offset;
+    NodeList declarations = {0};
+
+    while (!check(parser, TOKEN_EOF)) {
+        ASTNode* declaration = NULL;
+        parse_declaration(parser, &declaration);
+        if (declaration) node_list_push(&declarations, declaration);
+    }
+
+    ASTNode* root = ast_new_block_stmt(declarations);
+    root->offset = offset;
+    return root;
+}
+
+// Parses the stream tokens [begin, end) as a sequence of declarations, as if
+// the range were a file of its own, and appends them to 'declarations'.
+// Stream mode only.
+void parse_range(Parser* parser, uint32_t begin, uint32_t end, DynamicArray* declarations) {
+    parser->token_index = begin;
+    parser->token_end = end;
+    parser->panic_mode = false;
+    advance(parser);
+
+    while (!check(parser, TOKEN_EOF)) {
+        ASTNode* declaration = NULL;
+        parse_declaration(parser, &declaration);
+        if (declaration) da_append(declarations, &declaration);
+    }
 }
\ No newline at end of file
@@ -36,9 +36,10 @@ void parse_chan_declaration(Parser* parser, ASTNode** node) {
 
 // Parse a select statement with multiple channel operations
 void parse_select_statement(Parser* parser, ASTNode** node) {
+    Token keyword = parser->previous;
     consume(parser, TOKEN_LBRACE, "Expect '{' after 'select'");
     
-    DynamicArray cases = da_new(sizeof(ASTNode*), 8);
+    SelectCaseList cases = {0};
     ASTNode* default_case = NULL;
     
     while (!check(parser, TOKEN_RBRACE) && !check(parser, TOKEN_EOF)) {
@@ -63,8 +64,8 @@ void parse_select_statement(Parser* parser, ASTNode** node) {
             ASTNode* body = NULL;
             parse_block(parser, &body);
             
-            ASTNode* case_node = ast_new_select_case(channel, value, is_send, body);
-            da_append(&cases, &case_node);
+            SelectCase* case_node = ast_new_select_case(channel, value, is_send, body);
+            select_case_list_push(&cases, case_node);
         } else if (match(parser, TOKEN_DEFAULT)) {
             consume(parser, TOKEN_LBRACE, "Expect '{' after 'default'");
             parse_block(parser, &default_case);
@@ -76,6 +77,7 @@ void parse_select_statement(Parser* parser, ASTNode** node) {
     
     consume(parser, TOKEN_RBRACE, "Expect '}' after select cases");
     *node = ast_new_select_stmt(cases, default_case);
+    (*node)->offset = keyword.offset;
 }
 
 // Parse channel operations (send/receive)
@@ -83,14 +85,12 @@ void parse_chan_operation(Parser* parser, ASTNode** node, bool can_assign) {
     (void)can_assign;
     ASTNode* channel = NULL;
     ASTNode* value = NULL;
-    bool is_send = false;
     
     if (match(parser, TOKEN_LT)) {
         consume(parser, TOKEN_MINUS, "Expect '-' after '<' in channel operation");
         if (parser->previous.type == TOKEN_IDENT) {
             // Send operation: ch <- value
             channel = *node;
-            is_send = true;
             parse_expression(parser, &value, false);
             *node = ast_new_chan_send_expr(channel, value);
         } else {
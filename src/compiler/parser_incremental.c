@@ -0,0 +1,200 @@
+#include "../../include/parser_incremental.h"
+#include "../../include/parser_parallel.h"
+#include <string.h>
+
+static void parsed_range_free(ParsedRange* range) {
+    flat_ast_free(&range->flat);
+    f_free(range->declarations);
+    range->declarations = NULL;
+}
+
+void parse_cache_init(ParseCache* cache) {
+    interner_init(&cache->interner);
+    cache->ranges = NULL;
+    cache->range_count = 0;
+    cache->reused = 0;
+    cache->reparsed = 0;
+}
+
+void parse_cache_free(ParseCache* cache) {
+    if (!cache) return;
+
+    for (uint32_t i = 0; i < cache->range_count; i++) {
+        parsed_range_free(&cache->ranges[i]);
+    }
+    f_free(cache->ranges);
+    interner_free(&cache->interner);
+    cache->ranges = NULL;
+    cache->range_count = 0;
+}
+
+static inline uint64_t hash_mix(uint64_t hash, uint64_t word) {
+    hash ^= word;
+    hash *= 0xff51afd7ed558ccdull;
+    return hash ^ (hash >> 33);
+}
+
+// Hash of each token's type, length, offset relative to the range start and
+// text, eight bytes at a time
+static uint64_t hash_range(const TokenStream* tokens, uint32_t begin, uint32_t end) {
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ (uint64_t)(end - begin);
+    uint32_t base = tokens->offsets[begin];
+
+    for (uint32_t i = begin; i < end; i++) {
+        uint32_t relative = tokens->offsets[i] - base;
+        uint32_t length = tokens->lengths[i];
+        hash = hash_mix(hash, ((uint64_t)relative << 32) | ((uint64_t)length << 8) | tokens->types[i]);
+
+        const char* text = tokens->source + tokens->offsets[i];
+        uint32_t j = 0;
+        for (; j + 8 <= length; j += 8) {
+            uint64_t word;
+            memcpy(&word, text + j, 8);
+            hash = hash_mix(hash, word);
+        }
+        if (j < length) {
+            uint64_t word = 0;
+            memcpy(&word, text + j, length - j);
+            hash = hash_mix(hash, word);
+        }
+    }
+    return hash;
+}
+
+// Moves a reused range to its new place in 'source'. Offsets are plain
+// fields of the flat tables, so this is a linear pass over nodes and tokens.
+static void rebase_range(ParsedRange* range, uint32_t offset, const char* source) {
+    FlatAST* flat = &range->flat;
+    int64_t delta = (int64_t)offset - (int64_t)range->offset;
+    flat->source = source;
+    if (delta == 0) return;
+
+    for (uint32_t i = 1; i < flat->node_count; i++) {
+        flat->nodes[i].offset = (uint32_t)((int64_t)flat->nodes[i].offset + delta);
+    }
+    for (uint32_t i = 1; i < flat->token_count; i++) {
+        flat->tokens[i].offset = (uint32_t)((int64_t)flat->tokens[i].offset + delta);
+    }
+}
+
+// Open-addressing table from hash to the ranges of the previous parse that
+// may be reused. Slots hold a range index plus one; 0 is empty.
+typedef struct {
+    uint32_t* slots;
+    uint32_t mask;
+} RangeTable;
+
+static void range_table_build(RangeTable* table, const ParsedRange* ranges, uint32_t count) {
+    uint32_t size = 16;
+    while (size < count * 2) size *= 2;
+    table->slots = f_calloc(size, sizeof(uint32_t));
+    table->mask = size - 1;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (ranges[i].had_error) continue;
+        uint32_t index = (uint32_t)ranges[i].hash & table->mask;
+        while (table->slots[index] != 0) index = (index + 1) & table->mask;
+        table->slots[index] = i + 1;
+    }
+}
+
+// Finds an unclaimed range with 'hash' and claims it. Identical
+// declarations hash alike, so each old range is handed out only once.
+static ParsedRange* range_table_take(RangeTable* table, ParsedRange* ranges, uint64_t hash) {
+    uint32_t index = (uint32_t)hash & table->mask;
+    while (table->slots[index] != 0) {
+        uint32_t slot = table->slots[index];
+        if (slot != UINT32_MAX && ranges[slot - 1].hash == hash) {
+            table->slots[index] = UINT32_MAX;
+            return &ranges[slot - 1];
+        }
+        index = (index + 1) & table->mask;
+    }
+    return NULL;
+}
+
+ASTNode* parse_incremental(ParseCache* cache, TokenStream* tokens, const char* filename, bool* had_error) {
+    uint32_t* bounds;
+    uint32_t range_count = parse_declaration_bounds(tokens, &bounds);
+
+    ParsedRange* old_ranges = cache->ranges;
+    uint32_t old_count = cache->range_count;
+    RangeTable table;
+    range_table_build(&table, old_ranges, old_count);
+
+    ParsedRange* ranges = f_malloc(range_count * sizeof(ParsedRange));
+    DynamicArray scratch = da_new(sizeof(ASTNode*), 16);
+    Parser parser;
+    parser_init_stream(&parser, tokens, &cache->interner, filename);
+
+    cache->reused = 0;
+    cache->reparsed = 0;
+    NodeList statements = {0};
+    *had_error = false;
+
+    for (uint32_t i = 0; i < range_count; i++) {
+        uint32_t begin = bounds[i];
+        uint32_t end = bounds[i + 1];
+        uint32_t offset = tokens->offsets[begin];
+        uint64_t hash = hash_range(tokens, begin, end);
+        ParsedRange* range = &ranges[i];
+
+        ParsedRange* previous = range_table_take(&table, old_ranges, hash);
+        if (previous) {
+            *range = *previous;
+            memset(&previous->flat, 0, sizeof(FlatAST));     // Ownership moves
+            previous->declarations = NULL;
+            rebase_range(range, offset, tokens->source);
+            for (uint32_t j = 0; j < range->count; j++) {
+                node_list_push(&statements, flat_ast_to_tree(&range->flat, range->declarations[j]));
+            }
+            cache->reused++;
+        } else {
+            scratch.count = 0;
+            parser.had_error = false;
+            parse_range(&parser, begin, end, &scratch);
+
+            range->hash = hash;
+            range->count = (uint32_t)scratch.count;
+            range->declarations = NULL;
+            range->had_error = parser.had_error;
+            memset(&range->flat, 0, sizeof(FlatAST));
+
+            // Copied before any pass sees the tree; ranges with errors are
+            // never reused, so they need no copy
+            ASTNode** parsed = scratch.items;
+            if (!range->had_error) {
+                flat_ast_init(&range->flat, tokens->source);
+                range->declarations = f_malloc(range->count * sizeof(FlatIndex));
+                for (uint32_t j = 0; j < range->count; j++) {
+                    range->declarations[j] = flat_ast_from_tree(&range->flat, parsed[j]);
+                }
+            }
+            for (uint32_t j = 0; j < range->count; j++) {
+                node_list_push(&statements, parsed[j]);
+            }
+            cache->reparsed++;
+        }
+        range->offset = offset;
+
+        *had_error = *had_error || range->had_error;
+    }
+
+    parser_free(&parser);
+    da_free(&scratch);
+
+    // Whatever was not claimed belongs to edited or deleted declarations
+    for (uint32_t i = 0; i < old_count; i++) {
+        parsed_range_free(&old_ranges[i]);
+    }
+    f_free(table.slots);
+    f_free(old_ranges);
+    f_free(bounds);
+
+    cache->ranges = ranges;
+    cache->range_count = range_count;
+
+    ASTNode* root = ast_new_block_stmt(statements);
+    root->offset = tokens->offsets[0];
+    return root;
+}
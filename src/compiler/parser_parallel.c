@@ -0,0 +1,191 @@
+#include "../../include/parser_parallel.h"
+#include "../../include/runtime/sys.h"
+#include <stdio.h>
+
+#define PARSER_MAX_WORKERS 64
+
+typedef struct {
+    TokenStream* tokens;
+    Interner* interner;
+    const char* filename;
+    const uint32_t* bounds;     // Range i is [bounds[i], bounds[i + 1])
+    uint32_t first_range;
+    uint32_t last_range;        // One past the last range
+    bool use_arena;             // Mirror the caller's allocation mode
+    bool hash_cons;             // Likewise for hash-consing
+    Arena arena;
+    HashConsTable table;
+    DynamicArray declarations;  // ASTNode*, heap-backed
+    ByteBuffer diagnostics;
+    bool had_error;
+} ParseWorker;
+
+static bool starts_declaration(TokenType type) {
+    switch (type) {
+        case TOKEN_FN:
+        case TOKEN_TYPE:
+        case TOKEN_TRAIT:
+        case TOKEN_IMPL:
+        case TOKEN_INTERFACE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+uint32_t parse_declaration_bounds(const TokenStream* tokens, uint32_t** bounds_out) {
+    uint32_t end = tokens->count - 1;
+    uint32_t capacity = 64;
+    uint32_t count = 0;
+    uint32_t* bounds = f_malloc(capacity * sizeof(uint32_t));
+    bounds[count++] = 0;
+
+    uint32_t depth = 0;
+    TokenType previous = TOKEN_SEMI;
+    for (uint32_t i = 0; i < end; i++) {
+        TokenType type = (TokenType)tokens->types[i];
+
+        if (type == TOKEN_LBRACE) {
+            depth++;
+        } else if (type == TOKEN_RBRACE) {
+            if (depth > 0) depth--;
+        } else if (depth == 0 && i > 0 && starts_declaration(type) &&
+                   (previous == TOKEN_SEMI || previous == TOKEN_RBRACE)) {
+            if (count + 1 >= capacity) {
+                bounds = f_realloc(bounds, capacity * sizeof(uint32_t), capacity * 2 * sizeof(uint32_t));
+                capacity *= 2;
+            }
+            bounds[count++] = i;
+        }
+        previous = type;
+    }
+
+    bounds[count] = end;
+    *bounds_out = bounds;
+    return count;
+}
+
+// Identifier nodes intern their names while parsing. Doing every lookup's
+// insertion here first leaves the workers with read-only probes, which are
+// safe to run concurrently, and keeps symbol ids independent of scheduling.
+static void intern_identifiers(const TokenStream* tokens, Interner* interner) {
+    for (uint32_t i = 0; i < tokens->count; i++) {
+        if (tokens->types[i] != TOKEN_IDENT) continue;
+        intern(interner, tokens->source + tokens->offsets[i], tokens->lengths[i]);
+    }
+}
+
+static void parse_worker(void* arg) {
+    ParseWorker* worker = (ParseWorker*)arg;
+
+    if (worker->use_arena) {
+        arena_init(&worker->arena, 0);
+        ast_set_arena(&worker->arena);
+    }
+    if (worker->hash_cons) {
+        hash_cons_init(&worker->table);
+        ast_set_hash_cons(&worker->table);
+    }
+
+    Parser parser;
+    parser_init_stream(&parser, worker->tokens, worker->interner, worker->filename);
+    parser.diagnostics = &worker->diagnostics;
+
+    for (uint32_t i = worker->first_range; i < worker->last_range; i++) {
+        parse_range(&parser, worker->bounds[i], worker->bounds[i + 1], &worker->declarations);
+    }
+
+    worker->had_error = parser.had_error;
+    parser_free(&parser);
+    if (worker->hash_cons) hash_cons_free(&worker->table);
+    ast_set_arena(NULL);
+    ast_set_hash_cons(NULL);
+}
+
+ASTNode* parse_parallel(TokenStream* tokens, Interner* interner, const char* filename,
+                        int thread_count, bool* had_error) {
+    uint32_t* bounds;
+    uint32_t range_count = parse_declaration_bounds(tokens, &bounds);
+    intern_identifiers(tokens, interner);
+
+    if (thread_count > PARSER_MAX_WORKERS) thread_count = PARSER_MAX_WORKERS;
+    if (tokens->count < PARSER_PARALLEL_MIN_TOKENS || thread_count < 1) thread_count = 1;
+    if ((uint32_t)thread_count > range_count) thread_count = (int)range_count;
+
+    Arena* caller_arena = ast_get_arena();
+    HashConsTable* caller_table = ast_get_hash_cons();
+    ParseWorker workers[PARSER_MAX_WORKERS];
+    Thread* threads[PARSER_MAX_WORKERS] = {0};
+
+    // Contiguous groups of ranges with roughly equal token counts
+    uint32_t total = bounds[range_count];
+    uint32_t range = 0;
+    for (int i = 0; i < thread_count; i++) {
+        ParseWorker* worker = &workers[i];
+        worker->tokens = tokens;
+        worker->interner = interner;
+        worker->filename = filename;
+        worker->bounds = bounds;
+        worker->use_arena = caller_arena != NULL;
+        worker->hash_cons = caller_table != NULL;
+        worker->declarations = da_new(sizeof(ASTNode*), 64);
+        worker->diagnostics = byte_buffer_new(0);
+        worker->had_error = false;
+
+        uint64_t target = (uint64_t)total * (uint64_t)(i + 1) / (uint64_t)thread_count;
+        worker->first_range = range;
+        if (i == thread_count - 1) {
+            range = range_count;
+        } else {
+            while (range < range_count && bounds[range + 1] <= target) range++;
+            // Leave at least one range for each later worker
+            if (range < worker->first_range + 1) range = worker->first_range + 1;
+            if (range > range_count - (uint32_t)(thread_count - 1 - i)) {
+                range = range_count - (uint32_t)(thread_count - 1 - i);
+            }
+        }
+        worker->last_range = range;
+    }
+
+    // Worker 0 runs on the calling thread; a worker that cannot be started
+    // runs inline instead
+    for (int i = 1; i < thread_count; i++) {
+        threads[i] = sys_thread_create(parse_worker, &workers[i]);
+        if (!threads[i]) parse_worker(&workers[i]);
+    }
+    parse_worker(&workers[0]);
+    ast_set_arena(caller_arena);
+    ast_set_hash_cons(caller_table);
+
+    usize declaration_count = 0;
+    for (int i = 0; i < thread_count; i++) {
+        if (threads[i]) sys_thread_join(threads[i]);
+        declaration_count += workers[i].declarations.count;
+    }
+
+    // Merge in source order
+    NodeList declarations = {0};
+    node_list_reserve(&declarations, (u32)declaration_count);
+    *had_error = false;
+    for (int i = 0; i < thread_count; i++) {
+        ParseWorker* worker = &workers[i];
+        for (usize j = 0; j < worker->declarations.count; j++) {
+            node_list_push(&declarations, ((ASTNode**)worker->declarations.items)[j]);
+        }
+
+        if (worker->diagnostics.length > 0) {
+            fwrite(worker->diagnostics.data, 1, worker->diagnostics.length, stderr);
+        }
+        *had_error = *had_error || worker->had_error;
+
+        if (worker->use_arena) arena_adopt(caller_arena, &worker->arena);
+        da_free(&worker->declarations);
+        byte_buffer_free(&worker->diagnostics);
+    }
+
+    f_free(bounds);
+
+    ASTNode* root = ast_new_block_stmt(declarations);
+    root->offset = tokens->count > 0 ? tokens->offsets[0] : 0;
+    return root;
+}
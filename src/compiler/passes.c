@@ -0,0 +1,351 @@
+#include "../../include/passes.h"
+#include "../../include/fold.h"
+#include "../../include/runtime/sys.h"
+#include <string.h>
+
+static const char* const level_names[] = { "-O0", "-O1", "-O2", "-O3" };
+
+void pass_manager_init(PassManager* manager, OptLevel level, bool time_passes) {
+    manager->level = level;
+    manager->time_passes = time_passes;
+    manager->module = NULL;
+    manager->pipeline = da_new(sizeof(const IrPass*), 8);
+    manager->rounds = level >= OPT_O2 ? IR_MAX_ROUNDS : 1;
+    manager->functions = da_new(sizeof(FunctionAnalyses), 0);
+    manager->timings = da_new(sizeof(PassTiming), 16);
+    manager->analysis_time = 0;
+    manager->module_version = 0;
+
+    const IrPass* round[8];
+    uint32_t count = 0;
+    if (level >= OPT_O3) round[count++] = &pass_inline;
+    if (level >= OPT_O1) {
+        round[count++] = &pass_simplify;
+        round[count++] = &pass_simplify_cfg;
+    }
+    if (level >= OPT_O2) round[count++] = &pass_cse;
+    if (level >= OPT_O1) round[count++] = &pass_dce;
+    for (uint32_t i = 0; i < count; i++) {
+        da_append(&manager->pipeline, &round[i]);
+    }
+}
+
+static void analyses_drop(FunctionAnalyses* analyses, uint32_t keep) {
+    uint32_t drop = analyses->valid & ~keep;
+    if (drop & ANALYSIS_USES) {
+        f_free(analyses->uses);
+        analyses->uses = NULL;
+    }
+    if (drop & ANALYSIS_DEFS) {
+        f_free(analyses->defs);
+        analyses->defs = NULL;
+    }
+    if (drop & ANALYSIS_DOMINATORS) {
+        IrDominators* dominators = &analyses->dominators;
+        f_free(dominators->order);
+        f_free(dominators->idom);
+        f_free(dominators->child);
+        f_free(dominators->sibling);
+        memset(dominators, 0, sizeof(*dominators));
+    }
+    analyses->valid &= keep;
+}
+
+void pass_manager_free(PassManager* manager) {
+    FunctionAnalyses* functions = manager->functions.items;
+    for (usize i = 0; i < manager->functions.count; i++) {
+        analyses_drop(&functions[i], 0);
+        f_free(functions[i].seen);
+    }
+    da_free(&manager->functions);
+    da_free(&manager->pipeline);
+    da_free(&manager->timings);
+}
+
+// Timing
+static PassTiming* timing_for(PassManager* manager, const char* name, TimingKind kind, bool measures_ir) {
+    PassTiming* timings = manager->timings.items;
+    for (usize i = 0; i < manager->timings.count; i++) {
+        if (strcmp(timings[i].name, name) == 0) return &timings[i];
+    }
+    PassTiming timing = { .name = name, .kind = kind, .measures_ir = measures_ir };
+    da_append(&manager->timings, &timing);
+    return (PassTiming*)manager->timings.items + manager->timings.count - 1;
+}
+
+void pass_manager_record(PassManager* manager, const char* name, uint64_t nanoseconds,
+                         usize before, usize after) {
+    if (!manager->time_passes) return;
+    PassTiming* timing = timing_for(manager, name, TIMING_STEP, true);
+    timing->nanoseconds += nanoseconds;
+    timing->runs++;
+    timing->delta += (int64_t)after - (int64_t)before;
+}
+
+void pass_manager_report(const PassManager* manager, FILE* out) {
+    const PassTiming* timings = manager->timings.items;
+    uint64_t total = 0;
+    for (usize i = 0; i < manager->timings.count; i++) {
+        total += timings[i].nanoseconds;
+    }
+
+    fprintf(out, "Pass timing (%s):\n", level_names[manager->level]);
+    fprintf(out, "  %-14s %8s %8s %12s %7s %10s\n", "pass", "runs", "changed", "time (ms)", "%", "IR delta");
+    for (usize i = 0; i < manager->timings.count; i++) {
+        const PassTiming* timing = &timings[i];
+        char changed[16] = "-";
+        char delta[24] = "-";
+        if (timing->kind == TIMING_PASS) snprintf(changed, sizeof(changed), "%u", timing->changed);
+        if (timing->measures_ir && timing->kind != TIMING_ANALYSIS) {
+            snprintf(delta, sizeof(delta), "%+lld", (long long)timing->delta);
+        }
+        fprintf(out, "  %-14s %8u %8s %12.3f %6.1f%% %10s\n", timing->name, timing->runs, changed,
+                timing->nanoseconds / 1e6, total ? 100.0 * timing->nanoseconds / total : 0.0, delta);
+    }
+    fprintf(out, "  %-14s %8s %8s %12.3f\n", "total", "", "", total / 1e6);
+}
+
+// Analyses
+static FunctionAnalyses* analyses_of(PassManager* manager, const IrFunction* function) {
+    return (FunctionAnalyses*)manager->functions.items + function->index;
+}
+
+static void compute_uses(FunctionAnalyses* analyses, const IrFunction* function) {
+    uint32_t* uses = f_calloc(function->values.count, sizeof(uint32_t));
+    IrBlock** blocks = function->blocks.items;
+    for (usize i = 0; i < function->blocks.count; i++) {
+        IrInstr* instrs = blocks[i]->instrs.items;
+        for (usize j = 0; j < blocks[i]->instrs.count; j++) {
+            for (uint32_t k = 0; k < instrs[j].arg_count; k++) uses[instrs[j].args[k]]++;
+        }
+    }
+    analyses->uses = uses;
+}
+
+static void compute_defs(FunctionAnalyses* analyses, const IrFunction* function) {
+    IrInstr** defs = f_calloc(function->values.count, sizeof(IrInstr*));
+    IrBlock** blocks = function->blocks.items;
+    for (usize i = 0; i < function->blocks.count; i++) {
+        IrInstr* instrs = blocks[i]->instrs.items;
+        for (usize j = 0; j < blocks[i]->instrs.count; j++) {
+            if (instrs[j].dest != IR_NO_VALUE) defs[instrs[j].dest] = &instrs[j];
+        }
+    }
+    analyses->defs = defs;
+}
+
+// Cooper, Harvey and Kennedy's iterative algorithm over the reverse
+// postorder: a block's dominator is the nearest common dominator of its
+// processed predecessors, repeated until nothing changes
+static uint32_t dominator_meet(const uint32_t* idom, const uint32_t* rank, uint32_t a, uint32_t b) {
+    while (a != b) {
+        while (rank[a] > rank[b]) a = idom[a];
+        while (rank[b] > rank[a]) b = idom[b];
+    }
+    return a;
+}
+
+static void compute_dominators(FunctionAnalyses* analyses, const IrFunction* function) {
+    uint32_t count = (uint32_t)function->blocks.count;
+    IrBlock** blocks = function->blocks.items;
+    IrDominators* dominators = &analyses->dominators;
+    dominators->order = f_malloc(count * sizeof(IrBlock*));
+    dominators->idom = f_malloc(count * sizeof(uint32_t));
+    dominators->child = f_malloc(count * sizeof(uint32_t));
+    dominators->sibling = f_malloc(count * sizeof(uint32_t));
+
+    // Postorder by an explicit depth-first walk; 'rank' is the position in
+    // the reverse postorder, IR_NONE until visited
+    uint32_t* rank = f_malloc(count * sizeof(uint32_t));
+    uint32_t* next_edge = f_calloc(count, sizeof(uint32_t));
+    IrBlock** stack = f_malloc(count * sizeof(IrBlock*));
+    for (uint32_t i = 0; i < count; i++) {
+        rank[i] = IR_NONE;
+        dominators->idom[i] = IR_NONE;
+        dominators->child[i] = IR_NONE;
+        dominators->sibling[i] = IR_NONE;
+    }
+    uint32_t depth = 0;
+    uint32_t visited = 0;
+    stack[depth++] = blocks[0];
+    rank[0] = 0;
+    while (depth > 0) {
+        IrBlock* block = stack[depth - 1];
+        IrBlock* successors[2];
+        uint32_t successor_count = ir_successors(block, successors);
+        if (next_edge[block->id] < successor_count) {
+            IrBlock* successor = successors[next_edge[block->id]++];
+            if (rank[successor->id] == IR_NONE) {
+                rank[successor->id] = 0;
+                stack[depth++] = successor;
+            }
+            continue;
+        }
+        depth--;
+        dominators->order[visited++] = block;
+    }
+    for (uint32_t i = 0; i < visited / 2; i++) {
+        IrBlock* swap = dominators->order[i];
+        dominators->order[i] = dominators->order[visited - 1 - i];
+        dominators->order[visited - 1 - i] = swap;
+    }
+    for (uint32_t i = 0; i < visited; i++) {
+        rank[dominators->order[i]->id] = i;
+    }
+    dominators->count = visited;
+
+    uint32_t* idom = dominators->idom;
+    idom[0] = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (uint32_t i = 1; i < visited; i++) {
+            IrBlock* block = dominators->order[i];
+            IrBlock** preds = block->preds.items;
+            uint32_t dominator = IR_NONE;
+            for (usize j = 0; j < block->preds.count; j++) {
+                uint32_t pred = preds[j]->id;
+                if (rank[pred] == IR_NONE || idom[pred] == IR_NONE) continue;
+                dominator = dominator == IR_NONE ? pred : dominator_meet(idom, rank, pred, dominator);
+            }
+            if (idom[block->id] != dominator) {
+                idom[block->id] = dominator;
+                changed = true;
+            }
+        }
+    }
+
+    // Children in reverse postorder, so walking the tree visits them that way
+    for (uint32_t i = visited; i-- > 1;) {
+        uint32_t id = dominators->order[i]->id;
+        dominators->sibling[id] = dominators->child[idom[id]];
+        dominators->child[idom[id]] = id;
+    }
+
+    f_free(rank);
+    f_free(next_edge);
+    f_free(stack);
+}
+
+static void ensure_analysis(PassManager* manager, IrFunction* function, AnalysisKind kind) {
+    FunctionAnalyses* analyses = analyses_of(manager, function);
+    if (analyses->valid & kind) return;
+
+    uint64_t start = manager->time_passes ? sys_nanotime() : 0;
+    const char* name;
+    switch (kind) {
+        case ANALYSIS_USES:
+            compute_uses(analyses, function);
+            name = "[uses]";
+            break;
+        case ANALYSIS_DEFS:
+            compute_defs(analyses, function);
+            name = "[defs]";
+            break;
+        default:
+            compute_dominators(analyses, function);
+            name = "[dominators]";
+            break;
+    }
+    analyses->valid |= kind;
+
+    if (manager->time_passes) {
+        uint64_t elapsed = sys_nanotime() - start;
+        PassTiming* timing = timing_for(manager, name, TIMING_ANALYSIS, false);
+        timing->nanoseconds += elapsed;
+        timing->runs++;
+        manager->analysis_time += elapsed;
+    }
+}
+
+uint32_t* pass_uses(PassManager* manager, IrFunction* function) {
+    ensure_analysis(manager, function, ANALYSIS_USES);
+    return analyses_of(manager, function)->uses;
+}
+
+IrInstr** pass_defs(PassManager* manager, IrFunction* function) {
+    ensure_analysis(manager, function, ANALYSIS_DEFS);
+    return analyses_of(manager, function)->defs;
+}
+
+const IrDominators* pass_dominators(PassManager* manager, IrFunction* function) {
+    ensure_analysis(manager, function, ANALYSIS_DOMINATORS);
+    return &analyses_of(manager, function)->dominators;
+}
+
+// Running
+void pass_manager_run_ast(PassManager* manager, ASTNode* root, const Resolver* resolver) {
+    if (manager->level == OPT_O0) return;
+
+    uint64_t start = manager->time_passes ? sys_nanotime() : 0;
+    FoldStats stats = {0};
+    fold_program(root, resolver, &stats);
+    if (manager->time_passes) {
+        PassTiming* timing = timing_for(manager, "fold", TIMING_PASS, false);
+        timing->nanoseconds += sys_nanotime() - start;
+        timing->runs++;
+        if (stats.folded + stats.propagated + stats.simplified > 0) timing->changed++;
+    }
+}
+
+// Runs 'pass' on every function. 'position' is its place in the pipeline,
+// or IR_NONE to run it even on functions it has seen.
+static bool run_pass(PassManager* manager, const IrPass* pass, uint32_t position) {
+    IrModule* module = manager->module;
+    PassTiming* timing = NULL;
+    usize before = 0;
+    if (manager->time_passes) {
+        timing = timing_for(manager, pass->name, TIMING_PASS, true);
+        before = ir_instr_count(module);
+    }
+
+    bool changed = false;
+    for (usize i = 0; i < module->functions.count; i++) {
+        IrFunction* function = ((IrFunction**)module->functions.items)[i];
+        if (function->external || function->blocks.count == 0) continue;
+        FunctionAnalyses* analyses = analyses_of(manager, function);
+        uint32_t version = pass->reads_callees ? manager->module_version : analyses->version;
+        if (position != IR_NONE && analyses->seen[position] == version + 1) continue;
+
+        uint64_t start = timing ? sys_nanotime() : 0;
+        manager->analysis_time = 0;
+        bool modified = pass->run(manager, function);
+        if (timing) {
+            timing->nanoseconds += sys_nanotime() - start - manager->analysis_time;
+            timing->runs++;
+            if (modified) timing->changed++;
+        }
+        if (modified) {
+            analyses->version++;
+            manager->module_version++;
+            analyses_drop(analyses, pass->preserves);
+            changed = true;
+        }
+        version = pass->reads_callees ? manager->module_version : analyses->version;
+        if (position != IR_NONE) analyses->seen[position] = version + 1;
+    }
+
+    if (timing) timing->delta += (int64_t)ir_instr_count(module) - (int64_t)before;
+    return changed;
+}
+
+void pass_manager_run_ir(PassManager* manager, IrModule* module) {
+    if (manager->level == OPT_O0) return;
+
+    manager->module = module;
+    FunctionAnalyses empty = {0};
+    for (usize i = manager->functions.count; i < module->functions.count; i++) {
+        da_append(&manager->functions, &empty);
+        FunctionAnalyses* analyses = (FunctionAnalyses*)manager->functions.items + i;
+        analyses->seen = f_calloc(manager->pipeline.count, sizeof(uint32_t));
+    }
+
+    const IrPass** pipeline = manager->pipeline.items;
+    for (uint32_t round = 0; round < manager->rounds; round++) {
+        bool changed = false;
+        for (uint32_t i = 0; i < manager->pipeline.count; i++) {
+            changed |= run_pass(manager, pipeline[i], i);
+        }
+        if (!changed) break;
+    }
+    run_pass(manager, &pass_renumber, IR_NONE);
+}
@@ -0,0 +1,602 @@
+#include "../../include/resolver.h"
+#include "../../include/ferror.h"
+#include "../../include/runtime/memory.h"
+#include <string.h>
+
+typedef struct {
+    uint32_t start;
+    uint32_t next_slot;
+} ScopeMark;
+
+static void resolve_node(Resolver* resolver, ASTNode** slot);
+
+// Error handling
+static void error_at(Resolver* resolver, uint32_t offset, const char* name, uint32_t name_length,
+                     const char* message) {
+    resolver->error_count++;
+    diagnostic_report(NULL, resolver->filename, &resolver->lines, offset, name, (int)name_length,
+                      "%s", message);
+}
+
+static inline Declaration* declaration_at(Resolver* resolver, uint32_t index) {
+    return (Declaration*)resolver->declarations.items + index;
+}
+
+// Scopes
+static ScopeMark scope_begin(Resolver* resolver) {
+    ScopeMark mark = { resolver->scope_start, resolver->function->next_slot };
+    resolver->scope_start = (uint32_t)resolver->declarations.count;
+    resolver->scope_depth++;
+    return mark;
+}
+
+// Pops the scope's declarations, unshadowing what they hid, and frees its
+// slots for the next block
+static void scope_end(Resolver* resolver, ScopeMark mark) {
+    while (resolver->declarations.count > resolver->scope_start) {
+        Declaration* declaration = declaration_at(resolver, (uint32_t)resolver->declarations.count - 1);
+        if (declaration->previous == RESOLVER_NONE) {
+            u32_map_remove(&resolver->names, declaration->symbol);
+        } else {
+            u32_map_set(&resolver->names, declaration->symbol, declaration->previous);
+        }
+        resolver->declarations.count--;
+    }
+    resolver->scope_start = mark.start;
+    resolver->scope_depth--;
+    resolver->function->next_slot = mark.next_slot;
+}
+
+static Binding declare_symbol(Resolver* resolver, Symbol symbol, Binding* target) {
+    Binding binding = { BINDING_GLOBAL, false, 0 };
+    if (resolver->scope_depth == 0) {
+        binding.index = resolver->global_count++;
+    } else {
+        FunctionScope* function = resolver->function;
+        binding.kind = BINDING_LOCAL;
+        binding.index = function->next_slot++;
+        if (function->next_slot > function->max_slots) function->max_slots = function->next_slot;
+    }
+
+    uint32_t* innermost = u32_map_get(&resolver->names, symbol);
+    Declaration declaration = {
+        .symbol = symbol,
+        .previous = innermost ? *innermost : RESOLVER_NONE,
+        .function = resolver->function->depth,
+        .binding = binding,
+        .target = target,
+    };
+    u32_map_set(&resolver->names, symbol, (uint32_t)resolver->declarations.count);
+    da_append(&resolver->declarations, &declaration);
+
+    if (target) *target = binding;
+    return binding;
+}
+
+static void declare(Resolver* resolver, Token name, Binding* target) {
+    Symbol symbol = intern(resolver->interner, name.start, (uint32_t)name.length);
+
+    uint32_t* innermost = u32_map_get(&resolver->names, symbol);
+    if (innermost && *innermost >= resolver->scope_start) {
+        error_at(resolver, name.offset, name.start, (uint32_t)name.length,
+                 "Already a variable with this name in this scope");
+    }
+    declare_symbol(resolver, symbol, target);
+}
+
+// The declaration of 'name' made for 'target', or NULL
+static Declaration* find_declaration(Resolver* resolver, Token name, const Binding* target) {
+    Symbol symbol = intern(resolver->interner, name.start, (uint32_t)name.length);
+    uint32_t* innermost = u32_map_get(&resolver->names, symbol);
+    uint32_t index = innermost ? *innermost : RESOLVER_NONE;
+    while (index != RESOLVER_NONE) {
+        Declaration* declaration = declaration_at(resolver, index);
+        if (declaration->target == target) return declaration;
+        index = declaration->previous;
+    }
+    return NULL;
+}
+
+// Returns the index of the upvalue of 'function' that refers to the
+// declaration, adding it (and the upvalues of the functions in between) if
+// it is not there yet
+static uint32_t capture(Resolver* resolver, FunctionScope* function, uint32_t index) {
+    uint32_t* captures = function->captures.items;
+    for (uint32_t i = 0; i < function->captures.count; i++) {
+        if (captures[i] == index) return i;
+    }
+
+    Declaration* declaration = declaration_at(resolver, index);
+    Upvalue upvalue;
+    if (declaration->function == function->enclosing->depth) {
+        upvalue.is_local = true;
+        upvalue.index = declaration->binding.index;
+        declaration->binding.captured = true;
+        if (declaration->target) declaration->target->captured = true;
+    } else {
+        upvalue.is_local = false;
+        upvalue.index = capture(resolver, function->enclosing, index);
+    }
+
+    da_append(&function->upvalues, &upvalue);
+    da_append(&function->captures, &index);
+    return (uint32_t)function->captures.count - 1;
+}
+
+static Binding resolve_symbol(Resolver* resolver, Symbol symbol) {
+    Binding binding = { BINDING_UNRESOLVED, false, 0 };
+
+    uint32_t* innermost = u32_map_get(&resolver->names, symbol);
+    if (!innermost) return binding;
+
+    Declaration* declaration = declaration_at(resolver, *innermost);
+    if (declaration->binding.kind == BINDING_GLOBAL || declaration->function == resolver->function->depth) {
+        binding = declaration->binding;
+        binding.captured = false;
+        return binding;
+    }
+
+    binding.kind = BINDING_UPVALUE;
+    binding.index = capture(resolver, resolver->function, *innermost);
+    return binding;
+}
+
+// Functions
+static FrameInfo* frame_new(ASTNode* node) {
+    FunctionDecl* decl = &node->func_decl;
+    if (decl->frame && !ast_get_arena()) {
+        f_free(decl->frame->upvalues);
+        f_free(decl->frame);
+    }
+
+    usize size = sizeof(FrameInfo) + decl->params.count * sizeof(Binding);
+    FrameInfo* frame = ast_alloc(size);
+    memset(frame, 0, size);
+    frame->param_count = decl->params.count;
+    frame->params = (Binding*)(frame + 1);
+    decl->frame = frame;
+    return frame;
+}
+
+// 'node' must already have a fresh frame. Parameters and the body's
+// statements share the function's outermost scope.
+static void resolve_function(Resolver* resolver, ASTNode* node, const TokenList* captures) {
+    FunctionDecl* decl = &node->func_decl;
+    FrameInfo* frame = decl->frame;
+
+    FunctionScope function = {
+        .enclosing = resolver->function,
+        .frame = frame,
+        .depth = resolver->function->depth + 1,
+        .upvalues = da_new(sizeof(Upvalue), 4),
+        .captures = da_new(sizeof(uint32_t), 4),
+    };
+    resolver->function = &function;
+    ScopeMark mark = scope_begin(resolver);
+
+    if (captures) {
+        for (uint32_t i = 0; i < captures->count; i++) {
+            Token name = SMALL_VEC_AT(captures, i);
+            Symbol symbol = intern(resolver->interner, name.start, (uint32_t)name.length);
+            if (resolve_symbol(resolver, symbol).kind == BINDING_UNRESOLVED) {
+                error_at(resolver, name.offset, name.start, (uint32_t)name.length, "Undefined variable");
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < decl->params.count; i++) {
+        declare(resolver, SMALL_VEC_AT(&decl->params, i), &frame->params[i]);
+    }
+
+    ASTNode* body = decl->body;
+    if (body && body->type == NODE_BLOCK_STMT) {
+        ASTNode** statements = SMALL_VEC_ITEMS(&body->block_stmt.statements);
+        for (uint32_t i = 0; i < body->block_stmt.statements.count; i++) {
+            resolve_node(resolver, &statements[i]);
+        }
+    } else {
+        resolve_node(resolver, &decl->body);
+    }
+
+    scope_end(resolver, mark);
+    resolver->function = function.enclosing;
+
+    frame->frame_size = function.max_slots;
+    frame->upvalue_count = (uint32_t)function.upvalues.count;
+    if (function.upvalues.count > 0) {
+        usize size = function.upvalues.count * sizeof(Upvalue);
+        frame->upvalues = ast_alloc(size);
+        memcpy(frame->upvalues, function.upvalues.items, size);
+    }
+
+    da_free(&function.upvalues);
+    da_free(&function.captures);
+}
+
+// Methods are functions whose names are not bound
+static void resolve_members(Resolver* resolver, NodeList* members) {
+    ASTNode** items = SMALL_VEC_ITEMS(members);
+    for (uint32_t i = 0; i < members->count; i++) {
+        if (items[i] && items[i]->type == NODE_FUNCTION_DECL) {
+            frame_new(items[i]);
+            resolve_function(resolver, items[i], NULL);
+        } else {
+            resolve_node(resolver, &items[i]);
+        }
+    }
+}
+
+static void resolve_list(Resolver* resolver, NodeList* list) {
+    ASTNode** items = SMALL_VEC_ITEMS(list);
+    for (uint32_t i = 0; i < list->count; i++) {
+        resolve_node(resolver, &items[i]);
+    }
+}
+
+// A hash-consed node may be reachable from several places, each of which
+// can bind its names differently
+static ASTNode* unshare(ASTNode** slot) {
+    ASTNode* node = *slot;
+    if (node->hash == 0) return node;
+
+    switch (node->type) {
+        case NODE_INT_LITERAL:
+        case NODE_FLOAT_LITERAL:
+        case NODE_STRING_LITERAL:
+        case NODE_BOOL_LITERAL:
+        case NODE_CHAR_LITERAL:
+        case NODE_NIL_LITERAL:
+            return node;
+        default:
+            break;
+    }
+
+    ASTNode* copy = ast_alloc(sizeof(ASTNode));
+    *copy = *node;
+    copy->hash = 0;
+    *slot = copy;
+    return copy;
+}
+
+static void resolve_node(Resolver* resolver, ASTNode** slot) {
+    if (!*slot) return;
+    ASTNode* node = unshare(slot);
+
+    switch (node->type) {
+        case NODE_IDENTIFIER: {
+            Symbol symbol = node->ident.symbol;
+            node->ident.binding = resolve_symbol(resolver, symbol);
+            if (node->ident.binding.kind == BINDING_UNRESOLVED) {
+                error_at(resolver, node->offset, symbol_text(resolver->interner, symbol),
+                         symbol_length(resolver->interner, symbol), "Undefined variable");
+                break;
+            }
+
+            // Top-level code runs in order; only function bodies may run later
+            uint32_t* innermost = u32_map_get(&resolver->names, symbol);
+            if (resolver->function == &resolver->script && declaration_at(resolver, *innermost)->pending) {
+                error_at(resolver, node->offset, symbol_text(resolver->interner, symbol),
+                         symbol_length(resolver->interner, symbol), "Variable used before its declaration");
+            }
+            break;
+        }
+
+        case NODE_BINARY_EXPR:
+            resolve_node(resolver, &node->binary_expr.left);
+            resolve_node(resolver, &node->binary_expr.right);
+            break;
+
+        case NODE_LOGICAL_EXPR:
+            resolve_node(resolver, &node->logical_expr.left);
+            resolve_node(resolver, &node->logical_expr.right);
+            break;
+
+        case NODE_UNARY_EXPR:
+            resolve_node(resolver, &node->unary_expr.operand);
+            break;
+
+        case NODE_CALL_EXPR:
+            resolve_node(resolver, &node->call_expr.callee);
+            resolve_list(resolver, &node->call_expr.args);
+            break;
+
+        case NODE_GET_EXPR:
+            resolve_node(resolver, &node->get_expr.object);
+            break;
+
+        case NODE_SET_EXPR:
+            resolve_node(resolver, &node->set_expr.object);
+            resolve_node(resolver, &node->set_expr.value);
+            break;
+
+        case NODE_ARRAY_EXPR:
+            resolve_list(resolver, &node->array_expr.elements);
+            break;
+
+        case NODE_INDEX_EXPR:
+            resolve_node(resolver, &node->index_expr.array);
+            resolve_node(resolver, &node->index_expr.index);
+            break;
+
+        case NODE_CLOSURE_EXPR: {
+            ASTNode* function = node->closure_expr.function;
+            if (function && function->type == NODE_FUNCTION_DECL) {
+                frame_new(function);
+                resolve_function(resolver, function, &node->closure_expr.captures);
+            } else {
+                resolve_node(resolver, &node->closure_expr.function);
+            }
+            break;
+        }
+
+        case NODE_ASYNC_EXPR:
+            resolve_node(resolver, &node->async_expr.expression);
+            break;
+
+        case NODE_AWAIT_EXPR:
+            resolve_node(resolver, &node->await_expr.expression);
+            break;
+
+        case NODE_CHAN_SEND_EXPR:
+            resolve_node(resolver, &node->chan_send_expr.channel);
+            resolve_node(resolver, &node->chan_send_expr.value);
+            break;
+
+        case NODE_CHAN_RECV_EXPR:
+            resolve_node(resolver, &node->chan_recv_expr.channel);
+            break;
+
+        case NODE_VAR_DECL:
+            // The initializer sees the scope before the variable exists
+            resolve_node(resolver, &node->var_decl.value);
+            declare(resolver, node->var_decl.name, &node->var_decl.binding);
+            break;
+
+        case NODE_FUNCTION_DECL: {
+            FrameInfo* frame = frame_new(node);
+            declare(resolver, node->func_decl.name, &frame->binding);
+            resolve_function(resolver, node, NULL);
+            break;
+        }
+
+        case NODE_CLASS_DECL:
+            resolve_members(resolver, &node->class_decl.members);
+            break;
+
+        case NODE_INTERFACE_DECL:
+            resolve_members(resolver, &node->interface_decl.methods);
+            break;
+
+        case NODE_TRAIT_DECL:
+            resolve_members(resolver, &node->trait_decl.methods);
+            break;
+
+        case NODE_IMPL_DECL:
+            resolve_members(resolver, &node->impl_decl.methods);
+            break;
+
+        case NODE_ENUM_DECL:
+            resolve_list(resolver, &node->enum_decl.values);
+            break;
+
+        case NODE_IMPORT_DECL:
+            if (node->import_decl.alias.length > 0) {
+                declare(resolver, node->import_decl.alias, &node->import_decl.binding);
+            }
+            break;
+
+        case NODE_EXPORT_DECL:
+            resolve_node(resolver, &node->export_decl.declaration);
+            break;
+
+        case NODE_CHAN_DECL:
+            resolve_node(resolver, &node->chan_decl.capacity);
+            declare(resolver, node->chan_decl.name, &node->chan_decl.binding);
+            break;
+
+        case NODE_BLOCK_STMT: {
+            ScopeMark mark = scope_begin(resolver);
+            resolve_list(resolver, &node->block_stmt.statements);
+            scope_end(resolver, mark);
+            break;
+        }
+
+        case NODE_IF_STMT:
+            resolve_node(resolver, &node->if_stmt.condition);
+            resolve_node(resolver, &node->if_stmt.then_branch);
+            resolve_node(resolver, &node->if_stmt.else_branch);
+            break;
+
+        case NODE_WHILE_STMT:
+            resolve_node(resolver, &node->while_stmt.condition);
+            resolve_node(resolver, &node->while_stmt.body);
+            break;
+
+        case NODE_FOR_STMT: {
+            // The initializer's variable is scoped to the loop
+            ScopeMark mark = scope_begin(resolver);
+            resolve_node(resolver, &node->for_stmt.initializer);
+            resolve_node(resolver, &node->for_stmt.condition);
+            resolve_node(resolver, &node->for_stmt.increment);
+            resolve_node(resolver, &node->for_stmt.body);
+            scope_end(resolver, mark);
+            break;
+        }
+
+        case NODE_FOREACH_STMT: {
+            resolve_node(resolver, &node->foreach_stmt.iterator);
+            ScopeMark mark = scope_begin(resolver);
+            declare(resolver, node->foreach_stmt.var, &node->foreach_stmt.var_binding);
+            resolve_node(resolver, &node->foreach_stmt.body);
+            scope_end(resolver, mark);
+            break;
+        }
+
+        case NODE_RETURN_STMT:
+            resolve_node(resolver, &node->return_stmt.value);
+            break;
+
+        case NODE_EXPR_STMT:
+            resolve_node(resolver, &node->expr_stmt.expr);
+            break;
+
+        case NODE_TRY_STMT:
+            resolve_node(resolver, &node->try_stmt.try_block);
+            resolve_list(resolver, &node->try_stmt.catch_blocks);
+            resolve_node(resolver, &node->try_stmt.finally_block);
+            break;
+
+        case NODE_CATCH_CLAUSE: {
+            ScopeMark mark = scope_begin(resolver);
+            declare(resolver, node->catch_clause.var, &node->catch_clause.var_binding);
+            resolve_node(resolver, &node->catch_clause.body);
+            scope_end(resolver, mark);
+            break;
+        }
+
+        case NODE_THROW_STMT:
+            resolve_node(resolver, &node->throw_stmt.value);
+            break;
+
+        case NODE_MATCH_STMT:
+            resolve_node(resolver, &node->match_stmt.value);
+            resolve_list(resolver, &node->match_stmt.cases);
+            resolve_node(resolver, &node->match_stmt.default_case);
+            break;
+
+        case NODE_DEFER_STMT:
+            resolve_node(resolver, &node->defer_stmt.statement);
+            break;
+
+        case NODE_GO_STMT:
+            resolve_node(resolver, &node->go_stmt.expression);
+            break;
+
+        case NODE_SELECT_STMT: {
+            SelectCase** cases = SMALL_VEC_ITEMS(&node->select_stmt.cases);
+            for (uint32_t i = 0; i < node->select_stmt.cases.count; i++) {
+                resolve_node(resolver, &cases[i]->channel);
+                resolve_node(resolver, &cases[i]->value);
+                resolve_node(resolver, &cases[i]->body);
+            }
+            resolve_node(resolver, &node->select_stmt.default_case);
+            break;
+        }
+
+        // Literals, break/continue, and the type namespace bind nothing
+        default:
+            break;
+    }
+}
+
+// Top level
+static void hoist(Resolver* resolver, ASTNode* node) {
+    switch (node->type) {
+        case NODE_VAR_DECL:
+            declare(resolver, node->var_decl.name, &node->var_decl.binding);
+            declaration_at(resolver, (uint32_t)resolver->declarations.count - 1)->pending = true;
+            break;
+        case NODE_FUNCTION_DECL:
+            declare(resolver, node->func_decl.name, &frame_new(node)->binding);
+            break;
+        case NODE_IMPORT_DECL:
+            if (node->import_decl.alias.length > 0) {
+                declare(resolver, node->import_decl.alias, &node->import_decl.binding);
+            }
+            break;
+        case NODE_CHAN_DECL:
+            declare(resolver, node->chan_decl.name, &node->chan_decl.binding);
+            declaration_at(resolver, (uint32_t)resolver->declarations.count - 1)->pending = true;
+            break;
+        case NODE_EXPORT_DECL:
+            if (node->export_decl.declaration) hoist(resolver, node->export_decl.declaration);
+            break;
+        default:
+            break;
+    }
+}
+
+// Resolves a top-level statement whose names hoist() already declared.
+// A variable stops being pending once its initializer is resolved.
+static void resolve_top_level(Resolver* resolver, ASTNode** slot) {
+    ASTNode* node = *slot;
+    switch (node->type) {
+        case NODE_VAR_DECL: {
+            resolve_node(resolver, &node->var_decl.value);
+            Declaration* declaration = find_declaration(resolver, node->var_decl.name, &node->var_decl.binding);
+            if (declaration) declaration->pending = false;
+            break;
+        }
+        case NODE_FUNCTION_DECL:
+            resolve_function(resolver, node, NULL);
+            break;
+        case NODE_IMPORT_DECL:
+            break;
+        case NODE_CHAN_DECL: {
+            resolve_node(resolver, &node->chan_decl.capacity);
+            Declaration* declaration = find_declaration(resolver, node->chan_decl.name, &node->chan_decl.binding);
+            if (declaration) declaration->pending = false;
+            break;
+        }
+        case NODE_EXPORT_DECL:
+            if (node->export_decl.declaration) resolve_top_level(resolver, &node->export_decl.declaration);
+            break;
+        default:
+            resolve_node(resolver, slot);
+            break;
+    }
+}
+
+void resolver_init(Resolver* resolver, Interner* interner, const char* source, const char* filename) {
+    resolver->interner = interner;
+    resolver->filename = filename;
+    line_map_init(&resolver->lines, source);
+    u32_map_init(&resolver->names, NULL);
+    resolver->declarations = da_new(sizeof(Declaration), 64);
+    resolver->scope_start = 0;
+    resolver->scope_depth = 0;
+    resolver->script = (FunctionScope){0};
+    resolver->function = &resolver->script;
+    resolver->global_count = 0;
+    resolver->script_frame_size = 0;
+    resolver->error_count = 0;
+
+    resolver_declare_global(resolver, "print");
+}
+
+void resolver_free(Resolver* resolver) {
+    line_map_free(&resolver->lines);
+    u32_map_free(&resolver->names);
+    da_free(&resolver->declarations);
+}
+
+uint32_t resolver_declare_global(Resolver* resolver, const char* name) {
+    Symbol symbol = intern(resolver->interner, name, (uint32_t)strlen(name));
+    return declare_symbol(resolver, symbol, NULL).index;
+}
+
+bool resolve_program(Resolver* resolver, ASTNode* root) {
+    if (!root) return resolver->error_count == 0;
+
+    // Builtins sit outside the program's scope, so the program may shadow them
+    uint32_t builtins_start = resolver->scope_start;
+    resolver->scope_start = (uint32_t)resolver->declarations.count;
+
+    if (root->type == NODE_BLOCK_STMT) {
+        NodeList* statements = &root->block_stmt.statements;
+        ASTNode** items = SMALL_VEC_ITEMS(statements);
+        for (uint32_t i = 0; i < statements->count; i++) {
+            if (items[i]) hoist(resolver, items[i]);
+        }
+        for (uint32_t i = 0; i < statements->count; i++) {
+            if (items[i]) resolve_top_level(resolver, &items[i]);
+        }
+    } else {
+        hoist(resolver, root);
+        resolve_top_level(resolver, &root);
+    }
+
+    resolver->script_frame_size = resolver->script.max_slots;
+    resolver->scope_start = builtins_start;
+    return resolver->error_count == 0;
+}
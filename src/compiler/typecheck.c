@@ -0,0 +1,776 @@
+#include "../../include/typecheck.h"
+#include "../../include/ferror.h"
+#include "../../include/runtime/memory.h"
+#include <stdarg.h>
+#include <string.h>
+
+#define TYPE_NAME_SIZE 128
+
+static TypeId check_expression(TypeChecker* checker, ASTNode* node);
+static void check_statement(TypeChecker* checker, ASTNode* node);
+
+// Error handling
+static void error_at(TypeChecker* checker, uint32_t offset, const char* format, ...) {
+    checker->error_count++;
+
+    va_list args;
+    va_start(args, format);
+    diagnostic_vreport(NULL, checker->filename, &checker->lines, offset, NULL, 0, format, args);
+    va_end(args);
+}
+
+// Unifies 'found' with 'expected'; on failure reports what 'context' needed
+static bool expect(TypeChecker* checker, uint32_t offset, TypeId expected, TypeId found, const char* context) {
+    if (type_unify(checker->types, expected, found)) return true;
+
+    char want[TYPE_NAME_SIZE];
+    char have[TYPE_NAME_SIZE];
+    error_at(checker, offset, "Type mismatch in %s: expected %s, found %s", context,
+             type_format(checker->types, checker->interner, expected, want, sizeof(want)),
+             type_format(checker->types, checker->interner, found, have, sizeof(have)));
+    return false;
+}
+
+static TypeId annotate(TypeChecker* checker, ASTNode* node, TypeId type) {
+    node->value_type = type;
+    da_append(&checker->checked, &node);
+    return type;
+}
+
+// Variables
+static TypeId binding_type(TypeChecker* checker, Binding binding) {
+    switch (binding.kind) {
+        case BINDING_LOCAL:
+            return checker->scope->slots[binding.index];
+        case BINDING_UPVALUE:
+            return checker->scope->upvalues[binding.index];
+        case BINDING_GLOBAL:
+            return ((TypeId*)checker->globals.items)[binding.index];
+        default:
+            return TYPE_ERROR;
+    }
+}
+
+// A declaration takes its slot; a global was hoisted as a variable that
+// its uses may already have constrained
+static void declare(TypeChecker* checker, Binding binding, TypeId type, uint32_t offset) {
+    switch (binding.kind) {
+        case BINDING_LOCAL:
+            checker->scope->slots[binding.index] = type;
+            break;
+        case BINDING_GLOBAL:
+            expect(checker, offset, ((TypeId*)checker->globals.items)[binding.index], type, "declaration");
+            break;
+        default:
+            break;
+    }
+}
+
+// Types written in the source
+static TypeId type_from_node(TypeChecker* checker, ASTNode* node, const TokenList* type_params) {
+    if (!node) return type_var(checker->types, 0);
+
+    switch (node->type) {
+        case NODE_IDENTIFIER: {
+            Symbol name = node->ident.symbol;
+            if (type_params) {
+                for (uint32_t i = 0; i < type_params->count; i++) {
+                    Token param = SMALL_VEC_AT(type_params, i);
+                    if (intern(checker->interner, param.start, (uint32_t)param.length) == name) return TYPE_ANY;
+                }
+            }
+
+            uint32_t* type = u32_map_get(&checker->named, name);
+            if (type) return *type;
+            error_at(checker, node->offset, "Unknown type '%.*s'", (int)symbol_length(checker->interner, name),
+                     symbol_text(checker->interner, name));
+            return TYPE_ERROR;
+        }
+
+        // '[T]'
+        case NODE_ARRAY_EXPR:
+            if (node->array_expr.elements.count == 1) {
+                ASTNode* element = SMALL_VEC_AT(&node->array_expr.elements, 0);
+                return type_array(checker->types, type_from_node(checker, element, type_params));
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    error_at(checker, node->offset, "Invalid type");
+    return TYPE_ERROR;
+}
+
+static void declare_type(TypeChecker* checker, Token name, TypeId type) {
+    Symbol symbol = intern(checker->interner, name.start, (uint32_t)name.length);
+    if (u32_map_get(&checker->named, symbol)) {
+        error_at(checker, name.offset, "Type '%.*s' is already defined", name.length, name.start);
+        return;
+    }
+    u32_map_set(&checker->named, symbol, type);
+}
+
+static void declare_nominal(TypeChecker* checker, Token name) {
+    Symbol symbol = intern(checker->interner, name.start, (uint32_t)name.length);
+    declare_type(checker, name, type_named(checker->types, symbol));
+}
+
+// Functions
+//
+// A function's type is built from fresh variables before its body is
+// checked, so calls that come first (including recursive ones) shape it.
+static TypeId function_signature(TypeChecker* checker, ASTNode* node) {
+    FunctionDecl* decl = &node->func_decl;
+    TypeId stack[16];
+    TypeId* params = decl->params.count <= 16 ? stack : f_malloc(decl->params.count * sizeof(TypeId));
+    for (uint32_t i = 0; i < decl->params.count; i++) {
+        params[i] = type_var(checker->types, 0);
+    }
+    TypeId result = decl->return_type ? type_from_node(checker, decl->return_type, &decl->type_params)
+                                      : type_var(checker->types, 0);
+
+    TypeId type = type_function(checker->types, params, decl->params.count, result);
+    if (params != stack) f_free(params);
+    return annotate(checker, node, type);
+}
+
+static void check_function_body(TypeChecker* checker, ASTNode* node) {
+    FunctionDecl* decl = &node->func_decl;
+    FrameInfo* frame = decl->frame;
+    if (!frame) return;
+
+    const TypeInfo* info = type_info(checker->types, node->value_type);
+    const TypeId* signature = info->args;
+    uint32_t arity = info->arity;
+
+    TypeScope* enclosing = checker->scope;
+    TypeScope scope = {
+        .enclosing = enclosing,
+        .slots = f_calloc(frame->frame_size ? frame->frame_size : 1, sizeof(TypeId)),
+        .upvalues = f_calloc(frame->upvalue_count ? frame->upvalue_count : 1, sizeof(TypeId)),
+        .result = signature[arity - 1],
+        .returns_value = false,
+    };
+    for (uint32_t i = 0; i < frame->upvalue_count; i++) {
+        Upvalue upvalue = frame->upvalues[i];
+        scope.upvalues[i] = upvalue.is_local ? enclosing->slots[upvalue.index] : enclosing->upvalues[upvalue.index];
+    }
+    for (uint32_t i = 0; i < frame->param_count; i++) {
+        scope.slots[frame->params[i].index] = signature[i];
+    }
+
+    checker->scope = &scope;
+    check_statement(checker, decl->body);
+    checker->scope = enclosing;
+
+    if (!scope.returns_value) expect(checker, node->offset, scope.result, TYPE_NIL, "return type");
+
+    f_free(scope.slots);
+    f_free(scope.upvalues);
+}
+
+static TypeId check_function(TypeChecker* checker, ASTNode* node) {
+    TypeId type = function_signature(checker, node);
+    check_function_body(checker, node);
+    return type;
+}
+
+static void check_members(TypeChecker* checker, NodeList* members) {
+    for (uint32_t i = 0; i < members->count; i++) {
+        ASTNode* member = SMALL_VEC_AT(members, i);
+        if (member && member->type == NODE_FUNCTION_DECL) {
+            check_function(checker, member);
+        } else {
+            check_statement(checker, member);
+        }
+    }
+}
+
+// Expressions
+static TypeId check_binary(TypeChecker* checker, ASTNode* node) {
+    BinaryExpr* binary = &node->binary_expr;
+    TypeId left = check_expression(checker, binary->left);
+    TypeId right = check_expression(checker, binary->right);
+
+    uint16_t allowed;
+    TypeId result;
+    switch (binary->op.type) {
+        case TOKEN_PLUS:
+            allowed = TYPE_NUMERIC | TYPE_KIND_BIT(TYPE_STRING);
+            result = left;
+            break;
+        case TOKEN_MINUS:
+        case TOKEN_STAR:
+        case TOKEN_SLASH:
+            allowed = TYPE_NUMERIC;
+            result = left;
+            break;
+        case TOKEN_GT:
+        case TOKEN_GTEQ:
+        case TOKEN_LTEQ:
+            allowed = TYPE_ORDERED;
+            result = TYPE_BOOL;
+            break;
+        case TOKEN_EQEQ:
+        case TOKEN_BANG_EQ:
+            allowed = 0;
+            result = TYPE_BOOL;
+            break;
+        default:
+            error_at(checker, node->offset, "Unsupported operator '%.*s'", binary->op.length, binary->op.start);
+            return TYPE_ERROR;
+    }
+
+    char left_name[TYPE_NAME_SIZE];
+    char right_name[TYPE_NAME_SIZE];
+    if (!type_unify(checker->types, left, right)) {
+        error_at(checker, node->offset, "Operands of '%.*s' have different types: %s and %s",
+                 binary->op.length, binary->op.start,
+                 type_format(checker->types, checker->interner, left, left_name, sizeof(left_name)),
+                 type_format(checker->types, checker->interner, right, right_name, sizeof(right_name)));
+        return TYPE_ERROR;
+    }
+    if (allowed && !type_constrain(checker->types, left, allowed)) {
+        error_at(checker, node->offset, "Operator '%.*s' cannot be applied to %s",
+                 binary->op.length, binary->op.start,
+                 type_format(checker->types, checker->interner, left, left_name, sizeof(left_name)));
+        return TYPE_ERROR;
+    }
+    return result;
+}
+
+static TypeId check_call(TypeChecker* checker, ASTNode* node) {
+    CallExpr* call = &node->call_expr;
+    TypeId callee = type_find(checker->types, check_expression(checker, call->callee));
+
+    uint32_t count = call->args.count;
+    TypeId stack[16];
+    TypeId* args = count <= 16 ? stack : f_malloc(count * sizeof(TypeId));
+    for (uint32_t i = 0; i < count; i++) {
+        args[i] = check_expression(checker, SMALL_VEC_AT(&call->args, i));
+    }
+
+    TypeId result;
+    const TypeInfo* info = type_info(checker->types, callee);
+    switch (info->kind) {
+        case TYPE_FUNCTION: {
+            const TypeId* params = info->args;
+            uint32_t arity = info->arity;
+            if (arity - 1 != count) {
+                error_at(checker, node->offset, "Expected %u arguments but got %u", arity - 1, count);
+                result = TYPE_ERROR;
+                break;
+            }
+            for (uint32_t i = 0; i < count; i++) {
+                expect(checker, SMALL_VEC_AT(&call->args, i)->offset, params[i], args[i], "argument");
+            }
+            result = params[arity - 1];
+            break;
+        }
+
+        // Called before anything else says what it is
+        case TYPE_VAR:
+            result = type_var(checker->types, 0);
+            expect(checker, node->offset, callee, type_function(checker->types, args, count, result), "call");
+            break;
+
+        case TYPE_ANY:
+            result = TYPE_ANY;
+            break;
+
+        case TYPE_ERROR:
+            result = TYPE_ERROR;
+            break;
+
+        default: {
+            char name[TYPE_NAME_SIZE];
+            error_at(checker, node->offset, "Can only call functions, not %s",
+                     type_format(checker->types, checker->interner, callee, name, sizeof(name)));
+            result = TYPE_ERROR;
+            break;
+        }
+    }
+
+    if (args != stack) f_free(args);
+    return result;
+}
+
+// Element type of what 'foreach' iterates over or indexing reads from
+static TypeId element_type(TypeChecker* checker, uint32_t offset, TypeId container, bool channels) {
+    container = type_find(checker->types, container);
+    const TypeInfo* info = type_info(checker->types, container);
+    switch (info->kind) {
+        case TYPE_STRING:
+            return TYPE_CHAR;
+        case TYPE_ANY:
+        case TYPE_ERROR:
+            return info->kind;
+        case TYPE_CHAN:
+            if (channels) return info->args[0];
+            break;
+        default:
+            break;
+    }
+
+    TypeId element = type_var(checker->types, 0);
+    if (!expect(checker, offset, type_array(checker->types, element), container, "element access")) return TYPE_ERROR;
+    return element;
+}
+
+static TypeId check_expression(TypeChecker* checker, ASTNode* node) {
+    if (!node) return TYPE_NIL;
+
+    TypeId type;
+    switch (node->type) {
+        case NODE_INT_LITERAL:
+            type = TYPE_INT;
+            break;
+        case NODE_FLOAT_LITERAL:
+            type = TYPE_FLOAT;
+            break;
+        case NODE_STRING_LITERAL:
+            type = TYPE_STRING;
+            break;
+        case NODE_BOOL_LITERAL:
+            type = TYPE_BOOL;
+            break;
+        case NODE_CHAR_LITERAL:
+            type = TYPE_CHAR;
+            break;
+        case NODE_NIL_LITERAL:
+            type = TYPE_NIL;
+            break;
+
+        case NODE_IDENTIFIER:
+            type = binding_type(checker, node->ident.binding);
+            if (type == TYPE_NONE) type = TYPE_ERROR;
+            break;
+
+        case NODE_BINARY_EXPR:
+            type = check_binary(checker, node);
+            break;
+
+        case NODE_UNARY_EXPR: {
+            type = check_expression(checker, node->unary_expr.operand);
+            Token op = node->unary_expr.op;
+            if (op.type == TOKEN_BANG) {
+                expect(checker, node->offset, TYPE_BOOL, type, "'!' operand");
+                type = TYPE_BOOL;
+            } else if (!type_constrain(checker->types, type, TYPE_NUMERIC)) {
+                char name[TYPE_NAME_SIZE];
+                error_at(checker, node->offset, "Operator '%.*s' cannot be applied to %s", op.length, op.start,
+                         type_format(checker->types, checker->interner, type, name, sizeof(name)));
+                type = TYPE_ERROR;
+            }
+            break;
+        }
+
+        case NODE_LOGICAL_EXPR:
+            expect(checker, node->logical_expr.left->offset, TYPE_BOOL,
+                   check_expression(checker, node->logical_expr.left), "logical operand");
+            expect(checker, node->logical_expr.right->offset, TYPE_BOOL,
+                   check_expression(checker, node->logical_expr.right), "logical operand");
+            type = TYPE_BOOL;
+            break;
+
+        case NODE_CALL_EXPR:
+            type = check_call(checker, node);
+            break;
+
+        // Fields are not typed yet
+        case NODE_GET_EXPR:
+            check_expression(checker, node->get_expr.object);
+            type = TYPE_ANY;
+            break;
+
+        case NODE_SET_EXPR:
+            check_expression(checker, node->set_expr.object);
+            type = check_expression(checker, node->set_expr.value);
+            break;
+
+        case NODE_ARRAY_EXPR: {
+            TypeId element = type_var(checker->types, 0);
+            for (uint32_t i = 0; i < node->array_expr.elements.count; i++) {
+                ASTNode* item = SMALL_VEC_AT(&node->array_expr.elements, i);
+                expect(checker, item->offset, element, check_expression(checker, item), "array element");
+            }
+            type = type_array(checker->types, element);
+            break;
+        }
+
+        case NODE_INDEX_EXPR: {
+            TypeId container = check_expression(checker, node->index_expr.array);
+            expect(checker, node->offset, TYPE_INT, check_expression(checker, node->index_expr.index), "index");
+            type = element_type(checker, node->offset, container, false);
+            break;
+        }
+
+        case NODE_CLOSURE_EXPR:
+            if (node->closure_expr.function && node->closure_expr.function->type == NODE_FUNCTION_DECL) {
+                type = check_function(checker, node->closure_expr.function);
+            } else {
+                type = check_expression(checker, node->closure_expr.function);
+            }
+            break;
+
+        // Futures are not typed yet
+        case NODE_ASYNC_EXPR:
+            check_statement(checker, node->async_expr.expression);
+            type = TYPE_ANY;
+            break;
+
+        case NODE_AWAIT_EXPR:
+            check_expression(checker, node->await_expr.expression);
+            type = TYPE_ANY;
+            break;
+
+        case NODE_CHAN_SEND_EXPR: {
+            TypeId channel = check_expression(checker, node->chan_send_expr.channel);
+            TypeId value = check_expression(checker, node->chan_send_expr.value);
+            expect(checker, node->offset, channel, type_chan(checker->types, value), "channel send");
+            type = TYPE_NIL;
+            break;
+        }
+
+        case NODE_CHAN_RECV_EXPR: {
+            TypeId channel = check_expression(checker, node->chan_recv_expr.channel);
+            type = type_var(checker->types, 0);
+            if (!expect(checker, node->offset, type_chan(checker->types, type), channel, "channel receive")) {
+                type = TYPE_ERROR;
+            }
+            break;
+        }
+
+        default:
+            error_at(checker, node->offset, "Expected an expression");
+            type = TYPE_ERROR;
+            break;
+    }
+
+    return annotate(checker, node, type);
+}
+
+// Statements
+static void check_condition(TypeChecker* checker, ASTNode* condition) {
+    if (!condition) return;
+    expect(checker, condition->offset, TYPE_BOOL, check_expression(checker, condition), "condition");
+}
+
+static void check_statement(TypeChecker* checker, ASTNode* node) {
+    if (!node) return;
+
+    switch (node->type) {
+        case NODE_VAR_DECL: {
+            VarDecl* decl = &node->var_decl;
+            TypeId type = decl->value ? check_expression(checker, decl->value) : type_var(checker->types, 0);
+            declare(checker, decl->binding, type, node->offset);
+            annotate(checker, node, type);
+            break;
+        }
+
+        case NODE_FUNCTION_DECL: {
+            TypeId type = function_signature(checker, node);
+            if (node->func_decl.frame) declare(checker, node->func_decl.frame->binding, type, node->offset);
+            check_function_body(checker, node);
+            break;
+        }
+
+        case NODE_CLASS_DECL:
+            check_members(checker, &node->class_decl.members);
+            break;
+
+        case NODE_INTERFACE_DECL:
+            check_members(checker, &node->interface_decl.methods);
+            break;
+
+        case NODE_TRAIT_DECL:
+            check_members(checker, &node->trait_decl.methods);
+            break;
+
+        case NODE_IMPL_DECL:
+            check_members(checker, &node->impl_decl.methods);
+            break;
+
+        case NODE_ENUM_DECL:
+            for (uint32_t i = 0; i < node->enum_decl.values.count; i++) {
+                check_expression(checker, SMALL_VEC_AT(&node->enum_decl.values, i));
+            }
+            break;
+
+        // Named by the top-level pass
+        case NODE_TYPE_DECL:
+            break;
+
+        // Modules are not typed yet
+        case NODE_IMPORT_DECL:
+            declare(checker, node->import_decl.binding, TYPE_ANY, node->offset);
+            break;
+
+        case NODE_EXPORT_DECL:
+            check_statement(checker, node->export_decl.declaration);
+            break;
+
+        case NODE_CHAN_DECL: {
+            ChanDecl* decl = &node->chan_decl;
+            TypeId type = type_chan(checker->types, type_from_node(checker, decl->element_type, NULL));
+            if (decl->capacity) {
+                expect(checker, decl->capacity->offset, TYPE_INT, check_expression(checker, decl->capacity),
+                       "channel capacity");
+            }
+            declare(checker, decl->binding, type, node->offset);
+            annotate(checker, node, type);
+            break;
+        }
+
+        case NODE_BLOCK_STMT:
+            for (uint32_t i = 0; i < node->block_stmt.statements.count; i++) {
+                check_statement(checker, SMALL_VEC_AT(&node->block_stmt.statements, i));
+            }
+            break;
+
+        case NODE_IF_STMT:
+            check_condition(checker, node->if_stmt.condition);
+            check_statement(checker, node->if_stmt.then_branch);
+            check_statement(checker, node->if_stmt.else_branch);
+            break;
+
+        case NODE_WHILE_STMT:
+            check_condition(checker, node->while_stmt.condition);
+            check_statement(checker, node->while_stmt.body);
+            break;
+
+        case NODE_FOR_STMT:
+            check_statement(checker, node->for_stmt.initializer);
+            check_condition(checker, node->for_stmt.condition);
+            if (node->for_stmt.increment) check_expression(checker, node->for_stmt.increment);
+            check_statement(checker, node->for_stmt.body);
+            break;
+
+        case NODE_FOREACH_STMT: {
+            ForeachStmt* loop = &node->foreach_stmt;
+            TypeId container = check_expression(checker, loop->iterator);
+            declare(checker, loop->var_binding, element_type(checker, node->offset, container, true), node->offset);
+            check_statement(checker, loop->body);
+            break;
+        }
+
+        case NODE_RETURN_STMT: {
+            TypeScope* scope = checker->scope;
+            if (node->return_stmt.value) {
+                expect(checker, node->return_stmt.value->offset, scope->result,
+                       check_expression(checker, node->return_stmt.value), "return value");
+                scope->returns_value = true;
+            } else {
+                expect(checker, node->offset, scope->result, TYPE_NIL, "return value");
+            }
+            break;
+        }
+
+        case NODE_BREAK_STMT:
+        case NODE_CONTINUE_STMT:
+            break;
+
+        case NODE_EXPR_STMT:
+            check_expression(checker, node->expr_stmt.expr);
+            break;
+
+        case NODE_TRY_STMT:
+            check_statement(checker, node->try_stmt.try_block);
+            for (uint32_t i = 0; i < node->try_stmt.catch_blocks.count; i++) {
+                check_statement(checker, SMALL_VEC_AT(&node->try_stmt.catch_blocks, i));
+            }
+            check_statement(checker, node->try_stmt.finally_block);
+            break;
+
+        case NODE_CATCH_CLAUSE:
+            // Thrown values are not typed yet, so the variable takes its type from use
+            declare(checker, node->catch_clause.var_binding, type_var(checker->types, 0), node->offset);
+            check_statement(checker, node->catch_clause.body);
+            break;
+
+        case NODE_THROW_STMT:
+            check_expression(checker, node->throw_stmt.value);
+            break;
+
+        case NODE_MATCH_STMT:
+            check_expression(checker, node->match_stmt.value);
+            for (uint32_t i = 0; i < node->match_stmt.cases.count; i++) {
+                check_statement(checker, SMALL_VEC_AT(&node->match_stmt.cases, i));
+            }
+            check_statement(checker, node->match_stmt.default_case);
+            break;
+
+        case NODE_DEFER_STMT:
+            check_statement(checker, node->defer_stmt.statement);
+            break;
+
+        case NODE_GO_STMT:
+            check_statement(checker, node->go_stmt.expression);
+            break;
+
+        case NODE_SELECT_STMT:
+            for (uint32_t i = 0; i < node->select_stmt.cases.count; i++) {
+                SelectCase* select = SMALL_VEC_AT(&node->select_stmt.cases, i);
+                TypeId channel = check_expression(checker, select->channel);
+                if (select->value) {
+                    TypeId value = check_expression(checker, select->value);
+                    expect(checker, select->value->offset, channel, type_chan(checker->types, value), "select case");
+                }
+                check_statement(checker, select->body);
+            }
+            check_statement(checker, node->select_stmt.default_case);
+            break;
+
+        case NODE_ERROR:
+            break;
+
+        default:
+            // An expression in statement position ('go f()', 'async { ... }')
+            check_expression(checker, node);
+            break;
+    }
+}
+
+// Top level
+//
+// Type names first, in two rounds so aliases can name any nominal type;
+// then function signatures, so bodies may call functions defined later.
+static void hoist_types(TypeChecker* checker, ASTNode* node, bool aliases) {
+    switch (node->type) {
+        case NODE_CLASS_DECL:
+            if (!aliases) declare_nominal(checker, node->class_decl.name);
+            break;
+        case NODE_INTERFACE_DECL:
+            if (!aliases) declare_nominal(checker, node->interface_decl.name);
+            break;
+        case NODE_TRAIT_DECL:
+            if (!aliases) declare_nominal(checker, node->trait_decl.name);
+            break;
+        case NODE_ENUM_DECL:
+            if (!aliases) declare_nominal(checker, node->enum_decl.name);
+            break;
+        case NODE_TYPE_DECL:
+            if (aliases) {
+                TypeId type = type_from_node(checker, node->type_decl.type, &node->type_decl.type_params);
+                declare_type(checker, node->type_decl.name, type);
+            }
+            break;
+        case NODE_EXPORT_DECL:
+            if (node->export_decl.declaration) hoist_types(checker, node->export_decl.declaration, aliases);
+            break;
+        default:
+            break;
+    }
+}
+
+static void hoist_function(TypeChecker* checker, ASTNode* node) {
+    if (node->type == NODE_EXPORT_DECL && node->export_decl.declaration) {
+        hoist_function(checker, node->export_decl.declaration);
+    } else if (node->type == NODE_FUNCTION_DECL && node->func_decl.frame) {
+        declare(checker, node->func_decl.frame->binding, function_signature(checker, node), node->offset);
+    }
+}
+
+static void check_top_level(TypeChecker* checker, ASTNode* node) {
+    if (node->type == NODE_EXPORT_DECL && node->export_decl.declaration) {
+        check_top_level(checker, node->export_decl.declaration);
+    } else if (node->type == NODE_FUNCTION_DECL && node->func_decl.frame) {
+        check_function_body(checker, node);
+    } else {
+        check_statement(checker, node);
+    }
+}
+
+// Types of the builtins resolver_init declares
+static TypeId builtin_type(TypeChecker* checker, Symbol name) {
+    const char* text = symbol_text(checker->interner, name);
+    uint32_t length = symbol_length(checker->interner, name);
+    if (length == 5 && memcmp(text, "print", 5) == 0) {
+        TypeId param = TYPE_ANY;
+        return type_function(checker->types, &param, 1, TYPE_NIL);
+    }
+    return TYPE_ANY;
+}
+
+void type_checker_init(TypeChecker* checker, TypeTable* types, Interner* interner,
+                       const char* source, const char* filename) {
+    checker->types = types;
+    checker->interner = interner;
+    checker->filename = filename;
+    line_map_init(&checker->lines, source);
+    u32_map_init(&checker->named, NULL);
+    checker->globals = da_new(sizeof(TypeId), 64);
+    checker->checked = da_new(sizeof(ASTNode*), 1024);
+    checker->scope = NULL;
+    checker->error_count = 0;
+
+    static const struct { const char* name; TypeId type; } primitives[] = {
+        { "any", TYPE_ANY },
+        { "nil", TYPE_NIL },
+        { "bool", TYPE_BOOL },
+        { "int", TYPE_INT },
+        { "float", TYPE_FLOAT },
+        { "char", TYPE_CHAR },
+        { "string", TYPE_STRING },
+    };
+    for (usize i = 0; i < sizeof(primitives) / sizeof(primitives[0]); i++) {
+        Symbol name = intern(interner, primitives[i].name, (uint32_t)strlen(primitives[i].name));
+        u32_map_set(&checker->named, name, primitives[i].type);
+    }
+}
+
+void type_checker_free(TypeChecker* checker) {
+    line_map_free(&checker->lines);
+    u32_map_free(&checker->named);
+    da_free(&checker->globals);
+    da_free(&checker->checked);
+}
+
+bool typecheck_program(TypeChecker* checker, ASTNode* root, const Resolver* resolver) {
+    if (!root) return checker->error_count == 0;
+
+    for (uint32_t i = 0; i < resolver->global_count; i++) {
+        TypeId type = type_var(checker->types, 0);
+        da_append(&checker->globals, &type);
+    }
+    const Declaration* declarations = resolver->declarations.items;
+    for (usize i = 0; i < resolver->declarations.count; i++) {
+        if (!declarations[i].target && declarations[i].binding.kind == BINDING_GLOBAL) {
+            TypeId* global = (TypeId*)checker->globals.items + declarations[i].binding.index;
+            type_unify(checker->types, *global, builtin_type(checker, declarations[i].symbol));
+        }
+    }
+
+    TypeScope script = {
+        .slots = f_calloc(resolver->script_frame_size ? resolver->script_frame_size : 1, sizeof(TypeId)),
+        .result = TYPE_ANY,
+    };
+    checker->scope = &script;
+
+    usize count = root->type == NODE_BLOCK_STMT ? root->block_stmt.statements.count : 1;
+    ASTNode** items = root->type == NODE_BLOCK_STMT ? SMALL_VEC_ITEMS(&root->block_stmt.statements) : &root;
+    for (usize i = 0; i < count; i++) {
+        if (items[i]) hoist_types(checker, items[i], false);
+    }
+    for (usize i = 0; i < count; i++) {
+        if (items[i]) hoist_types(checker, items[i], true);
+    }
+    for (usize i = 0; i < count; i++) {
+        if (items[i]) hoist_function(checker, items[i]);
+    }
+    for (usize i = 0; i < count; i++) {
+        if (items[i]) check_top_level(checker, items[i]);
+    }
+
+    checker->scope = NULL;
+    f_free(script.slots);
+
+    // Every annotation becomes a concrete, interned type
+    ASTNode** checked = checker->checked.items;
+    for (usize i = 0; i < checker->checked.count; i++) {
+        checked[i]->value_type = type_resolve(checker->types, checked[i]->value_type);
+    }
+    return checker->error_count == 0;
+}
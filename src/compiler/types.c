@@ -0,0 +1,286 @@
+#include "../../include/types.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TYPE_TABLE_INITIAL_CAPACITY 256
+#define TYPE_ARENA_CHUNK_SIZE (64 * 1024)
+
+// An interned type is keyed by its encoding: kind, name and arity, then the
+// argument ids. The stored copy's tail is the type's argument list.
+#define TYPE_HEADER_WORDS 3
+#define TYPE_STACK_ARGS 16
+
+static TypeId type_push(TypeTable* table, TypeInfo info) {
+    if (table->count == table->capacity) {
+        uint32_t capacity = table->capacity * 2;
+        table->types = f_realloc(table->types, table->capacity * sizeof(TypeInfo), capacity * sizeof(TypeInfo));
+        table->capacity = capacity;
+    }
+    TypeId id = table->count++;
+    info.parent = id;
+    table->types[id] = info;
+    return id;
+}
+
+void type_table_init(TypeTable* table) {
+    table->capacity = TYPE_TABLE_INITIAL_CAPACITY;
+    table->count = 0;
+    table->types = f_malloc(table->capacity * sizeof(TypeInfo));
+    string_map_init(&table->interned, NULL);
+    arena_init(&table->arena, TYPE_ARENA_CHUNK_SIZE);
+
+    // Primitives take the ids of their kinds
+    for (uint32_t kind = TYPE_NONE; kind <= TYPE_STRING; kind++) {
+        type_push(table, (TypeInfo){ .kind = (uint8_t)kind });
+    }
+}
+
+void type_table_free(TypeTable* table) {
+    f_free(table->types);
+    table->types = NULL;
+    table->count = table->capacity = 0;
+    string_map_free(&table->interned);
+    arena_free(&table->arena);
+}
+
+TypeId type_intern(TypeTable* table, TypeKind kind, Symbol name, const TypeId* args, uint32_t arity) {
+    uint32_t stack[TYPE_HEADER_WORDS + TYPE_STACK_ARGS];
+    uint32_t words = TYPE_HEADER_WORDS + arity;
+    uint32_t* key = arity <= TYPE_STACK_ARGS ? stack : f_malloc(words * sizeof(uint32_t));
+    key[0] = kind;
+    key[1] = name;
+    key[2] = arity;
+    if (arity > 0) memcpy(key + TYPE_HEADER_WORDS, args, arity * sizeof(TypeId));
+
+    StringKey lookup = { (const char*)key, words * sizeof(uint32_t) };
+    uint32_t* found = string_map_get(&table->interned, lookup);
+    if (found) {
+        if (key != stack) f_free(key);
+        return *found;
+    }
+
+    uint32_t* stored = arena_alloc_aligned(&table->arena, words * sizeof(uint32_t), _Alignof(uint32_t));
+    memcpy(stored, key, words * sizeof(uint32_t));
+    if (key != stack) f_free(key);
+
+    TypeId id = type_push(table, (TypeInfo){
+        .kind = (uint8_t)kind,
+        .arity = arity,
+        .name = name,
+        .args = stored + TYPE_HEADER_WORDS,
+    });
+    string_map_set(&table->interned, (StringKey){ (const char*)stored, words * sizeof(uint32_t) }, id);
+    return id;
+}
+
+TypeId type_array(TypeTable* table, TypeId element) {
+    return type_intern(table, TYPE_ARRAY, SYMBOL_NONE, &element, 1);
+}
+
+TypeId type_chan(TypeTable* table, TypeId element) {
+    return type_intern(table, TYPE_CHAN, SYMBOL_NONE, &element, 1);
+}
+
+TypeId type_named(TypeTable* table, Symbol name) {
+    return type_intern(table, TYPE_NAMED, name, NULL, 0);
+}
+
+TypeId type_function(TypeTable* table, const TypeId* params, uint32_t count, TypeId result) {
+    TypeId stack[TYPE_STACK_ARGS];
+    TypeId* args = count < TYPE_STACK_ARGS ? stack : f_malloc((count + 1) * sizeof(TypeId));
+    if (count > 0) memcpy(args, params, count * sizeof(TypeId));
+    args[count] = result;
+    TypeId id = type_intern(table, TYPE_FUNCTION, SYMBOL_NONE, args, count + 1);
+    if (args != stack) f_free(args);
+    return id;
+}
+
+TypeId type_var(TypeTable* table, uint16_t allowed) {
+    return type_push(table, (TypeInfo){ .kind = TYPE_VAR, .allowed = allowed });
+}
+
+TypeId type_find(TypeTable* table, TypeId type) {
+    TypeId root = type;
+    while (table->types[root].parent != root) root = table->types[root].parent;
+
+    while (table->types[type].parent != root) {
+        TypeId next = table->types[type].parent;
+        table->types[type].parent = root;
+        type = next;
+    }
+    return root;
+}
+
+// Whether the variable 'var' appears in 'type', which would make the type
+// infinite
+static bool type_occurs(TypeTable* table, TypeId var, TypeId type) {
+    type = type_find(table, type);
+    if (type == var) return true;
+
+    const TypeInfo* info = &table->types[type];
+    for (uint32_t i = 0; i < info->arity; i++) {
+        if (type_occurs(table, var, info->args[i])) return true;
+    }
+    return false;
+}
+
+// 'var' is an unbound variable and 'type' a representative
+static bool type_bind(TypeTable* table, TypeId var, TypeId type) {
+    TypeInfo* info = &table->types[type];
+    uint16_t allowed = table->types[var].allowed;
+
+    if (info->kind == TYPE_VAR) {
+        if (allowed) {
+            uint16_t both = info->allowed ? (uint16_t)(info->allowed & allowed) : allowed;
+            if (!both) return false;
+            info->allowed = both;
+        }
+    } else {
+        if (allowed && !(allowed & TYPE_KIND_BIT(info->kind))) return false;
+        if (type_occurs(table, var, type)) return false;
+    }
+
+    table->types[var].parent = type;
+    return true;
+}
+
+bool type_unify(TypeTable* table, TypeId a, TypeId b) {
+    a = type_find(table, a);
+    b = type_find(table, b);
+    if (a == b) return true;
+
+    const TypeInfo* left = &table->types[a];
+    const TypeInfo* right = &table->types[b];
+    if (left->kind == TYPE_ERROR || right->kind == TYPE_ERROR) return true;
+    if (left->kind == TYPE_ANY || right->kind == TYPE_ANY) return true;
+    if (left->kind == TYPE_VAR) return type_bind(table, a, b);
+    if (right->kind == TYPE_VAR) return type_bind(table, b, a);
+
+    if (left->kind != right->kind || left->name != right->name || left->arity != right->arity) return false;
+
+    // Binding variables never moves the argument lists, which live in the arena
+    const TypeId* left_args = left->args;
+    const TypeId* right_args = right->args;
+    for (uint32_t i = 0; i < left->arity; i++) {
+        if (!type_unify(table, left_args[i], right_args[i])) return false;
+    }
+    return true;
+}
+
+bool type_constrain(TypeTable* table, TypeId type, uint16_t allowed) {
+    type = type_find(table, type);
+    TypeInfo* info = &table->types[type];
+
+    switch (info->kind) {
+        case TYPE_ERROR:
+        case TYPE_ANY:
+            return true;
+        case TYPE_VAR: {
+            uint16_t both = info->allowed ? (uint16_t)(info->allowed & allowed) : allowed;
+            if (!both) return false;
+            info->allowed = both;
+            return true;
+        }
+        default:
+            return (allowed & TYPE_KIND_BIT(info->kind)) != 0;
+    }
+}
+
+TypeId type_resolve(TypeTable* table, TypeId type) {
+    type = type_find(table, type);
+    TypeInfo info = table->types[type];
+
+    if (info.kind == TYPE_VAR) {
+        TypeId fallback = TYPE_ANY;
+        if (info.allowed & TYPE_KIND_BIT(TYPE_INT)) {
+            fallback = TYPE_INT;
+        } else if (info.allowed) {
+            fallback = (TypeId)__builtin_ctz(info.allowed);
+        }
+        table->types[type].parent = fallback;
+        return fallback;
+    }
+    if (info.arity == 0) return type;
+
+    TypeId stack[TYPE_STACK_ARGS];
+    TypeId* args = info.arity <= TYPE_STACK_ARGS ? stack : f_malloc(info.arity * sizeof(TypeId));
+    bool changed = false;
+    for (uint32_t i = 0; i < info.arity; i++) {
+        args[i] = type_resolve(table, info.args[i]);
+        if (args[i] != info.args[i]) changed = true;
+    }
+
+    TypeId resolved = changed ? type_intern(table, (TypeKind)info.kind, info.name, args, info.arity) : type;
+    if (args != stack) f_free(args);
+    return resolved;
+}
+
+static usize type_write(TypeTable* table, const Interner* interner, TypeId type, char* buffer, usize size, usize length) {
+    static const char* const names[] = {
+        [TYPE_NONE] = "<unchecked>",
+        [TYPE_ERROR] = "<error>",
+        [TYPE_ANY] = "any",
+        [TYPE_NIL] = "nil",
+        [TYPE_BOOL] = "bool",
+        [TYPE_INT] = "int",
+        [TYPE_FLOAT] = "float",
+        [TYPE_CHAR] = "char",
+        [TYPE_STRING] = "string",
+    };
+
+    #define TYPE_APPEND(...) \
+        do { \
+            if (length < size) { \
+                int written = snprintf(buffer + length, size - length, __VA_ARGS__); \
+                if (written > 0) length += (usize)written; \
+            } \
+        } while (0)
+
+    type = type_find(table, type);
+    const TypeInfo* info = &table->types[type];
+    switch (info->kind) {
+        case TYPE_ARRAY:
+            TYPE_APPEND("[");
+            length = type_write(table, interner, info->args[0], buffer, size, length);
+            TYPE_APPEND("]");
+            break;
+        case TYPE_CHAN:
+            TYPE_APPEND("chan<");
+            length = type_write(table, interner, info->args[0], buffer, size, length);
+            TYPE_APPEND(">");
+            break;
+        case TYPE_FUNCTION:
+            TYPE_APPEND("fn(");
+            for (uint32_t i = 0; i + 1 < info->arity; i++) {
+                if (i > 0) TYPE_APPEND(", ");
+                length = type_write(table, interner, info->args[i], buffer, size, length);
+            }
+            TYPE_APPEND(") -> ");
+            length = type_write(table, interner, info->args[info->arity - 1], buffer, size, length);
+            break;
+        case TYPE_NAMED:
+            TYPE_APPEND("%.*s", (int)symbol_length(interner, info->name), symbol_text(interner, info->name));
+            break;
+        case TYPE_VAR:
+            if (info->allowed == TYPE_NUMERIC) {
+                TYPE_APPEND("number");
+            } else {
+                TYPE_APPEND("?%u", type);
+            }
+            break;
+        default:
+            TYPE_APPEND("%s", names[info->kind]);
+            break;
+    }
+
+    #undef TYPE_APPEND
+    return length;
+}
+
+const char* type_format(TypeTable* table, const Interner* interner, TypeId type, char* buffer, usize size) {
+    if (size == 0) return buffer;
+    buffer[0] = '\0';
+    usize length = type_write(table, interner, type, buffer, size, 0);
+    if (length >= size) buffer[size - 1] = '\0';
+    return buffer;
+}
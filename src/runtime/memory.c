@@ -1,133 +1,510 @@
 #include "../../include/runtime/memory.h"
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 
-typedef struct GCObject {
-    struct GCObject* next;
-    bool marked;
-    size_t size;
-    void* data;
-} GCObject;
+#ifdef _MSC_VER
+#include <windows.h>
+#endif
+
+// Phase heaps are shared with worker threads. Their live-byte counters are
+// updated atomically; everything else is counted per thread (see below).
+#ifdef _MSC_VER
+#define counter_add(target, value) \
+    ((size_t)InterlockedExchangeAdd64((volatile LONG64*)(target), (LONG64)(value)) + (size_t)(value))
+#define counter_load(target) ((size_t)InterlockedCompareExchange64((volatile LONG64*)(target), 0, 0))
+#define counter_cas(target, expected, desired) \
+    (InterlockedCompareExchange64((volatile LONG64*)(target), (LONG64)(desired), (LONG64)(expected)) == (LONG64)(expected))
+#else
+#define counter_add(target, value) __atomic_add_fetch((target), (value), __ATOMIC_RELAXED)
+#define counter_load(target) __atomic_load_n((target), __ATOMIC_RELAXED)
+#define counter_cas(target, expected, desired) \
+    __atomic_compare_exchange_n((target), &(expected), (desired), false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#endif
+
+static const char* phase_names[PHASE_COUNT] = {
+    "driver", "lexer", "parser", "semantic", "codegen"
+};
+
+// Arena and pool allocators, newest first
+static Allocator* registered = NULL;
+
+static void register_allocator(Allocator* allocator) {
+    allocator->next = registered;
+    registered = allocator;
+}
+
+static void unregister_allocator(Allocator* allocator) {
+    Allocator** link = &registered;
+    while (*link && *link != allocator) link = &(*link)->next;
+    if (*link) *link = allocator->next;
+    allocator->next = NULL;
+}
+
+static void allocator_setup(Allocator* allocator, const AllocatorOps* ops,
+                            const char* name, CompilerPhase phase) {
+    memset(allocator, 0, sizeof(Allocator));
+    allocator->ops = ops;
+    allocator->name = name;
+    allocator->phase = phase;
+}
+
+void* allocator_alloc(Allocator* allocator, size_t size) {
+    return allocator->ops->alloc(allocator, size);
+}
+
+void* allocator_realloc(Allocator* allocator, void* ptr, size_t old_size, size_t new_size) {
+    return allocator->ops->realloc(allocator, ptr, old_size, new_size);
+}
+
+void allocator_free(Allocator* allocator, void* ptr, size_t size) {
+    if (ptr) allocator->ops->free(allocator, ptr, size);
+}
+
+MemoryStats allocator_stats(Allocator* allocator) {
+    MemoryStats stats;
+    allocator->ops->stats(allocator, &stats);
+    return stats;
+}
+
+void allocator_release(Allocator* allocator) {
+    unregister_allocator(allocator);
+    allocator->ops->release(allocator);
+}
+
+// System backend
 
 typedef struct {
-    GCObject* objects;
-    size_t bytes_allocated;
-    size_t next_gc;
-    size_t threshold;
-} GC;
+    Allocator* owner;
+    size_t size;
+} BlockHeader;
+
+// Padded so the payload is as aligned as malloc's own result
+#define BLOCK_HEADER_SIZE \
+    ((sizeof(BlockHeader) + _Alignof(max_align_t) - 1) / _Alignof(max_align_t) * _Alignof(max_align_t))
+#define block_header(ptr) ((BlockHeader*)((char*)(ptr) - BLOCK_HEADER_SIZE))
+#define block_payload(header) ((void*)((char*)(header) + BLOCK_HEADER_SIZE))
+
+// Each thread counts into a block of its own, so f_malloc and f_free touch
+// no shared cache line. Live bytes are published to the phase heap once a
+// thread's unpublished balance passes SYSTEM_PUBLISH_BYTES either way, so a
+// reported peak can lag by up to that much per thread. Blocks are read
+// without synchronization, which is exact whenever no other thread is
+// allocating (e.g. between phases). A thread's block is handed to the next
+// new thread once it exits, so there are never more blocks than threads
+// alive at once.
+#define SYSTEM_PUBLISH_BYTES (64 * 1024)
 
-static GC gc;
+typedef struct ThreadCounters {
+    struct ThreadCounters* next;
+    long in_use;
+    MemoryStats phase[PHASE_COUNT];     // current_usage and peak_usage unused
+    ptrdiff_t pending[PHASE_COUNT];     // Live bytes not yet published
+} ThreadCounters;
 
-void memory_init() {
-    gc.objects = NULL;
-    gc.bytes_allocated = 0;
-    gc.next_gc = 1024 * 1024; // 1MB initial threshold
-    gc.threshold = gc.next_gc;
+static ThreadCounters* all_counters = NULL;
+static FERRUM_THREAD_LOCAL ThreadCounters* thread_counters = NULL;
+
+#ifdef _MSC_VER
+#define counters_head() \
+    ((ThreadCounters*)InterlockedCompareExchangePointer((PVOID volatile*)&all_counters, NULL, NULL))
+#define counters_claim(counters) (InterlockedCompareExchange(&(counters)->in_use, 1, 0) == 0)
+#define counters_unclaim(counters) InterlockedExchange(&(counters)->in_use, 0)
+#else
+#define counters_head() __atomic_load_n(&all_counters, __ATOMIC_ACQUIRE)
+#define counters_claim(counters) (__atomic_exchange_n(&(counters)->in_use, 1, __ATOMIC_ACQUIRE) == 0)
+#define counters_unclaim(counters) __atomic_store_n(&(counters)->in_use, 0, __ATOMIC_RELEASE)
+#endif
+
+static ThreadCounters* counters_for_thread(void) {
+    ThreadCounters* counters = thread_counters;
+    if (counters) return counters;
+
+    for (counters = counters_head(); counters; counters = counters->next) {
+        if (counters_claim(counters)) {
+            thread_counters = counters;
+            return counters;
+        }
+    }
+
+    // Plain calloc: the counters must not count themselves
+    counters = calloc(1, sizeof(ThreadCounters));
+    if (!counters) panic("Memory allocation failed for size: %zu", sizeof(ThreadCounters));
+    counters->in_use = 1;
+#ifdef _MSC_VER
+    do {
+        counters->next = all_counters;
+    } while (InterlockedCompareExchangePointer((PVOID volatile*)&all_counters, counters, counters->next) != counters->next);
+#else
+    counters->next = __atomic_load_n(&all_counters, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&all_counters, &counters->next, counters, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+#endif
+    thread_counters = counters;
+    return counters;
 }
 
-static void mark_object(GCObject* object) {
-    if (object == NULL || object->marked) return;
-    object->marked = true;
+void memory_thread_exit(void) {
+    if (!thread_counters) return;
+    counters_unclaim(thread_counters);
+    thread_counters = NULL;
 }
 
-static void mark_all() {
-    // TODO: Traverse root set (globals, stack)
-    // For now, just mark everything (conservative)
-    for (GCObject* obj = gc.objects; obj != NULL; obj = obj->next) {
-        mark_object(obj);
+static void system_publish(Allocator* allocator, ptrdiff_t* pending) {
+    MemoryStats* stats = &allocator->stats;
+    size_t usage = counter_add(&stats->current_usage, (size_t)*pending);
+    bool grew = *pending > 0;
+    *pending = 0;
+    if (!grew) return;
+
+    size_t peak = counter_load(&stats->peak_usage);
+    while (usage > peak && !counter_cas(&stats->peak_usage, peak, usage)) {
+        peak = counter_load(&stats->peak_usage);
     }
 }
 
-static void sweep() {
-    GCObject** object = &gc.objects;
-    while (*object) {
-        if (!(*object)->marked) {
-            GCObject* unreached = *object;
-            *object = unreached->next;
-            free(unreached->data);
-            free(unreached);
-            gc.bytes_allocated -= unreached->size;
-        } else {
-            (*object)->marked = false;
-            object = &(*object)->next;
-        }
+static void system_count_alloc(Allocator* allocator, size_t size) {
+    ThreadCounters* counters = counters_for_thread();
+    MemoryStats* stats = &counters->phase[allocator->phase];
+    stats->total_allocated += size;
+    stats->allocations++;
+
+    ptrdiff_t* pending = &counters->pending[allocator->phase];
+    *pending += (ptrdiff_t)size;
+    if (*pending > SYSTEM_PUBLISH_BYTES) system_publish(allocator, pending);
+}
+
+static void system_count_free(Allocator* allocator, size_t size) {
+    ThreadCounters* counters = counters_for_thread();
+    MemoryStats* stats = &counters->phase[allocator->phase];
+    stats->total_freed += size;
+    stats->frees++;
+
+    ptrdiff_t* pending = &counters->pending[allocator->phase];
+    *pending -= (ptrdiff_t)size;
+    if (*pending < -SYSTEM_PUBLISH_BYTES) system_publish(allocator, pending);
+}
+
+static void* system_attach(Allocator* allocator, BlockHeader* header, size_t size) {
+    header->owner = allocator;
+    header->size = size;
+    system_count_alloc(allocator, size);
+    return block_payload(header);
+}
+
+static void* system_alloc(Allocator* allocator, size_t size) {
+    if (size > SIZE_MAX - BLOCK_HEADER_SIZE) panic("Memory allocation failed for size: %zu", size);
+    BlockHeader* header = malloc(BLOCK_HEADER_SIZE + size);
+    if (!header) panic("Memory allocation failed for size: %zu", size);
+    return system_attach(allocator, header, size);
+}
+
+// A block stays charged to the allocator that allocated it, whichever
+// phase resizes or frees it. Sizes come from the header, so 'old_size' is
+// only a hint here.
+static void* system_realloc(Allocator* allocator, void* ptr, size_t old_size, size_t new_size) {
+    (void)old_size;
+    if (!ptr) return system_alloc(allocator, new_size);
+    if (new_size > SIZE_MAX - BLOCK_HEADER_SIZE) panic("Memory reallocation failed for size: %zu", new_size);
+
+    BlockHeader* header = block_header(ptr);
+    Allocator* owner = header->owner;
+    size_t size = header->size;
+
+    header = realloc(header, BLOCK_HEADER_SIZE + new_size);
+    if (!header) panic("Memory reallocation failed for size: %zu", new_size);
+    system_count_free(owner, size);
+    return system_attach(owner, header, new_size);
+}
+
+static void system_free(Allocator* allocator, void* ptr, size_t size) {
+    (void)allocator;
+    (void)size;
+    BlockHeader* header = block_header(ptr);
+    system_count_free(header->owner, header->size);
+    free(header);
+}
+
+// Blocks are only ever freed one by one
+static void system_release(Allocator* allocator) {
+    (void)allocator;
+}
+
+static void system_stats(Allocator* allocator, MemoryStats* stats) {
+    memset(stats, 0, sizeof(MemoryStats));
+    size_t usage = counter_load(&allocator->stats.current_usage);
+
+    for (ThreadCounters* counters = counters_head(); counters; counters = counters->next) {
+        const MemoryStats* local = &counters->phase[allocator->phase];
+        stats->total_allocated += local->total_allocated;
+        stats->total_freed += local->total_freed;
+        stats->allocations += local->allocations;
+        stats->frees += local->frees;
+        usage += (size_t)counters->pending[allocator->phase];
     }
+
+    size_t peak = counter_load(&allocator->stats.peak_usage);
+    stats->current_usage = usage;
+    stats->peak_usage = usage > peak ? usage : peak;
 }
 
-void* f_malloc(size_t size) {
-    gc.bytes_allocated += size;
+static const AllocatorOps system_ops = {
+    system_alloc, system_realloc, system_free, system_release, system_stats
+};
 
-    if (gc.bytes_allocated > gc.next_gc) {
-        mark_all();
-        sweep();
-        gc.next_gc = gc.bytes_allocated * 2;
+// One system allocator per phase. The phase is switched by the driver
+// between passes, never while worker threads are running.
+#define PHASE_HEAP(phase) { &system_ops, "heap", phase, {0, 0, 0, 0, 0, 0}, NULL }
+
+static Allocator phase_heaps[PHASE_COUNT] = {
+    PHASE_HEAP(PHASE_DRIVER),
+    PHASE_HEAP(PHASE_LEXER),
+    PHASE_HEAP(PHASE_PARSER),
+    PHASE_HEAP(PHASE_SEMANTIC),
+    PHASE_HEAP(PHASE_CODEGEN)
+};
+static CompilerPhase current_phase = PHASE_DRIVER;
+
+void memory_set_phase(CompilerPhase phase) {
+    current_phase = phase;
+}
+
+CompilerPhase memory_get_phase(void) {
+    return current_phase;
+}
+
+Allocator* memory_phase_heap(CompilerPhase phase) {
+    return &phase_heaps[phase];
+}
+
+// Arena backend
+
+static void* arena_backend_alloc(Allocator* allocator, size_t size) {
+    return arena_alloc(&((ArenaAllocator*)allocator)->arena, size);
+}
+
+// The old block is abandoned, as with any arena allocation
+static void* arena_backend_realloc(Allocator* allocator, void* ptr, size_t old_size, size_t new_size) {
+    void* fresh = arena_alloc(&((ArenaAllocator*)allocator)->arena, new_size);
+    if (ptr) memcpy(fresh, ptr, old_size < new_size ? old_size : new_size);
+    return fresh;
+}
+
+static void arena_backend_free(Allocator* allocator, void* ptr, size_t size) {
+    (void)allocator;
+    (void)ptr;
+    (void)size;
+}
+
+static void arena_backend_release(Allocator* allocator) {
+    arena_free(&((ArenaAllocator*)allocator)->arena);
+}
+
+// Read from the arena's own counters, so direct arena_alloc calls count too
+static void arena_backend_stats(Allocator* allocator, MemoryStats* stats) {
+    const Arena* arena = &((ArenaAllocator*)allocator)->arena;
+    stats->total_allocated = arena->released + arena->allocated;
+    stats->total_freed = arena->released;
+    stats->current_usage = arena->allocated;
+    stats->peak_usage = arena->peak > arena->allocated ? arena->peak : arena->allocated;
+    stats->allocations = arena->allocations;
+    stats->frees = 0;
+}
+
+static const AllocatorOps arena_ops = {
+    arena_backend_alloc, arena_backend_realloc, arena_backend_free,
+    arena_backend_release, arena_backend_stats
+};
+
+void arena_allocator_init(ArenaAllocator* allocator, const char* name, CompilerPhase phase, size_t chunk_size) {
+    allocator_setup(&allocator->base, &arena_ops, name, phase);
+    arena_init(&allocator->arena, chunk_size);
+    register_allocator(&allocator->base);
+}
+
+// Pool backend
+
+struct PoolChunk {
+    PoolChunk* next;
+    max_align_t data[];
+};
+
+static void* pool_alloc(Allocator* allocator, size_t size) {
+    PoolAllocator* pool = (PoolAllocator*)allocator;
+    if (size > pool->block_size) {
+        panic("Pool '%s' cannot serve %zu bytes (block size %zu)", allocator->name, size, pool->block_size);
     }
 
-    void* ptr = malloc(size);
-    if (ptr == NULL) return NULL;
+    if (!pool->free_list) {
+        PoolChunk* chunk = f_malloc(sizeof(PoolChunk) + pool->block_size * pool->blocks_per_chunk);
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
 
-    GCObject* object = (GCObject*)malloc(sizeof(GCObject));
-    if (object == NULL) {
-        free(ptr);
-        return NULL;
+        // Thread the new blocks onto the free list, first block first
+        char* blocks = (char*)chunk->data;
+        for (size_t i = pool->blocks_per_chunk; i > 0; i--) {
+            void* block = blocks + (i - 1) * pool->block_size;
+            *(void**)block = pool->free_list;
+            pool->free_list = block;
+        }
     }
 
-    object->next = gc.objects;
-    object->marked = false;
-    object->size = size;
-    object->data = ptr;
-    gc.objects = object;
+    void* block = pool->free_list;
+    pool->free_list = *(void**)block;
+
+    MemoryStats* stats = &allocator->stats;
+    stats->total_allocated += pool->block_size;
+    stats->current_usage += pool->block_size;
+    stats->allocations++;
+    if (stats->current_usage > stats->peak_usage) stats->peak_usage = stats->current_usage;
+    return block;
+}
+
+static void pool_free(Allocator* allocator, void* ptr, size_t size) {
+    PoolAllocator* pool = (PoolAllocator*)allocator;
+    (void)size;
+    *(void**)ptr = pool->free_list;
+    pool->free_list = ptr;
+
+    MemoryStats* stats = &allocator->stats;
+    stats->total_freed += pool->block_size;
+    stats->current_usage -= pool->block_size;
+    stats->frees++;
+}
 
+static void* pool_realloc(Allocator* allocator, void* ptr, size_t old_size, size_t new_size) {
+    (void)old_size;
+    if (!ptr) return pool_alloc(allocator, new_size);
+    if (new_size > ((PoolAllocator*)allocator)->block_size) {
+        panic("Pool '%s' cannot serve %zu bytes", allocator->name, new_size);
+    }
     return ptr;
 }
 
-void* f_realloc(void* ptr, size_t old_size, size_t new_size) {
-    if (ptr == NULL) return f_malloc(new_size);
-    
-    gc.bytes_allocated = gc.bytes_allocated - old_size + new_size;
-    
-    // Find the GC object
-    GCObject* object = gc.objects;
-    while (object != NULL && object->data != ptr) {
-        object = object->next;
+static void pool_release(Allocator* allocator) {
+    PoolAllocator* pool = (PoolAllocator*)allocator;
+    PoolChunk* chunk = pool->chunks;
+    while (chunk) {
+        PoolChunk* next = chunk->next;
+        f_free(chunk);
+        chunk = next;
     }
-    
-    if (object == NULL) return NULL;
-    
-    void* new_ptr = realloc(ptr, new_size);
-    if (new_ptr == NULL) return NULL;
-    
-    object->data = new_ptr;
-    object->size = new_size;
-    
-    return new_ptr;
+    pool->chunks = NULL;
+    pool->free_list = NULL;
+
+    MemoryStats* stats = &allocator->stats;
+    stats->total_freed += stats->current_usage;
+    stats->current_usage = 0;
 }
 
-void f_free(void* ptr) {
-    if (ptr == NULL) return;
+static void pool_stats(Allocator* allocator, MemoryStats* stats) {
+    *stats = allocator->stats;
+}
+
+static const AllocatorOps pool_ops = {
+    pool_alloc, pool_realloc, pool_free, pool_release, pool_stats
+};
+
+void pool_allocator_init(PoolAllocator* allocator, const char* name, CompilerPhase phase,
+                         size_t block_size, size_t blocks_per_chunk) {
+    allocator_setup(&allocator->base, &pool_ops, name, phase);
 
-    GCObject** object = &gc.objects;
-    while (*object != NULL && (*object)->data != ptr) {
-        object = &(*object)->next;
+    // Every block must hold the free-list link and stay aligned
+    size_t align = sizeof(max_align_t);
+    if (block_size < sizeof(void*)) block_size = sizeof(void*);
+    allocator->block_size = (block_size + align - 1) / align * align;
+    allocator->blocks_per_chunk = blocks_per_chunk ? blocks_per_chunk : 256;
+    allocator->chunks = NULL;
+    allocator->free_list = NULL;
+    register_allocator(&allocator->base);
+}
+
+// Statistics
+
+MemoryStats get_memory_stats(void) {
+    MemoryStats total;
+    memset(&total, 0, sizeof(total));
+
+    // Phases run one after another, so the sum of their peaks bounds the
+    // overall peak from above
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        MemoryStats stats = allocator_stats(&phase_heaps[i]);
+        total.total_allocated += stats.total_allocated;
+        total.total_freed += stats.total_freed;
+        total.current_usage += stats.current_usage;
+        total.peak_usage += stats.peak_usage;
+        total.allocations += stats.allocations;
+        total.frees += stats.frees;
     }
+    return total;
+}
 
-    if (*object != NULL) {
-        GCObject* found = *object;
-        *object = found->next;
-        gc.bytes_allocated -= found->size;
-        free(found->data);
-        free(found);
+// Counts restart from zero; live bytes carry over and become the new peak
+void reset_memory_stats(void) {
+    for (ThreadCounters* counters = counters_head(); counters; counters = counters->next) {
+        memset(counters->phase, 0, sizeof(counters->phase));
+    }
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        phase_heaps[i].stats.peak_usage = allocator_stats(&phase_heaps[i]).current_usage;
     }
 }
 
-void memory_cleanup() {
-    GCObject* object = gc.objects;
-    while (object != NULL) {
-        GCObject* next = object->next;
-        free(object->data);
-        free(object);
-        object = next;
+static void report_line(FILE* out, const char* phase, const char* name, const MemoryStats* stats) {
+    fprintf(out, "  %-9s %-10s %12zu %12zu %12zu %10zu %10zu\n", phase, name,
+            stats->current_usage, stats->peak_usage, stats->total_allocated,
+            stats->allocations, stats->frees);
+}
+
+// Arena and pool lines count bytes handed out to their users; the chunks
+// behind them are already part of the heap of the phase that created them
+void memory_report(FILE* out) {
+    fprintf(out, "Memory usage (bytes):\n");
+    fprintf(out, "  %-9s %-10s %12s %12s %12s %10s %10s\n",
+            "phase", "allocator", "live", "peak", "total", "allocs", "frees");
+
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        MemoryStats stats = allocator_stats(&phase_heaps[i]);
+        report_line(out, phase_names[i], phase_heaps[i].name, &stats);
+    }
+    for (Allocator* allocator = registered; allocator; allocator = allocator->next) {
+        MemoryStats stats = allocator_stats(allocator);
+        report_line(out, phase_names[allocator->phase], allocator->name, &stats);
+    }
+
+    MemoryStats total = get_memory_stats();
+    report_line(out, "all", "heap", &total);
+}
+
+void memory_init(void) {
+    current_phase = PHASE_DRIVER;
+}
+
+// Only what memory_init set up; allocators are released by their owners
+void memory_cleanup(void) {
+    registered = NULL;
+    current_phase = PHASE_DRIVER;
+}
+
+// Memory allocation functions
+
+void* f_malloc(size_t size) {
+    return system_alloc(&phase_heaps[current_phase], size);
+}
+
+void* f_calloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        panic("Memory allocation failed for count: %zu, size: %zu", count, size);
     }
-    gc.objects = NULL;
-    gc.bytes_allocated = 0;
-}
\ No newline at end of file
+    void* ptr = system_alloc(&phase_heaps[current_phase], count * size);
+    memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void* f_realloc(void* ptr, size_t old_size, size_t new_size) {
+    return system_realloc(&phase_heaps[current_phase], ptr, old_size, new_size);
+}
+
+void f_free(void* ptr) {
+    if (ptr) system_free(NULL, ptr, 0);
+}
@@ -1,10 +1,17 @@
+// mmap(MAP_ANONYMOUS), madvise, clock_gettime(CLOCK_MONOTONIC) for
+// sys_nanotime and stat's st_mtim are POSIX/BSD extensions that strict
+// -std=c11 hides
+#define _DEFAULT_SOURCE
+
 #include "../../include/runtime/sys.h"
 #include "../../include/common.h"
 #include "../../include/runtime/memory.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <stdint.h>
+#include <errno.h>
 
 #ifndef _WIN32
 #include <unistd.h>
@@ -13,9 +20,18 @@
 #include <sys/sysinfo.h>
 #include <sys/time.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <time.h>
+#include <sys/uio.h>
+#else
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #endif
 
+// Pages per writev call, well below any IOV_MAX
+#define SYS_OUTPUT_BATCH 64
+
 // Error handling state
 THREAD_LOCAL char error_message[256] = {0};
 THREAD_LOCAL int error_code = 0;
@@ -93,6 +109,7 @@ static void* thread_wrapper(void* param) {
 #endif
     Thread* thread = (Thread*)param;
     thread->func(thread->arg);
+    memory_thread_exit();
     thread->running = false;
 #ifdef _WIN32
     return 0;
@@ -230,13 +247,271 @@ int sys_munmap(void* addr, size_t length) {
 #endif
 }
 
+// File mapping
+static bool read_file_copy(const char* path, MappedFile* file) {
+    FILE* handle = fopen(path, "rb");
+    if (!handle) {
+        sys_set_error(errno, "Could not open file");
+        return false;
+    }
+    
+    size_t capacity = 64 * 1024;
+    size_t length = 0;
+    char* buffer = f_malloc(capacity);
+    for (;;) {
+        length += fread(buffer + length, 1, capacity - length - 1, handle);
+        if (length < capacity - 1) break;
+        buffer = f_realloc(buffer, capacity, capacity * 2);
+        capacity *= 2;
+    }
+    
+    bool failed = ferror(handle) != 0;
+    fclose(handle);
+    if (failed) {
+        f_free(buffer);
+        sys_set_error(EIO, "Could not read file");
+        return false;
+    }
+    
+    buffer[length] = '\0';
+    file->data = buffer;
+    file->length = length;
+    file->base = buffer;
+    file->mapped = 0;
+    return true;
+}
+
+bool sys_map_file(const char* path, MappedFile* file) {
+#ifdef _WIN32
+    return read_file_copy(path, file);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        sys_set_error(errno, "Could not open file");
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return read_file_copy(path, file);
+    }
+    
+    size_t length = (size_t)st.st_size;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t reserved = (length + 1 + page - 1) & ~(page - 1);
+    
+    char* base = mmap(NULL, reserved, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return read_file_copy(path, file);
+    }
+    
+    if (length > 0 && mmap(base, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, reserved);
+        close(fd);
+        return read_file_copy(path, file);
+    }
+    close(fd);
+    
+    // The whole input is lexed front to back
+    madvise(base, reserved, MADV_SEQUENTIAL);
+    
+    file->data = base;
+    file->length = length;
+    file->base = base;
+    file->mapped = reserved;
+    return true;
+#endif
+}
+
+void sys_unmap_file(MappedFile* file) {
+    if (!file->base) return;
+    
+#ifndef _WIN32
+    if (file->mapped) {
+        munmap(file->base, file->mapped);
+    } else
+#endif
+    {
+        f_free(file->base);
+    }
+    
+    file->data = NULL;
+    file->base = NULL;
+    file->length = 0;
+    file->mapped = 0;
+}
+
+bool sys_file_mtime(const char* path, uint64_t* mtime) {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path, &st) != 0) {
+        sys_set_error(errno, "Could not stat file");
+        return false;
+    }
+    *mtime = (uint64_t)st.st_mtime * 1000000000ull;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        sys_set_error(errno, "Could not stat file");
+        return false;
+    }
+    *mtime = (uint64_t)st.st_mtim.tv_sec * 1000000000ull + (uint64_t)st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+// Buffered output files
+void sys_output_init(OutputFile* out) {
+    memset(out, 0, sizeof(OutputFile));
+    out->fd = -1;
+}
+
+bool sys_output_open(OutputFile* out, const char* path) {
+#ifdef _WIN32
+    int fd = _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    if (fd < 0) {
+        sys_set_error(errno, "Could not create file");
+        return false;
+    }
+    
+    out->fd = fd;
+    return true;
+}
+
+void sys_output_write(OutputFile* out, const void* data, size_t size) {
+    const char* bytes = (const char*)data;
+    
+    while (size > 0) {
+        OutputPage* page = out->tail;
+        if (!page || page->used == SYS_OUTPUT_PAGE_SIZE) {
+            page = out->spare;
+            if (page) {
+                out->spare = page->next;
+            } else {
+                page = f_malloc(sizeof(OutputPage));
+            }
+            page->next = NULL;
+            page->used = 0;
+            
+            if (out->tail) {
+                out->tail->next = page;
+            } else {
+                out->head = page;
+            }
+            out->tail = page;
+        }
+        
+        size_t chunk = SYS_OUTPUT_PAGE_SIZE - page->used;
+        if (chunk > size) chunk = size;
+        memcpy(page->data + page->used, bytes, chunk);
+        page->used += chunk;
+        out->length += chunk;
+        bytes += chunk;
+        size -= chunk;
+    }
+}
+
+static bool write_pages(int fd, const OutputPage* page) {
+#ifdef _WIN32
+    for (; page; page = page->next) {
+        size_t done = 0;
+        while (done < page->used) {
+            int written = _write(fd, page->data + done, (unsigned)(page->used - done));
+            if (written <= 0) return false;
+            done += (size_t)written;
+        }
+    }
+    return true;
+#else
+    struct iovec vecs[SYS_OUTPUT_BATCH];
+    
+    while (page) {
+        int count = 0;
+        for (; page && count < SYS_OUTPUT_BATCH; page = page->next) {
+            vecs[count].iov_base = (void*)page->data;
+            vecs[count].iov_len = page->used;
+            count++;
+        }
+        
+        // Short writes resume inside the first unfinished page
+        struct iovec* vec = vecs;
+        while (count > 0) {
+            ssize_t written = writev(fd, vec, count);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            while (count > 0 && (size_t)written >= vec->iov_len) {
+                written -= (ssize_t)vec->iov_len;
+                vec++;
+                count--;
+            }
+            if (count > 0) {
+                vec->iov_base = (char*)vec->iov_base + written;
+                vec->iov_len -= (size_t)written;
+            }
+        }
+    }
+    return true;
+#endif
+}
+
+bool sys_output_flush(OutputFile* out) {
+    if (!out->head || out->fd < 0) return !out->failed;
+    
+    if (!out->failed && !write_pages(out->fd, out->head)) {
+        sys_set_error(errno, "Could not write file");
+        out->failed = true;
+    }
+    
+    out->tail->next = out->spare;
+    out->spare = out->head;
+    out->head = NULL;
+    out->tail = NULL;
+    out->written += out->length;
+    out->length = 0;
+    return !out->failed;
+}
+
+static void free_pages(OutputPage* page) {
+    while (page) {
+        OutputPage* next = page->next;
+        f_free(page);
+        page = next;
+    }
+}
+
+bool sys_output_close(OutputFile* out) {
+    bool ok = sys_output_flush(out);
+    
+    if (out->fd >= 0) {
+#ifdef _WIN32
+        ok = _close(out->fd) == 0 && ok;
+#else
+        ok = close(out->fd) == 0 && ok;
+#endif
+    }
+    
+    free_pages(out->head);
+    free_pages(out->spare);
+    sys_output_init(out);
+    return ok;
+}
+
 // Timing functions
 uint64_t sys_nanotime(void) {
 #ifdef FERRUM_OS_WINDOWS
     LARGE_INTEGER freq, time;
     QueryPerformanceFrequency(&freq);
     QueryPerformanceCounter(&time);
-    return (time.QuadPart * 1000000000ULL) / freq.QuadPart;
+    // Whole seconds first: time * 10^9 would overflow after a few hours
+    return (uint64_t)(time.QuadPart / freq.QuadPart) * 1000000000ULL +
+           (uint64_t)(time.QuadPart % freq.QuadPart) * 1000000000ULL / (uint64_t)freq.QuadPart;
 #else
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
@@ -0,0 +1,71 @@
+# Compiles one test program with --dump-ir and checks the IR against the
+# expectations in its leading comments:
+#
+#   // options: FLAGS      compiler flags, -O1 if not given
+#   // instructions: N     the module has exactly N instructions
+#   // ir: REGEX           some IR line matches REGEX
+#   // ir-not: REGEX       no IR line matches REGEX
+#
+# Run by CTest as: cmake -DFERRUMC=... -DSOURCE=... -DOUTPUT=... -P ir_test.cmake
+
+file(STRINGS "${SOURCE}" comments REGEX "^// ")
+set(options -O1)
+foreach(comment IN LISTS comments)
+    if(comment MATCHES "^// options: (.*)$")
+        separate_arguments(options UNIX_COMMAND "${CMAKE_MATCH_1}")
+    endif()
+endforeach()
+get_filename_component(output_dir "${OUTPUT}" DIRECTORY)
+file(MAKE_DIRECTORY "${output_dir}")
+
+execute_process(
+    COMMAND "${FERRUMC}" ${options} --dump-ir -o "${OUTPUT}" "${SOURCE}"
+    OUTPUT_VARIABLE dump
+    ERROR_VARIABLE errors
+    RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "ferrumc failed (${result}):\n${errors}")
+endif()
+
+# Instructions are the indented lines; headers, labels and externs are not
+string(REPLACE "\n" ";" lines "${dump}")
+set(instructions "")
+foreach(line IN LISTS lines)
+    if(line MATCHES "^    ")
+        string(STRIP "${line}" line)
+        list(APPEND instructions "${line}")
+    endif()
+endforeach()
+list(LENGTH instructions count)
+
+set(failed FALSE)
+foreach(comment IN LISTS comments)
+    if(comment MATCHES "^// instructions: ([0-9]+)")
+        if(NOT count EQUAL CMAKE_MATCH_1)
+            message(SEND_ERROR "expected ${CMAKE_MATCH_1} instructions, got ${count}")
+            set(failed TRUE)
+        endif()
+    elseif(comment MATCHES "^// ir(-not)?: (.*)$")
+        set(negated "${CMAKE_MATCH_1}")
+        set(pattern "${CMAKE_MATCH_2}")
+        set(found FALSE)
+        foreach(instruction IN LISTS instructions)
+            if(instruction MATCHES "${pattern}")
+                set(found TRUE)
+                break()
+            endif()
+        endforeach()
+        if(negated AND found)
+            message(SEND_ERROR "unexpected IR matching '${pattern}'")
+            set(failed TRUE)
+        elseif(NOT negated AND NOT found)
+            message(SEND_ERROR "no IR matching '${pattern}'")
+            set(failed TRUE)
+        endif()
+    endif()
+endforeach()
+
+if(failed)
+    message(FATAL_ERROR "IR of ${SOURCE}:\n${dump}")
+endif()
@@ -0,0 +1,149 @@
+// Incremental reparsing: reused declarations must come back as they were
+// parsed, at their new offsets, whatever the passes did to the last tree.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lexer.h"
+#include "parser_incremental.h"
+#include "resolver.h"
+#include "typecheck.h"
+#include "passes.h"
+#include "runtime/memory.h"
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+// One watch-mode round: the tree lives in an arena released afterwards,
+// as in the driver
+typedef struct {
+    char* source;               // Padded copy, for the lexer's 16-byte loads
+    ArenaAllocator memory;
+    TokenStream tokens;
+    ASTNode* root;
+    bool had_error;
+} Round;
+
+static void round_parse(Round* round, ParseCache* cache, const char* text) {
+    size_t length = strlen(text);
+    round->source = f_calloc(length + 16, 1);
+    memcpy(round->source, text, length);
+
+    arena_allocator_init(&round->memory, "ast", PHASE_PARSER, 0);
+    ast_set_arena(&round->memory.arena);
+    token_stream_init(&round->tokens);
+    token_stream_lex(&round->tokens, round->source);
+    round->root = parse_incremental(cache, &round->tokens, "test.fe", &round->had_error);
+}
+
+// Resolves, type checks and folds the tree in place
+static bool round_check(Round* round, ParseCache* cache) {
+    const char* source = round->source;
+    Resolver resolver;
+    resolver_init(&resolver, &cache->interner, source, "test.fe");
+    bool ok = resolve_program(&resolver, round->root);
+    TypeTable types;
+    type_table_init(&types);
+    if (ok) {
+        TypeChecker checker;
+        type_checker_init(&checker, &types, &cache->interner, source, "test.fe");
+        ok = typecheck_program(&checker, round->root, &resolver);
+        type_checker_free(&checker);
+    }
+    if (ok) {
+        PassManager passes;
+        pass_manager_init(&passes, OPT_O1, false);
+        pass_manager_run_ast(&passes, round->root, &resolver);
+        pass_manager_free(&passes);
+    }
+    type_table_free(&types);
+    resolver_free(&resolver);
+    return ok;
+}
+
+static void round_free(Round* round) {
+    ast_set_arena(NULL);
+    allocator_release(&round->memory.base);
+    token_stream_free(&round->tokens);
+    f_free(round->source);
+}
+
+// Argument of the print call in the last top-level statement
+static ASTNode* print_argument(ASTNode* root) {
+    NodeList* statements = &root->block_stmt.statements;
+    ASTNode* statement = SMALL_VEC_AT(statements, statements->count - 1);
+    if (statement->type != NODE_EXPR_STMT) return NULL;
+    ASTNode* call = statement->expr_stmt.expr;
+    if (call->type != NODE_CALL_EXPR || call->call_expr.args.count != 1) return NULL;
+    return SMALL_VEC_AT(&call->call_expr.args, 0);
+}
+
+// 'let N' is a range of its own; 'fn g' and the print after it share one
+static const char* first = "let N = 3;\nfn g(x) { return x * 2; }\nprint(N + 1);\n";
+static const char* edited = "let N = 5;\nfn g(x) { return x * 2; }\nprint(N + 1);\n";
+static const char* moved = "\n\nlet N = 5;\nfn g(x) { return x * 2; }\nprint(N + 1);\n";
+
+static void test_folding_does_not_leak(ParseCache* cache) {
+    Round round;
+    round_parse(&round, cache, first);
+    CHECK(!round.had_error);
+    CHECK(cache->reused == 0 && cache->reparsed == 2);
+    CHECK(round_check(&round, cache));
+    ASTNode* argument = print_argument(round.root);
+    CHECK(argument && argument->type == NODE_INT_LITERAL && argument->int_value == 4);
+    round_free(&round);
+
+    // The print range is reused, but as parsed, not as folded
+    round_parse(&round, cache, edited);
+    CHECK(!round.had_error);
+    CHECK(cache->reused == 1 && cache->reparsed == 1);
+    argument = print_argument(round.root);
+    CHECK(argument && argument->type == NODE_BINARY_EXPR);
+    CHECK(argument && argument->value_type == 0);
+    CHECK(round_check(&round, cache));
+    argument = print_argument(round.root);
+    CHECK(argument && argument->type == NODE_INT_LITERAL && argument->int_value == 6);
+    round_free(&round);
+}
+
+static void test_reused_ranges_move(ParseCache* cache) {
+    Round round;
+    round_parse(&round, cache, moved);
+    CHECK(!round.had_error);
+    CHECK(cache->reused == 2 && cache->reparsed == 0);
+
+    ASTNode* function = SMALL_VEC_AT(&round.root->block_stmt.statements, 1);
+    const char* name = strstr(round.source, "g(x)");
+    CHECK(function->type == NODE_FUNCTION_DECL);
+    CHECK(function->offset == (uint32_t)(name - round.source));
+    CHECK(function->func_decl.name.start == name);
+
+    ASTNode* argument = print_argument(round.root);
+    CHECK(argument && argument->type == NODE_BINARY_EXPR);
+    CHECK(argument && argument->binary_expr.op.start == strstr(round.source, "+ 1"));
+    CHECK(round_check(&round, cache));
+    round_free(&round);
+}
+
+int main(void) {
+    memory_init();
+    ParseCache cache;
+    parse_cache_init(&cache);
+
+    test_folding_does_not_leak(&cache);
+    test_reused_ranges_move(&cache);
+
+    parse_cache_free(&cache);
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("parser_incremental: all checks passed\n");
+    return 0;
+}